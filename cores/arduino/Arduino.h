@@ -94,6 +94,7 @@ void loop( void ) ;
 #include "wiring_analog.h"
 #include "wiring_shift.h"
 #include "wiring_pulse.h"
+#include "malloc_pool.h"
 #include "WInterrupts.h"
 
 // undefine stdlib's abs if encountered
@@ -34,17 +34,205 @@
  * to the Itanium C++ ABI.
  */
 
+/* All queued callbacks are collected on one list and run by a single PendSV
+ * event. The dispatcher keeps draining the list until it is empty, so a
+ * burst of driver events costs one PendSV entry, and pending wakeup requests
+ * are folded into one stm32l0_system_wakeup() at the end of the batch.
+ *
+ * A Callback is queued by identity, not by value: queuing it again before it
+ * has been called is counted as coalesced, and the call uses the target it
+ * has at dispatch time. "_queued" is set while it sits either on the submit
+ * list or on the batch dispatch() is working through. Both lists are only
+ * modified with interrupts disabled, so that the destructor can unlink it
+ * from whichever one it is on.
+ */
+
+static struct {
+    Callback * volatile   submit;
+    Callback * volatile   batch;
+    armv6m_pendsv_event_t event;
+    volatile bool         dispatching;
+    volatile bool         wakeup;
+    uint32_t              batches;
+    Callback::Statistics  statistics[Callback::TYPE_COUNT];
+} callback_queue = { nullptr, nullptr, { }, false, false, 0, { } };
+
 bool Callback::queue(bool wakeup) {
+    Callback::Statistics *statistics = &callback_queue.statistics[_type];
+    uint32_t primask;
+    bool post = false;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    statistics->queued++;
+
     if (_callback) {
-        return armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)_callback, _context, 0);
+        if (!_queued) {
+            _queued = true;
+
+            _next = callback_queue.submit;
+
+            callback_queue.submit = this;
+
+            post = (_next == nullptr);
+        } else {
+            statistics->coalesced++;
+        }
+    } else {
+        if (wakeup) {
+            statistics->wakeups++;
+
+            post = !callback_queue.wakeup;
+
+            callback_queue.wakeup = true;
+        }
+    }
+
+    if (post && !callback_queue.dispatching) {
+        callback_queue.event.routine = (armv6m_pendsv_routine_t)Callback::dispatch;
+
+        armv6m_pendsv_event_post(&callback_queue.event, 0);
+    }
+
+    __set_PRIMASK(primask);
+
+    return (_callback != nullptr);
+}
+
+bool Callback::unlink(Callback * volatile *p_callback, Callback *callback) {
+    for (; *p_callback != nullptr; p_callback = &(*p_callback)->_next) {
+        if (*p_callback == callback) {
+            *p_callback = callback->_next;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// A callback that is still queued is unlinked from the submit list or from
+// the batch in progress, so that dispatch() never touches it afterwards.
+Callback::~Callback() {
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (_queued) {
+        if (!unlink(&callback_queue.submit, this)) {
+            unlink(&callback_queue.batch, this);
+        }
+
+        _queued = false;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+void Callback::dispatch(void *context __attribute__((unused)), uint32_t data __attribute__((unused))) {
+    Callback *callback, *callback_next, *callback_head;
+    void (*routine)(void*);
+    void *routine_context;
+    uint32_t primask;
+    bool wakeup;
+
+    callback_queue.dispatching = true;
+    callback_queue.batches++;
+
+    do {
+        primask = __get_PRIMASK();
+
+        __disable_irq();
+
+        // The submit list is LIFO, reverse it to call in queue() order.
+        for (callback = callback_queue.submit, callback_head = nullptr; callback != nullptr; callback = callback_next) {
+            callback_next = callback->_next;
+
+            callback->_next = callback_head;
+
+            callback_head = callback;
+        }
+
+        callback_queue.submit = nullptr;
+        callback_queue.batch = callback_head;
+
+        __set_PRIMASK(primask);
+
+        while (1) {
+            primask = __get_PRIMASK();
+
+            __disable_irq();
+
+            callback = callback_queue.batch;
+
+            if (callback == nullptr) {
+                __set_PRIMASK(primask);
+
+                break;
+            }
+
+            callback_queue.batch = callback->_next;
+
+            callback->_next = nullptr;
+            callback->_queued = false;
+
+            routine = callback->_callback;
+            routine_context = callback->_context;
+
+            callback_queue.statistics[callback->_type].dispatched++;
+
+            __set_PRIMASK(primask);
+
+            // The target was copied above, the callback may be destroyed
+            // or queued again from here on.
+            if (routine) {
+                (*routine)(routine_context);
+            }
+        }
+    } while (callback_head != nullptr);
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    wakeup = callback_queue.wakeup;
+
+    callback_queue.wakeup = false;
+    callback_queue.dispatching = false;
+
+    if (callback_queue.submit != nullptr) {
+        armv6m_pendsv_event_post(&callback_queue.event, 0);
+    }
+
+    __set_PRIMASK(primask);
+
+    if (wakeup) {
+        stm32l0_system_wakeup(STM32L0_SYSTEM_EVENT_APPLICATION);
+    }
+}
+
+void Callback::statistics(Type type, Statistics &statistics) {
+    if (type < TYPE_COUNT) {
+        statistics = callback_queue.statistics[type];
     } else {
-	if (wakeup) {
-	    stm32l0_system_wakeup(STM32L0_SYSTEM_EVENT_APPLICATION);
-	}
-	return false;
+        memset(&statistics, 0, sizeof(statistics));
     }
 }
 
+uint32_t Callback::batches() {
+    return callback_queue.batches;
+}
+
+void Callback::resetStatistics() {
+    callback_queue.batches = 0;
+
+    memset(&callback_queue.statistics[0], 0, sizeof(callback_queue.statistics));
+}
+
 void Callback::call() {
     if (_callback) {
         (*_callback)(_context);
@@ -30,10 +30,39 @@
 
 class Callback {
 public:
+    enum Type : uint8_t {
+        TYPE_APPLICATION = 0,
+        TYPE_SERIAL,
+        TYPE_USB,
+        TYPE_TIMER,
+        TYPE_BUS,
+        TYPE_RADIO,
+        TYPE_LORAWAN,
+        TYPE_GNSS,
+        TYPE_COUNT
+    };
+
+    struct Statistics {
+        uint32_t queued;
+        uint32_t coalesced;   // queue() calls folded into an already pending call
+        uint32_t dispatched;
+        uint32_t wakeups;     // wakeup requests, delivered once per batch
+    };
+
     Callback() : _callback(nullptr), _context(nullptr) {  }
 
+    explicit Callback(Type type) : _callback(nullptr), _context(nullptr), _type(type) {  }
+
     Callback(void (*function)(void)) : _callback((void (*)(void*))function), _context(nullptr) { }
 
+    // The pending state and the type stay with the object, only the target is copied.
+    // A queued call runs whatever target the object holds when it is dispatched.
+    Callback(const Callback &other) : _callback(other._callback), _context(other._context) { }
+
+    Callback &operator=(const Callback &other) { _callback = other._callback; _context = other._context; return *this; }
+
+    ~Callback();
+
     template<typename T>
     Callback(void (T::*method)(), T *object) { bind(&method, object); }
 
@@ -63,9 +92,19 @@ public:
 
     operator bool() { return (_callback != nullptr); }
 
+    static void statistics(Type type, Statistics &statistics);
+    static uint32_t batches();
+    static void resetStatistics();
+
 private:
     void (*_callback)(void*);
     void *_context;
+    Callback * volatile _next = nullptr;
+    volatile bool _queued = false;
+    Type _type = TYPE_APPLICATION;
 
     void bind(const void *method, const void *object);
+
+    static bool unlink(Callback * volatile *p_callback, Callback *callback);
+    static void dispatch(void *context, uint32_t data);
 };
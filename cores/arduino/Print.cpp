@@ -24,6 +24,308 @@
 
 #include "Print.h"
 
+// Number formatting. Everything is rendered into a buffer on the stack and
+// goes out with a single write(). The Cortex-M0+ has no divide instruction,
+// so base 10 uses repeated subtraction of powers of ten and bases 2/4/8/16
+// use shifts. A double is formatted from its IEEE-754 bits with integer
+// arithmetic, as an integer part and a 64 bit binary fraction (print()
+// still adds its rounding in double arithmetic first). That is
+// exact for |number| >= 2^-11, which has at most 64 fractional digits;
+// smaller ones are truncated to 64 fraction bits.
+
+#define PRINT_FLOAT_DIGITS_MAX 64
+#define PRINT_FLOAT_BUFFER_SIZE (1 + 10 + 1 + PRINT_FLOAT_DIGITS_MAX)
+
+static const uint32_t powers10[9] = {
+  1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10
+};
+
+// Exactly "count" (1..10) decimal digits of n.
+static size_t formatDigits(char *buf, uint32_t n, unsigned int count)
+{
+  char *str = buf;
+
+  for (unsigned int i = 10 - count; i < 9; i++) {
+    uint32_t p = powers10[i];
+    char c = '0';
+
+    while (n >= p) {
+      n -= p;
+      c++;
+    }
+
+    *str++ = c;
+  }
+
+  *str++ = '0' + n;
+
+  return str - buf;
+}
+
+static size_t formatDecimal(char *buf, uint32_t n)
+{
+  unsigned int count = 1;
+
+  while ((count < 10) && (n >= powers10[9 - count])) count++;
+
+  return formatDigits(buf, n, count);
+}
+
+static size_t formatUnsigned(char *buf, uint32_t n, unsigned int base, bool upper)
+{
+  const char alpha = upper ? 'A' : 'a';
+
+  if (base == 10) return formatDecimal(buf, n);
+
+  if ((base & (base - 1)) == 0) {
+    unsigned int shift = 0, count = 1;
+
+    while ((1u << shift) != base) shift++;
+
+    for (uint32_t m = n >> shift; m; m >>= shift) count++;
+
+    char *str = buf + count;
+
+    do {
+      char c = n & (base - 1);
+      n >>= shift;
+
+      *--str = c < 10 ? c + '0' : c + alpha - 10;
+    } while (n);
+
+    return count;
+  }
+
+  char tmp[8 * sizeof(uint32_t)];
+  char *str = &tmp[sizeof(tmp)];
+
+  do {
+    char c = n % base;
+    n /= base;
+
+    *--str = c < 10 ? c + '0' : c + alpha - 10;
+  } while (n);
+
+  size_t count = &tmp[sizeof(tmp)] - str;
+  memcpy(buf, str, count);
+
+  return count;
+}
+
+static size_t formatUnsigned64(char *buf, uint64_t n, unsigned int base, bool upper)
+{
+  const char alpha = upper ? 'A' : 'a';
+
+  if (!(n >> 32)) return formatUnsigned(buf, (uint32_t)n, base, upper);
+
+  if (base == 10) {
+    size_t count = formatUnsigned64(buf, n / 1000000000, 10, upper);
+
+    return count + formatDigits(buf + count, (uint32_t)(n % 1000000000), 9);
+  }
+
+  char tmp[8 * sizeof(uint64_t)];
+  char *str = &tmp[sizeof(tmp)];
+
+  do {
+    char c = n % base;
+    n /= base;
+
+    *--str = c < 10 ? c + '0' : c + alpha - 10;
+  } while (n);
+
+  size_t count = &tmp[sizeof(tmp)] - str;
+  memcpy(buf, str, count);
+
+  return count;
+}
+
+// "digits" (up to PRINT_FLOAT_DIGITS_MAX) fractional digits of number into a buffer of
+// PRINT_FLOAT_BUFFER_SIZE. printf() (cstyle) rounds exact halves to even and prints
+// "-0.0", "-inf". For print() the caller has rounded already, so the digits are cut
+// off like the old double code did, and there is no sign for -0.0, nan and inf.
+static size_t formatFloat(char *buf, double number, unsigned int digits, bool cstyle)
+{
+  uint64_t bits, mantissa, integer, fraction;
+  unsigned int exponent, shift;
+  bool negative, sticky, up;
+  char *str = buf;
+
+  memcpy(&bits, &number, sizeof(bits));
+
+  negative = (bits >> 63) && (cstyle || (bits << 1));
+  exponent = (bits >> 52) & 0x7ff;
+  mantissa = bits & 0x000fffffffffffffull;
+
+  if (exponent == 0x7ff) {
+    if (cstyle && negative) *str++ = '-';
+    memcpy(str, mantissa ? "nan" : "inf", 3);
+    return (str - buf) + 3;
+  }
+
+  if (exponent) {
+    mantissa |= 0x0010000000000000ull;
+  } else {
+    exponent = 1;
+  }
+
+  // number = mantissa / 2^shift, anything from 2^52 up is "ovf"
+  if (exponent >= 1075) {
+    memcpy(buf, "ovf", 3);
+    return 3;
+  }
+
+  shift = 1075 - exponent;
+  sticky = false;
+
+  if (shift < 64) {
+    integer = mantissa >> shift;
+    fraction = mantissa << (64 - shift);
+  } else {
+    integer = 0;
+
+    if (shift == 64) {
+      fraction = mantissa;
+    } else if (shift < 128) {
+      fraction = mantissa >> (shift - 64);
+      sticky = (mantissa << (128 - shift)) != 0;
+    } else {
+      fraction = 0;
+      sticky = mantissa != 0;
+    }
+  }
+
+  if ((integer > 4294967040ull) || (cstyle && (integer == 4294967040ull) && (fraction || sticky))) {
+    memcpy(buf, "ovf", 3);
+    return 3;
+  }
+
+  if (negative) *str++ = '-';
+
+  // the fractional digits go behind the room for the integer part; fraction * 10 is
+  // (fraction << 3) + (fraction << 1), with the bits shifted out being the digit
+  char *frac = buf + (1 + 10 + 1);
+
+  for (unsigned int i = 0; i < digits; i++) {
+    uint64_t f8 = fraction << 3;
+    uint64_t f2 = fraction << 1;
+    unsigned int digit = (unsigned int)(fraction >> 61) + (unsigned int)(fraction >> 63);
+
+    fraction = f8 + f2;
+    if (fraction < f8) digit++;
+
+    if (!cstyle) {
+      // print() did "remainder *= 10.0", which rounds digit.fraction to the 53 bits
+      // of a double (half to even); "drop" is the number of fraction bits below that
+      unsigned int drop;
+
+      if (digit) {
+        drop = 12 + ((digit >= 8) ? 3 : (digit >= 4) ? 2 : (digit >= 2) ? 1 : 0);
+      } else {
+        drop = (fraction >> 53) ? (11 - __builtin_clzll(fraction)) : 0;
+      }
+
+      if (drop) {
+        uint64_t mask = (1ull << drop) - 1;
+        uint64_t half = 1ull << (drop - 1);
+        uint64_t rest = fraction & mask;
+
+        fraction &= ~mask;
+        if ((rest > half) || ((rest == half) && (fraction & (mask + 1)))) {
+          fraction += mask + 1;
+          if (fraction == 0) digit++;
+        }
+      }
+    }
+
+    frac[i] = '0' + digit;
+  }
+
+  if (cstyle) {
+    unsigned int last = digits ? (frac[digits - 1] - '0') : (unsigned int)integer;
+
+    up = (fraction > 0x8000000000000000ull) || ((fraction == 0x8000000000000000ull) && (sticky || (last & 1)));
+  } else {
+    up = false;
+  }
+
+  if (up) {
+    unsigned int i;
+
+    for (i = digits; i != 0; i--) {
+      if (frac[i - 1] != '9') {
+        frac[i - 1]++;
+        break;
+      }
+
+      frac[i - 1] = '0';
+    }
+
+    if (i == 0) integer++;
+  }
+
+  str += formatDecimal(str, (uint32_t)integer);
+
+  if (digits) {
+    *str++ = '.';
+    memmove(str, frac, digits);
+    str += digits;
+  }
+
+  return str - buf;
+}
+
+namespace {
+
+// Collects printf() output and hands it to Print::write() in chunks.
+class PrintBuffer {
+  public:
+    PrintBuffer(Print &print) : _print(print), _count(0), _total(0) {}
+
+    void append(const char *data, size_t size) {
+      while (size) {
+        if (_count == sizeof(_data)) flush();
+
+        size_t n = sizeof(_data) - _count;
+        if (n > size) n = size;
+
+        memcpy(&_data[_count], data, n);
+        _count += n;
+        data += n;
+        size -= n;
+      }
+    }
+
+    void fill(char c, size_t size) {
+      while (size) {
+        if (_count == sizeof(_data)) flush();
+
+        size_t n = sizeof(_data) - _count;
+        if (n > size) n = size;
+
+        memset(&_data[_count], c, n);
+        _count += n;
+        size -= n;
+      }
+    }
+
+    size_t flush() {
+      if (_count) {
+        _total += _print.write((const uint8_t *)&_data[0], _count);
+        _count = 0;
+      }
+      return _total;
+    }
+
+  private:
+    Print &_print;
+    size_t _count;
+    size_t _total;
+    char _data[64];
+};
+
+}
+
 // Public Methods //////////////////////////////////////////////////////////////
 
 /* default implementation: may be overridden */
@@ -77,12 +379,17 @@ size_t Print::print(long n, int base)
   if (base == 0) {
     return write(n);
   } else if (base == 10) {
+    char buf[1 + 10];
+    size_t count = 0;
+    unsigned long m = n;
+
     if (n < 0) {
-      int t = print('-');
-      n = -n;
-      return printNumber(n, 10) + t;
+      buf[count++] = '-';
+      m = 0ul - m;
     }
-    return printNumber(n, 10);
+    count += formatDecimal(&buf[count], m);
+
+    return write(buf, count);
   } else {
     return printNumber(n, base);
   }
@@ -186,68 +493,285 @@ size_t Print::println(const Printable& x)
   return n;
 }
 
+size_t Print::printf(const char *format, ...)
+{
+  va_list args;
+
+  va_start(args, format);
+  size_t n = vprintf(format, args);
+  va_end(args);
+
+  return n;
+}
+
+size_t Print::vprintf(const char *format, va_list args)
+{
+  PrintBuffer out(*this);
+  char buf[PRINT_FLOAT_BUFFER_SIZE];
+
+  while (*format) {
+    if (*format != '%') {
+      const char *start = format;
+
+      while (*format && (*format != '%')) format++;
+
+      out.append(start, format - start);
+      continue;
+    }
+
+    const char *start = format++;
+    bool left = false, plus = false, space = false, zero = false, alt = false;
+    int width = 0, precision = -1;
+    char length = 0;
+
+    for (;; format++) {
+      if (*format == '-') left = true;
+      else if (*format == '+') plus = true;
+      else if (*format == ' ') space = true;
+      else if (*format == '0') zero = true;
+      else if (*format == '#') alt = true;
+      else break;
+    }
+
+    if (*format == '*') {
+      width = va_arg(args, int);
+      if (width < 0) {
+        left = true;
+        width = -width;
+      }
+      format++;
+    } else {
+      while ((*format >= '0') && (*format <= '9')) width = width * 10 + (*format++ - '0');
+    }
+
+    if (*format == '.') {
+      format++;
+      precision = 0;
+      if (*format == '*') {
+        precision = va_arg(args, int);
+        format++;
+      } else {
+        while ((*format >= '0') && (*format <= '9')) precision = precision * 10 + (*format++ - '0');
+      }
+    }
+
+    // 'H' is hh, 'L' is ll/j
+    if (*format == 'h') {
+      length = 'h';
+      if (*++format == 'h') {
+        length = 'H';
+        format++;
+      }
+    } else if (*format == 'l') {
+      length = 'l';
+      if (*++format == 'l') {
+        length = 'L';
+        format++;
+      }
+    } else if (*format == 'j') {
+      length = 'L';
+      format++;
+    } else if ((*format == 'z') || (*format == 't')) {
+      length = 'l';
+      format++;
+    }
+
+    char conversion = *format;
+    const char *prefix = "";
+    const char *body = buf;
+    size_t count = 0, zeros = 0;
+
+    if (conversion == '\0') {
+      out.append(start, format - start);
+      break;
+    }
+    format++;
+
+    switch (conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    case 'p': {
+      uint64_t value;
+      unsigned int base = (conversion == 'o') ? 8 : (((conversion == 'x') || (conversion == 'X') || (conversion == 'p')) ? 16 : 10);
+
+      if ((conversion == 'd') || (conversion == 'i')) {
+        int64_t svalue;
+
+        if (length == 'L') svalue = va_arg(args, long long);
+        else if (length == 'l') svalue = va_arg(args, long);
+        else if (length == 'h') svalue = (short)va_arg(args, int);
+        else if (length == 'H') svalue = (signed char)va_arg(args, int);
+        else svalue = va_arg(args, int);
+
+        if (svalue < 0) {
+          prefix = "-";
+          value = 0ull - (uint64_t)svalue;
+        } else {
+          prefix = plus ? "+" : (space ? " " : "");
+          value = svalue;
+        }
+      } else if (conversion == 'p') {
+        value = (uintptr_t)va_arg(args, void *);
+        alt = true;
+      } else {
+        if (length == 'L') value = va_arg(args, unsigned long long);
+        else if (length == 'l') value = va_arg(args, unsigned long);
+        else if (length == 'h') value = (unsigned short)va_arg(args, unsigned int);
+        else if (length == 'H') value = (unsigned char)va_arg(args, unsigned int);
+        else value = va_arg(args, unsigned int);
+      }
+
+      if ((precision != 0) || value) {
+        count = formatUnsigned64(buf, value, base, (conversion == 'X'));
+      }
+
+      if (alt && value && (base == 16)) {
+        prefix = (conversion == 'X') ? "0X" : "0x";
+      }
+
+      if ((precision >= 0) && ((size_t)precision > count)) {
+        zeros = precision - count;
+      } else if (alt && (base == 8) && ((count == 0) || (buf[0] != '0'))) {
+        zeros = 1;
+      }
+
+      if (precision >= 0) zero = false;
+      break;
+    }
+
+    case 'f':
+    case 'F': {
+      double value = va_arg(args, double);
+      unsigned int digits = (precision < 0) ? 6 : precision;
+
+      count = formatFloat(buf, value, (digits > PRINT_FLOAT_DIGITS_MAX) ? PRINT_FLOAT_DIGITS_MAX : digits, true);
+
+      bool overflow = (buf[0] == 'o');
+
+      if (buf[count - 1] > '9') {
+        zero = false;
+
+        if (conversion == 'F') {
+          for (size_t i = 0; i < count; i++) {
+            if (buf[i] >= 'a') buf[i] -= ('a' - 'A');
+          }
+        }
+      }
+
+      if (buf[0] == '-') {
+        prefix = "-";
+        body++;
+        count--;
+      } else if (!overflow) {
+        prefix = plus ? "+" : (space ? " " : "");
+      }
+
+      if (alt && !digits && (body[count - 1] <= '9')) {
+        buf[(body - buf) + count++] = '.';
+      }
+
+      if ((digits > PRINT_FLOAT_DIGITS_MAX) && (body[count - 1] <= '9')) {
+        // printed as trailing zeros behind the body
+        size_t pad = digits - PRINT_FLOAT_DIGITS_MAX;
+        size_t total = strlen(prefix) + count + pad;
+
+        if (!left && ((size_t)width > total)) out.fill(zero ? '0' : ' ', width - total);
+        out.append(prefix, strlen(prefix));
+        out.append(body, count);
+        out.fill('0', pad);
+        if (left && ((size_t)width > total)) out.fill(' ', width - total);
+        continue;
+      }
+      break;
+    }
+
+    case 'c':
+      buf[0] = (char)va_arg(args, int);
+      count = 1;
+      zero = false;
+      break;
+
+    case 's':
+      body = va_arg(args, const char *);
+      if (body == NULL) body = "(null)";
+      for (count = 0; body[count] && ((precision < 0) || (count < (size_t)precision)); count++) {}
+      zero = false;
+      break;
+
+    case '%':
+      out.append("%", 1);
+      continue;
+
+    default:
+      out.append(start, format - start);
+      continue;
+    }
+
+    size_t prefixLength = strlen(prefix);
+    size_t total = prefixLength + zeros + count;
+    size_t pad = ((size_t)width > total) ? (width - total) : 0;
+
+    if (!left && !zero) out.fill(' ', pad);
+    out.append(prefix, prefixLength);
+    if (!left && zero) out.fill('0', pad);
+    out.fill('0', zeros);
+    out.append(body, count);
+    if (left) out.fill(' ', pad);
+  }
+
+  return out.flush();
+}
+
 // Private Methods /////////////////////////////////////////////////////////////
 
 size_t Print::printNumber(unsigned long n, uint8_t base)
 {
-  char buf[8 * sizeof(long) + 1]; // Assumes 8-bit chars plus zero byte.
-  char *str = &buf[sizeof(buf) - 1];
-
-  *str = '\0';
+  char buf[8 * sizeof(long)]; // Assumes 8-bit chars.
 
   // prevent crash if called with base == 1
   if (base < 2) base = 10;
 
-  do {
-    char c = n % base;
-    n /= base;
-
-    *--str = c < 10 ? c + '0' : c + 'A' - 10;
-  } while(n);
-
-  return write(str);
+  return write(buf, formatUnsigned(buf, n, base, true));
 }
 
 size_t Print::printFloat(double number, uint8_t digits)
 {
-  size_t n = 0;
+  char buf[PRINT_FLOAT_BUFFER_SIZE];
 
-  if (isnan(number)) return print("nan");
-  if (isinf(number)) return print("inf");
-  if (number > 4294967040.0) return print ("ovf");  // constant determined empirically
-  if (number <-4294967040.0) return print ("ovf");  // constant determined empirically
+  // "ovf" goes by the value before rounding
+  if (!isinf(number) && ((number > 4294967040.0) || (number < -4294967040.0)))
+    return write("ovf");
 
-  // Handle negative numbers
-  if (number < 0.0)
-  {
-     n += print('-');
-     number = -number;
-  }
-
-  // Round correctly so that print(1.999, 2) prints as "2.00"
+  // round like print() always did, by adding half a unit of the last digit in double
+  // arithmetic (print(0.285, 2) is "0.29"); formatFloat() then cuts off the digits
   double rounding = 0.5;
-  for (uint8_t i=0; i<digits; ++i)
+  for (uint8_t i = 0; i < digits; ++i)
     rounding /= 10.0;
 
-  number += rounding;
+  if (number < 0.0)
+    number -= rounding;
+  else
+    number += rounding;
 
-  // Extract the integer part of the number and print it
-  unsigned long int_part = (unsigned long)number;
-  double remainder = number - (double)int_part;
-  n += print(int_part);
+  size_t count = formatFloat(buf, number, (digits > PRINT_FLOAT_DIGITS_MAX) ? PRINT_FLOAT_DIGITS_MAX : digits, false);
+  size_t n = write(buf, count);
 
-  // Print the decimal point, but only if there are digits beyond
-  if (digits > 0) {
-    n += print('.');
-  }
+  // digits beyond PRINT_FLOAT_DIGITS_MAX are zero
+  if ((digits > PRINT_FLOAT_DIGITS_MAX) && (buf[count - 1] <= '9')) {
+    size_t pad = digits - PRINT_FLOAT_DIGITS_MAX;
+
+    memset(buf, '0', sizeof(buf));
 
-  // Extract digits from the remainder one at a time
-  while (digits-- > 0)
-  {
-    remainder *= 10.0;
-    unsigned int toPrint = (unsigned int)(remainder);
-    n += print(toPrint);
-    remainder -= toPrint;
+    while (pad) {
+      size_t size = (pad > sizeof(buf)) ? sizeof(buf) : pad;
+
+      n += write(buf, size);
+      pad -= size;
+    }
   }
 
   return n;
@@ -20,6 +20,7 @@
 #define Print_h
 
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h> // for size_t
 
 #include "WString.h"
@@ -86,6 +87,13 @@ class Print
     size_t println(const Printable&);
     size_t println(void);
 
+    // printf() style output, rendered into a stack buffer and written in chunks of 64 bytes.
+    // Supports the flags "-+ 0#", width, precision, the length modifiers hh/h/l/ll/j/z/t and
+    // the conversions d/i/u/o/x/X/c/s/p/f/F/%. %f is formatted without floating point arithmetic
+    // and prints "ovf" beyond +/-4294967040 like print(double). %e/%g/%a are not supported.
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t vprintf(const char *format, va_list args);
+
     virtual void flush() { /* Empty implementation for backward compatibility */ }
 };
 
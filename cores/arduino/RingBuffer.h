@@ -19,33 +19,216 @@
 #ifndef _RING_BUFFER_
 #define _RING_BUFFER_
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
-// Define constants and variables for buffering incoming serial data.  We're
-// using a ring buffer (I think), in which head is the index of the location
-// to which to write the next incoming character and tail is the index of the
-// location from which to read.
+// Define constants and variables for buffering incoming serial data.
 #define SERIAL_BUFFER_SIZE 64
 
-class RingBuffer
+// A single producer / single consumer ring of N bytes, N a power of two.
+//
+// _iHead and _iTail are free running counters, head - tail is the number of
+// bytes stored, so all N bytes can be used. Only the producer writes _iHead
+// and only the consumer writes _iTail, which makes it safe to have one side
+// in thread mode and the other one in an interrupt handler without masking
+// interrupts. Data is published by a release store of the index and picked
+// up by an acquire load of it.
+//
+// writeSpan()/commitWrite() and readSpan()/commitRead() hand out the
+// contiguous free or filled part of the buffer, so that it can be filled or
+// drained by DMA (or a memcpy()) in place.
+//
+// Producer: store_char(), write(), availableForStore(), isFull(),
+//           writeSpan(), commitWrite()
+// Consumer: read_char(), read(), peek(), available(), readSpan(),
+//           commitRead(), clear()
+
+template <size_t N>
+class RingBufferN
 {
+    static_assert((N != 0) && ((N & (N - 1)) == 0), "RingBufferN size must be a power of two");
+
   public:
-    uint8_t _aucBuffer[SERIAL_BUFFER_SIZE] ;
-    int _iHead ;
-    int _iTail ;
+    uint8_t _aucBuffer[N] ;
+    uint32_t _iHead ;
+    uint32_t _iTail ;
 
   public:
-    RingBuffer( void ) ;
+    RingBufferN( void ) : _iHead(0), _iTail(0) { }
+
     void store_char( uint8_t c ) ;
-	void clear();
-	int read_char();
-	int available();
-	int availableForStore();
-	int peek();
-	bool isFull();
+    size_t write( const uint8_t *data, size_t size ) ;
+    uint8_t *writeSpan( size_t &size ) ;
+    void commitWrite( size_t size ) ;
+
+    int read_char( void ) ;
+    size_t read( uint8_t *data, size_t size ) ;
+    const uint8_t *readSpan( size_t &size ) ;
+    void commitRead( size_t size ) ;
+    void clear( void ) ;
+    int peek( void ) ;
+
+    int available( void ) ;
+    int availableForStore( void ) ;
+    bool isFull( void ) ;
 
   private:
-	int nextIndex(int index);
+    uint32_t head( void ) { return __atomic_load_n(&_iHead, __ATOMIC_ACQUIRE); }
+    uint32_t tail( void ) { return __atomic_load_n(&_iTail, __ATOMIC_ACQUIRE); }
 } ;
 
+typedef RingBufferN<SERIAL_BUFFER_SIZE> RingBuffer;
+
+template <size_t N>
+void RingBufferN<N>::store_char( uint8_t c )
+{
+    uint32_t head = _iHead ;
+
+    // drop the character if the buffer is full
+    if ( (head - tail()) != N )
+    {
+        _aucBuffer[head & (N - 1)] = c ;
+        __atomic_store_n(&_iHead, head + 1, __ATOMIC_RELEASE) ;
+    }
+}
+
+template <size_t N>
+size_t RingBufferN<N>::write( const uint8_t *data, size_t size )
+{
+    size_t count, total ;
+    uint8_t *span ;
+
+    // the free space wraps at most once, so this takes two memcpy() calls
+    for ( total = 0; total < size; total += count )
+    {
+        span = writeSpan(count) ;
+
+        if ( count == 0 )
+            break ;
+
+        if ( count > (size - total) )
+            count = size - total ;
+
+        memcpy(span, &data[total], count) ;
+        commitWrite(count) ;
+    }
+
+    return total ;
+}
+
+template <size_t N>
+uint8_t *RingBufferN<N>::writeSpan( size_t &size )
+{
+    uint32_t head = _iHead ;
+    uint32_t offset = head & (N - 1) ;
+
+    size = N - (head - tail()) ;
+
+    if ( size > (N - offset) )
+        size = N - offset ;
+
+    return &_aucBuffer[offset] ;
+}
+
+template <size_t N>
+void RingBufferN<N>::commitWrite( size_t size )
+{
+    __atomic_store_n(&_iHead, _iHead + size, __ATOMIC_RELEASE) ;
+}
+
+template <size_t N>
+int RingBufferN<N>::read_char( void )
+{
+    uint32_t tail = _iTail ;
+    uint8_t value ;
+
+    if ( tail == head() )
+        return -1 ;
+
+    value = _aucBuffer[tail & (N - 1)] ;
+    __atomic_store_n(&_iTail, tail + 1, __ATOMIC_RELEASE) ;
+
+    return value ;
+}
+
+template <size_t N>
+size_t RingBufferN<N>::read( uint8_t *data, size_t size )
+{
+    size_t count, total ;
+    const uint8_t *span ;
+
+    for ( total = 0; total < size; total += count )
+    {
+        span = readSpan(count) ;
+
+        if ( count == 0 )
+            break ;
+
+        if ( count > (size - total) )
+            count = size - total ;
+
+        memcpy(&data[total], span, count) ;
+        commitRead(count) ;
+    }
+
+    return total ;
+}
+
+template <size_t N>
+const uint8_t *RingBufferN<N>::readSpan( size_t &size )
+{
+    uint32_t tail = _iTail ;
+    uint32_t offset = tail & (N - 1) ;
+
+    size = head() - tail ;
+
+    if ( size > (N - offset) )
+        size = N - offset ;
+
+    return &_aucBuffer[offset] ;
+}
+
+template <size_t N>
+void RingBufferN<N>::commitRead( size_t size )
+{
+    __atomic_store_n(&_iTail, _iTail + size, __ATOMIC_RELEASE) ;
+}
+
+// discards everything stored so far; this is a consumer operation
+template <size_t N>
+void RingBufferN<N>::clear( void )
+{
+    __atomic_store_n(&_iTail, head(), __ATOMIC_RELEASE) ;
+}
+
+template <size_t N>
+int RingBufferN<N>::peek( void )
+{
+    uint32_t tail = _iTail ;
+
+    if ( tail == head() )
+        return -1 ;
+
+    return _aucBuffer[tail & (N - 1)] ;
+}
+
+template <size_t N>
+int RingBufferN<N>::available( void )
+{
+    return (int)(head() - tail()) ;
+}
+
+template <size_t N>
+int RingBufferN<N>::availableForStore( void )
+{
+    return (int)(N - (head() - tail())) ;
+}
+
+template <size_t N>
+bool RingBufferN<N>::isFull( void )
+{
+    return ((head() - tail()) == N) ;
+}
+
 #endif /* _RING_BUFFER_ */
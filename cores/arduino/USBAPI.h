@@ -29,6 +29,7 @@
 #pragma once
 
 #include "HardwareSerial.h"
+#include "RingBuffer.h"
 
 enum USBDeviceDetect {
     SLEEP = 0,
@@ -69,10 +70,10 @@ public:
 private:
     bool _wakeup;
 
-    Callback _connectCallback;
-    Callback _disconnectCallback;
-    Callback _suspendCallback;
-    Callback _resumeCallback;
+    Callback _connectCallback { Callback::TYPE_USB };
+    Callback _disconnectCallback { Callback::TYPE_USB };
+    Callback _suspendCallback { Callback::TYPE_USB };
+    Callback _resumeCallback { Callback::TYPE_USB };
     
     static void connectCallback(void);
     static void disconnectCallback(void);
@@ -144,14 +145,13 @@ private:
     bool _wakeup;
     bool _nonblocking;
     uint8_t _rx_data[CDC_RX_BUFFER_SIZE];
-    uint8_t _tx_data[CDC_TX_BUFFER_SIZE];
+    RingBufferN<CDC_TX_BUFFER_SIZE> _tx_fifo;
     volatile bool _tx_busy;
-    volatile uint16_t _tx_write;
-    volatile uint16_t _tx_read;
-    volatile uint32_t _tx_count;
     volatile uint32_t _tx_size;
 
-    Callback _receiveCallback;
+    Callback _receiveCallback { Callback::TYPE_SERIAL };
+
+    void _transmit();
 
     static void _eventCallback(class CDC *self, uint32_t events);
     static void _doneCallback(class CDC *self);
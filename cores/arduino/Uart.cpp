@@ -42,9 +42,6 @@ Uart::Uart(struct _stm32l0_uart_t *uart, const struct _stm32l0_uart_params_t *pa
 
     _tx_busy = false;
 
-    _tx_read = 0;
-    _tx_write = 0;
-    _tx_count = 0;
     _tx_size = 0;
 
     if (serialEventRun) {
@@ -119,7 +116,7 @@ int Uart::availableForWrite()
         return 0;
     }
 
-    return UART_TX_BUFFER_SIZE - _tx_count;
+    return _tx_fifo.availableForStore();
 }
 
 int Uart::peek()
@@ -153,7 +150,7 @@ void Uart::flush()
 {
     if (__get_IPSR() == 0) {
         while (_tx_busy) {
-            __WFE();
+            armv6m_task_wfe();
         }
     }
 }
@@ -165,7 +162,6 @@ size_t Uart::write(const uint8_t data)
 
 size_t Uart::write(const uint8_t *buffer, size_t size)
 {
-    unsigned int tx_read, tx_write, tx_count, tx_size;
     size_t count;
 
     if (!_enabled) {
@@ -180,88 +176,26 @@ size_t Uart::write(const uint8_t *buffer, size_t size)
 
     while (count < size) {
 
-        tx_count = UART_TX_BUFFER_SIZE - _tx_count;
-
-        if (tx_count == 0) {
+        if (_tx_fifo.isFull()) {
 
             if (_nonblocking || (__get_IPSR() != 0)) {
                 break;
             }
 
             if (!_tx_busy) {
-                tx_size = _tx_count;
-                tx_read = _tx_read;
-
-                if (tx_size > (UART_TX_BUFFER_SIZE - tx_read)) {
-                    tx_size = (UART_TX_BUFFER_SIZE - tx_read);
-                }
-                
-                if (tx_size > UART_TX_PACKET_SIZE) {
-                    tx_size = UART_TX_PACKET_SIZE;
-                }
-                
-                _tx_size = tx_size;
-                _tx_busy = true;
-
-                if (!stm32l0_uart_transmit(_uart, &_tx_data[tx_read], tx_size, (stm32l0_uart_done_callback_t)Uart::_doneCallback, (void*)this)) {
-                    _tx_busy = false;
-
-                    _tx_size = 0;
-                    _tx_count = 0;
-                    _tx_read = _tx_write;
-                }
+                _transmit();
             }
 
-            while (UART_TX_BUFFER_SIZE == _tx_count) {
-                __WFE();
+            while (_tx_fifo.isFull()) {
+                armv6m_task_wfe();
             }
-
-            tx_count = UART_TX_BUFFER_SIZE - _tx_count;
-        }
-
-        tx_write = _tx_write;
-
-        if (tx_count > (UART_TX_BUFFER_SIZE - tx_write)) {
-            tx_count = (UART_TX_BUFFER_SIZE - tx_write);
         }
 
-        if (tx_count > (size - count)) {
-            tx_count = (size - count);
-        }
-
-        memcpy(&_tx_data[tx_write], &buffer[count], tx_count);
-        count += tx_count;
-      
-        _tx_write = (unsigned int)(tx_write + tx_count) & (UART_TX_BUFFER_SIZE -1);
-
-        armv6m_atomic_add(&_tx_count, tx_count);
+        count += _tx_fifo.write(&buffer[count], size - count);
     }
 
     if (!_tx_busy) {
-        tx_size = _tx_count;
-        
-        if (tx_size) {
-            tx_read = _tx_read;
-
-            if (tx_size > (UART_TX_BUFFER_SIZE - tx_read)) {
-                tx_size = (UART_TX_BUFFER_SIZE - tx_read);
-            }
-            
-            if (tx_size > UART_TX_PACKET_SIZE) {
-                tx_size = UART_TX_PACKET_SIZE;
-            }
-            
-            _tx_size = tx_size;
-            _tx_busy = true;
-            
-            if (!stm32l0_uart_transmit(_uart, &_tx_data[tx_read], tx_size, (stm32l0_uart_done_callback_t)Uart::_doneCallback, (void*)this)) {
-                _tx_busy = false;
-
-                _tx_size = 0;
-                _tx_count = 0;
-                _tx_read = _tx_write;
-            }
-        }
+        _transmit();
     }
 
     return count;
@@ -319,43 +253,41 @@ void Uart::_eventCallback(class Uart *self, uint32_t events)
     }
 }
 
-void Uart::_doneCallback(class Uart *self)
+void Uart::_transmit()
 {
-    unsigned int tx_read, tx_size;
-
-    self->_tx_busy = false;
+    const uint8_t *tx_data;
+    size_t tx_size;
 
-    tx_size = self->_tx_size;
+    /* Hand the contiguous part of the FIFO, at most a packet, to the driver.
+     */
+    tx_data = _tx_fifo.readSpan(tx_size);
 
     if (tx_size != 0) {
-        self->_tx_read = (self->_tx_read + tx_size) & (UART_TX_BUFFER_SIZE -1);
-      
-        armv6m_atomic_sub(&self->_tx_count, tx_size);
-      
-        self->_tx_size = 0;
+        if (tx_size > UART_TX_PACKET_SIZE) {
+            tx_size = UART_TX_PACKET_SIZE;
+        }
 
-        if (self->_tx_count != 0) {
-            tx_size = self->_tx_count;
-            tx_read = self->_tx_read;
+        _tx_size = tx_size;
+        _tx_busy = true;
 
-            if (tx_size > (UART_TX_BUFFER_SIZE - tx_read)) {
-                tx_size = (UART_TX_BUFFER_SIZE - tx_read);
-            }
-          
-            if (tx_size > UART_TX_PACKET_SIZE) {
-                tx_size = UART_TX_PACKET_SIZE;
-            }
-            
-            self->_tx_size = tx_size;
-            self->_tx_busy = true;
-            
-            if (!stm32l0_uart_transmit(self->_uart, &self->_tx_data[tx_read], tx_size, (stm32l0_uart_done_callback_t)Uart::_doneCallback, (void*)self)) {
-                self->_tx_busy = false;
-
-                self->_tx_size = 0;
-                self->_tx_count = 0;
-                self->_tx_read = self->_tx_write;
-            }
+        if (!stm32l0_uart_transmit(_uart, tx_data, tx_size, (stm32l0_uart_done_callback_t)Uart::_doneCallback, (void*)this)) {
+            _tx_busy = false;
+
+            _tx_size = 0;
+            _tx_fifo.clear();
         }
     }
 }
+
+void Uart::_doneCallback(class Uart *self)
+{
+    self->_tx_busy = false;
+
+    if (self->_tx_size != 0) {
+        self->_tx_fifo.commitRead(self->_tx_size);
+
+        self->_tx_size = 0;
+
+        self->_transmit();
+    }
+}
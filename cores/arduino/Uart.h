@@ -29,6 +29,7 @@
 #pragma once
 
 #include "HardwareSerial.h"
+#include "RingBuffer.h"
 
 #define SERIAL_SBUS     (STM32L0_UART_OPTION_DATA_SIZE_8 | STM32L0_UART_OPTION_PARITY_EVEN | STM32L0_UART_OPTION_STOP_2 | STM32L0_UART_OPTION_RX_INVERT | STM32L0_UART_OPTION_TX_INVERT)
 #define SERIAL_WAKEUP   (STM32L0_UART_OPTION_WAKEUP)
@@ -90,14 +91,13 @@ public:
     uint32_t _baudrate;
     uint32_t _option;
     uint8_t _rx_data[UART_RX_BUFFER_SIZE];
-    uint8_t _tx_data[UART_TX_BUFFER_SIZE];
+    RingBufferN<UART_TX_BUFFER_SIZE> _tx_fifo;
     volatile bool _tx_busy;
-    volatile uint16_t _tx_write;
-    volatile uint16_t _tx_read;
-    volatile uint32_t _tx_count;
     volatile uint32_t _tx_size;
 
-    Callback _receiveCallback;
+    Callback _receiveCallback { Callback::TYPE_SERIAL };
+
+    void _transmit();
 
     static void _eventCallback(class Uart *self, uint32_t events);
     static void _doneCallback(class Uart *self);
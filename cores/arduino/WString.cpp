@@ -56,6 +56,11 @@ String::String(StringSumHelper &&rval)
 	init();
 	move(rval);
 }
+String::String(StringSumHelper &rval)
+{
+	init();
+	move(rval);
+}
 #endif
 
 String::String(char c)
@@ -123,7 +128,7 @@ String::String(double value, unsigned char decimalPlaces)
 
 String::~String()
 {
-	free(buffer);
+	if (buffer != inline_buffer) free(buffer);
 }
 
 /*********************************************/
@@ -139,14 +144,14 @@ inline void String::init(void)
 
 void String::invalidate(void)
 {
-	if (buffer) free(buffer);
+	if (buffer && buffer != inline_buffer) free(buffer);
 	buffer = NULL;
 	capacity = len = 0;
 }
 
 unsigned char String::reserve(unsigned int size)
 {
-	if (buffer && capacity >= size) return 1;
+	if (buffer && space() >= size) return 1;
 	if (changeBuffer(size)) {
 		if (len == 0) buffer[0] = 0;
 		return 1;
@@ -154,9 +159,33 @@ unsigned char String::reserve(unsigned int size)
 	return 0;
 }
 
+// reserve() for appending: grow by at least half the capacity, so that a
+// series of concatenations reallocates only a logarithmic number of times.
+// If that much memory is not there, try for just what is needed.
+unsigned char String::reserveAppend(unsigned int size)
+{
+	if (buffer && space() >= size) return 1;
+	if (buffer) {
+		unsigned int grown = space() + (space() >> 1);
+		if (grown > size && reserve(grown)) return 1;
+	}
+	return reserve(size);
+}
+
 unsigned char String::changeBuffer(unsigned int maxStrLen)
 {
-	char *newbuffer = (char *)realloc(buffer, maxStrLen + 1);
+	char *newbuffer;
+
+	if (!buffer && maxStrLen <= STRING_INLINE_CAPACITY) {
+		buffer = inline_buffer;
+		return 1;
+	}
+	if (!buffer || buffer == inline_buffer) {
+		newbuffer = (char *)malloc(maxStrLen + 1);
+		if (newbuffer && buffer) memcpy(newbuffer, buffer, len + 1);
+	} else {
+		newbuffer = (char *)realloc(buffer, maxStrLen + 1);
+	}
 	if (newbuffer) {
 		buffer = newbuffer;
 		capacity = maxStrLen;
@@ -176,7 +205,8 @@ String & String::copy(const char *cstr, unsigned int length)
 		return *this;
 	}
 	len = length;
-	strcpy(buffer, cstr);
+	memmove(buffer, cstr, length);
+	buffer[length] = 0;
 	return *this;
 }
 
@@ -194,15 +224,21 @@ String & String::copy(const __FlashStringHelper *pstr, unsigned int length)
 #if __cplusplus >= 201103L || defined(__GXX_EXPERIMENTAL_CXX0X__)
 void String::move(String &rhs)
 {
-	if (buffer) {
-		if (rhs && capacity >= rhs.len) {
-			strcpy(buffer, rhs.buffer);
-			len = rhs.len;
-			rhs.len = 0;
-			return;
-		} else {
-			free(buffer);
-		}
+	// an inline string is copied, and so is one that fits into the buffer
+	// we have (which keeps a reserve()d buffer); a heap buffer is stolen
+	if (rhs.buffer && (rhs.buffer == rhs.inline_buffer || (buffer && space() >= rhs.len))) {
+		if (!buffer) buffer = inline_buffer;
+		memcpy(buffer, rhs.buffer, rhs.len + 1);
+		len = rhs.len;
+		rhs.len = 0;
+		rhs.buffer[0] = 0;
+		return;
+	}
+	if (buffer && buffer != inline_buffer) free(buffer);
+	if (!rhs.buffer) {
+		buffer = NULL;
+		capacity = len = 0;
+		return;
 	}
 	buffer = rhs.buffer;
 	capacity = rhs.capacity;
@@ -235,6 +271,13 @@ String & String::operator = (StringSumHelper &&rval)
 	if (this != &rval) move(rval);
 	return *this;
 }
+
+// the result of an operator + chain is a temporary, so its buffer can be taken
+String & String::operator = (StringSumHelper &rval)
+{
+	if (this != &rval) move(rval);
+	return *this;
+}
 #endif
 
 String & String::operator = (const char *cstr)
@@ -267,8 +310,16 @@ unsigned char String::concat(const char *cstr, unsigned int length)
 	unsigned int newlen = len + length;
 	if (!cstr) return 0;
 	if (length == 0) return 1;
-	if (!reserve(newlen)) return 0;
-	strcpy(buffer + len, cstr);
+	if (buffer && cstr >= buffer && cstr <= buffer + len) {
+		// appending (part of) itself, the buffer may move
+		unsigned int offset = cstr - buffer;
+		if (!reserveAppend(newlen)) return 0;
+		cstr = buffer + offset;
+	} else {
+		if (!reserveAppend(newlen)) return 0;
+	}
+	memcpy(buffer + len, cstr, length);
+	buffer[newlen] = 0;
 	len = newlen;
 	return 1;
 }
@@ -342,7 +393,7 @@ unsigned char String::concat(const __FlashStringHelper * str)
 	int length = strlen_P((const char *) str);
 	if (length == 0) return 1;
 	unsigned int newlen = len + length;
-	if (!reserve(newlen)) return 0;
+	if (!reserveAppend(newlen)) return 0;
 	strcpy_P(buffer + len, (const char *) str);
 	len = newlen;
 	return 1;
@@ -672,7 +723,7 @@ void String::replace(const String& find, const String& replace)
 			size += diff;
 		}
 		if (size == len) return;
-		if (size > capacity && !changeBuffer(size)) return; // XXX: tell user!
+		if (size > space() && !changeBuffer(size)) return; // XXX: tell user!
 		int index = len - 1;
 		while (index >= 0 && (index = lastIndexOf(find, index)) >= 0) {
 			readFrom = buffer + index + find.len;
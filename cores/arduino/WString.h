@@ -34,6 +34,9 @@
 //     -felide-constructors
 //     -std=c++0x
 
+// Strings up to this length live in the String object itself.
+#define STRING_INLINE_CAPACITY 15
+
 class __FlashStringHelper;
 #define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(PSTR(string_literal)))
 
@@ -62,6 +65,7 @@ public:
        #if __cplusplus >= 201103L || defined(__GXX_EXPERIMENTAL_CXX0X__)
 	String(String &&rval);
 	String(StringSumHelper &&rval);
+	String(StringSumHelper &rval);
 	#endif
 	explicit String(char c);
 	explicit String(unsigned char, unsigned char base=10);
@@ -76,7 +80,9 @@ public:
 	// memory management
 	// return true on success, false on failure (in which case, the string
 	// is left unchanged).  reserve(0), if successful, will validate an
-	// invalid string (i.e., "if (s)" will be true afterwards)
+	// invalid string (i.e., "if (s)" will be true afterwards).
+	// strings of up to STRING_INLINE_CAPACITY characters are stored in
+	// the String object itself and need no heap allocation.
 	unsigned char reserve(unsigned int size);
 	inline unsigned int length(void) const {return len;}
 
@@ -89,6 +95,7 @@ public:
        #if __cplusplus >= 201103L || defined(__GXX_EXPERIMENTAL_CXX0X__)
 	String & operator = (String &&rval);
 	String & operator = (StringSumHelper &&rval);
+	String & operator = (StringSumHelper &rval);
 	#endif
 
 	// concatenate (works w/ built-in types)
@@ -193,13 +200,18 @@ public:
 	double toDouble(void) const;
 
 protected:
-	char *buffer;	        // the actual char array
-	unsigned int capacity;  // the array length minus one (for the '\0')
+	char *buffer;	        // the actual char array, inline_buffer or on the heap
 	unsigned int len;       // the String length (not counting the '\0')
+	union {
+		unsigned int capacity;  // the heap array length minus one (for the '\0')
+		char inline_buffer[STRING_INLINE_CAPACITY + 1];
+	};
 protected:
 	void init(void);
 	void invalidate(void);
+	unsigned int space(void) const { return (buffer == inline_buffer) ? STRING_INLINE_CAPACITY : capacity; }
 	unsigned char changeBuffer(unsigned int maxStrLen);
+	unsigned char reserveAppend(unsigned int size);
 	unsigned char concat(const char *cstr, unsigned int length);
 
 	// copy and move
@@ -46,13 +46,28 @@ unsigned long micros(void)
 void delay(uint32_t timeout) 
 {
     uint32_t now, start, end;
+    armv6m_task_semaphore_t semaphore;
+    stm32l0_rtc_timer_t timer;
 
     if (timeout == 0)
         return;
 
     if (__get_IPSR() == 0) {
 
-        stm32l0_system_sleep(g_defaultPolicy, 0, timeout);
+        if (armv6m_task_is_main()) {
+            stm32l0_system_sleep(g_defaultPolicy, 0, timeout);
+        } else {
+            /* The system timeout is shared, so other tasks use their own timer.
+             * Parking with g_defaultPolicy lets the system STOP if all tasks
+             * are delayed.
+             */
+            armv6m_task_semaphore_create(&semaphore, 0);
+            stm32l0_rtc_timer_create(&timer, (stm32l0_rtc_timer_callback_t)armv6m_task_semaphore_give, (void*)&semaphore);
+            stm32l0_rtc_timer_start(&timer, stm32l0_rtc_millis_to_clock(timeout), STM32L0_RTC_TIMER_MODE_RELATIVE);
+            while (!armv6m_task_semaphore_try_take(&semaphore))
+                armv6m_task_sleep(g_defaultPolicy);
+            stm32l0_rtc_timer_destroy(&timer);
+        }
 
     } else {
 
@@ -16,16 +16,19 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "armv6m.h"
+
 /**
- * Empty yield() hook.
+ * Default yield() hook.
  *
  * This function is intended to be used by library writers to build
- * libraries or sketches that supports cooperative threads.
+ * libraries or sketches that supports cooperative threads. By default
+ * it switches to the next armv6m_task.
  *
  * Its defined as a weak symbol and it can be redefined to implement a
- * real cooperative scheduler.
+ * different cooperative scheduler.
  */
-static void __empty() {
-	// Empty
+static void __yield() {
+	armv6m_task_yield();
 }
-void yield(void) __attribute__ ((weak, alias("__empty")));
+void yield(void) __attribute__ ((weak, alias("__yield")));
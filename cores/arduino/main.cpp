@@ -61,6 +61,7 @@ int main( void )
   {
     loop();
     if (g_serialEventRun) (*g_serialEventRun)();
+    armv6m_task_yield();
   }
 
   return 0;
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016-2018 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * malloc()/free()/realloc() serve requests of up to 256 bytes from a pool
+ * of size classes, and larger ones (or small ones once the pool is used up)
+ * from the newlib heap. The pool is a single region of
+ * STM32L0_MALLOC_POOL_SIZE bytes, taken from the heap on first use.
+ *
+ * requested / granted is the internal fragmentation of the pool (bytes
+ * lost to rounding up to a class), (blocks - used) * size per class the
+ * bytes sitting on a free list. carved and used_max are high-water marks.
+ */
+
+#define MALLOC_POOL_CLASS_COUNT 5
+
+struct malloc_pool_stats {
+    uint32_t size;          /* pool region, 0 before the first small malloc() */
+    uint32_t carved;        /* bytes of the region carved into blocks */
+    uint32_t requested;     /* bytes requested from the pool, cumulative */
+    uint32_t granted;       /* bytes handed out from the pool, cumulative */
+    uint32_t fallbacks;     /* small requests served by the heap */
+    struct {
+        uint32_t size;      /* block size */
+        uint32_t blocks;    /* blocks carved */
+        uint32_t used;      /* blocks allocated */
+        uint32_t used_max;  /* high-water mark of used */
+        uint32_t allocs;    /* allocations, cumulative */
+    } classes[MALLOC_POOL_CLASS_COUNT];
+};
+
+extern void malloc_pool_stats(struct malloc_pool_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -31,12 +31,14 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <malloc.h>
 #include <sys/stat.h>
 #include <sys/times.h>
 #include <sys/unistd.h>
 
 #include "armv6m.h"
+#include "malloc_pool.h"
 
 int (*stm32l0_stdio_put)(char, FILE*) = NULL;
 int (*stm32l0_stdio_get)(FILE*) = NULL;
@@ -200,7 +202,47 @@ void _exit(int status)
     while (1) { };
 }
 
-void *malloc(size_t nbytes)
+/* Small blocks come from a pool of size classes. The pool is a single
+ * region taken from the heap on first use. Blocks are carved from it on
+ * demand, and go to a free list per class when freed (they are never
+ * merged or split). A class map with one byte per 16 byte granule behind
+ * the region gives the class of a block. All of it is lock free via
+ * armv6m_atomic_cas(), so unlike the heap it needs no SVCall to serialize
+ * against interrupt handlers.
+ *
+ * A free list head holds the index + 1 of the first block in the lower
+ * 16 bits and a counter in the upper 16 bits, so that a pop that gets
+ * interrupted by a pop and push of the same block fails (ABA).
+ */
+
+#if !defined(STM32L0_MALLOC_POOL_SIZE)
+#if defined(STM32L052xx)
+#define STM32L0_MALLOC_POOL_SIZE 1024
+#else
+#define STM32L0_MALLOC_POOL_SIZE 2048
+#endif
+#endif
+
+#define MALLOC_POOL_GRANULE_SHIFT 4
+#define MALLOC_POOL_GRANULE_COUNT (STM32L0_MALLOC_POOL_SIZE >> MALLOC_POOL_GRANULE_SHIFT)
+#define MALLOC_POOL_BLOCK_MAX     256
+
+static const uint16_t malloc_pool_class_size[MALLOC_POOL_CLASS_COUNT] = { 16, 32, 64, 128, 256 };
+
+static struct {
+    uint8_t * volatile base;
+    volatile uint32_t  carved;
+    volatile uint32_t  head[MALLOC_POOL_CLASS_COUNT];
+    volatile uint32_t  blocks[MALLOC_POOL_CLASS_COUNT];
+    volatile uint32_t  used[MALLOC_POOL_CLASS_COUNT];
+    volatile uint32_t  used_max[MALLOC_POOL_CLASS_COUNT];
+    volatile uint32_t  allocs[MALLOC_POOL_CLASS_COUNT];
+    volatile uint32_t  requested;
+    volatile uint32_t  granted;
+    volatile uint32_t  fallbacks;
+} malloc_pool;
+
+static void *malloc_heap(size_t nbytes)
 {
     if (__get_IPSR() == 0)
     {
@@ -212,7 +254,7 @@ void *malloc(size_t nbytes)
     }
 }
 
-void free(void *aptr)
+static void free_heap(void *aptr)
 {
     if (__get_IPSR() == 0)
     {
@@ -224,7 +266,7 @@ void free(void *aptr)
     }
 }
 
-void *realloc(void *aptr, size_t nbytes)
+static void *realloc_heap(void *aptr, size_t nbytes)
 {
     if (__get_IPSR() == 0)
     {
@@ -236,6 +278,267 @@ void *realloc(void *aptr, size_t nbytes)
     }
 }
 
+static inline int malloc_pool_class(size_t nbytes)
+{
+    unsigned int class;
+
+    for (class = 0; class < MALLOC_POOL_CLASS_COUNT; class++)
+    {
+        if (nbytes <= malloc_pool_class_size[class])
+        {
+            return class;
+        }
+    }
+
+    return -1;
+}
+
+static inline bool malloc_pool_contains(const void *aptr)
+{
+    const uint8_t *base = malloc_pool.base;
+
+    return (base && ((const uint8_t*)aptr >= base) && ((const uint8_t*)aptr < (base + STM32L0_MALLOC_POOL_SIZE)));
+}
+
+static void *malloc_pool_alloc(unsigned int class, size_t nbytes)
+{
+    uint8_t *base, *block;
+    uint32_t head, head_next, index, size, carved, used, used_max;
+
+    base = malloc_pool.base;
+
+    if (base == NULL)
+    {
+        base = (uint8_t*)malloc_heap(STM32L0_MALLOC_POOL_SIZE + MALLOC_POOL_GRANULE_COUNT);
+
+        if (base == NULL)
+        {
+            return NULL;
+        }
+
+        if (__armv6m_atomic_cas((volatile uint32_t*)&malloc_pool.base, (uint32_t)NULL, (uint32_t)base) != (uint32_t)NULL)
+        {
+            free_heap(base);
+
+            base = malloc_pool.base;
+        }
+    }
+
+    size = malloc_pool_class_size[class];
+
+    do
+    {
+        head = malloc_pool.head[class];
+        index = head & 0xffff;
+
+        if (index == 0)
+        {
+            break;
+        }
+
+        block = base + ((index - 1) << MALLOC_POOL_GRANULE_SHIFT);
+
+        head_next = ((head + 0x00010000) & 0xffff0000) | (*((volatile uint32_t*)block) & 0xffff);
+    }
+    while (__armv6m_atomic_cas(&malloc_pool.head[class], head, head_next) != head);
+
+    if (index == 0)
+    {
+        do
+        {
+            carved = malloc_pool.carved;
+
+            if ((carved + size) > STM32L0_MALLOC_POOL_SIZE)
+            {
+                return NULL;
+            }
+        }
+        while (__armv6m_atomic_cas(&malloc_pool.carved, carved, (carved + size)) != carved);
+
+        block = base + carved;
+
+        base[STM32L0_MALLOC_POOL_SIZE + (carved >> MALLOC_POOL_GRANULE_SHIFT)] = class;
+
+        __armv6m_atomic_add(&malloc_pool.blocks[class], 1);
+    }
+
+    used = __armv6m_atomic_add(&malloc_pool.used[class], 1) + 1;
+
+    do
+    {
+        used_max = malloc_pool.used_max[class];
+
+        if (used <= used_max)
+        {
+            break;
+        }
+    }
+    while (__armv6m_atomic_cas(&malloc_pool.used_max[class], used_max, used) != used_max);
+
+    __armv6m_atomic_add(&malloc_pool.allocs[class], 1);
+    __armv6m_atomic_add(&malloc_pool.requested, nbytes);
+    __armv6m_atomic_add(&malloc_pool.granted, size);
+
+    return block;
+}
+
+static void malloc_pool_free(void *aptr)
+{
+    uint8_t *base;
+    uint32_t head, head_next, index, class;
+
+    base = malloc_pool.base;
+
+    index = ((uint8_t*)aptr - base) >> MALLOC_POOL_GRANULE_SHIFT;
+    class = base[STM32L0_MALLOC_POOL_SIZE + index];
+
+    /* Count the block as free before it can be popped again, so that used
+     * never exceeds blocks.
+     */
+    __armv6m_atomic_sub(&malloc_pool.used[class], 1);
+
+    do
+    {
+        head = malloc_pool.head[class];
+
+        *((volatile uint32_t*)aptr) = head & 0xffff;
+
+        head_next = ((head + 0x00010000) & 0xffff0000) | (index + 1);
+    }
+    while (__armv6m_atomic_cas(&malloc_pool.head[class], head, head_next) != head);
+}
+
+static inline size_t malloc_pool_usable_size(const void *aptr)
+{
+    const uint8_t *base = malloc_pool.base;
+
+    return malloc_pool_class_size[base[STM32L0_MALLOC_POOL_SIZE + (((const uint8_t*)aptr - base) >> MALLOC_POOL_GRANULE_SHIFT)]];
+}
+
+void malloc_pool_stats(struct malloc_pool_stats *stats)
+{
+    unsigned int class;
+
+    stats->size = malloc_pool.base ? STM32L0_MALLOC_POOL_SIZE : 0;
+    stats->carved = malloc_pool.carved;
+    stats->requested = malloc_pool.requested;
+    stats->granted = malloc_pool.granted;
+    stats->fallbacks = malloc_pool.fallbacks;
+
+    for (class = 0; class < MALLOC_POOL_CLASS_COUNT; class++)
+    {
+        stats->classes[class].size = malloc_pool_class_size[class];
+        stats->classes[class].blocks = malloc_pool.blocks[class];
+        stats->classes[class].used = malloc_pool.used[class];
+        stats->classes[class].used_max = malloc_pool.used_max[class];
+        stats->classes[class].allocs = malloc_pool.allocs[class];
+    }
+}
+
+void *malloc(size_t nbytes)
+{
+    void *ptr;
+    int class;
+
+    class = malloc_pool_class(nbytes);
+
+    if (class >= 0)
+    {
+        ptr = malloc_pool_alloc(class, nbytes);
+
+        if (ptr)
+        {
+            return ptr;
+        }
+
+        __armv6m_atomic_add(&malloc_pool.fallbacks, 1);
+    }
+
+    return malloc_heap(nbytes);
+}
+
+void free(void *aptr)
+{
+    if (aptr == NULL)
+    {
+        return;
+    }
+
+    if (malloc_pool_contains(aptr))
+    {
+        malloc_pool_free(aptr);
+    }
+    else
+    {
+        free_heap(aptr);
+    }
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr;
+    size_t nbytes;
+
+    if (size && (nmemb > ((size_t)~0 / size)))
+    {
+        errno = ENOMEM;
+
+        return NULL;
+    }
+
+    nbytes = nmemb * size;
+
+    ptr = malloc(nbytes);
+
+    if (ptr)
+    {
+        memset(ptr, 0, nbytes);
+    }
+
+    return ptr;
+}
+
+void *realloc(void *aptr, size_t nbytes)
+{
+    void *nptr;
+    size_t size;
+
+    if (aptr == NULL)
+    {
+        return malloc(nbytes);
+    }
+
+    if (!malloc_pool_contains(aptr))
+    {
+        return realloc_heap(aptr, nbytes);
+    }
+
+    if (nbytes == 0)
+    {
+        malloc_pool_free(aptr);
+
+        return NULL;
+    }
+
+    size = malloc_pool_usable_size(aptr);
+
+    if (nbytes <= size)
+    {
+        return aptr;
+    }
+
+    nptr = malloc(nbytes);
+
+    if (nptr)
+    {
+        memcpy(nptr, aptr, size);
+
+        malloc_pool_free(aptr);
+    }
+
+    return nptr;
+}
+
 void *reallocf(void *aptr, size_t nbytes)
 {
     void *nptr;
@@ -261,6 +564,11 @@ void *memalign(size_t align, size_t nbytes)
 
 size_t malloc_usable_size(void *aptr)
 {
+    if (malloc_pool_contains(aptr))
+    {
+        return malloc_pool_usable_size(aptr);
+    }
+
     if (__get_IPSR() == 0)
     {
         return armv6m_svcall_2((uint32_t)&_malloc_usable_size_r, (uint32_t)_REENT, (uint32_t)aptr);
@@ -43,6 +43,23 @@ static uint8_t _channels[PWM_INSTANCE_COUNT];
 
 #endif /* PWM_INSTANCE_COUNT */
 
+#if defined(DAC_RESOLUTION)
+
+#if defined(STM32L072xx) || defined(STM32L082xx)
+#define STM32L0_DAC_STREAM_INSTANCE STM32L0_TIMER_INSTANCE_TIM7
+#define STM32L0_DAC_STREAM_TRIG     STM32L0_DAC_CONTROL_TRIG_TIM7
+#else /* STM32L072xx || STM32L082xx */
+#define STM32L0_DAC_STREAM_INSTANCE STM32L0_TIMER_INSTANCE_TIM6
+#define STM32L0_DAC_STREAM_TRIG     STM32L0_DAC_CONTROL_TRIG_TIM6
+#endif /* STM32L072xx || STM32L082xx */
+
+static stm32l0_timer_t stm32l0_dac_timer;
+
+static analogWriteStreamCallback _streamCallback = NULL;
+static uint32_t _streamPin = ~0u;
+
+#endif /* DAC_RESOLUTION */
+
 static int _readResolution = 10;
 static int _readPeriod = 2;
 static int _writeResolution = 8;
@@ -221,6 +238,110 @@ void analogWrite(uint32_t ulPin, uint32_t value)
     }
 }
 
+#if defined(DAC_RESOLUTION)
+
+static void analogWriteStreamEvent(void *context, void *data, uint32_t count, uint32_t events)
+{
+    (void)context;
+    (void)events;
+
+    if (_streamCallback)
+    {
+	(*_streamCallback)((uint16_t*)data, count / 2);
+    }
+}
+
+#endif /* DAC_RESOLUTION */
+
+bool analogWriteStream(uint32_t ulPin, const uint16_t *data, uint32_t count, uint32_t frequency, analogWriteStreamCallback callback)
+{
+#if defined(DAC_RESOLUTION)
+    uint32_t divider, prescaler;
+
+    if ( (ulPin >= PINS_COUNT) || !(g_APinDescription[ulPin].attr & PIN_ATTR_DAC1) || (frequency == 0) )
+    {
+	return false;
+    }
+
+    analogWriteStreamStop(_streamPin);
+
+    if (stm32l0_dac_timer.state == STM32L0_TIMER_STATE_NONE)
+    {
+	stm32l0_timer_create(&stm32l0_dac_timer, STM32L0_DAC_STREAM_INSTANCE, STM32L0_DAC_IRQ_PRIORITY, 0);
+    }
+
+    /* The sample rate is derived from the timer clock at this point, like
+     * for analogWrite() PWM. A 16 bit counter covers the full range with a
+     * prescaler of at most 256 at 32MHz.
+     */
+    divider = stm32l0_timer_clock(&stm32l0_dac_timer) / frequency;
+
+    if (divider == 0)
+    {
+	divider = 1;
+    }
+
+    prescaler = (divider + 65535) / 65536;
+
+    stm32l0_gpio_pin_configure(g_APinDescription[ulPin].pin, (STM32L0_GPIO_PUPD_NONE | STM32L0_GPIO_MODE_ANALOG));
+
+    stm32l0_dac_enable(STM32L0_DAC_CHANNEL_1);
+
+    _streamCallback = callback;
+
+    if (!stm32l0_dac_stream(data, count * 2, (STM32L0_DAC_CONTROL_RIGHT_ALIGNED | STM32L0_DAC_STREAM_TRIG), (callback ? analogWriteStreamEvent : NULL), NULL))
+    {
+	_streamCallback = NULL;
+
+	return false;
+    }
+
+    _streamPin = ulPin;
+
+    stm32l0_timer_enable(&stm32l0_dac_timer, prescaler -1, 0, NULL, NULL, 0);
+    stm32l0_timer_start(&stm32l0_dac_timer, (divider / prescaler) -1, false);
+
+    return true;
+#else /* DAC_RESOLUTION */
+    (void)ulPin;
+    (void)data;
+    (void)count;
+    (void)frequency;
+    (void)callback;
+
+    return false;
+#endif /* DAC_RESOLUTION */
+}
+
+void analogWriteStreamStop(uint32_t ulPin)
+{
+#if defined(DAC_RESOLUTION)
+    if ((_streamPin == ~0u) || (ulPin != _streamPin))
+    {
+	return;
+    }
+
+    stm32l0_timer_stop(&stm32l0_dac_timer);
+    stm32l0_timer_disable(&stm32l0_dac_timer);
+
+    stm32l0_dac_cancel();
+
+    _streamCallback = NULL;
+    _streamPin = ~0u;
+#else /* DAC_RESOLUTION */
+    (void)ulPin;
+#endif /* DAC_RESOLUTION */
+}
+
+#if defined(PWM_INSTANCE_COUNT)
+
+bool __analogWriteActive(uint32_t instance)
+{
+    return (_channels[instance] != 0);
+}
+
+#endif /* PWM_INSTANCE_COUNT */
+
 void __analogWriteDisable(uint32_t ulPin)
 {
 #if defined(PWM_INSTANCE_COUNT)
@@ -230,6 +351,8 @@ void __analogWriteDisable(uint32_t ulPin)
 #if defined(DAC_RESOLUTION)
     if (g_APinDescription[ulPin].attr & (PIN_ATTR_DAC1 | PIN_ATTR_DAC2))
     {
+	analogWriteStreamStop(ulPin);
+
 	stm32l0_dac_disable(g_APinDescription[ulPin].attr & (PIN_ATTR_DAC1 | PIN_ATTR_DAC2));
 
 	return;
@@ -80,6 +80,23 @@ extern void analogReadPeriod(int period);
  */
 extern void analogWriteResolution(int resolution);
 
+typedef void (*analogWriteStreamCallback)(uint16_t *data, uint32_t count);
+
+/*
+ * \brief Streams 12 bit samples from a circular buffer of "count" samples to a DAC pin
+ * at "frequency" samples per second. Whenever one half of the buffer has been played, 
+ * "callback" is invoked from interrupt context with that half, so it can be refilled
+ * while the other half plays. Without a callback the buffer loops.
+ *
+ * \return false if the pin has no DAC or the DAC is busy.
+ */
+extern bool analogWriteStream(uint32_t ulPin, const uint16_t *data, uint32_t count, uint32_t frequency, analogWriteStreamCallback callback);
+
+/*
+ * \brief Stops a stream started with analogWriteStream().
+ */
+extern void analogWriteStreamStop(uint32_t ulPin);
+
 #ifdef __cplusplus
 }
 #endif
@@ -68,4 +68,115 @@ extern int digitalRead( uint32_t ulPin ) ;
 }
 #endif
 
+#ifdef __cplusplus
+
+/**
+ * \brief Compile time pin access.
+ *
+ * The pin number is a template argument, so the GPIO port and bit are taken from the variant's
+ * g_APinGPIO[] at compile time: no range check, no g_APinDescription[] load, and
+ * digitalWriteFast<PIN_LED>(HIGH) is a single store to BSRR. Using a pin without a GPIO is a
+ * compile time error. Use pinMode() (or FastPin<PIN>::mode()) to configure the pin first.
+ *
+ *   FastPin<13> led;
+ *   led.high();
+ *   led.toggle();
+ */
+template<uint32_t PIN>
+class FastPin
+{
+    static_assert(PIN < PINS_COUNT, "FastPin: pin number out of range");
+    static_assert(g_APinGPIO[PIN] != STM32L0_GPIO_PIN_NONE, "FastPin: pin is not usable as GPIO");
+
+public:
+    static constexpr uint32_t base = GPIOA_BASE + (GPIOB_BASE - GPIOA_BASE) * ((g_APinGPIO[PIN] & STM32L0_GPIO_PIN_GROUP_MASK) >> STM32L0_GPIO_PIN_GROUP_SHIFT);
+    static constexpr uint32_t index = (g_APinGPIO[PIN] & STM32L0_GPIO_PIN_INDEX_MASK) >> STM32L0_GPIO_PIN_INDEX_SHIFT;
+    static constexpr uint32_t mask = (1ul << index);
+
+    static inline void mode(uint32_t mode) { pinMode(PIN, mode); }
+    static inline void high() { ((GPIO_TypeDef*)base)->BSRR = mask; }
+    static inline void low() { ((GPIO_TypeDef*)base)->BRR = mask; }
+    static inline void write(uint32_t value) { if (value) { high(); } else { low(); } }
+    static inline void toggle() { ((GPIO_TypeDef*)base)->BSRR = (((GPIO_TypeDef*)base)->ODR & mask) ? (mask << 16) : mask; }
+    static inline int read() { return !!(((GPIO_TypeDef*)base)->IDR & mask); }
+};
+
+template<uint32_t PIN>
+static inline __attribute__((always_inline)) void digitalWriteFast(uint32_t value)
+{
+    FastPin<PIN>::write(value);
+}
+
+template<uint32_t PIN>
+static inline __attribute__((always_inline)) int digitalReadFast()
+{
+    return FastPin<PIN>::read();
+}
+
+template<uint32_t PIN>
+static inline __attribute__((always_inline)) void digitalToggleFast()
+{
+    FastPin<PIN>::toggle();
+}
+
+template<uint32_t... PINS>
+struct __FastPortPins;
+
+template<>
+struct __FastPortPins<>
+{
+    static constexpr uint32_t mask = 0;
+    static constexpr bool same(uint32_t base) { return true; }
+    static constexpr bool contiguous(uint32_t mask) { return true; }
+    static inline uint32_t set(uint32_t value) { return 0; }
+    static inline uint32_t get(uint32_t data) { return 0; }
+};
+
+template<uint32_t PIN, uint32_t... PINS>
+struct __FastPortPins<PIN, PINS...>
+{
+    static constexpr uint32_t mask = FastPin<PIN>::mask | __FastPortPins<PINS...>::mask;
+    static constexpr bool same(uint32_t base) { return (FastPin<PIN>::base == base) && __FastPortPins<PINS...>::same(base); }
+    static constexpr bool contiguous(uint32_t mask) { return (FastPin<PIN>::mask == mask) && __FastPortPins<PINS...>::contiguous(mask << 1); }
+    static inline uint32_t set(uint32_t value) { return ((value & 1) ? FastPin<PIN>::mask : 0) | __FastPortPins<PINS...>::set(value >> 1); }
+    static inline uint32_t get(uint32_t data) { return ((data & FastPin<PIN>::mask) ? 1 : 0) | (__FastPortPins<PINS...>::get(data) << 1); }
+};
+
+/**
+ * \brief Compile time access to several pins of one GPIO port.
+ *
+ * Bit i of the value is pin i of the list. write() drives all pins with a single store to BSRR,
+ * so they change at the same time; if the pins are adjacent port bits in ascending order the
+ * value is just shifted into place. All pins have to be on the same port.
+ *
+ *   FastPort<2, 3, 4, 5> nibble;
+ *   nibble.write(0x9);
+ */
+template<uint32_t PIN, uint32_t... PINS>
+class FastPort
+{
+    typedef __FastPortPins<PIN, PINS...> Pins;
+
+    static_assert(Pins::same(FastPin<PIN>::base), "FastPort: pins are not on the same GPIO port");
+
+public:
+    static constexpr uint32_t base = FastPin<PIN>::base;
+    static constexpr uint32_t mask = Pins::mask;
+    static constexpr bool contiguous = Pins::contiguous(FastPin<PIN>::mask);
+
+    static inline void write(uint32_t value) {
+        uint32_t set = contiguous ? ((value << FastPin<PIN>::index) & mask) : Pins::set(value);
+
+        ((GPIO_TypeDef*)base)->BSRR = ((mask & ~set) << 16) | set;
+    }
+
+    static inline uint32_t read() {
+        uint32_t data = ((GPIO_TypeDef*)base)->IDR;
+
+        return contiguous ? ((data & mask) >> FastPin<PIN>::index) : Pins::get(data);
+    }
+};
+
+#endif /* __cplusplus */
+
 #endif /* _WIRING_DIGITAL_ */
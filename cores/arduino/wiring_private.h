@@ -48,7 +48,9 @@
 #include "stm32l0_spi.h"
 #include "stm32l0_system.h"
 #include "stm32l0_timer.h"
+#include "stm32l0_timestamp.h"
 #include "stm32l0_uart.h"
+#include "stm32l0_update.h"
 #include "stm32l0_usbd_cdc.h"
 #include "stm32l0_usbd_hid.h"
 
@@ -84,6 +86,7 @@ extern void (*g_serialEventRun)(void);
 
 extern uint32_t __analogReadInternal(uint32_t channel, uint32_t smp);
 extern void __analogWriteDisable(uint32_t pin);
+extern bool __analogWriteActive(uint32_t instance);
 
 /*
  * TIM2   PWM
@@ -103,6 +106,7 @@ extern void __analogWriteDisable(uint32_t pin);
 #define STM32L0_UART_IRQ_PRIORITY    1
 
 #define STM32L0_ADC_IRQ_PRIORITY     0
+#define STM32L0_PULSE_IRQ_PRIORITY   0
 #define STM32L0_SERVO_IRQ_PRIORITY   0
 #define STM32L0_TONE_IRQ_PRIORITY    0
 
@@ -29,6 +29,36 @@
 #include "Arduino.h"
 #include "wiring_private.h"
 
+#if defined(PWM_INSTANCE_COUNT)
+
+extern const unsigned int g_PWMInstances[PWM_INSTANCE_COUNT];
+
+static stm32l0_timer_t _captureTimer;
+
+static pulseCaptureCallback _captureCallback = NULL;
+static uint16_t *_captureData = NULL;
+static uint32_t _capturePin = ~0u;
+
+static void pulseCaptureEvent(void *context, uint32_t events)
+{
+    uint32_t count;
+
+    (void)context;
+    (void)events;
+
+    count = stm32l0_timer_capture_count(&_captureTimer);
+
+    // the buffer is full, so let the system go back to STOP mode
+    stm32l0_timer_stop(&_captureTimer);
+
+    if (_captureCallback)
+    {
+	(*_captureCallback)(_captureData, count);
+    }
+}
+
+#endif /* PWM_INSTANCE_COUNT */
+
 static inline __attribute__((optimize("O3"),always_inline)) uint32_t countPulseInline(const volatile uint32_t *port, uint32_t bit, uint32_t stateMask, unsigned long maxloops)
 {
     uint32_t micros;
@@ -89,3 +119,128 @@ uint32_t pulseIn(uint32_t pin, uint32_t state, uint32_t timeout)
     return countPulseInline(&GPIO->IDR, bit, stateMask, maxloops);
 }
 
+bool pulseCapture(uint32_t pin, uint32_t mode, uint16_t *data, uint32_t count, uint32_t frequency, pulseCaptureCallback callback)
+{
+#if defined(PWM_INSTANCE_COUNT)
+    uint32_t instance, divider, control;
+
+    if ( (pin >= PINS_COUNT) || (g_APinDescription[pin].pwm_instance == PWM_INSTANCE_NONE) || (data == NULL) || (count == 0) || (count > 65535) || (frequency == 0) )
+    {
+	return false;
+    }
+
+    switch (mode) {
+    case RISING:  control = STM32L0_TIMER_CONTROL_CAPTURE_RISING_EDGE;  break;
+    case FALLING: control = STM32L0_TIMER_CONTROL_CAPTURE_FALLING_EDGE; break;
+    case CHANGE:  control = STM32L0_TIMER_CONTROL_CAPTURE_BOTH_EDGES;   break;
+    default:
+	return false;
+    }
+
+    pulseCaptureStop(_capturePin);
+
+    instance = g_APinDescription[pin].pwm_instance;
+
+    if (__analogWriteActive(instance))
+    {
+	return false;
+    }
+
+    stm32l0_timer_create(&_captureTimer, g_PWMInstances[instance], STM32L0_PULSE_IRQ_PRIORITY, 0);
+
+    divider = stm32l0_timer_clock(&_captureTimer) / frequency;
+
+    if (divider == 0)
+    {
+	divider = 1;
+    }
+
+    if (divider > 65536)
+    {
+	divider = 65536;
+    }
+
+    stm32l0_gpio_pin_configure(g_APinDescription[pin].pin, (STM32L0_GPIO_PUPD_NONE | STM32L0_GPIO_MODE_ALTERNATE));
+
+    _captureCallback = callback;
+    _captureData = data;
+
+    // the counter runs free over 16 bits; DMA (or the capture interrupt) stores CCR on each edge
+    stm32l0_timer_enable(&_captureTimer, divider -1, 0, pulseCaptureEvent, NULL, STM32L0_TIMER_EVENT_CAPTURE_DONE);
+    stm32l0_timer_start(&_captureTimer, 0xffff, false);
+
+    if (!stm32l0_timer_capture_stream(&_captureTimer, g_APinDescription[pin].pwm_channel, data, count, control))
+    {
+	stm32l0_timer_stop(&_captureTimer);
+	stm32l0_timer_disable(&_captureTimer);
+	stm32l0_timer_destroy(&_captureTimer);
+
+	_captureCallback = NULL;
+	_captureData = NULL;
+
+	return false;
+    }
+
+    _capturePin = pin;
+
+    return true;
+#else /* PWM_INSTANCE_COUNT */
+    (void)pin;
+    (void)mode;
+    (void)data;
+    (void)count;
+    (void)frequency;
+    (void)callback;
+
+    return false;
+#endif /* PWM_INSTANCE_COUNT */
+}
+
+uint32_t pulseCaptureCount(uint32_t pin)
+{
+#if defined(PWM_INSTANCE_COUNT)
+    if ((_capturePin == ~0u) || (pin != _capturePin))
+    {
+	return 0;
+    }
+
+    return stm32l0_timer_capture_count(&_captureTimer);
+#else /* PWM_INSTANCE_COUNT */
+    (void)pin;
+
+    return 0;
+#endif /* PWM_INSTANCE_COUNT */
+}
+
+uint32_t pulseCaptureStop(uint32_t pin)
+{
+#if defined(PWM_INSTANCE_COUNT)
+    uint32_t count;
+
+    if ((_capturePin == ~0u) || (pin != _capturePin))
+    {
+	return 0;
+    }
+
+    count = stm32l0_timer_capture_cancel(&_captureTimer);
+
+    stm32l0_timer_channel(&_captureTimer, g_APinDescription[pin].pwm_channel, 0, STM32L0_TIMER_CONTROL_DISABLE);
+
+    // already stopped if the buffer filled up
+    stm32l0_timer_stop(&_captureTimer);
+    stm32l0_timer_disable(&_captureTimer);
+    stm32l0_timer_destroy(&_captureTimer);
+
+    stm32l0_gpio_pin_configure(g_APinDescription[pin].pin, (STM32L0_GPIO_PUPD_NONE | STM32L0_GPIO_OSPEED_MEDIUM | STM32L0_GPIO_OTYPE_PUSHPULL | STM32L0_GPIO_MODE_INPUT));
+
+    _captureCallback = NULL;
+    _captureData = NULL;
+    _capturePin = ~0u;
+
+    return count;
+#else /* PWM_INSTANCE_COUNT */
+    (void)pin;
+
+    return 0;
+#endif /* PWM_INSTANCE_COUNT */
+}
@@ -30,6 +30,30 @@ extern "C" {
  */
 uint32_t pulseIn(uint32_t pin, uint32_t state, uint32_t timeout);
 
+typedef void (*pulseCaptureCallback)(uint16_t *data, uint32_t count);
+
+/*
+ * \brief Records the timestamps of the next "count" edges on the pin into "data", without
+ * the CPU; mode is RISING, FALLING or CHANGE. The pin needs a timer channel (digitalPinHasPWM()),
+ * and the timer counts "frequency" ticks per second. Timestamps are 16 bit and wrap, so
+ * the difference of two consecutive ones is right as long as the edges are less than
+ * 65536 ticks apart. "callback" is invoked from interrupt context once "data" is full.
+ * While capturing, the timer cannot be used for analogWrite().
+ *
+ * \return false if the pin has no timer channel, or the timer is busy.
+ */
+extern bool pulseCapture(uint32_t pin, uint32_t mode, uint16_t *data, uint32_t count, uint32_t frequency, pulseCaptureCallback callback);
+
+/*
+ * \brief Returns the number of edges recorded so far by pulseCapture().
+ */
+extern uint32_t pulseCaptureCount(uint32_t pin);
+
+/*
+ * \brief Stops pulseCapture() and returns the number of edges recorded.
+ */
+extern uint32_t pulseCaptureStop(uint32_t pin);
+
 #ifdef __cplusplus
 // Provides a version of pulseIn with a default argument (C++ only)
 uint32_t pulseIn(uint32_t pin, uint32_t state, uint32_t timeout = 1000000L);
@@ -34,20 +34,48 @@ uint32_t shiftIn( uint32_t ulDataPin, uint32_t ulClockPin, uint32_t ulBitOrder )
     uint8_t value = 0 ;
     uint8_t i ;
 
+    if ( (ulDataPin >= PINS_COUNT) || (g_APinDescription[ulDataPin].GPIO == NULL) ||
+	 (ulClockPin >= PINS_COUNT) || (g_APinDescription[ulClockPin].GPIO == NULL) )
+    {
+	for ( i=0 ; i < 8 ; ++i )
+	{
+	    digitalWrite( ulClockPin, HIGH ) ;
+
+	    if ( ulBitOrder == LSBFIRST )
+	    {
+		value |= digitalRead( ulDataPin ) << i ;
+	    }
+	    else
+	    {
+		value |= digitalRead( ulDataPin ) << (7 - i) ;
+	    }
+
+	    digitalWrite( ulClockPin, LOW ) ;
+	}
+
+	return value ;
+    }
+
+    // Look up the pins once instead of in every digitalWrite()/digitalRead()
+    GPIO_TypeDef *DATA = (GPIO_TypeDef*)g_APinDescription[ulDataPin].GPIO;
+    GPIO_TypeDef *CLOCK = (GPIO_TypeDef*)g_APinDescription[ulClockPin].GPIO;
+    uint32_t data = g_APinDescription[ulDataPin].bit;
+    uint32_t clock = g_APinDescription[ulClockPin].bit;
+
     for ( i=0 ; i < 8 ; ++i )
     {
-	digitalWrite( ulClockPin, HIGH ) ;
+	CLOCK->BSRR = clock ;
 
 	if ( ulBitOrder == LSBFIRST )
 	{
-	    value |= digitalRead( ulDataPin ) << i ;
+	    value |= !!(DATA->IDR & data) << i ;
 	}
 	else
 	{
-	    value |= digitalRead( ulDataPin ) << (7 - i) ;
+	    value |= !!(DATA->IDR & data) << (7 - i) ;
 	}
 
-	digitalWrite( ulClockPin, LOW ) ;
+	CLOCK->BRR = clock ;
     }
 
     return value ;
@@ -57,18 +85,44 @@ void shiftOut( uint32_t ulDataPin, uint32_t ulClockPin, uint32_t ulBitOrder, uin
 {
     uint8_t i ;
 
+    if ( (ulDataPin >= PINS_COUNT) || (g_APinDescription[ulDataPin].GPIO == NULL) ||
+	 (ulClockPin >= PINS_COUNT) || (g_APinDescription[ulClockPin].GPIO == NULL) )
+    {
+	for ( i=0 ; i < 8 ; i++ )
+	{
+	    if ( ulBitOrder == LSBFIRST )
+	    {
+		digitalWrite( ulDataPin, !!(ulVal & (1 << i)) ) ;
+	    }
+	    else
+	    {
+		digitalWrite( ulDataPin, !!(ulVal & (1 << (7 - i))) ) ;
+	    }
+
+	    digitalWrite( ulClockPin, HIGH ) ;
+	    digitalWrite( ulClockPin, LOW ) ;
+	}
+
+	return ;
+    }
+
+    GPIO_TypeDef *DATA = (GPIO_TypeDef*)g_APinDescription[ulDataPin].GPIO;
+    GPIO_TypeDef *CLOCK = (GPIO_TypeDef*)g_APinDescription[ulClockPin].GPIO;
+    uint32_t data = g_APinDescription[ulDataPin].bit;
+    uint32_t clock = g_APinDescription[ulClockPin].bit;
+
     for ( i=0 ; i < 8 ; i++ )
     {
-	if ( ulBitOrder == LSBFIRST )
+	if ( (ulBitOrder == LSBFIRST) ? (ulVal & (1 << i)) : (ulVal & (1 << (7 - i))) )
 	{
-	    digitalWrite( ulDataPin, !!(ulVal & (1 << i)) ) ;
+	    DATA->BSRR = data ;
 	}
 	else
 	{
-	    digitalWrite( ulDataPin, !!(ulVal & (1 << (7 - i))) ) ;
+	    DATA->BRR = data ;
 	}
 
-	digitalWrite( ulClockPin, HIGH ) ;
-	digitalWrite( ulClockPin, LOW ) ;
+	CLOCK->BSRR = clock ;
+	CLOCK->BRR = clock ;
     }
 }
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2016-2018 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "EEPROMCache.h"
+#include "avr/eeprom.h"
+#include "avr/io.h"
+#include "stm32l0_eeprom.h"
+
+/* Each slot is the record, rounded up to words, followed by a trailer of
+ * { sequence, crc32 }. The trailer is programmed after the record, and
+ * the CRC covers the record and the sequence, so a slot torn by a power
+ * loss fails the CRC and begin() falls back to the other slot.
+ *
+ * There are two dirty bitmaps, one bit per word. The first one has the
+ * words changed since the last commit(). The second one has the words
+ * where the older slot differs from the newer one. commit() writes both
+ * sets to the older slot, which then becomes the newer one.
+ */
+
+#define EEPROM_CACHE_TRAILER_SIZE 8
+
+static const uint32_t eeprom_cache_crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static uint32_t eeprom_cache_crc(uint32_t crc, const uint8_t *data, size_t count)
+{
+    while (count--) {
+        crc = eeprom_cache_crc_table[(crc ^ *data) & 0x0f] ^ (crc >> 4);
+        crc = eeprom_cache_crc_table[(crc ^ (*data >> 4)) & 0x0f] ^ (crc >> 4);
+        data++;
+    }
+
+    return crc;
+}
+
+static bool eeprom_cache_program(uint32_t address, const uint8_t *data, uint32_t count)
+{
+    stm32l0_eeprom_transaction_t transaction;
+
+    transaction.status = STM32L0_EEPROM_STATUS_BUSY;
+    transaction.control = STM32L0_EEPROM_CONTROL_PROGRAM;
+    transaction.count = count;
+    transaction.address = address;
+    transaction.data = (uint8_t*)data;
+    transaction.callback = NULL;
+    transaction.context = NULL;
+
+    if (!stm32l0_eeprom_enqueue(&transaction)) {
+        return false;
+    }
+
+    while (transaction.status == STM32L0_EEPROM_STATUS_BUSY) {
+    }
+
+    return (transaction.status == STM32L0_EEPROM_STATUS_SUCCESS);
+}
+
+EEPROMCacheClass::EEPROMCacheClass(int address, uint8_t *data, uint32_t *dirty, size_t size) {
+    _address = address;
+    _data = data;
+    _dirty = dirty;
+    _size = size;
+    _words = (size + 3) / 4;
+    _slot = 0;
+    _sequence = 0;
+}
+
+uint32_t EEPROMCacheClass::slotAddress(unsigned int slot) {
+    return _address + slot * (_words * 4 + EEPROM_CACHE_TRAILER_SIZE);
+}
+
+bool EEPROMCacheClass::validate(unsigned int slot, uint32_t &sequence) {
+    uint8_t buffer[32];
+    uint32_t address, offset, count, crc, trailer[2];
+
+    address = slotAddress(slot);
+
+    eeprom_read_block((void*)&trailer[0], (const void*)(address + _words * 4), sizeof(trailer));
+
+    crc = ~0ul;
+
+    for (offset = 0; offset < (uint32_t)(_words * 4); offset += count) {
+        count = _words * 4 - offset;
+
+        if (count > sizeof(buffer)) {
+            count = sizeof(buffer);
+        }
+
+        eeprom_read_block((void*)&buffer[0], (const void*)(address + offset), count);
+
+        crc = eeprom_cache_crc(crc, &buffer[0], count);
+    }
+
+    crc = ~eeprom_cache_crc(crc, (const uint8_t*)&trailer[0], 4);
+
+    sequence = trailer[0];
+
+    return (trailer[1] == crc);
+}
+
+bool EEPROMCacheClass::begin() {
+    uint32_t sequence[2], offset, data, masks;
+    bool valid[2];
+    unsigned int slot, index;
+
+    masks = (_words + 31) / 32;
+
+    memset(_data, 0, _words * 4);
+    memset(_dirty, 0, 2 * masks * sizeof(uint32_t));
+
+    _slot = 1;
+    _sequence = 0;
+
+    if ((_address & 3) || !_words || ((slotAddress(2)) > (E2END + 1))) {
+        return false;
+    }
+
+    valid[0] = validate(0, sequence[0]);
+    valid[1] = validate(1, sequence[1]);
+
+    if (!valid[0] && !valid[1]) {
+        // Nothing to keep, so the first commit() writes all of slot 0.
+        for (index = 0; index < _words; index++) {
+            _dirty[index >> 5] |= (1ul << (index & 31));
+            _dirty[masks + (index >> 5)] |= (1ul << (index & 31));
+        }
+
+        return false;
+    }
+
+    if (valid[0] && valid[1]) {
+        slot = ((int32_t)(sequence[1] - sequence[0]) > 0) ? 1 : 0;
+    } else {
+        slot = valid[1] ? 1 : 0;
+    }
+
+    _slot = slot;
+    _sequence = sequence[slot];
+
+    eeprom_read_block((void*)_data, (const void*)slotAddress(slot), _words * 4);
+
+    for (index = 0, offset = slotAddress(slot ^ 1); index < _words; index++, offset += 4) {
+        if (valid[slot ^ 1]) {
+            data = eeprom_read_dword((const uint32_t*)offset);
+
+            if (data == ((const uint32_t*)_data)[index]) {
+                continue;
+            }
+        }
+
+        _dirty[masks + (index >> 5)] |= (1ul << (index & 31));
+    }
+
+    return true;
+}
+
+void EEPROMCacheClass::mark(unsigned int offset) {
+    unsigned int index = offset / 4;
+
+    _dirty[index >> 5] |= (1ul << (index & 31));
+}
+
+uint8_t EEPROMCacheClass::read(int idx) {
+    if ((idx < 0) || (idx >= _size)) {
+        return 0;
+    }
+
+    return _data[idx];
+}
+
+void EEPROMCacheClass::write(int idx, uint8_t val) {
+    if ((idx < 0) || (idx >= _size)) {
+        return;
+    }
+
+    if (_data[idx] != val) {
+        _data[idx] = val;
+
+        mark(idx);
+    }
+}
+
+void EEPROMCacheClass::readBlock(int idx, uint8_t *data, size_t count) {
+    if ((idx < 0) || ((idx + count) > _size)) {
+        return;
+    }
+
+    memcpy(data, &_data[idx], count);
+}
+
+void EEPROMCacheClass::writeBlock(int idx, const uint8_t *data, size_t count) {
+    size_t offset;
+
+    if ((idx < 0) || ((idx + count) > _size)) {
+        return;
+    }
+
+    for (offset = 0; offset < count; offset++) {
+        if (_data[idx + offset] != data[offset]) {
+            _data[idx + offset] = data[offset];
+
+            mark(idx + offset);
+        }
+    }
+}
+
+bool EEPROMCacheClass::dirty() {
+    unsigned int index, masks;
+
+    masks = (_words + 31) / 32;
+
+    for (index = 0; index < masks; index++) {
+        if (_dirty[index]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool EEPROMCacheClass::commit() {
+    uint32_t address, sequence, trailer[2];
+    unsigned int slot, index, start, masks;
+    bool success;
+
+    if (!dirty()) {
+        return true;
+    }
+
+    if ((_address & 3) || !_words || ((slotAddress(2)) > (E2END + 1))) {
+        return false;
+    }
+
+    masks = (_words + 31) / 32;
+
+    slot = _slot ^ 1;
+    address = slotAddress(slot);
+
+    success = true;
+
+    // Program each run of words that differ from the older slot.
+    for (index = 0; success && (index < _words); ) {
+        if (!((_dirty[index >> 5] | _dirty[masks + (index >> 5)]) & (1ul << (index & 31)))) {
+            index++;
+
+            continue;
+        }
+
+        for (start = index; index < _words; index++) {
+            if (!((_dirty[index >> 5] | _dirty[masks + (index >> 5)]) & (1ul << (index & 31)))) {
+                break;
+            }
+        }
+
+        success = eeprom_cache_program(address + start * 4, &_data[start * 4], (index - start) * 4);
+    }
+
+    if (success) {
+        sequence = _sequence + 1;
+
+        trailer[0] = sequence;
+        trailer[1] = ~eeprom_cache_crc(eeprom_cache_crc(~0ul, _data, _words * 4), (const uint8_t*)&trailer[0], 4);
+
+        success = eeprom_cache_program(address + _words * 4, (const uint8_t*)&trailer[0], sizeof(trailer));
+    }
+
+    if (!success) {
+        // The older slot is now a mix, so everything written so far is stale.
+        for (index = 0; index < masks; index++) {
+            _dirty[masks + index] |= _dirty[index];
+        }
+
+        return false;
+    }
+
+    for (index = 0; index < masks; index++) {
+        _dirty[masks + index] = _dirty[index];
+        _dirty[index] = 0;
+    }
+
+    _slot = slot;
+    _sequence = sequence;
+
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016-2018 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef EEPROMCache_h
+#define EEPROMCache_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/***
+    EEPROMCacheClass class.
+
+    A RAM copy of a record of "size" bytes in the EEPROM. read/write/get/put
+    only touch the RAM copy and mark the changed 32 bit words dirty. commit()
+    programs the record in whole words into the older of two slots at
+    "address", and then a trailer with a sequence number and a CRC32. begin()
+    picks the newest slot with a valid trailer, so a power loss during
+    commit() leaves either the old or the new record, never a mix.
+
+    The EEPROM needs 2 * (size rounded up to 4 + 8) bytes at "address",
+    which needs to be 4 byte aligned.
+***/
+
+class EEPROMCacheClass {
+public:
+    EEPROMCacheClass(int address, uint8_t *data, uint32_t *dirty, size_t size);
+
+    // Load the newest valid record. Returns false (with the cache zeroed) if there is none.
+    bool begin();
+
+    uint8_t read(int idx);
+    void write(int idx, uint8_t val);
+    void update(int idx, uint8_t val) { write(idx, val); }
+
+    uint16_t length() { return _size; }
+
+    template< typename T > T &get(int idx, T &t) {
+        readBlock(idx, (uint8_t*)&t, sizeof(T));
+        return t;
+    }
+
+    template< typename T > const T &put(int idx, const T &t) {
+        writeBlock(idx, (const uint8_t*)&t, sizeof(T));
+        return t;
+    }
+
+    void readBlock(int idx, uint8_t *data, size_t count);
+    void writeBlock(int idx, const uint8_t *data, size_t count);
+
+    // True if the cache holds changes not yet committed.
+    bool dirty();
+
+    // Program the changes atomically. Returns false on an EEPROM error; the changes stay dirty.
+    bool commit();
+
+    uint32_t sequence() { return _sequence; }
+
+private:
+    uint32_t _address;
+    uint8_t *_data;
+    uint32_t *_dirty;
+    uint16_t _size;
+    uint16_t _words;
+    uint8_t _slot;
+    uint32_t _sequence;
+
+    uint32_t slotAddress(unsigned int slot);
+    bool validate(unsigned int slot, uint32_t &sequence);
+    void mark(unsigned int offset);
+};
+
+template<size_t SIZE> class EEPROMCache : public EEPROMCacheClass {
+public:
+    EEPROMCache(int address) : EEPROMCacheClass(address, (uint8_t*)&_cache[0], &_dirtyMask[0], SIZE) { }
+
+private:
+    // _dirtyMask holds two bitmaps, changed since the last commit and stale in the older slot
+    uint32_t _cache[(SIZE + 3) / 4];
+    uint32_t _dirtyMask[2 * ((((SIZE + 3) / 4) + 31) / 32)];
+};
+
+#endif
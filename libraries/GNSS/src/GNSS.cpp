@@ -330,6 +330,8 @@ bool GNSSSatellites::navigating(unsigned int index) const
 
 GNSSClass::GNSSClass()
 {
+    armv6m_pendsv_event_create(&_receiveEvent, (armv6m_pendsv_routine_t)&GNSSClass::uartReceiveCallback, this);
+    armv6m_pendsv_event_create(&_doneEvent, NULL, NULL);
 }
 
 void GNSSClass::begin(GNSSmode mode, GNSSrate rate)
@@ -682,14 +684,15 @@ void GNSSClass::uartReceiveCallback(class GNSSClass *self)
 void GNSSClass::uartEventCallback(class GNSSClass *self, uint32_t events)
 {
     if (events & STM32L0_UART_EVENT_RECEIVE) {
-        armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)&GNSSClass::uartReceiveCallback, self, 0);
+        armv6m_pendsv_event_post(&self->_receiveEvent, 0);
     }
 }
 
 void GNSSClass::uartDoneCallback(class GNSSClass *self)
 {
     if (self->_doneCallback) {
-        armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)self->_doneCallback, NULL, 0);
+        self->_doneEvent.routine = (armv6m_pendsv_routine_t)self->_doneCallback;
+        armv6m_pendsv_event_post(&self->_doneEvent, 0);
     } else {
         stm32l0_uart_configure(self->_uart,
                                self->_baudrate,
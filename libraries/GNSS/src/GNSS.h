@@ -206,11 +206,14 @@ private:
     gnss_satellites_t _satellites_data;
     volatile uint32_t _satellites_pending;
 
-    Callback _locationCallback;
-    Callback _satellitesCallback;
+    Callback _locationCallback { Callback::TYPE_GNSS };
+    Callback _satellitesCallback { Callback::TYPE_GNSS };
 
     void (*_doneCallback)(void);
 
+    armv6m_pendsv_event_t _receiveEvent;
+    armv6m_pendsv_event_t _doneEvent;
+
     void uartBegin(GNSSmode mode, GNSSrate rate, struct _stm32l0_uart_t *uart, const struct _stm32l0_uart_params_t *params, uint16_t wakeup, uint16_t pps, uint16_t enable, uint16_t backup, bool internal);
     void uartEnd();
     static void uartReceiveCallback(class GNSSClass*);
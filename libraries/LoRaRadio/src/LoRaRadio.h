@@ -166,9 +166,9 @@ private:
     bool              _implicitHeader;
     uint32_t          _timeout;
 
-    Callback          _transmitCallback;
-    Callback          _receiveCallback;
-    Callback          _cadCallback;
+    Callback          _transmitCallback { Callback::TYPE_RADIO };
+    Callback          _receiveCallback { Callback::TYPE_RADIO };
+    Callback          _cadCallback { Callback::TYPE_RADIO };
 
     static bool       __TxStart(void);
     static bool       __RxStart(void);
@@ -502,6 +502,10 @@ static LoRaMacStatus_t LoRaWANMcpsRequest( McpsReq_t *mcpsRequest )
 
 LoRaWANClass::LoRaWANClass()
 {
+    armv6m_pendsv_event_create(&_McpsJoinEvent, (armv6m_pendsv_routine_t)LoRaWANClass::__McpsJoin, NULL);
+    armv6m_pendsv_event_create(&_McpsSendEvent, (armv6m_pendsv_routine_t)LoRaWANClass::__McpsSend, NULL);
+    armv6m_pendsv_event_create(&_MlmeJoinEvent, (armv6m_pendsv_routine_t)LoRaWANClass::__MlmeJoin, NULL);
+
     _Band = NULL;
     _Joined = false;
     _Save = false;
@@ -614,7 +618,11 @@ int LoRaWANClass::begin(const struct LoRaWANBand &band)
         RTC->BKP2R = 0;
     }
 
-    LoRaMacInitialization(&LoRaMacPrimitives, &LoRaMacCallbacks, _Band->LoRaMacRegion);
+    if (LoRaMacInitialization(&LoRaMacPrimitives, &LoRaMacCallbacks, _Band->LoRaMacRegion) != LORAMAC_STATUS_OK) {
+        _Band = NULL;
+
+        return 0;
+    }
 
 #if defined(STM32L0_CONFIG_ANTENNA_GAIN)
     {
@@ -3160,7 +3168,7 @@ void LoRaWANClass::__McpsConfirm( McpsConfirm_t *mcpsConfirm )
     {
         if (LoRaWAN._tx_active)
         {
-            armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)LoRaWANClass::__McpsSend, NULL, 0);
+            armv6m_pendsv_event_post(&LoRaWAN._McpsSendEvent, 0);
         }
         else
         {
@@ -3297,7 +3305,7 @@ void LoRaWANClass::__McpsIndication( McpsIndication_t *mcpsIndication )
                         LoRaWAN._Joined = false;
                         LoRaWAN._JoinTrials = 0;
                             
-                        armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)LoRaWANClass::__MlmeJoin, NULL, 0);
+                        armv6m_pendsv_event_post(&LoRaWAN._MlmeJoinEvent, 0);
                         break;
                         
                     case 7: // (x)
@@ -3552,7 +3560,7 @@ void LoRaWANClass::__MlmeConfirm( MlmeConfirm_t *mlmeConfirm )
             {
                 LoRaWAN._tx_join = true;
                 
-                armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)LoRaWANClass::__McpsJoin, NULL, 0);
+                armv6m_pendsv_event_post(&LoRaWAN._McpsJoinEvent, 0);
             }
             else
             {
@@ -3567,7 +3575,7 @@ void LoRaWANClass::__MlmeConfirm( MlmeConfirm_t *mlmeConfirm )
         {
             if (LoRaWAN._JoinTrials < LoRaWAN._JoinRetries)
             {
-                armv6m_pendsv_enqueue((armv6m_pendsv_routine_t)LoRaWANClass::__MlmeJoin, NULL, 0);
+                armv6m_pendsv_event_post(&LoRaWAN._MlmeJoinEvent, 0);
             }
             else
             {
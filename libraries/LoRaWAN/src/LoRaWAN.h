@@ -284,12 +284,16 @@ private:
     LoRaWANSession    _session;
     LoRaWANParams     _params;
 
-    Callback          _joinCallback;
-    Callback          _linkCheckCallback;
-    Callback          _receiveCallback;
-    Callback          _transmitCallback;
+    Callback          _joinCallback { Callback::TYPE_LORAWAN };
+    Callback          _linkCheckCallback { Callback::TYPE_LORAWAN };
+    Callback          _receiveCallback { Callback::TYPE_LORAWAN };
+    Callback          _transmitCallback { Callback::TYPE_LORAWAN };
 
     bool              _wakeup;
+
+    armv6m_pendsv_event_t _McpsJoinEvent;
+    armv6m_pendsv_event_t _McpsSendEvent;
+    armv6m_pendsv_event_t _MlmeJoinEvent;
     
     void              _saveSession();
     bool              _restoreSession();
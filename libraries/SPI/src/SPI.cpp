@@ -277,6 +277,100 @@ void SPIClass::_doneCallback(class SPIClass *self)
     self->_callback.queue(false);;
 }
 
+SPITransaction::SPITransaction()
+{
+    _transaction.status = STM32L0_SPI_STATUS_SUCCESS;
+}
+
+SPITransaction::~SPITransaction()
+{
+    if (_transaction.status == STM32L0_SPI_STATUS_BUSY) {
+        __BKPT();
+    }
+}
+
+bool SPITransaction::submit(class SPIClass &spi, uint32_t pin, SPISettings settings, const uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, void(*callback)(void))
+{
+    return submit(spi, pin, settings, txBuffer, txSize, rxBuffer, rxSize, Callback(callback));
+}
+
+bool SPITransaction::submit(class SPIClass &spi, uint32_t pin, SPISettings settings, const uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, Callback callback)
+{
+    unsigned int count;
+
+    if (pin >= PINS_COUNT) {
+        return false;
+    }
+
+    if (!txBuffer && txSize) {
+        return false;
+    }
+
+    if (!rxBuffer && rxSize) {
+        return false;
+    }
+
+    if ((!txSize && !rxSize) || (txSize > 65535) || (rxSize > 65535)) {
+        return false;
+    }
+
+    if (_transaction.status == STM32L0_SPI_STATUS_BUSY) {
+        return false;
+    }
+
+    count = 0;
+
+    if (txSize) {
+        _segments[count].tx_data = txBuffer;
+        _segments[count].rx_data = NULL;
+        _segments[count].count = txSize;
+        count++;
+    }
+
+    if (rxSize) {
+        _segments[count].tx_data = NULL;
+        _segments[count].rx_data = rxBuffer;
+        _segments[count].count = rxSize;
+        count++;
+    }
+
+    _transaction.status = STM32L0_SPI_STATUS_SUCCESS;
+    _transaction.segment_count = count;
+    _transaction.pin = g_APinDescription[pin].pin;
+    _transaction.clock = settings._clock;
+    _transaction.option = settings._option;
+    _transaction.segments = &_segments[0];
+    _transaction.callback = (stm32l0_spi_done_callback_t)SPITransaction::_doneCallback;
+    _transaction.context = (void*)this;
+
+    _callback = callback;
+
+    if (!stm32l0_spi_submit(spi._spi, &_transaction)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool SPITransaction::done()
+{
+    return (_transaction.status != STM32L0_SPI_STATUS_BUSY);
+}
+
+// Status:
+//  0 : Success
+//  1 : Busy
+
+uint8_t SPITransaction::status()
+{
+    return _transaction.status;
+}
+
+void SPITransaction::_doneCallback(class SPITransaction *self)
+{
+    self->_callback.queue(false);
+}
+
 #if SPI_INTERFACES_COUNT > 0
 
 extern stm32l0_spi_t g_SPI;
@@ -21,6 +21,7 @@
 #define _SPI_H_INCLUDED
 
 #include <Arduino.h>
+#include "stm32l0_spi.h"
 
 // SPI_HAS_TRANSACTION means SPI has
 //   - beginTransaction()
@@ -50,6 +51,7 @@ private:
   uint32_t _option;
 
   friend class SPIClass;
+  friend class SPITransaction;
 };
 
 class SPIClass {
@@ -92,7 +94,7 @@ private:
     uint32_t _clock;
     uint32_t _option;
 
-    Callback _callback;
+    Callback _callback { Callback::TYPE_BUS };
 
     uint8_t (*_transfer8Routine)(struct _stm32l0_spi_t*, uint8_t);
     uint16_t (*_transfer16Routine)(struct _stm32l0_spi_t*, uint16_t);
@@ -109,6 +111,31 @@ private:
     static uint16_t _transfer16Select(struct _stm32l0_spi_t *spi, uint16_t data);
 
     static void _doneCallback(class SPIClass *self);
+
+    friend class SPITransaction;
+};
+
+// STM32L0 EXTENSTION: queued transaction. "pin" is driven low for the whole transaction,
+// "txSize" bytes are sent from "txBuffer", and then "rxSize" bytes are received into "rxBuffer".
+// Queued transactions are chained back to back by the DMA completion interrupt, switching
+// settings and chip selects in between. beginTransaction() waits for the current one to end.
+class SPITransaction {
+public:
+    SPITransaction();
+    ~SPITransaction();
+    SPITransaction(const SPITransaction&) = delete;
+    SPITransaction& operator=(const SPITransaction&) = delete;
+
+    bool submit(class SPIClass &spi, uint32_t pin, SPISettings settings, const uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, void(*callback)(void));
+    bool submit(class SPIClass &spi, uint32_t pin, SPISettings settings, const uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, Callback callback);
+    bool done();
+    uint8_t status();
+
+private:
+    stm32l0_spi_transaction_t _transaction;
+    stm32l0_spi_segment_t _segments[2];
+    Callback _callback { Callback::TYPE_BUS };
+    static void _doneCallback(class SPITransaction *self);
 };
 
 #if SPI_INTERFACES_COUNT > 0
@@ -0,0 +1,558 @@
+#!/usr/bin/env python3
+#
+# Host test of the double buffered ADC scan in stm32l0_adc.c. The driver and
+# stm32l0_dma.c are compiled with the host g++ against register stand-ins:
+# ADC1 converts once per trigger while ADSTART is set, and requests a DMA
+# transfer for each conversion (after the first transfer complete only with
+# DMACFG set, as in the DMA one shot mode the ADC stops there). DMA1
+# channel 1 writes a running sample number into the ring, counts down
+# CNDTR, and raises HT/TC as the hardware does.
+#
+# The DMA interrupt is taken after a random latency, and a preemption point
+# follows every statement of the DMA interrupt handling and
+# stm32l0_adc_dma_callback(), where further conversions may come in. The
+# latency goes beyond a half, but a half is longer than the interrupt itself
+# takes up to the DMA position read, which is as late as the driver can
+# tell.
+#
+# Checked are: every trigger is converted and transferred, every half
+# handed to the callback without OVERRUN is the one after the previous,
+# and holds its own samples as of the DMA position the driver read, halves
+# lost to a late interrupt are reported with OVERRUN, no half is handed out
+# twice, CFGR1 is only written with ADSTART clear, and stm32l0_adc_cancel()
+# stops the ADC and DMA and drops the locks again.
+#
+#   python3 adc_scan_test.py [samples]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCES = ("system/STM32L0xx/Source/stm32l0_dma.c", "system/STM32L0xx/Source/stm32l0_adc.c")
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void model_preempt(void);
+
+/* Preemption only happens between statements, so these are atomic. */
+static inline uint32_t armv6m_atomic_or(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_and(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t armv6m_atomic_modify(volatile uint32_t *p_data, uint32_t mask, uint32_t data) { uint32_t o = *p_data; *p_data = (o & ~mask) | data; return o; }
+static inline uint32_t armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t __armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_orb(p_data, data); }
+static inline uint32_t __armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_andb(p_data, data); }
+static inline uint32_t armv6m_atomic_andzb(volatile uint32_t *p_data, uint32_t data, volatile uint8_t *p_zero) { uint32_t o = *p_data; if (!*p_zero) { *p_data = o & data; } return o; }
+
+static inline uint32_t armv6m_atomic_cash(volatile uint16_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+static inline void armv6m_core_udelay(uint32_t delay) { }
+
+#define ARMV6M_TRACE_IRQ_ENTER()
+#define ARMV6M_TRACE_IRQ_LEAVE()
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef struct { model_register_t ISR, IER, CR, CFGR1, CFGR2, SMPR, TR, CHSELR, DR, CALFACT; } ADC_TypeDef;
+typedef struct { model_register_t CCR; } ADC_Common_TypeDef;
+typedef struct { model_register_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { model_register_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { volatile uint32_t CSELR; } DMA_Request_TypeDef;
+typedef struct { volatile uint32_t AHBENR, AHBSMENR; } RCC_TypeDef;
+typedef struct { volatile uint32_t ACR; } FLASH_TypeDef;
+typedef struct { volatile uint32_t CFGR3; } SYSCFG_TypeDef;
+
+extern ADC_TypeDef model_adc;
+extern ADC_Common_TypeDef model_adc_common;
+extern DMA_Channel_TypeDef model_dma_channel[7];
+extern DMA_TypeDef model_dma;
+extern DMA_Request_TypeDef model_dma_cselr;
+extern RCC_TypeDef model_rcc;
+extern FLASH_TypeDef model_flash;
+extern SYSCFG_TypeDef model_syscfg;
+
+#define ADC1          (&model_adc)
+#define ADC1_COMMON   (&model_adc_common)
+#define DMA1          (&model_dma)
+#define DMA1_CSELR    (&model_dma_cselr)
+#define DMA1_Channel1 (&model_dma_channel[0])
+#define DMA1_Channel2 (&model_dma_channel[1])
+#define DMA1_Channel3 (&model_dma_channel[2])
+#define DMA1_Channel4 (&model_dma_channel[3])
+#define DMA1_Channel5 (&model_dma_channel[4])
+#define DMA1_Channel6 (&model_dma_channel[5])
+#define DMA1_Channel7 (&model_dma_channel[6])
+#define RCC           (&model_rcc)
+#define FLASH         (&model_flash)
+#define SYSCFG        (&model_syscfg)
+
+#define DMA1_Channel1_IRQn       9
+#define DMA1_Channel2_3_IRQn     10
+#define DMA1_Channel4_5_6_7_IRQn 11
+
+static inline void NVIC_EnableIRQ(int irq) { }
+static inline void NVIC_SetPriority(int irq, uint32_t priority) { }
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_dma.c"
+#include "stm32l0_adc.c"
+#include <stdio.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d, sample %llu)\n", #_c, __LINE__, (unsigned long long)samples); exit(1); } } while (0)
+
+#define RING_SIZE 65536
+
+ADC_TypeDef model_adc;
+ADC_Common_TypeDef model_adc_common;
+DMA_Channel_TypeDef model_dma_channel[7];
+DMA_TypeDef model_dma;
+DMA_Request_TypeDef model_dma_cselr;
+RCC_TypeDef model_rcc;
+FLASH_TypeDef model_flash;
+SYSCFG_TypeDef model_syscfg;
+
+static uint64_t samples;                /* conversions transferred */
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+
+    return rng_state;
+}
+
+/* ---- system ---- */
+
+static uint32_t locks, periph, hsi16;
+
+void stm32l0_system_lock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); locks++; }
+void stm32l0_system_unlock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); CHECK(locks); locks--; }
+void stm32l0_system_periph_enable(unsigned int index) { CHECK(index == STM32L0_SYSTEM_PERIPH_ADC); periph++; }
+void stm32l0_system_periph_disable(unsigned int index) { CHECK(index == STM32L0_SYSTEM_PERIPH_ADC); CHECK(periph); periph--; }
+void stm32l0_system_hsi16_enable(void) { hsi16++; }
+void stm32l0_system_hsi16_disable(void) { CHECK(hsi16); hsi16--; }
+uint32_t stm32l0_system_hclk(void) { return 32000000; }
+uint32_t stm32l0_system_pclk2(void) { return 32000000; }
+
+/* ---- DMA1 channel 1 ---- */
+
+static uint64_t shadow[RING_SIZE];      /* sample number per ring slot */
+static uint64_t position_samples;       /* "samples" as of the last CNDTR read */
+static uint32_t position_remaining, dma_reload, dma_remaining, dma_flags;
+static bool adc_oneshot_done;
+
+static bool dma_pending(void)
+{
+    return !!(dma_flags & model_dma_channel[0].CCR.value & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE));
+}
+
+static void dma_ccr_write(model_register_t *reg, uint32_t data)
+{
+    if ((data & DMA_CCR_EN) && !(reg->value & DMA_CCR_EN))
+    {
+        dma_remaining = dma_reload;
+    }
+
+    reg->value = data;
+}
+
+static void dma_cndtr_write(model_register_t *reg, uint32_t data)
+{
+    CHECK(!(model_dma_channel[0].CCR.value & DMA_CCR_EN));
+
+    dma_reload = data & 0xffff;
+}
+
+static uint32_t dma_cndtr_read(model_register_t *reg)
+{
+    position_samples = samples;
+    position_remaining = dma_remaining;
+
+    return dma_remaining;
+}
+
+static uint32_t dma_isr_read(model_register_t *reg)
+{
+    return dma_flags;
+}
+
+static void dma_ifcr_write(model_register_t *reg, uint32_t data)
+{
+    dma_flags &= ~(data & 15);
+}
+
+/* ---- ADC1 ---- */
+
+static uint32_t adc_cr_read(model_register_t *reg)
+{
+    /* ADCAL, ADSTP and ADDIS complete right away */
+    if (reg->value & ADC_CR_ADSTP)
+    {
+        reg->value &= ~(ADC_CR_ADSTP | ADC_CR_ADSTART);
+    }
+
+    if (reg->value & ADC_CR_ADDIS)
+    {
+        reg->value &= ~(ADC_CR_ADDIS | ADC_CR_ADEN);
+    }
+
+    reg->value &= ~ADC_CR_ADCAL;
+
+    return reg->value;
+}
+
+static void adc_cr_write(model_register_t *reg, uint32_t data)
+{
+    if ((data & ADC_CR_ADSTART) && !(reg->value & ADC_CR_ADSTART))
+    {
+        CHECK(data & ADC_CR_ADEN);
+
+        adc_oneshot_done = false;
+    }
+
+    reg->value = data;
+}
+
+static uint32_t adc_isr_read(model_register_t *reg)
+{
+    return reg->value | ((model_adc.CR.value & ADC_CR_ADEN) ? ADC_ISR_ADRDY : 0);
+}
+
+static void adc_isr_write(model_register_t *reg, uint32_t data)
+{
+    reg->value &= ~data;
+}
+
+static void adc_cfgr1_write(model_register_t *reg, uint32_t data)
+{
+    /* RM0377: CFGR1 is only writable with no conversion ongoing */
+    CHECK(!(model_adc.CR.value & ADC_CR_ADSTART));
+
+    reg->value = data;
+}
+
+/* One trigger (timer or the free running ADC): a conversion, and its DMA
+ * transfer into the ring.
+ */
+static void hw_convert(void)
+{
+    DMA_Channel_TypeDef *DMA = &model_dma_channel[0];
+    uint32_t slot, data;
+
+    CHECK((model_adc.CR.value & (ADC_CR_ADEN | ADC_CR_ADSTART)) == (ADC_CR_ADEN | ADC_CR_ADSTART));
+    CHECK(model_adc.CFGR1.value & ADC_CFGR1_DMAEN);
+    CHECK(!adc_oneshot_done);
+    CHECK(DMA->CCR.value & DMA_CCR_EN);
+    CHECK(dma_remaining);
+
+    slot = dma_reload - dma_remaining;
+
+    data = (model_adc.CFGR1.value & ADC_CFGR1_RES_1) ? (samples & 0xff) : (samples & 0xffff);
+
+    if (DMA->CCR.value & DMA_CCR_MSIZE_0)
+    {
+        ((uint16_t*)(uintptr_t)DMA->CMAR.value)[slot] = data;
+    }
+    else
+    {
+        ((uint8_t*)(uintptr_t)DMA->CMAR.value)[slot] = data;
+    }
+
+    shadow[slot] = samples;
+    samples++;
+
+    dma_remaining--;
+
+    if (dma_remaining == (dma_reload / 2))
+    {
+        dma_flags |= (DMA_ISR_GIF1 | DMA_ISR_HTIF1);
+    }
+
+    if (dma_remaining == 0)
+    {
+        dma_flags |= (DMA_ISR_GIF1 | DMA_ISR_TCIF1);
+
+        if (DMA->CCR.value & DMA_CCR_CIRC)
+        {
+            dma_remaining = dma_reload;
+        }
+
+        /* in the DMA one shot mode the ADC stops requesting at TC */
+        if (!(model_adc.CFGR1.value & ADC_CFGR1_DMACFG))
+        {
+            adc_oneshot_done = true;
+        }
+    }
+}
+
+void model_preempt(void)
+{
+    /* the DMA keeps going while the interrupt runs */
+    if (!(rng() % 4))
+    {
+        hw_convert();
+    }
+}
+
+/* ---- scan client ---- */
+
+typedef struct {
+    const char *name;
+    uint32_t bytes;
+    uint16_t mask;
+    uint32_t control;
+    uint32_t latency[8];
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "prompt",    512, 0x0007, STM32L0_ADC_CONTROL_MODE_CONTINUOUS_1000000,                                 { 0, 1, 2, 4, 0, 1, 2, 4 } },
+    { "jitter",    512, 0x0003, STM32L0_ADC_CONTROL_MODE_SINGLE | STM32L0_ADC_CONTROL_TRIG_TIM6,             { 0, 8, 32, 60, 0, 8, 32, 60 } },
+    { "late",      512, 0x0001, STM32L0_ADC_CONTROL_MODE_CONTINUOUS_500000 | STM32L0_ADC_CONTROL_RATIO_16,   { 0, 16, 70, 130, 200, 16, 70, 130 } },
+    { "packed",    256, 0x0011, STM32L0_ADC_CONTROL_MODE_SINGLE | STM32L0_ADC_CONTROL_TRIG_TIM2 | STM32L0_ADC_CONTROL_BYTE_PACKED, { 0, 8, 32, 60, 100, 0, 8, 32 } },
+    { "tiny ring",  16, 0x0001, STM32L0_ADC_CONTROL_MODE_SINGLE | STM32L0_ADC_CONTROL_TRIG_TIM6 | STM32L0_ADC_CONTROL_BYTE_PACKED, { 0, 1, 3, 5, 7, 9, 12, 17 } },
+};
+
+static uint8_t ring[RING_SIZE] __attribute__((aligned(4)));
+static const scenario_t *scenario;
+static uint32_t half_samples, context;
+static int64_t expected;
+static uint32_t delivered, overruns, lost;
+
+static void scan_callback(void *context_, void *data, uint32_t count, uint32_t events)
+{
+    uint32_t half, slot, size, index, mask;
+    int64_t lap, first;
+
+    CHECK(context_ == &context);
+    CHECK(((events & (STM32L0_ADC_EVENT_HALF | STM32L0_ADC_EVENT_FULL)) == STM32L0_ADC_EVENT_HALF) || ((events & (STM32L0_ADC_EVENT_HALF | STM32L0_ADC_EVENT_FULL)) == STM32L0_ADC_EVENT_FULL));
+
+    half = (events & STM32L0_ADC_EVENT_HALF) ? 0 : 1;
+    size = 2 * half_samples;
+    mask = (scenario->control & STM32L0_ADC_CONTROL_BYTE_PACKED) ? 0xff : 0xffff;
+
+    CHECK(count == ((mask == 0xff) ? half_samples : (half_samples * 2)));
+    CHECK(data == (ring + half * count));
+
+    /* the instance of this half last completed as of the DMA position
+     * the driver looked at */
+    lap = position_samples - (dma_reload - position_remaining);
+    first = lap + half * half_samples;
+
+    if ((dma_reload - position_remaining) < ((half + 1) * half_samples))
+    {
+        first -= size;
+    }
+
+    /* no half twice, and none lost without OVERRUN */
+    CHECK(first >= expected);
+    CHECK((first == expected) || (events & STM32L0_ADC_EVENT_OVERRUN));
+
+    if (events & STM32L0_ADC_EVENT_OVERRUN)
+    {
+        overruns++;
+    }
+    else
+    {
+        for (index = 0; index < half_samples; index++)
+        {
+            slot = half * half_samples + index;
+
+            /* intact, unless the DMA got there after the position read */
+            CHECK((shadow[slot] == (uint64_t)(first + index)) || (shadow[slot] >= position_samples));
+
+            if (mask == 0xff)
+            {
+                CHECK(((uint8_t*)data)[index] == (shadow[slot] & mask));
+            }
+            else
+            {
+                CHECK(((uint16_t*)data)[index] == (shadow[slot] & mask));
+            }
+        }
+
+        delivered++;
+    }
+
+    lost += (first - expected) / half_samples;
+    expected = first + half_samples;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t limit, start;
+    int32_t latency;
+    uint32_t pass, channels;
+
+    scenario = &scenarios[strtoul(argv[1], NULL, 0)];
+    limit = strtoull(argv[2], NULL, 0);
+    rng_state = strtoul(argv[3], NULL, 0);
+
+    model_adc.CR.read = adc_cr_read;
+    model_adc.CR.write = adc_cr_write;
+    model_adc.ISR.read = adc_isr_read;
+    model_adc.ISR.write = adc_isr_write;
+    model_adc.CFGR1.write = adc_cfgr1_write;
+    model_dma_channel[0].CCR.write = dma_ccr_write;
+    model_dma_channel[0].CNDTR.read = dma_cndtr_read;
+    model_dma_channel[0].CNDTR.write = dma_cndtr_write;
+    model_dma.ISR.read = dma_isr_read;
+    model_dma.IFCR.write = dma_ifcr_write;
+
+    CHECK(stm32l0_adc_enable());
+
+    /* no scan without a trigger, or without room for a scan per half */
+    CHECK(!stm32l0_adc_scan(ring, scenario->bytes, scenario->mask, 10, STM32L0_ADC_CONTROL_MODE_ONESHOT, scan_callback, &context));
+    CHECK(!stm32l0_adc_scan(ring, 1, scenario->mask, 10, scenario->control, scan_callback, &context));
+    CHECK(!locks && !hsi16);
+
+    channels = __builtin_popcount(scenario->mask);
+
+    /* twice, to cover the restart after stm32l0_adc_cancel() */
+    for (pass = 0; pass < 2; pass++)
+    {
+        memset(ring, 0xaa, sizeof(ring));
+
+        CHECK(stm32l0_adc_scan(ring, scenario->bytes, scenario->mask, 10, scenario->control, scan_callback, &context));
+
+        half_samples = dma_reload / 2;
+
+        CHECK(half_samples && !(half_samples % channels));
+        CHECK((scenario->control & STM32L0_ADC_CONTROL_BYTE_PACKED) ? ((2 * half_samples) <= scenario->bytes) : ((4 * half_samples) <= scenario->bytes));
+
+        start = samples;
+        expected = samples;
+        latency = -1;
+
+        while ((samples - start) < limit)
+        {
+            hw_convert();
+
+            if (dma_pending())
+            {
+                if (latency < 0)
+                {
+                    latency = scenario->latency[rng() & 7];
+                }
+
+                if (latency-- == 0)
+                {
+                    DMA1_Channel1_IRQHandler();
+
+                    latency = -1;
+                }
+            }
+        }
+
+        stm32l0_adc_cancel();
+
+        CHECK(stm32l0_adc_done());
+        CHECK(!(model_dma_channel[0].CCR.value & DMA_CCR_EN));
+        CHECK(!(model_adc.CR.value & (ADC_CR_ADEN | ADC_CR_ADSTART)));
+        CHECK(!locks && !hsi16);
+        CHECK(stm32l0_adc_overruns() == overruns);
+
+        overruns = 0;
+        dma_flags = 0;
+    }
+
+    CHECK(stm32l0_adc_disable());
+    CHECK(!periph);
+
+    printf("half %4u samples, delivered %6u, lost %6u\n", half_samples, delivered, lost);
+
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+SCENARIOS = ("prompt", "jitter", "late", "packed", "tiny ring")
+
+def main():
+    samples = sys.argv[1] if len(sys.argv) > 1 else "200000"
+    dma = open(os.path.join(ROOT, SOURCES[0])).read()
+    for name in ("stm32l0_dma_interrupt", "DMA1_Channel1_IRQHandler"):
+        dma = instrument(dma, name)
+    adc = instrument(open(os.path.join(ROOT, SOURCES[1])).read(), "stm32l0_adc_dma_callback")
+    device = open(DEVICE).read()
+    defines = "\n".join(re.findall(r"^#define (?:ADC|DMA|RCC_AHBENR|RCC_AHBSMENR|FLASH_ACR|SYSCFG_CFGR3)_\w*[ \t]+[^\n]*", device, flags=re.M))
+    with tempfile.TemporaryDirectory() as directory:
+        files = (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines),
+                 ("stm32l0_dma.c", dma), ("stm32l0_adc.c", adc), ("harness.cpp", HARNESS))
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory, "-I" + INCLUDE,
+                                os.path.join(directory, "harness.cpp"), "-o", binary ])
+        failed = False
+        for index, name in enumerate(SCENARIOS):
+            for seed in (1, 2):
+                run = subprocess.run([ binary, str(index), samples, str(seed) ], capture_output=True, text=True)
+                output = run.stdout.strip()
+                print("%-10s seed %d: %s" % (name, seed, output))
+                if run.returncode or "fail:" in output:
+                    failed = True
+                    continue
+                lost = int(re.search(r"lost +(\d+)", output).group(1))
+                if ((name == "prompt") and lost) or ((name == "late") and not lost):
+                    print("fail: %d halves lost" % lost)
+                    failed = True
+    assert not failed
+    print("OK")
+
+if __name__ == "__main__":
+    main()
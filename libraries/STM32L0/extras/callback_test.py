@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+#
+# Host test for the batched Callback dispatch in cores/arduino/Callback.cpp.
+# Callback.cpp is built as is against a stub Arduino.h that records PendSV
+# event posts and wakeups, and with AddressSanitizer, so that a Callback
+# the dispatcher touches after it has been destroyed fails the test. The
+# harness checks queue() order, coalescing, requeuing from the callback
+# itself, and destroying queued callbacks on the submit list as well as at
+# the head, in the middle and at the end of the batch being dispatched.
+#
+#   python3 callback_test.py
+
+import os
+import shutil
+import subprocess
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+SHIM = r'''
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef void (*armv6m_pendsv_routine_t)(void *context, uint32_t data);
+
+typedef struct _armv6m_pendsv_event_t {
+    armv6m_pendsv_routine_t routine;
+    void *context;
+} armv6m_pendsv_event_t;
+
+#define STM32L0_SYSTEM_EVENT_APPLICATION 0x00000001
+
+extern uint32_t model_primask, model_posts, model_wakeups;
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+
+extern armv6m_pendsv_event_t *model_event;
+
+static inline bool armv6m_pendsv_event_post(armv6m_pendsv_event_t *event, uint32_t data) { model_event = event; model_posts++; return true; }
+static inline void stm32l0_system_wakeup(uint32_t events) { model_wakeups++; }
+
+#include "Callback.h"
+'''
+
+HARNESS = r'''
+#include "Arduino.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+uint32_t model_primask, model_posts, model_wakeups;
+armv6m_pendsv_event_t *model_event;
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d)\n", #_c, __LINE__); exit(1); } } while (0)
+
+#define COUNT 4
+
+static Callback *slot[COUNT];
+static int victim[COUNT][2];
+static bool requeue[COUNT];
+static char order[16];
+static unsigned length;
+
+static void run(int index)
+{
+    order[length++] = '0' + index;
+
+    for (unsigned i = 0; i < 2; i++) {
+        if (victim[index][i] >= 0) {
+            delete slot[victim[index][i]];
+            slot[victim[index][i]] = nullptr;
+        }
+    }
+
+    if (requeue[index]) {
+        requeue[index] = false;
+        slot[index]->queue(false);
+    }
+}
+
+template<int I> static void function() { run(I); }
+
+static void (* const functions[COUNT])(void) = { function<0>, function<1>, function<2>, function<3> };
+
+static void setup()
+{
+    for (int i = 0; i < COUNT; i++) {
+        delete slot[i];
+        slot[i] = new Callback(functions[i]);
+        victim[i][0] = victim[i][1] = -1;
+        requeue[i] = false;
+    }
+    length = 0;
+    memset(order, 0, sizeof(order));
+}
+
+static void dispatch()
+{
+    CHECK(model_event && model_event->routine);
+    (*model_event->routine)(model_event->context, 0);
+    CHECK(model_primask == 0);
+}
+
+static Callback::Statistics statistics()
+{
+    Callback::Statistics statistics;
+    Callback::statistics(Callback::TYPE_APPLICATION, statistics);
+    return statistics;
+}
+
+int main()
+{
+    /* queue() order, coalescing and one wakeup per batch */
+    setup();
+    CHECK(slot[1]->queue(false));
+    CHECK(slot[0]->queue(true));
+    CHECK(slot[1]->queue(false));
+    CHECK(!Callback().queue(true));
+    CHECK(!Callback().queue(true));
+    CHECK(slot[2]->queue(false));
+    CHECK(model_posts == 2);
+    dispatch();
+    CHECK(!strcmp(order, "102"));
+    CHECK(statistics().queued == 6 && statistics().coalesced == 1 && statistics().dispatched == 3 && statistics().wakeups == 2);
+    CHECK(model_wakeups == 1);
+
+    /* requeue from inside the callback runs it again in the same event */
+    setup();
+    requeue[0] = true;
+    slot[0]->queue(false);
+    dispatch();
+    CHECK(!strcmp(order, "00"));
+
+    /* destroy a queued callback still on the submit list */
+    for (int v = 0; v < 3; v++) {
+        setup();
+        slot[0]->queue(false);
+        slot[1]->queue(false);
+        slot[2]->queue(false);
+        delete slot[v];
+        slot[v] = nullptr;
+        dispatch();
+        CHECK(length == 2 && !strchr(order, '0' + v));
+    }
+
+    /* destroy callbacks dispatch() has already taken into its batch: the
+     * next, a middle and the last entry, two at once, and the running one
+     */
+    static const int cases[5][2] = { { 1, -1 }, { 2, -1 }, { 3, -1 }, { 1, 3 }, { 0, -1 } };
+    static const char *const expect[5] = { "023", "013", "012", "02", "0123" };
+
+    for (int k = 0; k < 5; k++) {
+        setup();
+        victim[0][0] = cases[k][0];
+        victim[0][1] = cases[k][1];
+        for (int i = 0; i < COUNT; i++) slot[i]->queue(false);
+        dispatch();
+        CHECK(!strcmp(order, expect[k]));
+    }
+
+    /* a callback destroyed while queued can be replaced and queued again */
+    setup();
+    slot[0]->queue(false);
+    slot[1]->queue(false);
+    delete slot[0];
+    slot[0] = new Callback(functions[0]);
+    slot[0]->queue(false);
+    dispatch();
+    CHECK(!strcmp(order, "10"));
+
+    setup();
+    for (int i = 0; i < COUNT; i++) {
+        delete slot[i];
+        slot[i] = nullptr;
+    }
+
+    printf("OK\n");
+    return 0;
+}
+'''
+
+def main():
+    with tempfile.TemporaryDirectory() as directory:
+        for name in ("Callback.cpp", "Callback.h"):
+            shutil.copy(os.path.join(ROOT, "cores/arduino", name), directory)
+        with open(os.path.join(directory, "Arduino.h"), "w") as f:
+            f.write(SHIM)
+        with open(os.path.join(directory, "wiring_private.h"), "w") as f:
+            f.write("#pragma once\n")
+        harness = os.path.join(directory, "harness.cpp")
+        with open(harness, "w") as f:
+            f.write(HARNESS)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O1", "-g", "-std=gnu++11", "-w", "-fsanitize=address", "-fno-omit-frame-pointer",
+                                "-I" + directory, os.path.join(directory, "Callback.cpp"), harness, "-o", binary ])
+        subprocess.check_call([ binary ])
+
+if __name__ == "__main__":
+    main()
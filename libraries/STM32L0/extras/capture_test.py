@@ -0,0 +1,1355 @@
+#!/usr/bin/env python3
+#
+# Host test of pulseCapture() in wiring_pulse.c and the capture streams of
+# stm32l0_timer.c. Both and stm32l0_dma.c are compiled with the host g++
+# against register stand-ins: a 16 bit timer counts HCLK / (PSC + 1), with
+# the prescaler taken over at an update event as the hardware does, and an
+# edge of the signal latches CNT into CCRx per the CCER polarity. It sets
+# CCxIF (and CCxOF if CCxIF was still set), and with CCxDE the DMA channel
+# the reference manual assigns to the request moves CCRx into memory.
+# Reading CCRx clears CCxIF.
+#
+# Interrupts are taken after a random latency, and a preemption point
+# follows every statement of stm32l0_timer_interrupt(), where the timer
+# keeps counting and the signal keeps moving.
+#
+# The signals are an ultrasonic echo, a flow meter, an NEC IR frame and a
+# burst of edges 2us apart, captured on TIM2_CH1 (DMA), TIM3_CH2 (no DMA
+# request) and TIM2_CH3, whose DMA channel the ADC holds. Checked are: the
+# buffer holds the captured CCR values in order, without duplicates and
+# nothing past the count, widths from the wrapping timestamps match the
+# signal to a tick, an NEC frame decodes, edges are only lost to
+# overcapture when they are closer than the interrupt latency, the done
+# callback comes once with the count, pulseCaptureCount() follows the
+# stream, and pulseCaptureStop() cancels it and releases the timer, DMA
+# channel and RUN lock. "shared" drives TIM3 directly with PERIOD and
+# CHANNEL_1 compare events next to a capture stream, and checks that no
+# event is lost to the interrupt clearing flags that came in after it
+# looked.
+#
+#   python3 capture_test.py
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCES = ("system/STM32L0xx/Source/stm32l0_dma.c", "system/STM32L0xx/Source/stm32l0_timer.c", "cores/arduino/wiring_pulse.c")
+HEADERS = ("cores/arduino/wiring_pulse.h",)
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+
+extern void model_preempt(void);
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+
+/* Preemption only happens between statements, so these are atomic. */
+static inline uint32_t armv6m_atomic_or(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_and(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t armv6m_atomic_modify(volatile uint32_t *p_data, uint32_t mask, uint32_t data) { uint32_t o = *p_data; *p_data = (o & ~mask) ^ data; return o; }
+static inline uint32_t armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t __armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_orb(p_data, data); }
+static inline uint32_t __armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_andb(p_data, data); }
+static inline uint32_t armv6m_atomic_andzb(volatile uint32_t *p_data, uint32_t data, volatile uint8_t *p_zero) { uint32_t o = *p_data; if (!*p_zero) { *p_data = o & data; } return o; }
+
+static inline uint32_t armv6m_atomic_cash(volatile uint16_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+extern uint64_t armv6m_systick_micros(void);
+
+#define ARMV6M_TRACE_IRQ_ENTER()
+#define ARMV6M_TRACE_IRQ_LEAVE()
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+static inline uint32_t armv6m_atomic_or(model_register_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_and(model_register_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t armv6m_atomic_modify(model_register_t *p_data, uint32_t mask, uint32_t data) { uint32_t o = *p_data; *p_data = (o & ~mask) ^ data; return o; }
+
+typedef struct { model_register_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, CCR1, CCR2, CCR3, CCR4; } TIM_TypeDef;
+typedef struct { model_register_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { model_register_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { volatile uint32_t CSELR; } DMA_Request_TypeDef;
+typedef struct { volatile uint32_t AHBENR, AHBSMENR; } RCC_TypeDef;
+typedef struct { volatile uint32_t ACR; } FLASH_TypeDef;
+typedef struct { volatile uint32_t IDR; } GPIO_TypeDef;
+
+extern TIM_TypeDef model_tim[6];
+extern DMA_Channel_TypeDef model_dma_channel[7];
+extern DMA_TypeDef model_dma;
+extern DMA_Request_TypeDef model_dma_cselr;
+extern RCC_TypeDef model_rcc;
+extern FLASH_TypeDef model_flash;
+
+#define TIM2          (&model_tim[0])
+#define TIM3          (&model_tim[1])
+#define TIM6          (&model_tim[2])
+#define TIM7          (&model_tim[3])
+#define TIM21         (&model_tim[4])
+#define TIM22         (&model_tim[5])
+#define DMA1          (&model_dma)
+#define DMA1_CSELR    (&model_dma_cselr)
+#define DMA1_Channel1 (&model_dma_channel[0])
+#define DMA1_Channel2 (&model_dma_channel[1])
+#define DMA1_Channel3 (&model_dma_channel[2])
+#define DMA1_Channel4 (&model_dma_channel[3])
+#define DMA1_Channel5 (&model_dma_channel[4])
+#define DMA1_Channel6 (&model_dma_channel[5])
+#define DMA1_Channel7 (&model_dma_channel[6])
+#define RCC           (&model_rcc)
+#define FLASH         (&model_flash)
+
+typedef int IRQn_Type;
+
+#define DMA1_Channel1_IRQn       9
+#define DMA1_Channel2_3_IRQn     10
+#define DMA1_Channel4_5_6_7_IRQn 11
+#define TIM2_IRQn                15
+#define TIM3_IRQn                16
+#define TIM6_IRQn                17
+#define TIM7_IRQn                18
+#define TIM21_IRQn               20
+#define TIM22_IRQn               22
+
+extern uint32_t model_nvic_enabled;
+
+static inline void NVIC_EnableIRQ(int irq) { model_nvic_enabled |= (1u << irq); }
+static inline void NVIC_DisableIRQ(int irq) { model_nvic_enabled &= ~(1u << irq); }
+static inline void NVIC_SetPriority(int irq, uint32_t priority) { }
+
+#endif
+'''
+
+ARDUINO = r'''
+#pragma once
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_timer.h"
+#include "wiring_pulse.h"
+
+#define CHANGE  2
+#define FALLING 3
+#define RISING  4
+
+typedef struct _PinDescription
+{
+  void                    *GPIO;
+  uint16_t                bit;
+  uint16_t                pin;
+  uint8_t                 attr;
+  uint8_t                 pwm_instance;
+  uint8_t                 pwm_channel;
+  uint8_t                 adc_channel;
+} PinDescription;
+
+#define PINS_COUNT          4
+#define PWM_INSTANCE_COUNT  2
+#define PWM_INSTANCE_NONE   255
+
+extern const PinDescription g_APinDescription[PINS_COUNT];
+
+#define microsecondsToClockCycles(_a) ((_a) * 32)
+'''
+
+WIRING_PRIVATE = r'''
+#pragma once
+
+%s
+
+#define STM32L0_PULSE_IRQ_PRIORITY   0
+
+extern bool __analogWriteActive(uint32_t instance);
+extern bool stm32l0_gpio_pin_configure(uint32_t pin, uint32_t mode);
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_dma.c"
+#include "stm32l0_timer.c"
+#include "wiring_pulse.c"
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d, %llu cycles)\n", #_c, __LINE__, (unsigned long long)now); fflush(stdout); _exit(1); } } while (0)
+
+#define HCLK            32000000
+#define MAX_EDGES       4096
+#define GUARD           16
+#define NEVER           (~0ull)
+
+TIM_TypeDef model_tim[6];
+DMA_Channel_TypeDef model_dma_channel[7];
+DMA_TypeDef model_dma;
+DMA_Request_TypeDef model_dma_cselr;
+RCC_TypeDef model_rcc;
+FLASH_TypeDef model_flash;
+uint32_t model_primask;
+uint32_t model_nvic_enabled;
+
+static uint64_t now;                    /* HCLK cycles */
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+
+    return rng_state;
+}
+
+static double uniform(double lo, double hi)
+{
+    return lo + (hi - lo) * (rng() / 4294967296.0);
+}
+
+uint64_t armv6m_systick_micros(void) { return now / (HCLK / 1000000); }
+
+/* ---- system ---- */
+
+static uint32_t locks, periphs;
+
+uint32_t stm32l0_system_hclk(void) { return HCLK; }
+uint32_t stm32l0_system_pclk1(void) { return HCLK; }
+uint32_t stm32l0_system_pclk2(void) { return HCLK; }
+void stm32l0_system_periph_enable(unsigned int periph) { periphs |= (1u << periph); }
+void stm32l0_system_periph_disable(unsigned int periph) { periphs &= ~(1u << periph); }
+void stm32l0_system_lock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); locks++; }
+void stm32l0_system_unlock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); CHECK(locks); locks--; }
+
+static uint32_t gpio_modes[PINS_COUNT];
+
+bool stm32l0_gpio_pin_configure(uint32_t pin, uint32_t mode) { CHECK(pin < PINS_COUNT); gpio_modes[pin] = mode; return true; }
+
+static bool pwm_active[PWM_INSTANCE_COUNT];
+
+bool __analogWriteActive(uint32_t instance) { return pwm_active[instance]; }
+
+/* ---- variant ---- */
+
+#define PIN_NONE 0xff
+
+static GPIO_TypeDef model_gpio;
+
+extern const PinDescription g_APinDescription[PINS_COUNT] = {
+    { &model_gpio, 1, 0, 0, 0,                 STM32L0_TIMER_CHANNEL_1, 0 },   /* TIM2_CH1, DMA1 channel 5 */
+    { &model_gpio, 2, 1, 0, 1,                 STM32L0_TIMER_CHANNEL_2, 0 },   /* TIM3_CH2, no DMA request */
+    { &model_gpio, 4, 2, 0, 0,                 STM32L0_TIMER_CHANNEL_3, 0 },   /* TIM2_CH3, DMA1 channel 1 is the ADC's */
+    { &model_gpio, 8, 3, 0, PWM_INSTANCE_NONE, 0,                       0 },
+};
+
+extern const unsigned int g_PWMInstances[PWM_INSTANCE_COUNT] = {
+    STM32L0_TIMER_INSTANCE_TIM2,
+    STM32L0_TIMER_INSTANCE_TIM3,
+};
+
+/* ---- signals ---- */
+
+enum { SIGNAL_ULTRASONIC, SIGNAL_FLOW, SIGNAL_NEC, SIGNAL_BURST, SIGNAL_SPACED };
+
+static uint64_t edges[MAX_EDGES];       /* cycles */
+static uint8_t levels[MAX_EDGES];       /* level after the edge */
+static uint32_t edge_count, edge_next;
+static uint32_t nec_data;
+
+static void edge(double us)
+{
+    CHECK(edge_count < MAX_EDGES);
+
+    edges[edge_count] = llround(us * (HCLK / 1000000));
+    levels[edge_count] = edge_count ? !levels[edge_count - 1] : 1;
+    edge_count++;
+}
+
+static void signal_generate(uint32_t signal)
+{
+    double t, width, frequency, period;
+    uint32_t index, address, command, bit;
+
+    switch (signal) {
+    case SIGNAL_ULTRASONIC:
+        /* 10us trigger echo, 150us .. 25ms high (2.5cm .. 4m), every 60ms */
+        for (t = 1000.0, index = 0; index < 20; index++, t += 60000.0)
+        {
+            width = uniform(150.0, 25000.0);
+
+            edge(t);
+            edge(t + width);
+        }
+        break;
+
+    case SIGNAL_FLOW:
+        /* a hall sensor at 5 .. 200Hz, 50% duty, with jitter */
+        for (t = 500.0, frequency = 5.0; edge_count < 400; t += period)
+        {
+            frequency = (frequency * 1.02 < 200.0) ? (frequency * 1.02) : 200.0;
+            period = 1e6 / frequency * uniform(0.98, 1.02);
+
+            edge(t);
+            edge(t + period / 2);
+        }
+        break;
+
+    case SIGNAL_NEC:
+        /* an active low IR receiver: 9ms mark, 4.5ms space, 32 bits of 562.5us mark
+         * and 562.5us/1687.5us space, stop mark */
+        address = rng() & 0xff;
+        command = rng() & 0xff;
+        nec_data = address | ((~address & 0xff) << 8) | (command << 16) | ((~command & 0xff) << 24);
+
+        t = 2000.0;
+        edge(t); t += 9000.0;
+        edge(t); t += 4500.0;
+
+        for (bit = 0; bit < 32; bit++)
+        {
+            edge(t); t += 562.5;
+            edge(t); t += (nec_data & (1u << bit)) ? 1687.5 : 562.5;
+        }
+
+        edge(t); t += 562.5;
+        edge(t);
+
+        for (index = 0; index < edge_count; index++)
+        {
+            levels[index] = !levels[index];
+        }
+        break;
+
+    case SIGNAL_BURST:
+        for (index = 0; index < 64; index++)
+        {
+            edge(1000.0 + index * 2.0);
+        }
+        break;
+
+    case SIGNAL_SPACED:
+        for (t = 100.0, index = 0; index < 2000; index++)
+        {
+            edge(t);
+
+            t += uniform(25.0, 100.0);
+        }
+        break;
+    }
+}
+
+/* ---- scenarios ---- */
+
+typedef struct {
+    const char *name;
+    uint8_t pin;                        /* PIN_NONE drives TIM3 directly */
+    uint8_t mode;
+    uint8_t signal;
+    bool dma;                           /* expected path */
+    bool lossy;                         /* edges closer than the latency */
+    uint32_t frequency;
+    uint32_t count;
+    uint32_t cancel;                    /* pulseCaptureStop() after this many edges */
+    uint8_t latency[6];                 /* us */
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "ultrasonic", 0,        CHANGE,  SIGNAL_ULTRASONIC, true,  false, 1000000,   40,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "ultrasonic", 1,        CHANGE,  SIGNAL_ULTRASONIC, false, false, 1000000,   40,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "flow",       0,        RISING,  SIGNAL_FLOW,       true,  false,  100000,  200,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "flow",       1,        FALLING, SIGNAL_FLOW,       false, false,  100000,  200,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "nec",        0,        CHANGE,  SIGNAL_NEC,        true,  false, 1000000,   68,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "nec",        2,        CHANGE,  SIGNAL_NEC,        false, false, 1000000,   68,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "burst",      0,        CHANGE,  SIGNAL_BURST,      true,  false, 1000000,   64,   0, { 1, 1, 1, 2, 5, 40 } },
+    { "burst",      1,        CHANGE,  SIGNAL_BURST,      false, true,  1000000,   64,  64, { 1, 1, 1, 2, 5, 40 } },
+    { "cancel",     0,        CHANGE,  SIGNAL_FLOW,       true,  false,  100000, 1000, 150, { 1, 1, 1, 2, 5, 40 } },
+    { "cancel",     1,        CHANGE,  SIGNAL_FLOW,       false, false,  100000, 1000, 150, { 1, 1, 1, 2, 5, 40 } },
+    { "shared",     PIN_NONE, CHANGE,  SIGNAL_SPACED,     false, false,       0, 2000,   0, { 1, 1, 1, 2, 3, 5 } },
+};
+
+static const scenario_t *scenario;
+
+/* ---- DMA1 ---- */
+
+static const int8_t dma_xlate[2][4] = {
+    { 4, 2, 0, 3 },                     /* TIM2_CH1 .. TIM2_CH4 */
+    { 4, -1, 1, 2 },                    /* TIM3_CH1 .. TIM3_CH4 */
+};
+
+static const uint8_t dma_request[2] = { 8, 10 };
+
+static uint32_t dma_reload[7], dma_remaining[7], dma_index[7], dma_flags, dma_transfers;
+
+static uint32_t dma_channel_index(model_register_t *reg)
+{
+    return ((uintptr_t)reg - (uintptr_t)&model_dma_channel[0]) / sizeof(DMA_Channel_TypeDef);
+}
+
+static void dma_ccr_write(model_register_t *reg, uint32_t data)
+{
+    uint32_t index = dma_channel_index(reg);
+
+    if ((data & DMA_CCR_EN) && !(reg->value & DMA_CCR_EN))
+    {
+        dma_remaining[index] = dma_reload[index];
+        dma_index[index] = 0;
+    }
+
+    reg->value = data;
+}
+
+static void dma_cndtr_write(model_register_t *reg, uint32_t data)
+{
+    uint32_t index = dma_channel_index(reg);
+
+    CHECK(!(model_dma_channel[index].CCR.value & DMA_CCR_EN));
+
+    dma_reload[index] = data & 0xffff;
+}
+
+static uint32_t dma_cndtr_read(model_register_t *reg)
+{
+    return dma_remaining[dma_channel_index(reg)];
+}
+
+static uint32_t dma_isr_read(model_register_t *reg)
+{
+    uint32_t index, isr;
+
+    for (isr = dma_flags, index = 0; index < 7; index++)
+    {
+        if (isr & (14 << (index * 4)))
+        {
+            isr |= (1 << (index * 4));
+        }
+    }
+
+    return isr;
+}
+
+static void dma_ifcr_write(model_register_t *reg, uint32_t data)
+{
+    uint32_t index;
+
+    for (index = 0; index < 7; index++)
+    {
+        if (data & (1 << (index * 4)))
+        {
+            data |= (15 << (index * 4));
+        }
+    }
+
+    dma_flags &= ~data;
+}
+
+static bool dma_asserted(uint32_t first, uint32_t last)
+{
+    uint32_t index;
+
+    for (index = first; index <= last; index++)
+    {
+        if ((dma_flags >> (index * 4)) & model_dma_channel[index].CCR.value & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* ---- timers ---- */
+
+typedef struct {
+    bool running;
+    uint64_t t_ref;                     /* CNT was cnt_ref at t_ref */
+    uint32_t cnt_ref;
+    uint32_t psc;                       /* the prescaler in use, PSC is taken over at an update */
+    uint64_t t_start;
+    uint32_t overflows;
+    uint32_t compares[4];
+} model_counter_t;
+
+static model_counter_t counters[6];
+
+/* the input the signal is connected to */
+static uint32_t input_tim, input_channel;
+
+/* every latched edge, and every driver read of it */
+static uint16_t latched[MAX_EDGES];
+static uint32_t latched_edge[MAX_EDGES], latched_count, reads[MAX_EDGES], read_count, overcaptures;
+static bool latched_unread;
+
+static uint32_t tim_index(model_register_t *reg)
+{
+    return ((uintptr_t)reg - (uintptr_t)&model_tim[0]) / sizeof(TIM_TypeDef);
+}
+
+static uint32_t tim_ccs(uint32_t tim, uint32_t channel)
+{
+    uint32_t ccmr = (channel < 2) ? model_tim[tim].CCMR1.value : model_tim[tim].CCMR2.value;
+
+    return (ccmr >> ((channel & 1) * 8)) & 0xff;
+}
+
+static uint32_t tim_cnt(uint32_t tim)
+{
+    model_counter_t *counter = &counters[tim];
+
+    if (!counter->running)
+    {
+        return counter->cnt_ref;
+    }
+
+    return counter->cnt_ref + (now - counter->t_ref) / (counter->psc + 1);
+}
+
+static void tim_cr1_write(model_register_t *reg, uint32_t data)
+{
+    uint32_t tim = tim_index(reg);
+    model_counter_t *counter = &counters[tim];
+
+    CHECK(!(data & (TIM_CR1_DIR | TIM_CR1_CMS | TIM_CR1_OPM)));
+
+    if ((data & TIM_CR1_CEN) && !counter->running)
+    {
+        counter->running = true;
+        counter->t_ref = now;
+        counter->t_start = now;
+
+        CHECK(counter->cnt_ref <= model_tim[tim].ARR.value);
+    }
+
+    if (!(data & TIM_CR1_CEN) && counter->running)
+    {
+        counter->cnt_ref = tim_cnt(tim);
+        counter->running = false;
+    }
+
+    reg->value = data;
+}
+
+static void tim_egr_write(model_register_t *reg, uint32_t data)
+{
+    uint32_t tim = tim_index(reg);
+    model_counter_t *counter = &counters[tim];
+
+    if (data & TIM_EGR_UG)
+    {
+        counter->t_ref = now;
+        counter->cnt_ref = 0;
+        counter->psc = model_tim[tim].PSC.value;
+
+        model_tim[tim].SR.value |= TIM_SR_UIF;
+    }
+}
+
+static void tim_sr_write(model_register_t *reg, uint32_t data)
+{
+    /* rc_w0 */
+    reg->value &= data;
+}
+
+static uint32_t tim_cnt_read(model_register_t *reg)
+{
+    return tim_cnt(tim_index(reg));
+}
+
+static uint32_t tim_ccr_channel(model_register_t *reg)
+{
+    return ((uintptr_t)reg - (uintptr_t)&model_tim[tim_index(reg)].CCR1) / sizeof(model_register_t);
+}
+
+static uint32_t tim_ccr_read(model_register_t *reg)
+{
+    uint32_t tim = tim_index(reg), channel = tim_ccr_channel(reg);
+
+    if (tim_ccs(tim, channel) & 3)
+    {
+        model_tim[tim].SR.value &= ~(TIM_SR_CC1IF << channel);
+
+        if ((tim == input_tim) && (channel == input_channel) && latched_count)
+        {
+            reads[read_count++] = latched_count - 1;
+
+            latched_unread = false;
+        }
+    }
+
+    return reg->value;
+}
+
+static void tim_ccr_write(model_register_t *reg, uint32_t data)
+{
+    /* read only as an input */
+    if (!(tim_ccs(tim_index(reg), tim_ccr_channel(reg)) & 3))
+    {
+        reg->value = data & 0xffff;
+    }
+}
+
+/* a capture request: the DMA channel assigned to it moves CCRx to memory */
+static void tim_dma_request(uint32_t tim, uint32_t channel)
+{
+    DMA_Channel_TypeDef *DMA;
+    uint32_t index, ccr;
+
+    CHECK(tim < 2);
+    CHECK(dma_xlate[tim][channel] >= 0);
+
+    index = dma_xlate[tim][channel];
+    DMA = &model_dma_channel[index];
+    ccr = DMA->CCR.value;
+
+    if (!(ccr & DMA_CCR_EN) || !dma_remaining[index])
+    {
+        return;
+    }
+
+    CHECK(((model_dma_cselr.CSELR >> (index * 4)) & 15) == dma_request[tim]);
+    CHECK(!(ccr & (DMA_CCR_DIR | DMA_CCR_CIRC | DMA_CCR_PINC | DMA_CCR_MEM2MEM)));
+    CHECK(ccr & DMA_CCR_MINC);
+    CHECK((ccr & DMA_CCR_PSIZE) == DMA_CCR_PSIZE_1);
+    CHECK((ccr & DMA_CCR_MSIZE) == DMA_CCR_MSIZE_0);
+    CHECK(DMA->CPAR.value == (uint32_t)(uintptr_t)(&model_tim[tim].CCR1 + channel));
+
+    ((uint16_t*)(uintptr_t)DMA->CMAR.value)[dma_index[index]++] = *((model_register_t*)(uintptr_t)DMA->CPAR.value);
+
+    dma_transfers++;
+
+    if (--dma_remaining[index] == (dma_reload[index] / 2))
+    {
+        dma_flags |= (DMA_ISR_HTIF1 << (index * 4));
+    }
+
+    if (dma_remaining[index] == 0)
+    {
+        dma_flags |= (DMA_ISR_TCIF1 << (index * 4));
+    }
+}
+
+static void tim_capture(uint32_t tim, uint32_t channel, uint32_t level)
+{
+    TIM_TypeDef *TIM = &model_tim[tim];
+    uint32_t ccer, ccs;
+
+    ccer = (TIM->CCER.value >> (channel * 4)) & (TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP);
+    ccs = tim_ccs(tim, channel);
+
+    if (!counters[tim].running || !(ccer & TIM_CCER_CC1E) || !(ccs & 3))
+    {
+        return;
+    }
+
+    /* TI1 (TI2 ...) direct, no input prescaler or filter */
+    CHECK(ccs == TIM_CCMR1_CC1S_0);
+
+    switch (ccer & (TIM_CCER_CC1P | TIM_CCER_CC1NP)) {
+    case 0:                                 if (!level) { return; } break;
+    case TIM_CCER_CC1P:                     if (level) { return; } break;
+    case (TIM_CCER_CC1P | TIM_CCER_CC1NP):  break;
+    default:
+        CHECK(!"reserved polarity");
+    }
+
+    (&TIM->CCR1)[channel].value = tim_cnt(tim);
+
+    if (TIM->SR.value & (TIM_SR_CC1IF << channel))
+    {
+        TIM->SR.value |= (TIM_SR_CC1OF << channel);
+    }
+
+    TIM->SR.value |= (TIM_SR_CC1IF << channel);
+
+    /* the previous value is gone unless it was read (CCxOF only tells if
+     * CCxIF was still set) */
+    if (latched_unread)
+    {
+        overcaptures++;
+    }
+
+    CHECK(latched_count < MAX_EDGES);
+
+    latched[latched_count] = tim_cnt(tim);
+    latched_edge[latched_count] = edge_next;
+    latched_count++;
+    latched_unread = true;
+
+    if (TIM->DIER.value & (TIM_DIER_CC1DE << channel))
+    {
+        tim_dma_request(tim, channel);
+    }
+}
+
+/* the next overflow or compare match of a running counter */
+static uint64_t tim_next(uint32_t tim, uint32_t *p_channel)
+{
+    model_counter_t *counter = &counters[tim];
+    TIM_TypeDef *TIM = &model_tim[tim];
+    uint64_t next, match;
+    uint32_t channel, ccr;
+
+    if (!counter->running)
+    {
+        return NEVER;
+    }
+
+    next = counter->t_ref + (uint64_t)(TIM->ARR.value + 1 - counter->cnt_ref) * (counter->psc + 1);
+    *p_channel = 4;
+
+    for (channel = 0; channel < 4; channel++)
+    {
+        ccr = (&TIM->CCR1)[channel].value;
+
+        if (!(tim_ccs(tim, channel) & 3) && (ccr > counter->cnt_ref) && (ccr <= TIM->ARR.value))
+        {
+            match = counter->t_ref + (uint64_t)(ccr - counter->cnt_ref) * (counter->psc + 1);
+
+            if (match < next)
+            {
+                next = match;
+                *p_channel = channel;
+            }
+        }
+    }
+
+    return next;
+}
+
+/* ---- hardware events ---- */
+
+static uint64_t hw_next(uint32_t *p_tim, uint32_t *p_channel)
+{
+    uint64_t next, t;
+    uint32_t tim, channel;
+
+    next = (edge_next < edge_count) ? edges[edge_next] : NEVER;
+    *p_tim = 6;
+
+    for (tim = 0; tim < 6; tim++)
+    {
+        t = tim_next(tim, &channel);
+
+        if (t < next)
+        {
+            next = t;
+            *p_tim = tim;
+            *p_channel = channel;
+        }
+    }
+
+    return next;
+}
+
+static void hw_step(void)
+{
+    model_counter_t *counter;
+    uint32_t tim, channel;
+
+    now = hw_next(&tim, &channel);
+
+    if (tim == 6)
+    {
+        tim_capture(input_tim, input_channel, levels[edge_next]);
+
+        edge_next++;
+    }
+    else
+    {
+        counter = &counters[tim];
+
+        if (channel == 4)
+        {
+            counter->t_ref = now;
+            counter->cnt_ref = 0;
+            counter->psc = model_tim[tim].PSC.value;
+            counter->overflows++;
+
+            model_tim[tim].SR.value |= TIM_SR_UIF;
+        }
+        else
+        {
+            counter->t_ref = now;
+            counter->cnt_ref = (&model_tim[tim].CCR1)[channel].value;
+            counter->compares[channel]++;
+
+            model_tim[tim].SR.value |= (TIM_SR_CC1IF << channel);
+        }
+    }
+}
+
+/* ---- interrupts ---- */
+
+typedef struct {
+    int irqn;
+    void (*handler)(void);
+    uint64_t pending;
+    uint32_t count;
+} source_t;
+
+static source_t sources[] = {
+    { TIM2_IRQn,                TIM2_IRQHandler,                NEVER, 0 },
+    { TIM3_IRQn,                TIM3_IRQHandler,                NEVER, 0 },
+    { TIM6_IRQn,                TIM6_IRQHandler,                NEVER, 0 },
+    { TIM7_IRQn,                TIM7_IRQHandler,                NEVER, 0 },
+    { TIM21_IRQn,               TIM21_IRQHandler,               NEVER, 0 },
+    { TIM22_IRQn,               TIM22_IRQHandler,               NEVER, 0 },
+    { DMA1_Channel1_IRQn,       DMA1_Channel1_IRQHandler,       NEVER, 0 },
+    { DMA1_Channel2_3_IRQn,     DMA1_Channel2_3_IRQHandler,     NEVER, 0 },
+    { DMA1_Channel4_5_6_7_IRQn, DMA1_Channel4_5_6_7_IRQHandler, NEVER, 0 },
+};
+
+#define SOURCE_COUNT (sizeof(sources) / sizeof(sources[0]))
+
+static int active = -1;
+
+static bool irq_asserted(uint32_t index)
+{
+    if (!(model_nvic_enabled & (1u << sources[index].irqn)))
+    {
+        return false;
+    }
+
+    switch (index) {
+    case 6:  return dma_asserted(0, 0);
+    case 7:  return dma_asserted(1, 2);
+    case 8:  return dma_asserted(3, 6);
+    default: return !!(model_tim[index].SR.value & model_tim[index].DIER.value & (TIM_SR_UIF | TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF));
+    }
+}
+
+static void irq_update(void)
+{
+    uint32_t index;
+
+    for (index = 0; index < SOURCE_COUNT; index++)
+    {
+        if (((int)index != active) && (sources[index].pending == NEVER) && irq_asserted(index))
+        {
+            sources[index].pending = now + scenario->latency[rng() % 6] * (HCLK / 1000000);
+        }
+    }
+}
+
+static uint64_t irq_next(uint32_t *p_index)
+{
+    uint64_t next;
+    uint32_t index;
+
+    for (next = NEVER, index = 0; index < SOURCE_COUNT; index++)
+    {
+        if (sources[index].pending < next)
+        {
+            next = sources[index].pending;
+            *p_index = index;
+        }
+    }
+
+    return next;
+}
+
+static void irq_dispatch(uint32_t index)
+{
+    sources[index].pending = NEVER;
+
+    if (model_nvic_enabled & (1u << sources[index].irqn))
+    {
+        active = index;
+        sources[index].count++;
+
+        (*sources[index].handler)();
+
+        active = -1;
+    }
+
+    irq_update();
+}
+
+void model_preempt(void)
+{
+    uint64_t until = now + (rng() % 12);
+    uint32_t tim, channel;
+
+    /* the timer keeps counting while the interrupt runs */
+    while (hw_next(&tim, &channel) <= until)
+    {
+        hw_step();
+        irq_update();
+    }
+
+    now = until;
+}
+
+/* Runs hardware and interrupts until "until" returns true or nothing is
+ * left to happen. */
+static void run(bool (*until)(void))
+{
+    uint64_t t_hw, t_irq;
+    uint32_t tim, channel, index;
+
+    while (!(*until)())
+    {
+        t_hw = hw_next(&tim, &channel);
+        t_irq = irq_next(&index);
+
+        if ((t_hw == NEVER) && (t_irq == NEVER))
+        {
+            break;
+        }
+
+        /* only the counters are left */
+        if ((t_irq == NEVER) && (edge_next == edge_count))
+        {
+            break;
+        }
+
+        if (t_hw <= t_irq)
+        {
+            hw_step();
+            irq_update();
+        }
+        else
+        {
+            now = t_irq;
+
+            irq_dispatch(index);
+        }
+    }
+}
+
+/* ---- checks ---- */
+
+static uint16_t buffer[MAX_EDGES + GUARD];
+static bool done;
+static uint16_t *done_data;
+static uint32_t done_count, periods, compares;
+
+static void capture_callback(uint16_t *data, uint32_t count)
+{
+    CHECK(active >= 0);
+    CHECK(!done);
+
+    done = true;
+    done_data = data;
+    done_count = count;
+}
+
+static void shared_callback(void *context, uint32_t events)
+{
+    CHECK(context == (void*)buffer);
+    CHECK(active == 1);
+
+    if (events & STM32L0_TIMER_EVENT_PERIOD)
+    {
+        periods++;
+    }
+
+    if (events & STM32L0_TIMER_EVENT_CHANNEL_1)
+    {
+        compares++;
+    }
+
+    if (events & STM32L0_TIMER_EVENT_CAPTURE_DONE)
+    {
+        CHECK(!done);
+
+        done = true;
+    }
+}
+
+static uint32_t check_point, check_count;
+
+static bool until_done(void)
+{
+    uint32_t index;
+
+    /* pulseCaptureCount() follows the stream */
+    if ((edge_next == check_point) && !check_count && (scenario->pin != PIN_NONE))
+    {
+        check_count = pulseCaptureCount(scenario->pin);
+
+        CHECK(check_count == read_count);
+        CHECK(check_count <= scenario->count);
+    }
+
+    if (scenario->cancel && (edge_next >= scenario->cancel))
+    {
+        return true;
+    }
+
+    if (!done)
+    {
+        return false;
+    }
+
+    for (index = 0; index < SOURCE_COUNT; index++)
+    {
+        if (sources[index].pending != NEVER)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool until_idle(void)
+{
+    return (edge_next == edge_count);
+}
+
+static uint32_t decode_nec(const uint16_t *data, uint32_t count)
+{
+    uint32_t widths[MAX_EDGES], index, bits;
+
+    CHECK(count == 68);
+
+    for (index = 0; index < (count - 1); index++)
+    {
+        widths[index] = (uint16_t)(data[index + 1] - data[index]);
+    }
+
+    CHECK((widths[0] > 8500) && (widths[0] < 9500));
+    CHECK((widths[1] > 4000) && (widths[1] < 5000));
+
+    for (bits = 0, index = 0; index < 32; index++)
+    {
+        if (widths[3 + 2 * index] > 1000)
+        {
+            bits |= (1u << index);
+        }
+    }
+
+    return bits;
+}
+
+int main(int argc, char **argv)
+{
+    TIM_TypeDef *TIM;
+    stm32l0_timer_t shared;
+    uint32_t index, tim, stored, lost, divider, width, exact, path_irqs;
+
+    scenario = &scenarios[strtoul(argv[1], NULL, 0)];
+    rng_state = strtoul(argv[2], NULL, 0);
+
+    for (tim = 0; tim < 6; tim++)
+    {
+        model_tim[tim].CR1.write = tim_cr1_write;
+        model_tim[tim].EGR.write = tim_egr_write;
+        model_tim[tim].SR.write = tim_sr_write;
+        model_tim[tim].CNT.read = tim_cnt_read;
+        model_tim[tim].ARR.value = 0xffff;
+
+        for (index = 0; index < 4; index++)
+        {
+            (&model_tim[tim].CCR1)[index].read = tim_ccr_read;
+            (&model_tim[tim].CCR1)[index].write = tim_ccr_write;
+        }
+    }
+
+    for (index = 0; index < 7; index++)
+    {
+        model_dma_channel[index].CCR.write = dma_ccr_write;
+        model_dma_channel[index].CNDTR.read = dma_cndtr_read;
+        model_dma_channel[index].CNDTR.write = dma_cndtr_write;
+    }
+
+    model_dma.ISR.read = dma_isr_read;
+    model_dma.IFCR.write = dma_ifcr_write;
+
+    __stm32l0_dma_initialize();
+
+    signal_generate(scenario->signal);
+
+    for (index = 0; index < (MAX_EDGES + GUARD); index++)
+    {
+        buffer[index] = 0xa5a5;
+    }
+
+    if (scenario->pin == PIN_NONE)
+    {
+        /* TIM3 at HCLK with a 40us period and a compare half way, and a
+         * capture stream on CH2 from the interrupt */
+        input_tim = 1;
+        input_channel = STM32L0_TIMER_CHANNEL_2;
+        divider = 1;
+
+        CHECK(stm32l0_timer_create(&shared, STM32L0_TIMER_INSTANCE_TIM3, 0, 0));
+        CHECK(stm32l0_timer_enable(&shared, 0, 0, shared_callback, (void*)buffer, (STM32L0_TIMER_EVENT_PERIOD | STM32L0_TIMER_EVENT_CHANNEL_1 | STM32L0_TIMER_EVENT_CAPTURE_DONE)));
+        CHECK(stm32l0_timer_start(&shared, 1279, false));
+        CHECK(stm32l0_timer_channel(&shared, STM32L0_TIMER_CHANNEL_1, 640, STM32L0_TIMER_CONTROL_COMPARE_TIMING));
+        CHECK(stm32l0_timer_capture_stream(&shared, STM32L0_TIMER_CHANNEL_2, buffer, scenario->count, STM32L0_TIMER_CONTROL_CAPTURE_BOTH_EDGES));
+        CHECK(!stm32l0_timer_capture_stream(&shared, STM32L0_TIMER_CHANNEL_2, buffer, scenario->count, STM32L0_TIMER_CONTROL_CAPTURE_BOTH_EDGES));
+        CHECK(shared.capture_dma == STM32L0_DMA_CHANNEL_NONE);
+
+        run(until_done);
+
+        CHECK(done);
+        CHECK(stm32l0_timer_capture_count(&shared) == scenario->count);
+
+        /* the compares and periods keep coming */
+        for (index = counters[1].overflows + 8; counters[1].overflows < index; )
+        {
+            hw_step();
+            irq_update();
+            run(until_done);
+        }
+
+        CHECK(stm32l0_timer_stop(&shared));
+
+        run(until_idle);
+
+        CHECK(periods == counters[1].overflows);
+        CHECK(compares == counters[1].compares[0]);
+        CHECK(!locks);
+
+        CHECK(stm32l0_timer_disable(&shared));
+        CHECK(stm32l0_timer_destroy(&shared));
+
+        stored = scenario->count;
+    }
+    else
+    {
+        input_tim = g_PWMInstances[g_APinDescription[scenario->pin].pwm_instance];
+        input_channel = g_APinDescription[scenario->pin].pwm_channel;
+        divider = HCLK / scenario->frequency;
+
+        /* what pulseCapture() turns down */
+        CHECK(!pulseCapture(3, CHANGE, buffer, scenario->count, scenario->frequency, capture_callback));
+        CHECK(!pulseCapture(scenario->pin, CHANGE, NULL, scenario->count, scenario->frequency, capture_callback));
+        CHECK(!pulseCapture(scenario->pin, CHANGE, buffer, 0, scenario->frequency, capture_callback));
+        CHECK(!pulseCapture(scenario->pin, CHANGE, buffer, 65536, scenario->frequency, capture_callback));
+        CHECK(!pulseCapture(scenario->pin, CHANGE, buffer, scenario->count, 0, capture_callback));
+        CHECK(!pulseCapture(scenario->pin, 1, buffer, scenario->count, scenario->frequency, capture_callback));
+
+        pwm_active[g_APinDescription[scenario->pin].pwm_instance] = true;
+        CHECK(!pulseCapture(scenario->pin, scenario->mode, buffer, scenario->count, scenario->frequency, capture_callback));
+        pwm_active[g_APinDescription[scenario->pin].pwm_instance] = false;
+
+        CHECK(!locks && !periphs);
+
+        /* the ADC holds the DMA channel of TIM2_CH3 */
+        CHECK(stm32l0_dma_enable(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC, NULL, NULL));
+
+        CHECK(pulseCapture(scenario->pin, scenario->mode, buffer, scenario->count, scenario->frequency, capture_callback));
+        CHECK(locks == 1);
+        CHECK(periphs == (1u << (STM32L0_SYSTEM_PERIPH_TIM2 + input_tim)));
+        CHECK(gpio_modes[scenario->pin] == (STM32L0_GPIO_PUPD_NONE | STM32L0_GPIO_MODE_ALTERNATE));
+        CHECK((_captureTimer.capture_dma != STM32L0_DMA_CHANNEL_NONE) == scenario->dma);
+
+        check_point = scenario->cancel ? (scenario->cancel / 2) : (edge_count / 4);
+
+        run(until_done);
+
+        CHECK(check_count || !check_point);
+
+        if (scenario->cancel)
+        {
+            CHECK(!done);
+
+            stored = pulseCaptureCount(scenario->pin);
+
+            CHECK(stored == read_count);
+            CHECK(pulseCaptureStop(scenario->pin) == stored);
+            CHECK(!locks);
+        }
+        else
+        {
+            CHECK(done);
+            CHECK(done_data == buffer);
+            CHECK(done_count == scenario->count);
+            CHECK(!locks);
+            CHECK(pulseCaptureCount(scenario->pin) == scenario->count);
+            CHECK(pulseCaptureStop(scenario->pin) == scenario->count);
+
+            stored = scenario->count;
+        }
+
+        CHECK(!pulseCaptureCount(scenario->pin));
+        CHECK(!pulseCaptureStop(scenario->pin));
+        CHECK(gpio_modes[scenario->pin] == (STM32L0_GPIO_PUPD_NONE | STM32L0_GPIO_OSPEED_MEDIUM | STM32L0_GPIO_OTYPE_PUSHPULL | STM32L0_GPIO_MODE_INPUT));
+
+        /* the rest of the signal goes nowhere */
+        run(until_idle);
+
+        CHECK(done == !scenario->cancel);
+
+        /* the ADC's channel was left alone */
+        CHECK(stm32l0_dma_channel(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC));
+        CHECK(((model_dma_cselr.CSELR >> 0) & 15) == 0);
+        stm32l0_dma_disable(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC);
+
+        /* and the timer's is free again */
+        if (scenario->dma)
+        {
+            CHECK(!(model_dma_channel[dma_xlate[input_tim][input_channel]].CCR.value & DMA_CCR_EN));
+            CHECK(stm32l0_dma_enable(STM32L0_DMA_CHANNEL_DMA1_CH5_TIM2_CH1, NULL, NULL));
+            stm32l0_dma_disable(STM32L0_DMA_CHANNEL_DMA1_CH5_TIM2_CH1);
+        }
+    }
+
+    TIM = &model_tim[input_tim];
+
+    CHECK(!periphs);
+    CHECK(!(model_nvic_enabled & (1u << sources[input_tim].irqn)));
+    CHECK(!(TIM->CR1.value & TIM_CR1_CEN));
+    CHECK(!(TIM->DIER.value & ((TIM_DIER_CC1IE | TIM_DIER_CC1DE) << input_channel)));
+
+    /* the buffer holds what the driver read from CCRx, in order, once each,
+     * and nothing past the count */
+    CHECK(read_count == stored);
+
+    for (index = 0; index < stored; index++)
+    {
+        CHECK(buffer[index] == latched[reads[index]]);
+        CHECK(!index || (reads[index] > reads[index - 1]));
+    }
+
+    for (index = stored; index < (MAX_EDGES + GUARD); index++)
+    {
+        CHECK(buffer[index] == 0xa5a5);
+    }
+
+    /* edges only go missing to overcapture */
+    lost = stored ? (reads[stored - 1] + 1 - stored) : 0;
+
+    CHECK(lost <= overcaptures);
+    CHECK(scenario->lossy ? (lost != 0) : (lost == 0));
+
+    if (scenario->pin != PIN_NONE)
+    {
+        /* timestamps count from the start at the requested rate, and widths
+         * come out of the wrapping 16 bit values */
+        CHECK(stored);
+        CHECK(llabs((int64_t)buffer[0] - (int64_t)(((edges[latched_edge[reads[0]]] - counters[input_tim].t_start) / divider) & 0xffff)) <= 1);
+
+        for (index = 0; index < stored; index++)
+        {
+            if (scenario->mode != CHANGE)
+            {
+                CHECK(levels[latched_edge[reads[index]]] == (scenario->mode == RISING));
+            }
+        }
+
+        for (index = 1; index < stored; index++)
+        {
+            width = (uint16_t)(buffer[index] - buffer[index - 1]);
+            exact = llround((double)(edges[latched_edge[reads[index]]] - edges[latched_edge[reads[index - 1]]]) / divider);
+
+            CHECK((width + 1 >= exact) && (width <= exact + 1));
+        }
+
+        if (scenario->signal == SIGNAL_NEC)
+        {
+            CHECK(decode_nec(buffer, stored) == nec_data);
+        }
+    }
+
+    path_irqs = scenario->dma ? sources[8].count : sources[input_tim].count;
+
+    if (scenario->dma)
+    {
+        CHECK(dma_transfers == stored);
+        CHECK(!sources[input_tim].count);
+        CHECK(path_irqs == !scenario->cancel);
+    }
+    else
+    {
+        CHECK(!dma_transfers);
+        CHECK(path_irqs >= stored);
+    }
+
+    printf("%-4s %4u edges, %2u lost, %4u irqs", (scenario->dma ? "dma" : "irq"), stored, lost, path_irqs);
+
+    if (scenario->pin == PIN_NONE)
+    {
+        printf(", %u periods, %u compares", periods, compares);
+    }
+
+    printf("\n");
+
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+SCENARIOS = ("ultrasonic", "ultrasonic", "flow", "flow", "nec", "nec", "burst", "burst", "cancel", "cancel", "shared")
+
+def main():
+    dma = open(os.path.join(ROOT, SOURCES[0])).read()
+    timer = instrument(open(os.path.join(ROOT, SOURCES[1])).read(), "stm32l0_timer_interrupt")
+    pulse = open(os.path.join(ROOT, SOURCES[2])).read()
+    device = open(DEVICE).read()
+    defines = "\n".join(re.findall(r"^#define (?:TIM|DMA|RCC_AHBENR|RCC_AHBSMENR|FLASH_ACR)_\w*[ \t]+[^\n]*", device, flags=re.M))
+    gpio = "\n".join(re.findall(r"^#define STM32L0_GPIO_(?:MODE|OTYPE|OSPEED|PUPD)_\w*[ \t]+[^\n]*", open(os.path.join(INCLUDE, "stm32l0_gpio.h")).read(), flags=re.M))
+    with tempfile.TemporaryDirectory() as directory:
+        files = [("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines), ("Arduino.h", ARDUINO), ("wiring_private.h", WIRING_PRIVATE % gpio),
+                 ("stm32l0_dma.c", dma), ("stm32l0_timer.c", timer), ("wiring_pulse.c", pulse), ("harness.cpp", HARNESS)]
+        files += [(os.path.basename(name), open(os.path.join(ROOT, name)).read()) for name in HEADERS]
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory, "-I" + INCLUDE,
+                                os.path.join(directory, "harness.cpp"), "-o", binary ])
+        failed = False
+        for index, name in enumerate(SCENARIOS):
+            for seed in (1, 2):
+                run = subprocess.run([ binary, str(index), str(seed) ], capture_output=True, text=True)
+                output = run.stdout.strip()
+                print("%-10s seed %d: %s" % (name, seed, output))
+                if run.returncode or "fail:" in output:
+                    failed = True
+    assert not failed
+    print("OK")
+
+if __name__ == "__main__":
+    main()
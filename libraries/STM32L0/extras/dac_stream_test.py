@@ -0,0 +1,570 @@
+#!/usr/bin/env python3
+#
+# Host test of the DAC streaming in stm32l0_dac.c. The driver and
+# stm32l0_dma.c are compiled with the host g++ against register stand-ins:
+# on each trigger DMA1 channel 2 moves the next item of the ring into the
+# DAC data holding register the driver set up, and the DAC plays it. The
+# DMA counts down CNDTR and raises HT/TC as the hardware does.
+#
+# The DMA interrupt is taken after a random latency, and a preemption point
+# follows every statement of the DMA interrupt handling and
+# stm32l0_dac_dma_callback(), where further samples may get played. The
+# latency goes beyond a half, but a half is longer than the interrupt itself
+# takes up to the DMA position read, which is as late as the driver can
+# tell. The refill callback writes the next sample numbers into the half it
+# is handed.
+#
+# Checked are: every trigger is served from the ring through the register
+# for the format (12 bit right or left aligned, 8 bit, mono or stereo),
+# the played sequence is gapless unless an UNDERRUN was reported for it
+# within a ring and the worst latency, no half is handed out twice, and
+# stm32l0_dac_cancel() stops the DAC and DMA and drops the lock again.
+#
+#   python3 dac_stream_test.py [samples]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCES = ("system/STM32L0xx/Source/stm32l0_dma.c", "system/STM32L0xx/Source/stm32l0_dac.c")
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+
+extern void model_preempt(void);
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+
+/* Preemption only happens between statements, so these are atomic. */
+static inline uint32_t armv6m_atomic_or(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_modify(volatile uint32_t *p_data, uint32_t mask, uint32_t data) { uint32_t o = *p_data; *p_data = (o & ~mask) | data; return o; }
+static inline uint32_t armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t __armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_orb(p_data, data); }
+static inline uint32_t __armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_andb(p_data, data); }
+static inline uint32_t armv6m_atomic_andzb(volatile uint32_t *p_data, uint32_t data, volatile uint8_t *p_zero) { uint32_t o = *p_data; if (!*p_zero) { *p_data = o & data; } return o; }
+
+static inline uint32_t armv6m_atomic_cash(volatile uint16_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+#define ARMV6M_TRACE_IRQ_ENTER()
+#define ARMV6M_TRACE_IRQ_LEAVE()
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef struct { volatile uint32_t CR, SWTRIGR, DHR12R1, DHR12L1, DHR8R1, DHR12R2, DHR12L2, DHR8R2, DHR12RD, DHR12LD, DHR8RD, DOR1, DOR2, SR; } DAC_TypeDef;
+typedef struct { model_register_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { model_register_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { volatile uint32_t CSELR; } DMA_Request_TypeDef;
+typedef struct { volatile uint32_t AHBENR, AHBSMENR, APB1ENR; } RCC_TypeDef;
+typedef struct { volatile uint32_t ACR; } FLASH_TypeDef;
+
+extern DAC_TypeDef model_dac;
+extern DMA_Channel_TypeDef model_dma_channel[7];
+extern DMA_TypeDef model_dma;
+extern DMA_Request_TypeDef model_dma_cselr;
+extern RCC_TypeDef model_rcc;
+extern FLASH_TypeDef model_flash;
+
+#define DAC           (&model_dac)
+#define DMA1          (&model_dma)
+#define DMA1_CSELR    (&model_dma_cselr)
+#define DMA1_Channel1 (&model_dma_channel[0])
+#define DMA1_Channel2 (&model_dma_channel[1])
+#define DMA1_Channel3 (&model_dma_channel[2])
+#define DMA1_Channel4 (&model_dma_channel[3])
+#define DMA1_Channel5 (&model_dma_channel[4])
+#define DMA1_Channel6 (&model_dma_channel[5])
+#define DMA1_Channel7 (&model_dma_channel[6])
+#define RCC           (&model_rcc)
+#define FLASH         (&model_flash)
+
+#define DMA1_Channel1_IRQn       9
+#define DMA1_Channel2_3_IRQn     10
+#define DMA1_Channel4_5_6_7_IRQn 11
+
+static inline void NVIC_EnableIRQ(int irq) { }
+static inline void NVIC_SetPriority(int irq, uint32_t priority) { }
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_dma.c"
+#include "stm32l0_dac.c"
+#include <stdio.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d, sample %llu)\n", #_c, __LINE__, (unsigned long long)samples); exit(1); } } while (0)
+
+#define RING_SIZE 65536
+#define DMA_INDEX 1                     /* STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1 */
+
+DAC_TypeDef model_dac;
+DMA_Channel_TypeDef model_dma_channel[7];
+DMA_TypeDef model_dma;
+DMA_Request_TypeDef model_dma_cselr;
+RCC_TypeDef model_rcc;
+FLASH_TypeDef model_flash;
+uint32_t model_primask;
+
+static uint64_t samples;                /* samples played */
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+
+    return rng_state;
+}
+
+/* ---- system ---- */
+
+static uint32_t locks;
+
+void stm32l0_system_lock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_SLEEP); locks++; }
+void stm32l0_system_unlock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_SLEEP); CHECK(locks); locks--; }
+
+/* ---- scenarios ---- */
+
+typedef struct {
+    const char *name;
+    uint32_t bytes;
+    uint32_t control;
+    uint32_t latency[8];
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "prompt",    512, STM32L0_DAC_CONTROL_RIGHT_ALIGNED | STM32L0_DAC_CONTROL_TRIG_TIM6,                                  { 0, 1, 2, 4, 0, 1, 2, 4 } },
+    { "jitter",    512, STM32L0_DAC_CONTROL_LEFT_ALIGNED | STM32L0_DAC_CONTROL_TRIG_TIM7,                                   { 0, 8, 32, 60, 0, 8, 32, 60 } },
+    { "stereo",   1024, STM32L0_DAC_CONTROL_RIGHT_ALIGNED | STM32L0_DAC_CONTROL_STEREO | STM32L0_DAC_CONTROL_TRIG_TIM2,     { 0, 8, 32, 60, 0, 8, 32, 60 } },
+    { "late",      256, STM32L0_DAC_CONTROL_BYTE_PACKED | STM32L0_DAC_CONTROL_TRIG_TIM21,                                   { 0, 16, 70, 130, 200, 16, 70, 130 } },
+    { "tiny ring",  32, STM32L0_DAC_CONTROL_BYTE_PACKED | STM32L0_DAC_CONTROL_STEREO | STM32L0_DAC_CONTROL_TRIG_TIM6,      { 0, 1, 3, 5, 7, 9, 12, 17 } },
+};
+
+static const scenario_t *scenario;
+
+/* ---- DMA1 channel 2 ---- */
+
+static uint64_t shadow[RING_SIZE];      /* sample number per ring slot */
+static uint64_t position_samples;       /* "samples" as of the last CNDTR read */
+static uint32_t position_remaining, dma_reload, dma_remaining, dma_flags;
+
+static bool dma_pending(void)
+{
+    return !!(dma_flags & model_dma_channel[DMA_INDEX].CCR.value & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE));
+}
+
+static void dma_ccr_write(model_register_t *reg, uint32_t data)
+{
+    if ((data & DMA_CCR_EN) && !(reg->value & DMA_CCR_EN))
+    {
+        dma_remaining = dma_reload;
+    }
+
+    reg->value = data;
+}
+
+static void dma_cndtr_write(model_register_t *reg, uint32_t data)
+{
+    CHECK(!(model_dma_channel[DMA_INDEX].CCR.value & DMA_CCR_EN));
+
+    dma_reload = data & 0xffff;
+}
+
+static uint32_t dma_cndtr_read(model_register_t *reg)
+{
+    position_samples = samples;
+    position_remaining = dma_remaining;
+
+    return dma_remaining;
+}
+
+static uint32_t dma_isr_read(model_register_t *reg)
+{
+    return dma_flags << 4;
+}
+
+static void dma_ifcr_write(model_register_t *reg, uint32_t data)
+{
+    dma_flags &= ~((data >> 4) & 15);
+}
+
+/* ---- DAC ---- */
+
+static volatile uint32_t *dac_register(void)
+{
+    if (scenario->control & STM32L0_DAC_CONTROL_STEREO)
+    {
+        return (scenario->control & STM32L0_DAC_CONTROL_BYTE_PACKED) ? &model_dac.DHR8RD : &model_dac.DHR12RD;
+    }
+    else
+    {
+        return (scenario->control & STM32L0_DAC_CONTROL_BYTE_PACKED) ? &model_dac.DHR8R1 : ((scenario->control & STM32L0_DAC_CONTROL_LEFT_ALIGNED) ? &model_dac.DHR12L1 : &model_dac.DHR12R1);
+    }
+}
+
+static uint32_t sample_size(void)
+{
+    if (scenario->control & STM32L0_DAC_CONTROL_STEREO)
+    {
+        return (scenario->control & STM32L0_DAC_CONTROL_BYTE_PACKED) ? 2 : 4;
+    }
+    else
+    {
+        return (scenario->control & STM32L0_DAC_CONTROL_BYTE_PACKED) ? 1 : 2;
+    }
+}
+
+/* what a refill writes for sample "number" */
+static uint32_t sample_data(uint64_t number)
+{
+    switch (sample_size()) {
+    case 1:  return (number & 0xff);
+    case 2:  return (number & 0xffff);
+    default: return (number & 0xffffffff);
+    }
+}
+
+static uint64_t *played;
+static uint32_t played_size;
+
+/* One trigger: the DMA moves the next item of the ring into the DAC, which
+ * plays it.
+ */
+static void hw_trigger(void)
+{
+    DMA_Channel_TypeDef *DMA = &model_dma_channel[DMA_INDEX];
+    uint32_t cr = model_dac.CR, tsel, slot, data;
+
+    tsel = (scenario->control & STM32L0_DAC_CONTROL_TRIG_MASK) >> STM32L0_DAC_CONTROL_TRIG_SHIFT;
+
+    CHECK((cr & (DAC_CR_EN1 | DAC_CR_TEN1 | DAC_CR_DMAEN1)) == (DAC_CR_EN1 | DAC_CR_TEN1 | DAC_CR_DMAEN1));
+    CHECK(((cr & DAC_CR_TSEL1) >> DAC_CR_TSEL1_Pos) == tsel);
+
+    if (scenario->control & STM32L0_DAC_CONTROL_STEREO)
+    {
+        CHECK((cr & (DAC_CR_EN2 | DAC_CR_TEN2)) == (DAC_CR_EN2 | DAC_CR_TEN2));
+        CHECK(((cr & DAC_CR_TSEL2) >> DAC_CR_TSEL2_Pos) == tsel);
+    }
+
+    CHECK(DMA->CCR.value & DMA_CCR_EN);
+    CHECK(DMA->CCR.value & DMA_CCR_DIR);
+    CHECK(DMA->CPAR.value == (uint32_t)(uintptr_t)dac_register());
+    CHECK(((DMA->CCR.value & DMA_CCR_MSIZE) >> DMA_CCR_MSIZE_Pos) == ((sample_size() == 1) ? 0 : ((sample_size() == 2) ? 1 : 2)));
+    CHECK(dma_remaining);
+
+    slot = dma_reload - dma_remaining;
+
+    switch (sample_size()) {
+    case 1:  data = ((uint8_t*)(uintptr_t)DMA->CMAR.value)[slot]; break;
+    case 2:  data = ((uint16_t*)(uintptr_t)DMA->CMAR.value)[slot]; break;
+    default: data = ((uint32_t*)(uintptr_t)DMA->CMAR.value)[slot]; break;
+    }
+
+    /* the ring holds what the refills wrote */
+    CHECK(data == sample_data(shadow[slot]));
+
+    *dac_register() = data;
+
+    if (samples < played_size)
+    {
+        played[samples] = shadow[slot];
+    }
+
+    samples++;
+
+    dma_remaining--;
+
+    if (dma_remaining == (dma_reload / 2))
+    {
+        dma_flags |= (DMA_ISR_GIF1 | DMA_ISR_HTIF1);
+    }
+
+    if (dma_remaining == 0)
+    {
+        dma_flags |= (DMA_ISR_GIF1 | DMA_ISR_TCIF1);
+
+        CHECK(DMA->CCR.value & DMA_CCR_CIRC);
+
+        dma_remaining = dma_reload;
+    }
+}
+
+void model_preempt(void)
+{
+    /* the DMA keeps going while the interrupt runs */
+    if (!(rng() % 4))
+    {
+        hw_trigger();
+    }
+}
+
+/* ---- refills ---- */
+
+static uint8_t ring[RING_SIZE] __attribute__((aligned(4)));
+static uint32_t half_samples, context, refills, duplicates;
+static uint64_t produced;
+static int64_t expected;
+static uint64_t *underruns;
+static uint32_t underrun_count;
+
+static void stream_callback(void *context_, void *data, uint32_t count, uint32_t events)
+{
+    uint32_t half, slot, index;
+    int64_t lap, first;
+
+    CHECK(context_ == &context);
+    CHECK(((events & (STM32L0_DAC_EVENT_HALF | STM32L0_DAC_EVENT_FULL)) == STM32L0_DAC_EVENT_HALF) || ((events & (STM32L0_DAC_EVENT_HALF | STM32L0_DAC_EVENT_FULL)) == STM32L0_DAC_EVENT_FULL));
+
+    half = (events & STM32L0_DAC_EVENT_HALF) ? 0 : 1;
+
+    CHECK(count == (half_samples * sample_size()));
+    CHECK(data == (ring + half * count));
+
+    /* the instance of this half last played out as of the DMA position
+     * the driver looked at */
+    lap = position_samples - (dma_reload - position_remaining);
+    first = lap + half * half_samples;
+
+    if ((dma_reload - position_remaining) < ((half + 1) * half_samples))
+    {
+        first -= 2 * half_samples;
+    }
+
+    /* no half twice, and none skipped without UNDERRUN */
+    CHECK(first >= expected);
+    CHECK((first == expected) || (events & STM32L0_DAC_EVENT_UNDERRUN));
+
+    expected = first + half_samples;
+
+    if (events & STM32L0_DAC_EVENT_UNDERRUN)
+    {
+        underruns[underrun_count++] = samples;
+
+        /* continue from where playback is */
+        if (produced < played[samples - 1] + 1)
+        {
+            produced = played[samples - 1] + 1;
+        }
+    }
+
+    for (index = 0; index < half_samples; index++)
+    {
+        slot = half * half_samples + index;
+
+        switch (sample_size()) {
+        case 1:  ((uint8_t*)data)[index] = sample_data(produced); break;
+        case 2:  ((uint16_t*)data)[index] = sample_data(produced); break;
+        default: ((uint32_t*)data)[index] = sample_data(produced); break;
+        }
+
+        shadow[slot] = produced++;
+    }
+
+    refills++;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t limit, index, glitches;
+    uint32_t channels, slot, latency_max, window, next;
+    int32_t latency;
+
+    scenario = &scenarios[strtoul(argv[1], NULL, 0)];
+    limit = strtoull(argv[2], NULL, 0);
+    rng_state = strtoul(argv[3], NULL, 0);
+
+    model_dma_channel[DMA_INDEX].CCR.write = dma_ccr_write;
+    model_dma_channel[DMA_INDEX].CNDTR.read = dma_cndtr_read;
+    model_dma_channel[DMA_INDEX].CNDTR.write = dma_cndtr_write;
+    model_dma.ISR.read = dma_isr_read;
+    model_dma.IFCR.write = dma_ifcr_write;
+
+    played_size = limit + 4096;
+    played = (uint64_t*)calloc(played_size, sizeof(uint64_t));
+    underruns = (uint64_t*)calloc(limit, sizeof(uint64_t));
+
+    channels = (scenario->control & STM32L0_DAC_CONTROL_STEREO) ? (STM32L0_DAC_CHANNEL_1 | STM32L0_DAC_CHANNEL_2) : STM32L0_DAC_CHANNEL_1;
+
+    CHECK(stm32l0_dac_enable(channels));
+
+    /* no stream without room for a sample per half */
+    CHECK(!stm32l0_dac_stream(ring, sample_size(), scenario->control, stream_callback, &context));
+    CHECK(!locks);
+
+    /* the ring starts out with the first two halves */
+    half_samples = (scenario->bytes / sample_size()) / 2;
+
+    for (produced = 0; produced < (2 * half_samples); produced++)
+    {
+        switch (sample_size()) {
+        case 1:  ((uint8_t*)ring)[produced] = sample_data(produced); break;
+        case 2:  ((uint16_t*)ring)[produced] = sample_data(produced); break;
+        default: ((uint32_t*)ring)[produced] = sample_data(produced); break;
+        }
+
+        shadow[produced] = produced;
+    }
+
+    CHECK(stm32l0_dac_stream(ring, scenario->bytes, scenario->control, stream_callback, &context));
+    CHECK(dma_reload == (2 * half_samples));
+    CHECK(locks == 1);
+
+    expected = 0;
+    latency = -1;
+
+    while (samples < limit)
+    {
+        hw_trigger();
+
+        if (dma_pending())
+        {
+            if (latency < 0)
+            {
+                latency = scenario->latency[rng() & 7];
+            }
+
+            if (latency-- == 0)
+            {
+                DMA1_Channel2_3_IRQHandler();
+
+                latency = -1;
+            }
+        }
+    }
+
+    stm32l0_dac_cancel();
+
+    CHECK(!(model_dma_channel[DMA_INDEX].CCR.value & DMA_CCR_EN));
+    CHECK(!(model_dac.CR & (DAC_CR_DMAEN1 | DAC_CR_TEN1 | DAC_CR_TEN2)));
+    CHECK(!locks);
+    CHECK(stm32l0_dac_underruns() == underrun_count);
+
+    CHECK(stm32l0_dac_disable(channels));
+    CHECK(!(model_rcc.APB1ENR & RCC_APB1ENR_DACEN));
+
+    /* every discontinuity is covered by an UNDERRUN reported no later than
+     * a ring plus the worst latency after it was played, unless that is
+     * past the end of the run */
+    for (latency_max = 0, index = 0; index < 8; index++)
+    {
+        if (latency_max < scenario->latency[index])
+        {
+            latency_max = scenario->latency[index];
+        }
+    }
+
+    window = 2 * half_samples + latency_max + 32;
+
+    for (glitches = 0, next = 0, index = 1; (index + window) < samples; index++)
+    {
+        if (played[index] != (played[index - 1] + 1))
+        {
+            glitches++;
+
+            while ((next < underrun_count) && ((underruns[next] + 2 * half_samples) < index))
+            {
+                next++;
+            }
+
+            CHECK((next < underrun_count) && (underruns[next] <= (index + window)));
+        }
+    }
+
+    printf("half %4u samples, refilled %6u, underrun %6u, glitches %6llu\n", half_samples, refills, underrun_count, (unsigned long long)glitches);
+
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+SCENARIOS = ("prompt", "jitter", "stereo", "late", "tiny ring")
+
+def main():
+    samples = sys.argv[1] if len(sys.argv) > 1 else "200000"
+    dma = open(os.path.join(ROOT, SOURCES[0])).read()
+    for name in ("stm32l0_dma_interrupt", "DMA1_Channel2_3_IRQHandler"):
+        dma = instrument(dma, name)
+    dac = instrument(open(os.path.join(ROOT, SOURCES[1])).read(), "stm32l0_dac_dma_callback")
+    device = open(DEVICE).read()
+    defines = "\n".join(re.findall(r"^#define (?:DAC|DMA|RCC_AHBENR|RCC_AHBSMENR|RCC_APB1ENR|FLASH_ACR)_\w*[ \t]+[^\n]*", device, flags=re.M))
+    with tempfile.TemporaryDirectory() as directory:
+        files = (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines),
+                 ("stm32l0_dma.c", dma), ("stm32l0_dac.c", dac), ("harness.cpp", HARNESS))
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory, "-I" + INCLUDE,
+                                os.path.join(directory, "harness.cpp"), "-o", binary ])
+        failed = False
+        for index, name in enumerate(SCENARIOS):
+            for seed in (1, 2):
+                run = subprocess.run([ binary, str(index), samples, str(seed) ], capture_output=True, text=True)
+                output = run.stdout.strip()
+                print("%-10s seed %d: %s" % (name, seed, output))
+                if run.returncode or "fail:" in output:
+                    failed = True
+                    continue
+                underruns = int(re.search(r"underrun +(\d+)", output).group(1))
+                if ((name == "prompt") and underruns) or ((name == "late") and not underruns):
+                    print("fail: %d underruns" % underruns)
+                    failed = True
+    assert not failed
+    print("OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,526 @@
+#!/usr/bin/env python3
+#
+# Host known answer tests for the CTR_DRBG behind stm32l0_random().
+# stm32l0_random.c is compiled from the source with the host g++, once for
+# the STM32L082 (with stm32l0_aes.c driving an emulated AES peripheral) and
+# once for the STM32L072 (with the software AES in LoRa/Crypto/aes.c). The
+# RNG data register is a stub fed from the harness, so that the entropy the
+# DRBG is instantiated with is known.
+#
+# Checked are: AES-128 against FIPS-197 and the SP 800-38A CTR vectors (the
+# peripheral's CTR mode via stm32l0_aes_ctr_keystream() and _ctr_xcrypt());
+# stm32l0_random() against a CAVP CTR_DRBG AES-128 no derivation function
+# vector; a request larger than one generate call against the same chunks
+# requested one by one; a concurrent call; the health test cutoffs, which
+# are recomputed from the binomial distribution, with good sources passing
+# and stuck or biased ones failing; and last how often the RNG is powered
+# up for a stream of small requests.
+#
+#   python3 drbg_kat.py
+
+import math
+import os
+import re
+import subprocess
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = os.path.join(ROOT, "system/STM32L0xx/Source")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+
+static inline uint32_t armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_previous = *p_data;
+    if (data_previous == data_expected) *p_data = data;
+    return data_previous;
+}
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef struct { model_register_t CR, SR, DINR, DOUTR, KEYR0, KEYR1, KEYR2, KEYR3, IVR0, IVR1, IVR2, IVR3; } model_aes_t;
+typedef struct { model_register_t CR, SR, DR; } model_rng_t;
+typedef struct { model_register_t AHBENR; } model_rcc_t;
+
+extern model_aes_t model_aes;
+extern model_rng_t model_rng;
+extern model_rcc_t model_rcc;
+extern uint32_t model_uid[6];
+
+#define AES      (&model_aes)
+#define RNG      (&model_rng)
+#define RCC      (&model_rcc)
+#define UID_BASE ((uintptr_t)&model_uid[0])
+
+#endif
+'''
+
+SYSTEM = r'''
+#if !defined(_STM32L0_SYSTEM_H)
+#define _STM32L0_SYSTEM_H
+
+#define STM32L0_SYSTEM_REFERENCE_RNG 0x00000008
+#define STM32L0_SYSTEM_PERIPH_RNG    6
+
+extern void stm32l0_system_reference(uint32_t reference);
+extern void stm32l0_system_unreference(uint32_t reference);
+extern void stm32l0_system_clk48_enable(void);
+extern void stm32l0_system_clk48_disable(void);
+extern void stm32l0_system_periph_enable(unsigned int periph);
+extern void stm32l0_system_periph_disable(unsigned int periph);
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "aes.c"
+#include "stm32l0_aes.c"
+#include "stm32l0_random.c"
+#include <stdio.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d)\n", #_c, __LINE__); exit(1); } } while (0)
+
+uint32_t model_primask;
+model_aes_t model_aes;
+model_rng_t model_rng;
+model_rcc_t model_rcc;
+uint32_t model_uid[6] = { 0x00370020, 0x32365111, 0x00000000, 0x00000000, 0x00000000, 0x30373736 };
+
+static unsigned int rng_enabled, rng_powerups, rng_references;
+
+void stm32l0_system_reference(uint32_t reference) { CHECK(reference == STM32L0_SYSTEM_REFERENCE_RNG); rng_references++; }
+void stm32l0_system_unreference(uint32_t reference) { CHECK(reference == STM32L0_SYSTEM_REFERENCE_RNG); rng_references--; }
+void stm32l0_system_clk48_enable(void) { }
+void stm32l0_system_clk48_disable(void) { }
+void stm32l0_system_periph_enable(unsigned int periph) { CHECK(periph == STM32L0_SYSTEM_PERIPH_RNG); rng_enabled = 1; rng_powerups++; }
+void stm32l0_system_periph_disable(unsigned int periph) { CHECK(periph == STM32L0_SYSTEM_PERIPH_RNG); rng_enabled = 0; }
+
+/* AES peripheral: 128 bit key, byte swapped data (DATATYPE 10), ECB, CBC
+ * and CTR encryption, which is all the drivers ask of it here.
+ */
+static uint32_t aes_in[4], aes_out[4];
+static unsigned int aes_in_index, aes_out_index;
+
+static void aes_bytes(uint8_t *b, model_register_t *r3, model_register_t *r2, model_register_t *r1, model_register_t *r0)
+{
+    model_register_t *r[4] = { r3, r2, r1, r0 };
+
+    for (int i = 0; i < 4; i++)
+    {
+        b[4 * i + 0] = r[i]->value >> 24;
+        b[4 * i + 1] = r[i]->value >> 16;
+        b[4 * i + 2] = r[i]->value >> 8;
+        b[4 * i + 3] = r[i]->value >> 0;
+    }
+}
+
+static void aes_cr_write(model_register_t *reg, uint32_t data)
+{
+    if (data & AES_CR_CCFC)
+    {
+        model_aes.SR.value &= ~AES_SR_CCF;
+    }
+
+    if ((data & AES_CR_EN) && !(reg->value & AES_CR_EN))
+    {
+        CHECK((data & AES_CR_DATATYPE) == AES_CR_DATATYPE_1);
+
+        aes_in_index = 0;
+        aes_out_index = 4;
+
+        if ((data & (AES_CR_MODE | AES_CR_CHMOD)) == AES_CR_MODE_0)
+        {
+            /* key derivation for decryption, not emulated */
+            CHECK(0);
+        }
+    }
+
+    reg->value = data & ~(AES_CR_CCFC | AES_CR_ERRC);
+}
+
+static void aes_dinr_write(model_register_t *reg, uint32_t data)
+{
+    uint8_t key[16], iv[16], in[16], out[16], block[16];
+    aes_context ctx;
+    uint32_t ctr;
+    int i;
+
+    CHECK(model_aes.CR.value & AES_CR_EN);
+    CHECK(model_rcc.AHBENR.value & RCC_AHBENR_CRYPEN);
+    CHECK(aes_out_index == 4);
+
+    aes_in[aes_in_index++] = data;
+
+    if (aes_in_index != 4)
+    {
+        return;
+    }
+
+    aes_in_index = 0;
+
+    aes_bytes(key, &model_aes.KEYR3, &model_aes.KEYR2, &model_aes.KEYR1, &model_aes.KEYR0);
+    aes_bytes(iv, &model_aes.IVR3, &model_aes.IVR2, &model_aes.IVR1, &model_aes.IVR0);
+
+    for (i = 0; i < 16; i++)
+    {
+        in[i] = aes_in[i / 4] >> (8 * (i & 3));
+    }
+
+    aes_set_key(key, 16, &ctx);
+
+    switch (model_aes.CR.value & (AES_CR_MODE | AES_CR_CHMOD)) {
+    case 0:
+        aes_encrypt(in, out, &ctx);
+        break;
+
+    case AES_CR_CHMOD_0:
+        for (i = 0; i < 16; i++) block[i] = in[i] ^ iv[i];
+        aes_encrypt(block, out, &ctx);
+        model_aes.IVR3.value = (out[ 0] << 24) | (out[ 1] << 16) | (out[ 2] << 8) | out[ 3];
+        model_aes.IVR2.value = (out[ 4] << 24) | (out[ 5] << 16) | (out[ 6] << 8) | out[ 7];
+        model_aes.IVR1.value = (out[ 8] << 24) | (out[ 9] << 16) | (out[10] << 8) | out[11];
+        model_aes.IVR0.value = (out[12] << 24) | (out[13] << 16) | (out[14] << 8) | out[15];
+        break;
+
+    case AES_CR_CHMOD_1:
+        aes_encrypt(iv, block, &ctx);
+        for (i = 0; i < 16; i++) out[i] = in[i] ^ block[i];
+        ctr = model_aes.IVR0.value + 1;
+        model_aes.IVR0.value = ctr;
+        break;
+
+    default:
+        CHECK(0);
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        aes_out[i] = (out[4 * i + 0] << 0) | (out[4 * i + 1] << 8) | (out[4 * i + 2] << 16) | ((uint32_t)out[4 * i + 3] << 24);
+    }
+
+    aes_out_index = 0;
+
+    model_aes.SR.value |= AES_SR_CCF;
+}
+
+static uint32_t aes_doutr_read(model_register_t *reg)
+{
+    CHECK(aes_out_index < 4);
+
+    return aes_out[aes_out_index++];
+}
+
+/* RNG: DR returns the next word of the current source. */
+static uint32_t (*rng_source)(void);
+static const uint32_t *rng_feed;
+static unsigned int rng_feed_count;
+static uint32_t rng_sr, rng_seed;
+static unsigned long rng_words;
+
+static uint32_t rng_random(void)
+{
+    rng_seed = rng_seed * 1103515245 + 12345;
+
+    return (rng_seed >> 16) ^ (rng_seed << 15) ^ (rng_seed * 2654435761u);
+}
+
+static uint32_t rng_sr_read(model_register_t *reg)
+{
+    CHECK(rng_enabled && (model_rng.CR.value & RNG_CR_RNGEN));
+
+    /* a seed or clock error stops the RNG */
+    return rng_sr ? rng_sr : RNG_SR_DRDY;
+}
+
+static uint32_t rng_dr_read(model_register_t *reg)
+{
+    CHECK(rng_enabled && (model_rng.CR.value & RNG_CR_RNGEN));
+
+    rng_words++;
+
+    if (rng_feed_count)
+    {
+        rng_feed_count--;
+
+        return *rng_feed++;
+    }
+
+    return (*rng_source)();
+}
+
+static uint32_t source_good(void)
+{
+    return rng_random();
+}
+
+static uint32_t source_nibbles(void)
+{
+    /* exactly the assumed H = 4 bits per byte */
+    return rng_random() & 0x0f0f0f0f;
+}
+
+static uint32_t source_biased(void)
+{
+    /* stuck to one byte value a third of the time */
+    uint32_t data = rng_random(), i;
+
+    for (i = 0; i < 4; i++)
+    {
+        if ((rng_random() % 10) < 3)
+        {
+            data = (data & ~(0xffu << (8 * i))) | (0x5au << (8 * i));
+        }
+    }
+
+    return data;
+}
+
+static uint32_t source_stuck(void)
+{
+    return 0xffffffff;
+}
+
+static void reset(uint32_t (*source)(void))
+{
+    memset(&stm32l0_random_device, 0, sizeof(stm32l0_random_device));
+
+    rng_source = source;
+    rng_feed_count = 0;
+    rng_sr = 0;
+    rng_seed = 1;
+    rng_powerups = 0;
+    rng_words = 0;
+}
+
+static void hex(uint8_t *data, const char *text)
+{
+    unsigned int i;
+
+    for (i = 0; text[2 * i]; i++)
+    {
+        sscanf(&text[2 * i], "%2hhx", &data[i]);
+    }
+}
+
+static void check(const char *name, const uint8_t *data, const char *expected)
+{
+    uint8_t buffer[256];
+    unsigned int size = strlen(expected) / 2;
+
+    hex(buffer, expected);
+
+    if (memcmp(data, buffer, size))
+    {
+        printf("fail: %s\n", name);
+        exit(1);
+    }
+
+    printf("%-40s ok\n", name);
+}
+
+int main(void)
+{
+    uint8_t key[16], data[64], out[64], ctr[16], entropy[32];
+    uint32_t feed[256 + 8];
+    static uint8_t big[4096 + 100], chunked[4096 + 100];
+    unsigned int i, requests;
+    aes_context ctx;
+
+    model_aes.CR.write = aes_cr_write;
+    model_aes.DINR.write = aes_dinr_write;
+    model_aes.DOUTR.read = aes_doutr_read;
+    model_rng.SR.read = rng_sr_read;
+    model_rng.DR.read = rng_dr_read;
+
+    hex(key, "000102030405060708090a0b0c0d0e0f");
+    hex(data, "00112233445566778899aabbccddeeff");
+#if defined(STM32L082xx)
+    stm32l0_aes_set_key(key);
+    stm32l0_aes_ecb_encrypt(data, out, 16);
+    CHECK(!(model_rcc.AHBENR.value & RCC_AHBENR_CRYPEN));
+#else
+    aes_set_key(key, 16, &ctx);
+    aes_encrypt(data, out, &ctx);
+#endif
+    check("FIPS-197 C.1 AES-128", out, "69c4e0d86a7b0430d8cdb78070b4c55a");
+
+#if defined(STM32L082xx)
+    hex(key, "2b7e151628aed2a6abf7158809cf4f3c");
+    hex(ctr, "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+    hex(data, "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+              "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+    stm32l0_aes_set_key(key);
+    stm32l0_aes_ctr_xcrypt(ctr, data, out, 64);
+    check("SP 800-38A F.5.1 CTR-AES128 xcrypt", out,
+          "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+          "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee");
+
+    /* the keystream is E(K, ctr) || E(K, ctr + 1) || ..., truncated; the key
+     * set before is left alone */
+    stm32l0_aes_set_key((const uint8_t*)"0123456789abcdef");
+    stm32l0_aes_ctr_keystream(key, ctr, out, 61);
+    for (i = 0; i < 61; i++) out[i] ^= data[i];
+    check("SP 800-38A F.5.1 CTR-AES128 keystream", out,
+          "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+          "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3");
+    CHECK(model_primask == 0);
+    CHECK(!memcmp(&stm32l0_aes_device.K[0], "fedc", 4));
+#endif
+
+    /* CAVP CTR_DRBG AES-128 no df, no reseed, no additional input, count 0:
+     * instantiate, generate 512 bits twice, the second output is checked.
+     * The startup words are discarded, the UID is XORed into the seed as
+     * personalization string, so the feed has it XORed in already.
+     */
+    reset(source_good);
+    for (i = 0; i < 256; i++) feed[i] = rng_random();
+    hex(entropy, "ce50f33da5d4c1d3d4004eb35244b7f2cd7f2e5076fbf6780a7ff634b249a5fc");
+    memcpy(&feed[256], entropy, 32);
+    feed[256 + 0] ^= model_uid[0];
+    feed[256 + 1] ^= model_uid[1];
+    feed[256 + 2] ^= model_uid[5];
+    rng_feed = feed;
+    rng_feed_count = 256 + 8;
+    CHECK(stm32l0_random(out, 64));
+    CHECK(rng_feed_count == 0 && rng_powerups == 2 && rng_references == 0);
+    CHECK(stm32l0_random(out, 64));
+    check("CAVP CTR_DRBG AES-128 no df", out,
+          "6545c0529d372443b392ceb3ae3a99a30f963eaf313280f1d1a1e87f9db373d3"
+          "61e75d18018266499cccd64d9bbb8de0185f213383080faddec46bae1f784e5a");
+    CHECK(rng_powerups == 2 && !rng_enabled);
+
+    /* a request larger than one generate call equals the same chunks
+     * requested one by one */
+    reset(source_good);
+    CHECK(stm32l0_random(big, sizeof(big)));
+    reset(source_good);
+    CHECK(stm32l0_random(chunked, 4096));
+    CHECK(stm32l0_random(chunked + 4096, 100));
+    CHECK(!memcmp(big, chunked, sizeof(big)));
+    printf("%-40s ok\n", "chunked generate");
+
+    /* a concurrent call fails instead of sharing the state */
+    stm32l0_random_device.lock = 1;
+    CHECK(!stm32l0_random(out, 16) && !stm32l0_random_entropy(out, 16) && !stm32l0_random_reseed());
+    stm32l0_random_device.lock = 0;
+    printf("%-40s ok\n", "concurrent call");
+
+    /* health tests: good sources pass, stuck and biased ones fail, and
+     * the DRBG instantiates again once the source is good again */
+    reset(source_good);
+    for (i = 0; i < 1000; i++) CHECK(stm32l0_random_entropy(big, 800));
+    reset(source_nibbles);
+    for (i = 0; i < 100; i++) CHECK(stm32l0_random_entropy(big, 800));
+    reset(source_good);
+    CHECK(stm32l0_random(out, 16));
+    for (i = 0; i < 3; i++) feed[i] = 0x12345678;
+    rng_feed = feed;
+    rng_feed_count = 3;
+    CHECK(!stm32l0_random_reseed());
+    CHECK(stm32l0_random_device.state == STM32L0_RANDOM_STATE_ERROR);
+    CHECK(stm32l0_random(out, 16) && stm32l0_random_device.state == STM32L0_RANDOM_STATE_READY);
+    reset(source_stuck);
+    CHECK(!stm32l0_random(out, 16) && rng_words < 8);
+    reset(source_biased);
+    for (i = 0; (i < 10) && stm32l0_random_entropy(big, 800); i++) { }
+    CHECK(i < 10);
+    reset(source_good);
+    rng_sr = RNG_SR_SECS;
+    CHECK(!stm32l0_random(out, 16));
+    rng_sr = 0;
+    CHECK(stm32l0_random(out, 16));
+    CHECK(rng_references == 0 && !rng_enabled);
+    printf("%-40s ok (RCT C=%d, APT W=%d C=%d)\n", "health tests", STM32L0_RANDOM_RCT_CUTOFF, STM32L0_RANDOM_APT_WINDOW, STM32L0_RANDOM_APT_CUTOFF);
+
+    /* RNG power ups for a stream of 16 byte requests (a LoRaWAN DevNonce,
+     * a nonce, ...) */
+    requests = 100000;
+    reset(source_good);
+    for (i = 0; i < requests; i++) CHECK(stm32l0_random(out, 16));
+    CHECK(rng_powerups == 2 + (requests - 1) / (STM32L0_RANDOM_RESEED_INTERVAL - 1));
+    printf("%u requests of 16 bytes: RNG powered up %u times (%lu words), %u times (%u words) before\n",
+           requests, rng_powerups, rng_words, requests, requests * 4);
+
+    printf("OK\n");
+    return 0;
+}
+'''
+
+def critbinom(n, p, target):
+    # smallest k with P(X <= k) >= target
+    total, k = 0.0, 0
+    while True:
+        total += math.comb(n, k) * p ** k * (1 - p) ** (n - k)
+        if total >= target:
+            return k
+        k += 1
+
+def main():
+    source = open(os.path.join(SOURCE, "stm32l0_random.c")).read()
+    constants = dict((name, int(value)) for name, value in re.findall(r"#define STM32L0_RANDOM_(\w+_CUTOFF|APT_WINDOW)\s+(\d+)", source))
+    # health test cutoffs, alpha = 2^-20
+    alpha = 2.0 ** -20
+    assert constants["RCT_CUTOFF"] == 1 + math.ceil(20 / 16)
+    assert constants["APT_CUTOFF"] == 1 + critbinom(constants["APT_WINDOW"], 2.0 ** -4, 1 - alpha)
+
+    # the register bit definitions of the device header, not the peripherals
+    defines = "\n".join(re.findall(r"^#define (?:AES_CR_|AES_SR_|RNG_CR_|RNG_SR_|RCC_AHBENR_CRYPEN)\w*[ \t]+[^\n]*", open(DEVICE).read(), flags=re.M))
+
+    for device in ("STM32L082xx", "STM32L072xx"):
+        print(device)
+        with tempfile.TemporaryDirectory() as directory:
+            for name, text in (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines), ("stm32l0_system.h", SYSTEM), ("harness.cpp", HARNESS)):
+                with open(os.path.join(directory, name), "w") as f:
+                    f.write(text)
+            for name in ("stm32l0_random.c", "stm32l0_aes.c", "LoRa/Crypto/aes.c", "LoRa/Crypto/aes.h", "../Include/stm32l0_random.h", "../Include/stm32l0_aes.h"):
+                with open(os.path.join(SOURCE, name)) as f:
+                    text = f.read()
+                with open(os.path.join(directory, os.path.basename(name)), "w") as f:
+                    f.write(text)
+            binary = os.path.join(directory, "harness")
+            subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-D" + device, "-I" + directory, os.path.join(directory, "harness.cpp"), "-o", binary ])
+            run = subprocess.run([ binary ], capture_output=True, text=True)
+            print("  " + run.stdout.rstrip().replace("\n", "\n  "))
+            assert run.returncode == 0 and "fail" not in run.stdout, run.returncode
+    print("OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,570 @@
+#!/usr/bin/env python3
+#
+# Host test of EEPROMCache in libraries/EEPROM. EEPROMCache.cpp, EEPROM.h,
+# cores/arduino/avr/eeprom.c and stm32l0_eeprom.c are compiled with the
+# host g++. Only the two stores of the driver to the data EEPROM are routed
+# to the model, which counts them as program operations and raises EOP (or
+# an error) in FLASH->SR, with the PELOCK key sequence in front. The data
+# EEPROM is mapped at DATA_EEPROM_BASE, read only for the code under test.
+#
+# A settings record is updated field by field, and stored either byte by
+# byte with EEPROM.write(), with one eeprom_write_block() per field (which
+# is what EEPROM.put() does), or through the cache with one commit() per
+# update or per 8 updates. For some of the stores the power is cut after
+# every single program operation (the interrupted word is left torn), and
+# a fresh cache has to begin() with either the old or the new record. The
+# cache also sees EEPROM errors in the middle of a commit(), after which
+# the next commit() has to store the record all the same.
+#
+#   python3 eeprom_cache_test.py [updates]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = "system/STM32L0xx/Source/stm32l0_eeprom.c"
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+
+/* Interrupts run to completion before the caller goes on, so this is atomic. */
+static inline uint32_t armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef enum {
+    FLASH_IRQn = 3,
+} IRQn_Type;
+
+typedef struct { model_register_t ACR, PECR, PDKEYR, PEKEYR, PRGKEYR, OPTKEYR, SR; } model_flash_t;
+
+extern model_flash_t model_flash;
+extern void model_eeprom_write(uint32_t address, uint32_t data);
+extern void model_flash_irq(void);
+
+#define FLASH (&model_flash)
+
+/* a pending FLASH interrupt is taken right away */
+static inline void NVIC_SetPendingIRQ(int irq) { model_flash_irq(); }
+static inline void NVIC_EnableIRQ(int irq) { }
+static inline void NVIC_SetPriority(int irq, uint32_t priority) { }
+
+#endif
+'''
+
+# EEPROMCache.cpp only sees these few parts of the core
+ARDUINO = r'''
+#pragma once
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_eeprom.c"
+#include "avr/eeprom.c"
+#include "EEPROM.h"
+#include "EEPROMCache.cpp"
+#include <stdio.h>
+#include <setjmp.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d)\n", #_c, __LINE__); fflush(stdout); _exit(1); } } while (0)
+
+#define EEPROM_SIZE     8192
+#define FLASH_ERRORS    (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_RDERR | FLASH_SR_NOTZEROERR | FLASH_SR_FWWERR)
+
+#define RECORD_ADDRESS  0x100
+#define RECORD_SIZE     96
+
+uint32_t model_primask;
+model_flash_t model_flash;
+
+static uint8_t *eeprom;                 /* the model's writable view */
+static uint32_t operations, locks;
+static int32_t budget = -1;             /* program operations until the power fails */
+static int32_t error_at = -1;           /* program operation that fails */
+static bool irq_active, irq_pending;
+static jmp_buf power_cut;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+void stm32l0_system_lock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); locks++; }
+void stm32l0_system_unlock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); CHECK(locks); locks--; }
+
+/* ---- FLASH interface and data EEPROM ---- */
+
+void model_flash_irq(void)
+{
+    uint32_t storm = 0;
+
+    irq_pending = true;
+
+    if (irq_active)
+    {
+        return;
+    }
+
+    irq_active = true;
+
+    while (irq_pending || ((model_flash.PECR.value & FLASH_PECR_EOPIE) && (model_flash.SR.value & FLASH_SR_EOP)) ||
+           ((model_flash.PECR.value & FLASH_PECR_ERRIE) && (model_flash.SR.value & FLASH_ERRORS)))
+    {
+        irq_pending = false;
+
+        FLASH_IRQHandler();
+
+        CHECK(++storm < 100000);
+    }
+
+    irq_active = false;
+}
+
+void model_eeprom_write(uint32_t address, uint32_t data)
+{
+    CHECK(!(model_flash.PECR.value & FLASH_PECR_PELOCK));
+    CHECK(model_flash.PECR.value & FLASH_PECR_DATA);
+    CHECK(!(model_flash.SR.value & (FLASH_SR_EOP | FLASH_ERRORS)));
+    CHECK(!(address & 3) && (address >= DATA_EEPROM_BASE) && (address < (DATA_EEPROM_BASE + DATA_EEPROM_SIZE)));
+
+    if (budget == 0)
+    {
+        /* the interrupted word is left with random content */
+        data = rng();
+
+        memcpy(&eeprom[address - DATA_EEPROM_BASE], &data, 4);
+
+        longjmp(power_cut, 1);
+    }
+
+    if (budget > 0)
+    {
+        budget--;
+    }
+
+    operations++;
+
+    if (error_at == 0)
+    {
+        error_at = -1;
+
+        model_flash.SR.value |= FLASH_SR_WRPERR;
+        return;
+    }
+
+    if (error_at > 0)
+    {
+        error_at--;
+    }
+
+    memcpy(&eeprom[address - DATA_EEPROM_BASE], &data, 4);
+
+    model_flash.SR.value |= FLASH_SR_EOP;
+}
+
+static void flash_pecr_write(model_register_t *reg, uint32_t data)
+{
+    /* PELOCK can be set, but only cleared by the key sequence */
+    reg->value = data | (reg->value & FLASH_PECR_PELOCK);
+}
+
+static uint32_t pekey_last;
+
+static void flash_pekeyr_write(model_register_t *reg, uint32_t data)
+{
+    if ((pekey_last == 0x89abcdef) && (data == 0x02030405))
+    {
+        model_flash.PECR.value &= ~FLASH_PECR_PELOCK;
+    }
+
+    pekey_last = data;
+}
+
+static void flash_sr_write(model_register_t *reg, uint32_t data)
+{
+    reg->value &= ~data;
+}
+
+/* what is left after a power cut: the EEPROM */
+static void model_reset(void)
+{
+    model_flash.PECR.value = FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK;
+    model_flash.SR.value = 0;
+    model_primask = 0;
+    irq_active = false;
+    irq_pending = false;
+    locks = 0;
+    pekey_last = 0;
+
+    __stm32l0_eeprom_initialize();
+}
+
+/* ---- settings record ---- */
+
+#define METHOD_WRITE    0
+#define METHOD_PUT      1
+#define METHOD_CACHE    2
+
+typedef struct {
+    uint32_t offset, size;
+} field_t;
+
+/* a few small fields that change often, a calibration table that changes
+ * rarely, a name */
+static const field_t fields[] = { { 0, 4 }, { 4, 2 }, { 6, 1 }, { 8, 4 }, { 12, 4 }, { 16, 16 }, { 32, 48 }, { 80, 16 } };
+
+typedef struct {
+    uint32_t offset, size;
+    uint8_t data[48];
+} change_t;
+
+static uint32_t method, batch, updates;
+static uint8_t record[RECORD_SIZE], old_record[RECORD_SIZE];
+static change_t changes[3 * 8 + 1];
+static uint32_t change_count;
+
+static EEPROMCache<RECORD_SIZE> cache(RECORD_ADDRESS);
+static EEPROMCache<RECORD_SIZE> reboot(RECORD_ADDRESS);
+static EEPROMCache<RECORD_SIZE> cache_before(RECORD_ADDRESS), cache_after(RECORD_ADDRESS);
+static uint8_t eeprom_before[EEPROM_SIZE], eeprom_after[EEPROM_SIZE];
+
+static void update(void)
+{
+    uint32_t count, index;
+    const field_t *field;
+    change_t *change;
+
+    for (count = 1 + (rng() % 3); count; count--)
+    {
+        field = &fields[(rng() % 10) ? (rng() % 6) : (rng() % 8)];
+        change = &changes[change_count++];
+
+        change->offset = field->offset;
+        change->size = field->size;
+
+        for (index = 0; index < field->size; index++)
+        {
+            change->data[index] = rng();
+        }
+
+        memcpy(&record[field->offset], change->data, field->size);
+    }
+}
+
+static bool store(void)
+{
+    uint32_t index, offset;
+    change_t *change;
+
+    for (index = 0; index < change_count; index++)
+    {
+        change = &changes[index];
+
+        if (method == METHOD_WRITE)
+        {
+            for (offset = 0; offset < change->size; offset++)
+            {
+                EEPROM.write(RECORD_ADDRESS + change->offset + offset, change->data[offset]);
+            }
+        }
+        else if (method == METHOD_PUT)
+        {
+            eeprom_write_block(change->data, (void*)(RECORD_ADDRESS + change->offset), change->size);
+        }
+        else
+        {
+            cache.writeBlock(change->offset, change->data, change->size);
+        }
+    }
+
+    if (method == METHOD_CACHE)
+    {
+        return cache.commit();
+    }
+
+    return true;
+}
+
+static void load(uint8_t *data)
+{
+    if (method == METHOD_CACHE)
+    {
+        reboot.begin();
+        reboot.readBlock(0, data, RECORD_SIZE);
+    }
+    else
+    {
+        eeprom_read_block(data, (const void*)RECORD_ADDRESS, RECORD_SIZE);
+    }
+}
+
+static void run(void)
+{
+    uint32_t step, cut, used, before, cuts, torn, errors;
+    uint8_t data[RECORD_SIZE];
+
+    for (step = 0; step < RECORD_SIZE; step++)
+    {
+        record[step] = rng();
+    }
+
+    /* the first store of the whole record */
+    if (method == METHOD_CACHE)
+    {
+        CHECK(!cache.begin());
+
+        cache.writeBlock(0, record, RECORD_SIZE);
+        CHECK(cache.commit());
+    }
+    else
+    {
+        eeprom_write_block(record, (void*)RECORD_ADDRESS, RECORD_SIZE);
+    }
+
+    memcpy(old_record, record, RECORD_SIZE);
+
+    operations = 0;
+    cuts = 0;
+    torn = 0;
+    errors = 0;
+
+    for (step = 0; step < updates; step++)
+    {
+        update();
+
+        /* the cache collects "batch" updates per commit() */
+        if ((step + 1) % batch)
+        {
+            continue;
+        }
+
+        if ((method == METHOD_CACHE) && !(rng() % 50))
+        {
+            /* an EEPROM error part way; the changes stay dirty */
+            error_at = rng() % 8;
+
+            if (!store())
+            {
+                errors++;
+
+                CHECK(cache.dirty());
+            }
+
+            error_at = -1;
+            change_count = 0;
+        }
+
+        memcpy(eeprom_before, eeprom, EEPROM_SIZE);
+        memcpy((void*)&cache_before, (const void*)&cache, sizeof(cache));
+
+        before = operations;
+
+        CHECK(store());
+        CHECK((method != METHOD_CACHE) || !cache.dirty());
+
+        used = operations - before;
+
+        memcpy(eeprom_after, eeprom, EEPROM_SIZE);
+        memcpy((void*)&cache_after, (const void*)&cache, sizeof(cache));
+
+        if (!(rng() % 20))
+        {
+            /* replay the store with the power cut after every operation */
+            for (cut = 0; cut <= used; cut++)
+            {
+                memcpy(eeprom, eeprom_before, EEPROM_SIZE);
+                memcpy((void*)&cache, (const void*)&cache_before, sizeof(cache));
+
+                budget = cut;
+
+                if (!setjmp(power_cut))
+                {
+                    store();
+                }
+
+                budget = -1;
+
+                model_reset();
+
+                cuts++;
+
+                load(data);
+
+                if (memcmp(data, old_record, RECORD_SIZE) && memcmp(data, record, RECORD_SIZE))
+                {
+                    torn++;
+                }
+            }
+
+            memcpy(eeprom, eeprom_after, EEPROM_SIZE);
+            memcpy((void*)&cache, (const void*)&cache_after, sizeof(cache));
+
+            operations = before + used;
+        }
+
+        /* a reboot sees the new record; sometimes go on with the rebooted cache */
+        load(data);
+
+        CHECK(!memcmp(data, record, RECORD_SIZE));
+
+        if ((method == METHOD_CACHE) && !(rng() % 10))
+        {
+            CHECK(cache.begin());
+            CHECK(!cache.dirty());
+        }
+
+        memcpy(old_record, record, RECORD_SIZE);
+
+        change_count = 0;
+    }
+
+    CHECK(!locks);
+    CHECK(model_flash.PECR.value & FLASH_PECR_PELOCK);
+
+    printf("%.1f %u %u %u\n", (double)operations / updates, torn, cuts, errors);
+}
+
+static uint8_t test_stack[256 * 1024] __attribute__((aligned(16)));
+static ucontext_t main_context, test_context;
+
+int main(int argc, char **argv)
+{
+    int fd;
+
+    method = strtoul(argv[1], NULL, 0);
+    batch = strtoul(argv[2], NULL, 0);
+    updates = strtoul(argv[3], NULL, 0);
+
+    model_flash.PECR.write = flash_pecr_write;
+    model_flash.PEKEYR.write = flash_pekeyr_write;
+    model_flash.SR.write = flash_sr_write;
+
+    /* the same memory, writable for the model, read only at DATA_EEPROM_BASE */
+    fd = memfd_create("eeprom", 0);
+    CHECK((fd >= 0) && (ftruncate(fd, EEPROM_SIZE) == 0));
+    eeprom = (uint8_t*)mmap(NULL, EEPROM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CHECK(eeprom != MAP_FAILED);
+    CHECK(mmap((void*)DATA_EEPROM_BASE, EEPROM_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) == (void*)DATA_EEPROM_BASE);
+
+    model_reset();
+
+    /* The driver keeps transaction pointers in 32 bit atomics, and the
+     * transactions are on the stack. So the test runs on a static stack,
+     * which like all other data of a -no-pie binary lies below 4 GiB.
+     */
+    getcontext(&test_context);
+    test_context.uc_stack.ss_sp = test_stack;
+    test_context.uc_stack.ss_size = sizeof(test_stack);
+    test_context.uc_link = &main_context;
+    makecontext(&test_context, run, 0);
+
+    CHECK(swapcontext(&main_context, &test_context) == 0);
+
+    return 0;
+}
+'''
+
+METHODS = (("write", 0, 1), ("put", 1, 1), ("cache", 2, 1), ("cache", 2, 8))
+
+def main():
+    updates = sys.argv[1] if len(sys.argv) > 1 else "2000"
+    source = open(os.path.join(ROOT, SOURCE)).read()
+    # route the stores to the data EEPROM to the model
+    for name in ("stm32l0_eeprom_do_erase", "stm32l0_eeprom_do_program"):
+        match = re.search(r"\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+        assert match, name
+        body, count = re.subn(r"\*\(\(volatile uint32_t\*\)\(?address\)?\) = ([^;]+);", r"model_eeprom_write(address, \1);", match.group(1))
+        assert count == 1, name
+        source = source[:match.start(1)] + body + source[match.end(1):]
+    device = open(DEVICE).read()
+    defines = "\n".join(re.findall(r"^#define (?:DATA_EEPROM_BASE|FLASH_PECR_|FLASH_SR_)\w*[ \t]+[^\n]*", device, flags=re.M))
+    with tempfile.TemporaryDirectory() as directory:
+        files = (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines), ("Arduino.h", ARDUINO),
+                 ("stm32l0_eeprom.c", source), ("harness.cpp", HARNESS))
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory,
+                                "-I" + os.path.join(ROOT, "cores/arduino"), "-I" + os.path.join(ROOT, "libraries/EEPROM/src"), "-I" + INCLUDE,
+                                os.path.join(directory, "harness.cpp"), "-o", binary ])
+        results = {}
+        for name, method, batch in METHODS:
+            run = subprocess.run([ binary, str(method), str(batch), updates ], capture_output=True, text=True, timeout=600)
+            output = run.stdout.strip()
+            if run.returncode or "fail:" in output:
+                print("%-6s %d update(s) per store: %s" % (name, batch, output))
+            assert run.returncode == 0 and "fail:" not in output, name
+            programs, torn, cuts, errors = output.split()
+            results[name, batch] = float(programs)
+            print("%-6s %d update(s) per store: %5s program operations per update, %4s of %4s power cuts left a torn record, %2s failed commits"
+                  % (name, batch, programs, torn, cuts, errors))
+            if name == "cache":
+                assert int(torn) == 0, "cache commit is not atomic"
+                assert int(errors) > 0
+            else:
+                assert int(torn) > 0
+    assert results["cache", 1] < results["write", 1]
+    assert results["cache", 8] < results["put", 1]
+    print("OK")
+
+if __name__ == "__main__":
+    main()
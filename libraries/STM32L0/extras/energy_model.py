@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# Estimates the average supply current from the output of
+# STM32L0.dumpProfile() ("hclk,<Hz>", "residency,<mode>,<ms>",
+# "blocked,<lock>,<ms>", "wakeup,<irq>,<count>" and
+# "frequency,<Hz>,<ms>,<count>" lines). With the clock governor enabled
+# RUN and IDLE are costed at the time weighted average HCLK.
+#
+#   python3 energy_model.py profile.txt
+#
+# The currents below are typical STM32L0x2 datasheet figures at 3.0V,
+# range 1, running from flash. They are a starting point only; replace
+# them with measured values for a specific board (radio, sensors and
+# regulator quiescent current are not included).
+
+import sys
+
+MODES = [ "RUN", "IDLE", "SLEEP", "STOP" ]
+
+LOCKS = { 0: "RUN", 1: "SLEEP", 2: "DEEPSLEEP", 3: "REGULATOR", 4: "VREFINT", 5: "EEPROM" }
+
+# uA per MHz of HCLK for RUN and IDLE (WFE with all clocks on)
+RUN_UA_PER_MHZ   = 165.0
+IDLE_UA_PER_MHZ  = 40.0
+
+# uA, independent of HCLK
+SLEEP_UA         = 100.0   # low power sleep with prescaled busses
+STOP_UA          = 0.8     # STOP with RTC on LSE, low power regulator, ULP
+
+# additional uA while in STOP with a lock held
+STOP_LOCK_UA     = { 3: 5.0, 4: 1.2 }
+
+# charge per wakeup from SLEEP/STOP in uA*ms (clock restart, flash wakeup)
+WAKEUP_UAMS      = 0.02
+
+def parse(lines):
+    hclk, residency, blocked, wakeups, frequency = 32000000, {}, {}, {}, {}
+    for line in lines:
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue
+        fields = line.split(",")
+        if fields[0] == "hclk":
+            hclk = int(fields[1])
+        elif fields[0] == "residency":
+            residency[int(fields[1])] = int(fields[2])
+        elif fields[0] == "blocked":
+            blocked[int(fields[1])] = int(fields[2])
+        elif fields[0] == "wakeup":
+            wakeups[int(fields[1])] = int(fields[2])
+        elif fields[0] == "frequency":
+            frequency[int(fields[1])] = int(fields[2])
+    if sum(frequency.values()):
+        hclk = sum(f * ms for f, ms in frequency.items()) / sum(frequency.values())
+    return hclk, residency, blocked, wakeups
+
+def model(hclk, residency, blocked, wakeups):
+    mhz = hclk / 1e6
+    current = [ RUN_UA_PER_MHZ * mhz, IDLE_UA_PER_MHZ * mhz, SLEEP_UA, STOP_UA ]
+    total = sum(residency.values())
+    if total == 0:
+        return 0.0, {}
+    charge = {}
+    for mode in range(len(MODES)):
+        charge[MODES[mode]] = residency.get(mode, 0) * current[mode]
+    for lock, ms in blocked.items():
+        if lock in STOP_LOCK_UA:
+            charge["STOP+" + LOCKS[lock]] = ms * STOP_LOCK_UA[lock]
+    charge["WAKEUP"] = sum(wakeups.values()) * WAKEUP_UAMS
+    return sum(charge.values()) / total, { k: v / total for k, v in charge.items() }
+
+def main():
+    with (open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin) as f:
+        hclk, residency, blocked, wakeups = parse(f)
+    average, parts = model(hclk, residency, blocked, wakeups)
+    total = sum(residency.values())
+    print("HCLK %.1f MHz, %.3f s profiled" % (hclk / 1e6, total / 1000.0))
+    for mode in range(len(MODES)):
+        ms = residency.get(mode, 0)
+        print("  %-6s %10d ms %6.2f%%" % (MODES[mode], ms, (100.0 * ms / total) if total else 0.0))
+    for lock, ms in sorted(blocked.items()):
+        print("  blocked by LOCK_%s: %d ms" % (LOCKS.get(lock, str(lock)), ms))
+    for irq, count in sorted(wakeups.items()):
+        print("  wakeups IRQ %d: %d" % (irq, count))
+    for name, ua in sorted(parts.items(), key=lambda item: -item[1]):
+        print("  %-16s %10.2f uA" % (name, ua))
+    print("average %.2f uA" % average)
+
+if __name__ == "__main__":
+    main()
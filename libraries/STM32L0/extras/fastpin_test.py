@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+#
+# Host tests for the compile time pin access in cores/arduino/wiring_digital.h
+# (FastPin<>, digitalWriteFast<>(), digitalReadFast<>(), FastPort<>) and the
+# g_APinGPIO[] tables in the variant.h files.
+#
+# For every variant, and for each DOSFS_SDCARD / DOSFS_SFLASH setting its
+# variant.cpp depends on, the expected GPIO of each pin is taken from the
+# g_APinDescription[] table in variant.cpp. A harness is generated that maps
+# host memory over the GPIO register space (GPIOA_BASE .. GPIOH_BASE), fills
+# it with a pattern and calls the fast path for every pin. The test checks
+# that each call stores exactly one word, to BSRR or BRR of the right port,
+# with the right bit, and that reads look at the right IDR bit. FastPort<> is
+# checked the same way on up to four pins of one port, for all values. Last,
+# FastPin<> of a pin without a GPIO has to fail to compile. variant.cpp is
+# compiled as well, as its static_asserts tie g_APinGPIO[] to the table, and
+# has to fail once an entry of g_APinGPIO[] is changed.
+#
+#   python3 fastpin_test.py
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+GPIOA_BASE = 0x50000000
+PORT_SIZE = 0x400
+PORTS = "ABCDEFGH"
+IDR, ODR, BSRR, BRR = 0x10, 0x14, 0x18, 0x28
+
+HEADER = r'''
+#include "Arduino.h"
+#include <stdio.h>
+#include <sys/mman.h>
+
+#define WORDS ((GPIOH_BASE + 0x400 - GPIOA_BASE) / 4)
+#define PATTERN 0xa5a5a5a5
+
+static volatile uint32_t *regs;
+
+static void fill(void)
+{
+	for (unsigned int i = 0; i < WORDS; i++) regs[i] = PATTERN;
+}
+
+static void dump(const char *tag, unsigned int pin)
+{
+	printf("%s\t%u", tag, pin);
+	for (unsigned int i = 0; i < WORDS; i++) if (regs[i] != PATTERN) printf("\t%x=%x", i * 4, regs[i]);
+	printf("\n");
+}
+
+static void poke(uint32_t base, uint32_t offset, uint32_t value)
+{
+	regs[(base - GPIOA_BASE + offset) / 4] = value;
+}
+
+template<uint32_t PIN>
+static void pin(void)
+{
+	typedef FastPin<PIN> P;
+
+	fill();
+	digitalWriteFast<PIN>(HIGH);
+	dump("high", PIN);
+	fill();
+	digitalWriteFast<PIN>(LOW);
+	dump("low", PIN);
+	fill();
+	poke(P::base, 0x14, P::mask);
+	digitalToggleFast<PIN>();
+	poke(P::base, 0x14, PATTERN);
+	dump("toggle1", PIN);
+	fill();
+	poke(P::base, 0x14, ~P::mask);
+	digitalToggleFast<PIN>();
+	poke(P::base, 0x14, PATTERN);
+	dump("toggle0", PIN);
+	fill();
+	poke(P::base, 0x10, P::mask);
+	int one = digitalReadFast<PIN>();
+	poke(P::base, 0x10, ~P::mask);
+	int zero = P::read();
+	printf("read\t%u\t%d\t%d\n", PIN, one, zero);
+}
+
+int main(void)
+{
+	regs = (volatile uint32_t *)mmap((void *)GPIOA_BASE, WORDS * 4, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	if (regs != (volatile uint32_t *)GPIOA_BASE) return 1;
+	for (unsigned int i = 0; i < PINS_COUNT; i++) printf("gpio\t%u\t%u\n", i, g_APinGPIO[i]);
+'''
+
+def device(variant):
+    boards = open(os.path.join(ROOT, "boards.txt")).read()
+    name = re.search(r"^(\S+)\.build\.variant=%s$" % re.escape(variant), boards, re.M).group(1)
+    return re.search(r"^%s\.build\.extra_flags=.*?-D(STM32L0\w+)" % re.escape(name), boards, re.M).group(1)
+
+def table(variant, defines):
+    # expected (port, index) or None per pin, from g_APinDescription[] in variant.cpp
+    source = open(os.path.join(ROOT, "variants", variant, "variant.cpp")).read()
+    body = re.search(r"g_APinDescription\[PINS_COUNT\] =\n\{\n(.*?)\n\};", source, re.S).group(1)
+    pins, stack = [], []
+    for line in body.split("\n"):
+        line = line.strip()
+        if line.startswith("#if"):
+            condition = line[3:].split("/*")[0].replace("||", " or ").replace("&&", " and ")
+            stack.append(bool(eval(condition, {}, dict(defines))))
+        elif line.startswith("#else"):
+            stack[-1] = not stack[-1]
+        elif line.startswith("#endif"):
+            stack.pop()
+        elif line.startswith("{") and all(stack):
+            entry = re.match(r"\{ *(GPIO[A-H]|NULL), *(?:STM32L0_GPIO_PIN_MASK\(STM32L0_GPIO_PIN_P([A-H])(\d+)\)|0),", line)
+            pins.append(None if entry.group(1) == "NULL" else (PORTS.index(entry.group(2)), int(entry.group(3))))
+    return pins
+
+def configurations(variant):
+    source = open(os.path.join(ROOT, "variants", variant, "variant.cpp")).read()
+    names = sorted(set(re.findall(r"\b(DOSFS_\w+)\b", source)))
+    settings = [ {} ]
+    for name in names:
+        settings = [ dict(s, **{ name: value }) for s in settings for value in (0, 1) ]
+    return settings
+
+def compile(directory, variant, defines, source, binary, override=None):
+    # source None compiles variant.cpp itself; "override" is a directory searched before the variant
+    includes = [ "system/CMSIS/Include", "system/CMSIS/Device/ST/STM32L0xx/Include", "system/STM32L0xx/Include",
+                 os.path.join("variants", variant), "cores/arduino" ]
+    command = ([ "g++", "-O2", "-std=gnu++11", "-w", "-D" + device(variant) ] + [ "-D%s=%d" % item for item in defines.items() ]
+               + ([ "-I" + override ] if override else []) + [ "-I" + os.path.join(ROOT, include) for include in includes ])
+    if source is None:
+        command += [ "-fsyntax-only", os.path.join(ROOT, "variants", variant, "variant.cpp") ]
+    else:
+        path = os.path.join(directory, binary + ".cpp")
+        with open(path, "w") as f:
+            f.write(source)
+        command += [ path, "-o", os.path.join(directory, binary) ]
+    return subprocess.run(command, capture_output=True, text=True)
+
+def port_groups(pins):
+    # up to four pins on the port with the most GPIO pins, in table order, and
+    # the longest run of adjacent port bits (in bit order, the shifted path)
+    ports = {}
+    for index, gpio in enumerate(pins):
+        if gpio:
+            ports.setdefault(gpio[0], []).append(index)
+    groups = [ max(ports.values(), key=len)[:4] ]
+    runs = []
+    for indices in ports.values():
+        indices = sorted(indices, key=lambda index: pins[index][1])
+        run = indices[:1]
+        for index in indices[1:]:
+            run = run + [ index ] if pins[index][1] == pins[run[-1]][1] + 1 else [ index ]
+            runs.append(run[:4])
+    runs = [ run for run in runs if len(run) >= 2 ]
+    if runs:
+        groups.append(max(runs, key=len))
+    return groups
+
+def check(variant, defines, directory):
+    result = compile(directory, variant, defines, None, None)
+    assert result.returncode == 0, result.stderr
+    pins = table(variant, defines)
+    groups = port_groups(pins)
+    lines = [ HEADER ]
+    lines += [ "\tpin<%d>();\n" % index for index, gpio in enumerate(pins) if gpio ]
+    for number, group in enumerate(groups):
+        port = "FastPort<%s>" % ", ".join(str(index) for index in group)
+        lines.append("\tprintf(\"contiguous\\t%d\\t%%d\\n\", (int)%s::contiguous);\n" % (number, port))
+        mask = sum(1 << pins[index][1] for index in group)
+        for value in range(1 << len(group)):
+            idr = (~mask & 0xffffffff) | sum(1 << pins[index][1] for i, index in enumerate(group) if value & (1 << i))
+            lines.append("\tfill(); %s::write(%d); dump(\"port%d\", %d);\n" % (port, value, number, value))
+            lines.append("\tfill(); poke(%s::base, 0x10, 0x%08x); printf(\"portread\\t%d\\t%%u\\n\", (unsigned)%s::read());\n" % (port, idr, value, port))
+    lines.append("\treturn 0;\n}\n")
+    result = compile(directory, variant, defines, "".join(lines), "harness")
+    assert result.returncode == 0, result.stderr
+    output = subprocess.run([ os.path.join(directory, "harness") ], capture_output=True, text=True, check=True).stdout
+    records = [ line.split("\t") for line in output.splitlines() ]
+
+    def writes(record):
+        return { int(a, 16): int(v, 16) for a, v in (field.split("=") for field in record[2:]) }
+
+    checked = 0
+    for record in records:
+        kind, pin = record[0], int(record[1])
+        if kind == "gpio":
+            gpio = pins[pin]
+            assert int(record[2]) == (0xff if gpio is None else (gpio[0] << 4) | gpio[1]), (variant, defines, record)
+            continue
+        if kind in ("high", "low", "toggle1", "toggle0"):
+            port, bit = pins[pin]
+            base = GPIOA_BASE + PORT_SIZE * port - GPIOA_BASE
+            expected = { "high": { base + BSRR: 1 << bit }, "low": { base + BRR: 1 << bit },
+                         "toggle1": { base + BSRR: 1 << (bit + 16) }, "toggle0": { base + BSRR: 1 << bit } }[kind]
+            assert writes(record) == expected, (variant, defines, record, expected)
+            checked += 1
+        elif kind == "read":
+            assert record[2:] == [ "1", "0" ], (variant, defines, record)
+        elif kind == "contiguous":
+            bits = [ pins[index][1] for index in groups[pin] ]
+            assert int(record[2]) == int(all(b == bits[0] + i for i, b in enumerate(bits))), (variant, record)
+        elif kind.startswith("port") and kind != "portread":
+            group = groups[int(kind[4:])]
+            value, port = pin, pins[group[0]][0]
+            mask = sum(1 << pins[index][1] for index in group)
+            set_bits = sum(1 << pins[index][1] for i, index in enumerate(group) if value & (1 << i))
+            expected = { PORT_SIZE * port + BSRR: ((mask & ~set_bits) << 16) | set_bits }
+            assert writes(record) == expected, (variant, defines, record, expected)
+            checked += 1
+        elif kind == "portread":
+            assert int(record[2]) == pin, (variant, defines, record)
+    return checked, groups
+
+def main():
+    variants = sorted(os.listdir(os.path.join(ROOT, "variants")))
+    with tempfile.TemporaryDirectory() as directory:
+        for variant in variants:
+            for defines in configurations(variant):
+                checked, groups = check(variant, defines, directory)
+                print("%-20s %-32s %3d single store accesses ok, %s"
+                      % (variant, " ".join("%s=%d" % item for item in defines.items()), checked,
+                         " ".join("FastPort<%s>" % ", ".join(map(str, group)) for group in groups)))
+        # a pin without a GPIO must not compile
+        variant = "Grasshopper-L082CZ"
+        defines = { "DOSFS_SDCARD": 0, "DOSFS_SFLASH": 1 }
+        none = table(variant, defines).index(None)
+        result = compile(directory, variant, defines, '#include "Arduino.h"\nint main(void) { digitalWriteFast<%d>(HIGH); return 0; }\n' % none, "none")
+        assert result.returncode != 0 and "not usable as GPIO" in result.stderr, result.stderr
+        print("%-20s FastPin<%d> (no GPIO) rejected at compile time" % (variant, none))
+        # a g_APinGPIO[] entry that differs from g_APinDescription[] must not compile
+        header = open(os.path.join(ROOT, "variants", variant, "variant.h")).read()
+        override = os.path.join(directory, "override")
+        os.mkdir(override)
+        with open(os.path.join(override, "variant.h"), "w") as f:
+            f.write(header.replace("STM32L0_GPIO_PIN_PB9,", "STM32L0_GPIO_PIN_PB10,", 1))
+        result = compile(directory, variant, defines, None, None, override)
+        assert result.returncode != 0 and "does not match g_APinDescription" in result.stderr, result.stderr
+        print("%-20s g_APinGPIO[] that differs from variant.cpp rejected at compile time" % variant)
+    print("OK")
+
+if __name__ == "__main__":
+    main()
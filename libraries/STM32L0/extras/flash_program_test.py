@@ -0,0 +1,474 @@
+#!/usr/bin/env python3
+#
+# Host test and benchmark for stm32l0_flash_program() and _erase(). The
+# driver is compiled from system/STM32L0xx/Source/stm32l0_flash.c with the
+# host g++; only the stores in the two RAM functions are routed to the
+# model, which keeps the rules the hardware enforces. The erased state is
+# all zero, a word write to a non-zero word fails with NOTZEROERR, a
+# half-page write needs 16 back to back word writes to a 64 byte aligned,
+# erased half-page, and a flash read in between aborts it with FWWERR.
+#
+# Program memory is mapped at FLASH_BASE, read only for the driver and not
+# at all while a half-page burst is in progress, so that any flash access
+# (like the source of the copy being in flash) is caught by the model. The
+# SR flags are write 1 to clear and PECR has the PELOCK/PRGLOCK key
+# sequences.
+#
+# The cases are: aligned and unaligned source buffers, sources in flash,
+# unaligned start addresses, rewriting identical data, appending to a
+# partially written half-page, overwriting with different data (which has
+# to fail), and the argument and lock checks. Each case has to leave the
+# right flash content; the number of program operations (3.2 ms each) is
+# printed against word by word programming. Given a git revision, the
+# driver from there is run over the same cases side by side.
+#
+#   python3 flash_program_test.py [revision]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = "system/STM32L0xx/Source/stm32l0_flash.c"
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+static inline void __DMB(void) { __sync_synchronize(); }
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef struct { model_register_t ACR, PECR, PDKEYR, PEKEYR, PRGKEYR, OPTKEYR, SR; } model_flash_t;
+
+extern model_flash_t model_flash;
+extern void model_flash_write(uint32_t address, uint32_t data);
+
+#define FLASH (&model_flash)
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_flash.c"
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d)\n", #_c, __LINE__); exit(1); } } while (0)
+
+#define FLASH_SIZE   (192 * 1024)
+#define FLASH_ERRORS (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_RDERR | FLASH_SR_NOTZEROERR | FLASH_SR_FWWERR)
+
+uint32_t model_primask;
+model_flash_t model_flash;
+
+static uint8_t *flash;                  /* the model's writable view */
+static unsigned int operations, eeprom_acquired;
+static uint32_t burst_address, burst_data[16];
+static unsigned int burst_count;
+static bool burst_aborted;
+
+void stm32l0_eeprom_acquire(void) { eeprom_acquired++; }
+void stm32l0_eeprom_release(void) { CHECK(eeprom_acquired); eeprom_acquired--; }
+
+static uint32_t flash_word(uint32_t address)
+{
+    return *((uint32_t*)&flash[address - FLASH_BASE]);
+}
+
+static void flash_done(uint32_t errors)
+{
+    operations++;
+
+    model_flash.SR.value |= (errors ? errors : FLASH_SR_EOP);
+}
+
+static void flash_protect(int protection)
+{
+    CHECK(mprotect((void*)FLASH_BASE, FLASH_SIZE, protection) == 0);
+}
+
+/* A flash access during a half-page burst aborts it. */
+static void flash_fault(int signal, siginfo_t *info, void *context)
+{
+    uintptr_t address = (uintptr_t)info->si_addr;
+
+    if (burst_count && (address >= FLASH_BASE) && (address < (FLASH_BASE + FLASH_SIZE)))
+    {
+        burst_aborted = true;
+
+        flash_protect(PROT_READ);
+    }
+    else
+    {
+        printf("fail: access to %p\n", info->si_addr);
+        fflush(stdout);
+        _exit(1);
+    }
+}
+
+void model_flash_write(uint32_t address, uint32_t data)
+{
+    uint32_t pecr = model_flash.PECR.value, index;
+
+    CHECK(model_primask);
+    CHECK(!(address & 3) && (address >= FLASH_BASE) && (address < (FLASH_BASE + FLASH_SIZE)));
+
+    if (pecr & FLASH_PECR_PRGLOCK)
+    {
+        flash_done(FLASH_SR_WRPERR);
+        return;
+    }
+
+    if ((pecr & (FLASH_PECR_PROG | FLASH_PECR_ERASE)) == (FLASH_PECR_PROG | FLASH_PECR_ERASE))
+    {
+        memset(&flash[(address & ~127) - FLASH_BASE], 0, 128);
+        flash_done(0);
+        return;
+    }
+
+    if ((pecr & (FLASH_PECR_PROG | FLASH_PECR_FPRG)) == (FLASH_PECR_PROG | FLASH_PECR_FPRG))
+    {
+        if (burst_count == 0)
+        {
+            burst_address = address;
+            burst_aborted = false;
+
+            flash_protect(PROT_NONE);
+        }
+
+        if ((burst_address & 63) || (address != (burst_address + 4 * burst_count)))
+        {
+            burst_count = 0;
+            flash_protect(PROT_READ);
+            flash_done(FLASH_SR_PGAERR);
+            return;
+        }
+
+        burst_data[burst_count++] = data;
+
+        if (burst_count != 16)
+        {
+            return;
+        }
+
+        burst_count = 0;
+        flash_protect(PROT_READ);
+
+        if (burst_aborted)
+        {
+            flash_done(FLASH_SR_FWWERR);
+            return;
+        }
+
+        for (index = 0; index < 16; index++)
+        {
+            if (flash_word(burst_address + 4 * index))
+            {
+                flash_done(FLASH_SR_NOTZEROERR);
+                return;
+            }
+        }
+
+        memcpy(&flash[burst_address - FLASH_BASE], &burst_data[0], 64);
+        flash_done(0);
+        return;
+    }
+
+    if (flash_word(address))
+    {
+        flash_done(FLASH_SR_NOTZEROERR);
+        return;
+    }
+
+    memcpy(&flash[address - FLASH_BASE], &data, 4);
+    flash_done(0);
+}
+
+static void flash_pecr_write(model_register_t *reg, uint32_t data)
+{
+    if (reg->value & FLASH_PECR_PELOCK)
+    {
+        return;
+    }
+
+    /* the locks can be set, but only cleared by the key sequences; PELOCK
+     * locks the program memory as well */
+    reg->value = data | (reg->value & FLASH_PECR_PRGLOCK);
+
+    if (data & FLASH_PECR_PELOCK)
+    {
+        reg->value |= FLASH_PECR_PRGLOCK;
+    }
+}
+
+static uint32_t pekey_last, prgkey_last;
+
+static void flash_pekeyr_write(model_register_t *reg, uint32_t data)
+{
+    if ((pekey_last == 0x89abcdef) && (data == 0x02030405))
+    {
+        model_flash.PECR.value &= ~FLASH_PECR_PELOCK;
+    }
+
+    pekey_last = data;
+}
+
+static void flash_prgkeyr_write(model_register_t *reg, uint32_t data)
+{
+    if (!(model_flash.PECR.value & FLASH_PECR_PELOCK) && (prgkey_last == 0x8c9daebf) && (data == 0x13141516))
+    {
+        model_flash.PECR.value &= ~FLASH_PECR_PRGLOCK;
+    }
+
+    prgkey_last = data;
+}
+
+static void flash_sr_write(model_register_t *reg, uint32_t data)
+{
+    reg->value &= ~data;
+}
+
+/* Sources: RAM buffers (static, so their addresses fit the driver's 32 bit
+ * casts), or data placed in flash.
+ */
+static uint8_t ram[4096 + 4] __attribute__((aligned(4)));
+static uint8_t data[4096];
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+#define IMAGE (FLASH_BASE + 0x10000)
+
+enum { SETUP_NONE, SETUP_REWRITE, SETUP_PARTIAL, SETUP_DIFFERENT };
+
+static void test(const char *name, uint32_t address, const uint8_t *source, uint32_t count, int setup)
+{
+    unsigned int i;
+    bool success;
+
+    memset(flash, 0, FLASH_SIZE);
+
+    for (i = 0; i < count; i++)
+    {
+        data[i] = 1 + (rng() % 255);
+    }
+
+    if (((uintptr_t)source >= FLASH_BASE) && ((uintptr_t)source < (FLASH_BASE + FLASH_SIZE)))
+    {
+        memcpy(&flash[(uintptr_t)source - FLASH_BASE], data, count);
+    }
+    else
+    {
+        memcpy((void*)source, data, count);
+    }
+
+    switch (setup) {
+    case SETUP_REWRITE:
+        memcpy(&flash[address - FLASH_BASE], data, count);
+        break;
+    case SETUP_PARTIAL:
+        /* an append only log, the first 20 bytes are there already */
+        memcpy(&flash[address - FLASH_BASE], data, 20);
+        break;
+    case SETUP_DIFFERENT:
+        memcpy(&flash[address - FLASH_BASE], data, count);
+        flash[address - FLASH_BASE + count / 2] ^= 0xff;
+        break;
+    }
+
+    operations = 0;
+
+    CHECK(stm32l0_flash_unlock());
+    success = stm32l0_flash_program(address, source, count);
+    stm32l0_flash_lock();
+
+    CHECK(model_primask == 0);
+    CHECK(eeprom_acquired == 0);
+    CHECK(!(model_flash.SR.value & (FLASH_ERRORS | FLASH_SR_EOP)));
+    CHECK(!(model_flash.PECR.value & (FLASH_PECR_PROG | FLASH_PECR_FPRG | FLASH_PECR_ERASE)));
+    CHECK((model_flash.PECR.value & (FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK)) == (FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK));
+
+    if (setup == SETUP_DIFFERENT)
+    {
+        CHECK(!success);
+        printf("case\t%s\t%u\trefused\t%u\n", name, count, operations);
+        return;
+    }
+
+    printf("case\t%s\t%u\t%s\t%u\n", name, count, (success && !memcmp(&flash[address - FLASH_BASE], data, count)) ? "ok" : "failed", operations);
+}
+
+int main(void)
+{
+    struct sigaction action;
+    uint16_t *size;
+    int fd;
+
+    model_flash.PECR.value = FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK;
+    model_flash.PECR.write = flash_pecr_write;
+    model_flash.PEKEYR.write = flash_pekeyr_write;
+    model_flash.PRGKEYR.write = flash_prgkeyr_write;
+    model_flash.SR.write = flash_sr_write;
+
+    /* the same memory, writable for the model, read only at FLASH_BASE */
+    fd = memfd_create("flash", 0);
+    CHECK((fd >= 0) && (ftruncate(fd, FLASH_SIZE) == 0));
+    flash = (uint8_t*)mmap(NULL, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CHECK(flash != MAP_FAILED);
+    CHECK(mmap((void*)FLASH_BASE, FLASH_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) == (void*)FLASH_BASE);
+
+    /* the flash size register in the factory bytes */
+    size = (uint16_t*)mmap((void*)0x1ff80000, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    CHECK(size == (uint16_t*)0x1ff80000);
+    size[0x7c / 2] = FLASH_SIZE / 1024;
+    CHECK(stm32l0_flash_size() == FLASH_SIZE);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = flash_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &action, NULL);
+
+    test("image staging, 2k", IMAGE, &ram[0], 2048, SETUP_NONE);
+    test("unaligned source", IMAGE, &ram[1], 1024, SETUP_NONE);
+    test("source in flash", IMAGE, (const uint8_t*)(FLASH_BASE + 0x8000), 1024, SETUP_NONE);
+    test("unaligned source in flash", IMAGE, (const uint8_t*)(FLASH_BASE + 0x8002), 1024, SETUP_NONE);
+    test("unaligned start", IMAGE + 20, &ram[0], 1000, SETUP_NONE);
+    test("short record", IMAGE + 8, &ram[0], 12, SETUP_NONE);
+    test("rewrite same data", IMAGE, &ram[0], 1024, SETUP_REWRITE);
+    test("append to half-page", IMAGE, &ram[0], 256, SETUP_PARTIAL);
+    test("overwrite with other data", IMAGE, &ram[0], 256, SETUP_DIFFERENT);
+
+    /* erase clears whole pages, and nothing outside */
+    memset(flash, 0x5a, FLASH_SIZE);
+    operations = 0;
+    CHECK(stm32l0_flash_unlock());
+    CHECK(stm32l0_flash_erase(IMAGE + 128, 512));
+    stm32l0_flash_lock();
+    CHECK((operations == 4) && (flash[IMAGE - FLASH_BASE + 127] == 0x5a) && (flash[IMAGE - FLASH_BASE + 128 + 512] == 0x5a));
+    for (unsigned int i = 0; i < 512; i++)
+    {
+        CHECK(flash[IMAGE - FLASH_BASE + 128 + i] == 0);
+    }
+    CHECK(!(model_flash.SR.value & (FLASH_ERRORS | FLASH_SR_EOP)) && (model_primask == 0) && (eeprom_acquired == 0));
+
+    /* arguments, and the lock */
+    memset(flash, 0, FLASH_SIZE);
+    operations = 0;
+    CHECK(!stm32l0_flash_program(IMAGE, &ram[0], 64));
+    CHECK(!stm32l0_flash_erase(IMAGE, 128));
+    CHECK(stm32l0_flash_unlock());
+    CHECK(!stm32l0_flash_program(IMAGE + 2, &ram[0], 64));
+    CHECK(!stm32l0_flash_program(IMAGE, &ram[0], 62));
+    CHECK(!stm32l0_flash_program(FLASH_BASE - 4, &ram[0], 8));
+    CHECK(!stm32l0_flash_program(FLASH_BASE + FLASH_SIZE - 4, &ram[0], 8));
+    CHECK(!stm32l0_flash_erase(IMAGE + 64, 128));
+    stm32l0_flash_lock();
+    CHECK(operations == 0);
+    printf("arguments and lock\tok\n");
+
+    return 0;
+}
+'''
+
+def build(directory, source):
+    # route the stores of the RAM functions (to flash) to the model
+    for name in ("stm32l0_flash_do_erase", "stm32l0_flash_do_program"):
+        match = re.search(r"\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+        assert match, name
+        body, count = re.subn(r"\*\(\(volatile uint32_t\*\)address\) = ([^;]+);", r"model_flash_write(address, \1);", match.group(1))
+        assert count == 1, name
+        source = source[:match.start(1)] + body + source[match.end(1):]
+    defines = "\n".join(re.findall(r"^#define (?:FLASH_BASE|FLASH_PECR_|FLASH_SR_)\w*[ \t]+[^\n]*", open(DEVICE).read(), flags=re.M))
+    for name, text in (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines), ("stm32l0_flash.c", source), ("harness.cpp", HARNESS),
+                       ("stm32l0_flash.h", open(os.path.join(ROOT, "system/STM32L0xx/Include/stm32l0_flash.h")).read())):
+        with open(os.path.join(directory, name), "w") as f:
+            f.write(text)
+    binary = os.path.join(directory, "harness")
+    subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory,
+                            os.path.join(directory, "harness.cpp"), "-o", binary ])
+    run = subprocess.run([ binary ], capture_output=True, text=True)
+    return run.returncode, run.stdout
+
+def cases(output):
+    return [ line.split("\t")[1:] for line in output.splitlines() if line.startswith("case\t") ]
+
+def main():
+    revision = sys.argv[1] if len(sys.argv) > 1 else None
+    source = open(os.path.join(ROOT, SOURCE)).read()
+    # the weak aliases of the EEPROM lock hooks are C names; the harness has them
+    source = source.replace('__attribute__ ((weak, alias("__empty")))', "")
+    with tempfile.TemporaryDirectory() as directory:
+        returncode, output = build(directory, source)
+        if returncode or "fail:" in output:
+            print(output)
+        assert returncode == 0 and "fail:" not in output, returncode
+        new = cases(output)
+        old = None
+        if revision:
+            source = subprocess.check_output([ "git", "-C", ROOT, "show", "%s:%s" % (revision, SOURCE) ], text=True)
+            source = source.replace('__attribute__ ((weak, alias("__empty")))', "")
+            os.mkdir(os.path.join(directory, "old"))
+            returncode, output = build(os.path.join(directory, "old"), source)
+            old = cases(output)
+    for index, (name, count, result, operations) in enumerate(new):
+        words = int(count) // 4
+        line = "%-26s %5s bytes: words %4d ops %7.1f ms | %s %4s ops %7.1f ms" % (name, count, words, words * 3.2, result, operations, int(operations) * 3.2)
+        if old is not None:
+            if index < len(old):
+                line += " | %s %s %4s ops" % (revision, old[index][2], old[index][3])
+            else:
+                line += " | %s crashed" % revision
+        print(line)
+        assert result == ("refused" if name.startswith("overwrite") else "ok"), name
+    staging = new[0]
+    assert int(staging[3]) * 8 < int(staging[1]) // 4, "half-page path not taken"
+    print("OK")
+
+if __name__ == "__main__":
+    main()
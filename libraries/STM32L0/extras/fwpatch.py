@@ -0,0 +1,636 @@
+#!/usr/bin/env python3
+#
+# Builds and applies firmware patches for stm32l0_update (FirmwareUpdate in
+# the STM32L0 library). The format is described in stm32l0_update.h: a
+# header with sizes and CRCs, followed by ADD (source bytes plus a run
+# length coded difference, bsdiff style) and INSERT (new bytes) commands.
+#
+# The diff finds matches through an index of 8 byte keys of the old image
+# and extends each match over small differences (as relocated addresses and
+# branch offsets are in a rebuilt firmware), so that only the changed bytes
+# end up in the patch.
+#
+#   python3 fwpatch.py diff old.bin new.bin patch.bin
+#   python3 fwpatch.py apply old.bin patch.bin new.bin
+#   python3 fwpatch.py test [old.bin new.bin]
+#
+# "apply" and "test" run stm32l0_update.c itself, compiled with the host
+# g++ (the flash driver is a stub that enforces erase before program and
+# writes to the inactive bank only). "test" feeds patches in random pieces
+# and checks the new image, and that corrupted patches, patches for the
+# wrong image, images larger than a bank and flash failures are rejected.
+# It also runs stm32l0_system_swap() against emulated FLASH option byte
+# registers. Without image files it uses synthetic firmware images, rebuilt
+# with a function inserted and a few constants changed.
+
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+MAGIC = 0x31505746
+OPCODE_END, OPCODE_ADD, OPCODE_INSERT = 0x00, 0x01, 0x02
+KEY = 8
+
+def uvarint(value):
+    data = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            data.append(byte | 0x80)
+        else:
+            data.append(byte)
+            return bytes(data)
+
+def svarint(value):
+    # zigzag coding, as decoded by stm32l0_update_field()
+    return uvarint(((-value) << 1) - 1 if value < 0 else value << 1)
+
+def crc32(data):
+    return zlib.crc32(data) & 0xffffffff
+
+def header(source, target):
+    words = struct.pack("<5I", MAGIC, len(source), crc32(source), len(target), crc32(target))
+    return words + struct.pack("<I", crc32(words))
+
+class Encoder:
+    def __init__(self):
+        self.delta = b""            # previous difference bytes, for "repeat"
+
+def encode_add(encoder, source, target, s, t, length, position):
+    # ADD: length, seek, then { zeros, count << 1 | repeat, difference bytes } runs
+    out = bytearray([ OPCODE_ADD ]) + uvarint(length) + svarint(s - position)
+    diff = bytes((target[t + index] - source[s + index]) & 0xff for index in range(length))
+    index = 0
+    while index < length:
+        zeros = index
+        while zeros < length and diff[zeros] == 0:
+            zeros += 1
+        literal = zeros
+        # a literal run ends at 2 zero bytes, a shorter gap is cheaper inline
+        while literal < length and (diff[literal] != 0 or (literal + 1 < length and diff[literal + 1] != 0)):
+            literal += 1
+        delta = diff[zeros:literal]
+        if delta and delta == encoder.delta:
+            out += uvarint(zeros - index) + uvarint((len(delta) << 1) | 1)
+        else:
+            out += uvarint(zeros - index) + uvarint(len(delta) << 1) + delta
+            encoder.delta = delta if len(delta) <= 8 else b""
+        index = literal
+    return bytes(out)
+
+def encode_insert(data):
+    return bytes([ OPCODE_INSERT ]) + uvarint(len(data)) + bytes(data)
+
+def diff(source, target):
+    index = {}
+    for s in range(len(source) - KEY + 1):
+        key = source[s:s + KEY]
+        positions = index.setdefault(key, [])
+        if len(positions) < 16:
+            positions.append(s)
+    patch = bytearray(header(source, target))
+    encoder = Encoder()
+    position = 0
+    pending = bytearray()
+    t = 0
+    while t < len(target):
+        best, best_length = None, 0
+        candidates = list(index.get(target[t:t + KEY], []))
+        if position < len(source):
+            candidates.insert(0, position)
+        for s in candidates:
+            length = 0
+            while t + length < len(target) and s + length < len(source) and target[t + length] == source[s + length]:
+                length += 1
+            if length > best_length:
+                best, best_length = s, length
+        if best is None or best_length < KEY:
+            pending.append(target[t])
+            t += 1
+            continue
+        # extend over small differences while at least half of the next 16 bytes match
+        length = good = best_length
+        while t + length < len(target) and best + length < len(source):
+            if target[t + length] == source[best + length]:
+                length += 1
+                good = length
+                continue
+            window = min(16, len(target) - t - length, len(source) - best - length)
+            same = sum(1 for index in range(window) if target[t + length + index] == source[best + length + index])
+            if same * 2 < window or window < 8:
+                break
+            length += 1
+        length = good
+        if pending:
+            patch += encode_insert(pending)
+            pending = bytearray()
+        patch += encode_add(encoder, source, target, best, t, length, position)
+        position = best + length
+        t += length
+    if pending:
+        patch += encode_insert(pending)
+    patch.append(OPCODE_END)
+    return bytes(patch)
+
+# Host build of stm32l0_update.c, and of stm32l0_system_swap() taken from
+# stm32l0_system.c. Program memory is mapped at FLASH_BASE, the running
+# image in the lower bank, and is read only to everything but the flash
+# driver stubs. Those check that only the inactive bank is erased and
+# programmed, page by page and erase before program.
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = os.path.join(ROOT, "system/STM32L0xx/Source")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+STATUS_SUCCESS, ERROR_FORMAT, ERROR_SOURCE, ERROR_SIZE, ERROR_FLASH, ERROR_VERIFY = 2, 3, 4, 5, 6, 7
+
+ARMV6M = r"""
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+
+static inline void __disable_irq(void) { model_primask = 1; }
+static inline void __WFE(void) { }
+
+#endif
+"""
+
+STM32L0XX = r"""
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef struct { model_register_t ACR, PECR, PDKEYR, PEKEYR, PRGKEYR, OPTKEYR, SR, OPTR; } model_flash_t;
+typedef struct { model_register_t RDP, USER, WRP01, WRP23, WRP45; } model_ob_t;
+
+extern model_flash_t model_flash;
+extern model_ob_t model_ob;
+
+#define FLASH (&model_flash)
+#define OB    (&model_ob)
+
+#endif
+"""
+
+HARNESS = r"""
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_update.c"
+#include <stdio.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %%s (line %%d)\n", #_c, __LINE__); exit(1); } } while (0)
+
+#define FLASH_SIZE                  (192 * 1024)
+#define BANK_SIZE                   (FLASH_SIZE / 2)
+
+#define STM32L0_SYSTEM_LOCK_EEPROM  %d
+#define STM32L0_SYSTEM_NOTIFY_RESET %d
+
+uint32_t model_primask;
+model_flash_t model_flash;
+model_ob_t model_ob;
+
+static uint8_t *flash = (uint8_t*)FLASH_BASE;
+static bool unlocked;
+static unsigned int erases, programs, programs_fail;
+
+static void flash_access(int protection)
+{
+    CHECK(mprotect(flash, FLASH_SIZE, protection) == 0);
+}
+
+/* The flash driver, tested by flash_program_test.py: only the inactive bank,
+ * whole pages, erase before program.
+ */
+uint32_t stm32l0_flash_size(void)
+{
+    return FLASH_SIZE;
+}
+
+bool stm32l0_flash_unlock(void)
+{
+    CHECK(!unlocked);
+
+    unlocked = true;
+
+    return true;
+}
+
+void stm32l0_flash_lock(void)
+{
+    CHECK(unlocked);
+
+    unlocked = false;
+}
+
+bool stm32l0_flash_erase(uint32_t address, uint32_t count)
+{
+    CHECK(unlocked);
+    CHECK(!(address & 127) && (count == 128));
+    CHECK((address >= (FLASH_BASE + BANK_SIZE)) && ((address + count) <= (FLASH_BASE + FLASH_SIZE)));
+
+    flash_access(PROT_READ | PROT_WRITE);
+    memset(&flash[address - FLASH_BASE], 0, count);
+    flash_access(PROT_READ);
+
+    erases++;
+
+    return true;
+}
+
+bool stm32l0_flash_program(uint32_t address, const uint8_t *data, uint32_t count)
+{
+    uint32_t offset, word;
+
+    CHECK(unlocked);
+    CHECK(!(address & 3) && !(count & 3) && count && (count <= 64) && ((address & ~63) == ((address + count - 1) & ~63)));
+    CHECK((address >= (FLASH_BASE + BANK_SIZE)) && ((address + count) <= (FLASH_BASE + FLASH_SIZE)));
+
+    for (offset = 0; offset < count; offset += 4)
+    {
+        memcpy(&word, &flash[address - FLASH_BASE + offset], 4);
+        CHECK(!word || !memcmp(&word, &data[offset], 4));
+    }
+
+    if (programs_fail && (programs == programs_fail))
+    {
+        return false;
+    }
+
+    flash_access(PROT_READ | PROT_WRITE);
+    memcpy(&flash[address - FLASH_BASE], data, count);
+    flash_access(PROT_READ);
+
+    programs++;
+
+    return true;
+}
+
+/* stm32l0_system_swap() and what it calls */
+static struct { uint8_t lock[8]; } stm32l0_system_device;
+static uint32_t notified, rtc_resets, ob_writes;
+static jmp_buf reset;
+
+static void stm32l0_system_notify(uint32_t events) { notified |= events; }
+static void stm32l0_rtc_reset(void) { rtc_resets++; }
+static void NVIC_SystemReset(void) { longjmp(reset, 1); }
+
+static uint32_t pekey_last, optkey_last;
+
+static void flash_pekeyr_write(model_register_t *reg, uint32_t data)
+{
+    if ((pekey_last == 0x89abcdef) && (data == 0x02030405))
+    {
+        model_flash.PECR.value &= ~FLASH_PECR_PELOCK;
+    }
+
+    pekey_last = data;
+}
+
+static void flash_optkeyr_write(model_register_t *reg, uint32_t data)
+{
+    if (!(model_flash.PECR.value & FLASH_PECR_PELOCK) && (optkey_last == 0xfbead9c8) && (data == 0x24252627))
+    {
+        model_flash.PECR.value &= ~FLASH_PECR_OPTLOCK;
+    }
+
+    optkey_last = data;
+}
+
+static void flash_pecr_write(model_register_t *reg, uint32_t data)
+{
+    CHECK(!(reg->value & FLASH_PECR_PELOCK));
+
+    reg->value = data;
+
+    if (data & FLASH_PECR_OBL_LAUNCH)
+    {
+        /* reload the user option bytes, if their complement matches */
+        CHECK((model_ob.USER.value >> 16) == (~model_ob.USER.value & 0xffff));
+
+        model_flash.OPTR.value = (model_flash.OPTR.value & 0x0000ffff) | (model_ob.USER.value << 16);
+        model_flash.PECR.value = FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK | FLASH_PECR_OPTLOCK;
+    }
+}
+
+static void ob_user_write(model_register_t *reg, uint32_t data)
+{
+    CHECK(!(model_flash.PECR.value & (FLASH_PECR_PELOCK | FLASH_PECR_OPTLOCK)));
+
+    reg->value = data;
+
+    ob_writes++;
+}
+
+%s
+
+static void swap(void)
+{
+    uint32_t optr, options;
+
+    model_flash.PECR.value = FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK | FLASH_PECR_OPTLOCK;
+    model_flash.PECR.write = flash_pecr_write;
+    model_flash.PEKEYR.write = flash_pekeyr_write;
+    model_flash.OPTKEYR.write = flash_optkeyr_write;
+    model_ob.USER.write = ob_user_write;
+
+    /* BOR level 1, the watchdog in software, no reset on STOP/STANDBY,
+     * BFB2 cleared; twice round from bank 1 to bank 2 and back */
+    model_flash.OPTR.value = 0x80710000 | 0x000000aa;
+    optr = model_flash.OPTR.value;
+
+    for (options = 0; options < 2; options++)
+    {
+        if (!setjmp(reset))
+        {
+            stm32l0_system_swap();
+        }
+
+        CHECK(model_primask && (notified & STM32L0_SYSTEM_NOTIFY_RESET) && (rtc_resets == (options + 1)) && (ob_writes == (options + 1)));
+        CHECK(model_flash.OPTR.value == (optr ^ ((options & 1) ? 0 : FLASH_OPTR_BFB2)));
+
+        model_primask = 0;
+    }
+
+    printf("swap ok\n");
+}
+
+int main(int argc, char **argv)
+{
+    stm32l0_update_t update;
+    static uint8_t patch[1024 * 1024];
+    uint32_t seed, offset, size, patch_size, source_size;
+    FILE *file;
+    bool success;
+
+    if (!strcmp(argv[1], "swap"))
+    {
+        swap();
+        return 0;
+    }
+
+    /* apply <source> <patch> <target> <seed> [fail after n programs] */
+    CHECK(mmap(flash, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == flash);
+
+    seed = strtoul(argv[5], NULL, 0);
+    programs_fail = (argc > 6) ? strtoul(argv[6], NULL, 0) : 0;
+
+    for (offset = 0; offset < FLASH_SIZE; offset++)
+    {
+        seed = seed * 1103515245 + 12345;
+        flash[offset] = seed >> 16;
+    }
+
+    file = fopen(argv[2], "rb");
+    CHECK(file);
+    source_size = fread(flash, 1, BANK_SIZE, file);
+    fclose(file);
+
+    file = fopen(argv[3], "rb");
+    CHECK(file);
+    patch_size = fread(patch, 1, sizeof(patch), file);
+    fclose(file);
+
+    flash_access(PROT_READ);
+
+    CHECK(stm32l0_update_bank_size() == BANK_SIZE);
+    CHECK(stm32l0_update_begin(&update));
+
+    for (offset = 0; offset < patch_size; offset += size)
+    {
+        static const uint32_t sizes[] = { 1, 7, 64, 512, 4096 };
+
+        seed = seed * 1103515245 + 12345;
+        size = sizes[(seed >> 16) %% 5];
+
+        if (size > (patch_size - offset))
+        {
+            size = patch_size - offset;
+        }
+
+        if (!stm32l0_update_write(&update, &patch[offset], size))
+        {
+            break;
+        }
+    }
+
+    success = stm32l0_update_end(&update);
+
+    CHECK(success == (update.status == STM32L0_UPDATE_STATUS_SUCCESS));
+    CHECK(!unlocked);
+
+    if (success)
+    {
+        file = fopen(argv[4], "wb");
+        CHECK(file);
+        fwrite(&flash[BANK_SIZE], 1, update.header[STM32L0_UPDATE_HEADER_TARGET_SIZE], file);
+        fclose(file);
+    }
+
+    printf("status %%u erases %%u programs %%u\n", update.status, erases, programs);
+
+    return 0;
+}
+"""
+
+class Harness:
+    def __init__(self):
+        self.directory = tempfile.TemporaryDirectory()
+        directory = self.directory.name
+        system = open(os.path.join(SOURCE, "stm32l0_system.c")).read()
+        swap = re.search(r"\nvoid stm32l0_system_swap\(void\)\n\{\n.*?\n\}\n", system, flags=re.S).group(0)
+        constants = open(os.path.join(ROOT, "system/STM32L0xx/Include/stm32l0_system.h")).read()
+        lock = int(re.search(r"#define STM32L0_SYSTEM_LOCK_EEPROM\s+(\w+)", constants).group(1), 0)
+        notify = int(re.search(r"#define STM32L0_SYSTEM_NOTIFY_RESET\s+(\w+)", constants).group(1), 0)
+        defines = "\n".join(re.findall(r"^#define (?:FLASH_BASE|FLASH_PECR_|FLASH_SR_|FLASH_OPTR_)\w*[ \t]+[^\n]*", open(DEVICE).read(), flags=re.M))
+        files = (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines), ("harness.cpp", HARNESS % (lock, notify, swap)),
+                 ("stm32l0_update.c", open(os.path.join(SOURCE, "stm32l0_update.c")).read()),
+                 ("stm32l0_update.h", open(os.path.join(ROOT, "system/STM32L0xx/Include/stm32l0_update.h")).read()),
+                 ("stm32l0_flash.h", open(os.path.join(ROOT, "system/STM32L0xx/Include/stm32l0_flash.h")).read()))
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        self.binary = os.path.join(directory, "harness")
+        # the running image ends within its bank
+        subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory,
+                                "-Wl,--defsym,__FlashBase=0x08010000", os.path.join(directory, "harness.cpp"), "-o", self.binary ])
+
+    def run(self, *arguments):
+        run = subprocess.run([ self.binary ] + [ str(argument) for argument in arguments ], capture_output=True, text=True)
+        assert run.returncode == 0 and "fail" not in run.stdout, run.stdout
+        return run.stdout
+
+    def apply(self, source, patch, seed=1, fail=0):
+        # returns (status, erases, programs, target)
+        directory = self.directory.name
+        names = [ os.path.join(directory, name) for name in ("source.bin", "patch.bin", "target.bin") ]
+        open(names[0], "wb").write(source)
+        open(names[1], "wb").write(patch)
+        if os.path.exists(names[2]):
+            os.remove(names[2])
+        fields = self.run("apply", names[0], names[1], names[2], seed, fail).split()
+        status, erases, programs = int(fields[1]), int(fields[3]), int(fields[5])
+        target = open(names[2], "rb").read() if status == STATUS_SUCCESS else None
+        return status, erases, programs, target
+
+def apply(source, patch):
+    status, erases, programs, target = Harness().apply(source, patch)
+    if status != STATUS_SUCCESS:
+        raise ValueError("patch failed with status %d" % status)
+    return target
+
+# Synthetic firmware
+
+class Firmware:
+    # functions with code bytes, absolute pointers (literal pools, vector
+    # table) and relative branches; rebuilt by laying them out again
+    def __init__(self, rng, count):
+        self.rng = rng
+        self.functions = []
+        for _ in range(count):
+            self.functions.append(self.function())
+
+    def function(self):
+        # calls and pointers name their callee by index in the first build
+        rng = self.rng
+        body = []
+        for _ in range(rng.randrange(10, 120)):
+            kind = rng.random()
+            if kind < 0.08:
+                body.append(("pointer", rng.choice(self.functions or [ body ])))
+            elif kind < 0.2:
+                body.append(("branch", rng.choice(self.functions or [ body ])))
+            else:
+                # Thumb code is made of recurring instruction patterns
+                body.append(("code", bytes(rng.choice([ 0x00, 0x20, 0x46, 0x68, 0xb5, 0xbd, rng.randrange(256) ]) for _ in range(4))))
+        return body
+
+    def build(self):
+        address, start = 0x08000000 + 0xc0, {}
+        for body in self.functions:
+            start[id(body)] = address
+            address += 4 * len(body)
+        image = bytearray()
+        for index in range(48):
+            image += struct.pack("<I", start[id(self.functions[index % len(self.functions)])] | 1)
+        for body in self.functions:
+            for offset, (kind, value) in enumerate(body):
+                if kind == "code":
+                    image += value
+                else:
+                    callee = start[id(value)]
+                    if kind == "pointer":
+                        image += struct.pack("<I", callee | 1)
+                    else:
+                        here = start[id(body)] + 4 * offset + 4
+                        image += struct.pack("<i", (callee - here) >> 1)
+        return bytes(image)
+
+    def rebuild(self):
+        # add a function in the middle, change a few constants
+        self.functions.insert(len(self.functions) // 2, self.function())
+        for _ in range(4):
+            body = self.rng.choice(self.functions)
+            index = self.rng.randrange(len(body))
+            if body[index][0] == "code":
+                body[index] = ("code", bytes(self.rng.randrange(256) for _ in range(4)))
+
+def run(harness, name, source, target, rng):
+    patch = diff(source, target)
+    # streaming, in random pieces
+    status, erases, programs, output = harness.apply(source, patch, rng.randrange(1 << 31))
+    assert status == STATUS_SUCCESS, "%s: status %d" % (name, status)
+    assert output == target, "%s: wrong image" % name
+    # a patch for another image is rejected before anything is written
+    other = bytearray(source)
+    other[len(other) // 3] ^= 0x55
+    status, _, written, _ = harness.apply(bytes(other), patch)
+    assert status == ERROR_SOURCE and written == 0, "%s: wrong source accepted" % name
+    # a failed program stops the update
+    if programs > 2:
+        status, _, _, _ = harness.apply(source, patch, 1, programs // 2)
+        assert status == ERROR_FLASH, "%s: flash failure ignored" % name
+    # corrupted patches never pass with a wrong image
+    for _ in range(50):
+        broken = bytearray(patch)
+        if rng.random() < 0.5:
+            for _ in range(rng.randrange(1, 4)):
+                index = rng.randrange(24, len(broken))
+                broken[index] ^= 1 << rng.randrange(8)
+        else:
+            broken = broken[:rng.randrange(24, len(broken))]
+        if bytes(broken) == patch:
+            continue
+        status, _, _, output = harness.apply(source, bytes(broken), rng.randrange(1 << 31))
+        assert status != STATUS_SUCCESS or output == target, "%s: corrupted patch accepted" % name
+    print("%-22s %6d -> %6d bytes, patch %6d bytes (%4.1f%%), %3d erases, %4d half-page programs, %d bytes of state"
+          % (name, len(source), len(target), len(patch), 100.0 * len(patch) / len(target),
+             erases, programs, 4 + 5 * 4 + 12 + 24 + 64))
+    return len(patch), len(target)
+
+def test(files):
+    rng = random.Random(1)
+    harness = Harness()
+    if files:
+        source, target = (open(name, "rb").read() for name in files)
+        run(harness, "files", source, target, rng)
+    else:
+        firmware = Firmware(rng, 300)
+        source = firmware.build()
+        firmware.rebuild()
+        target = firmware.build()
+        size, total = run(harness, "function inserted", source, target, rng)
+        assert size * 10 < total, "patch not an order of magnitude smaller"
+        run(harness, "unrelated images", source, bytes(rng.randrange(256) for _ in range(20000)), rng)
+        run(harness, "identical", source, source, rng)
+        # an image larger than a bank is refused before anything is written
+        status, erases, _, _ = harness.apply(source, header(source, bytes(96 * 1024 + 4)) + bytes([ OPCODE_END ]))
+        assert status == ERROR_SIZE and erases == 0
+    print(harness.run("swap").strip())
+    print("OK")
+
+def main():
+    if len(sys.argv) >= 2 and sys.argv[1] == "test":
+        test(sys.argv[2:4])
+    elif len(sys.argv) == 5 and sys.argv[1] == "diff":
+        source, target = (open(name, "rb").read() for name in sys.argv[2:4])
+        open(sys.argv[4], "wb").write(diff(source, target))
+    elif len(sys.argv) == 5 and sys.argv[1] == "apply":
+        source, patch = (open(name, "rb").read() for name in sys.argv[2:4])
+        open(sys.argv[4], "wb").write(apply(source, patch))
+    else:
+        print("usage: fwpatch.py diff old.bin new.bin patch.bin | apply old.bin patch.bin new.bin | test [old.bin new.bin]")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1143 @@
+#!/usr/bin/env python3
+#
+# Host test of large TwoWire transfers in libraries/Wire. Wire.cpp,
+# Callback.cpp, stm32l0_i2c.c and stm32l0_dma.c are compiled with the host
+# g++ against register stand-ins. I2C1 is a model of the master that clocks
+# address and data bytes to and from a register FIFO and a 64 KiB EEPROM on
+# a simulated time line, with TXIS, RXNE, TC, TCR and STOPF as the hardware
+# raises them. DMA1 channels 7 and 6 move the received and transmitted bytes
+# when the driver enables them. armv6m_task_wfe() runs the time line on, so
+# the blocking calls of TwoWire run as they do on the target.
+#
+# Each transfer is done with BUFFER_LENGTH chunks and in one piece through
+# caller owned buffers, once as the variants set up I2C1 (RX DMA only),
+# once without DMA and once with TX DMA too. Checked are the data on both
+# sides, the EEPROM write cycles, the 65535 byte limits, and the number of
+# I2C interrupts a long read takes; bus time, payload share and interrupts
+# are reported.
+#
+#   python3 i2c_transfer_test.py
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCES = ("system/STM32L0xx/Source/stm32l0_dma.c", "system/STM32L0xx/Source/stm32l0_i2c.c")
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask;
+extern int model_irq;
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+static inline int __current_irq(void) { return model_irq; }
+static inline uint32_t __get_IPSR(void) { return model_irq + 16; }
+
+/* runs the model until the bus moves on */
+extern void armv6m_task_wfe(void);
+static inline void armv6m_core_udelay(uint32_t delay) { }
+
+#define __BKPT(...) abort()
+
+/* Nothing preempts the code under test, so these are atomic. */
+static inline uint32_t armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+static inline uint32_t armv6m_atomic_cash(volatile uint16_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+static inline uint32_t armv6m_atomic_or(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_and(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t armv6m_atomic_modify(volatile uint32_t *p_data, uint32_t mask, uint32_t data) { uint32_t o = *p_data; *p_data = (o & ~mask) | data; return o; }
+static inline uint32_t armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t __armv6m_atomic_orb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_orb(p_data, data); }
+static inline uint32_t __armv6m_atomic_andb(volatile uint8_t *p_data, uint32_t data) { return armv6m_atomic_andb(p_data, data); }
+static inline uint32_t armv6m_atomic_andzb(volatile uint32_t *p_data, uint32_t data, volatile uint8_t *p_zero) { uint32_t o = *p_data; if (!*p_zero) { *p_data = o & data; } return o; }
+
+typedef void (*armv6m_pendsv_routine_t)(void *context, uint32_t data);
+
+typedef struct _armv6m_pendsv_event_t {
+    armv6m_pendsv_routine_t routine;
+    void *context;
+} armv6m_pendsv_event_t;
+
+extern armv6m_pendsv_event_t *model_event;
+
+static inline bool armv6m_pendsv_event_post(armv6m_pendsv_event_t *event, uint32_t data) { model_event = event; return true; }
+
+#define ARMV6M_TRACE_IRQ_ENTER()
+#define ARMV6M_TRACE_IRQ_LEAVE()
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef enum {
+    DMA1_Channel1_IRQn = 9,
+    DMA1_Channel2_3_IRQn = 10,
+    DMA1_Channel4_5_6_7_IRQn = 11,
+    I2C3_IRQn = 21,
+    I2C1_IRQn = 23,
+    I2C2_IRQn = 24,
+} IRQn_Type;
+
+typedef struct { model_register_t CR1, CR2, OAR1, OAR2, TIMINGR, TIMEOUTR, ISR, ICR, PECR, RXDR, TXDR; } I2C_TypeDef;
+typedef struct { model_register_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { model_register_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { volatile uint32_t CSELR; } DMA_Request_TypeDef;
+typedef struct { volatile uint32_t AHBENR, AHBSMENR; } RCC_TypeDef;
+typedef struct { volatile uint32_t ACR; } FLASH_TypeDef;
+typedef struct { volatile uint32_t CFGR2; } SYSCFG_TypeDef;
+typedef struct { volatile uint32_t IMR; } EXTI_TypeDef;
+
+extern I2C_TypeDef model_i2c[3];
+extern DMA_Channel_TypeDef model_dma_channel[7];
+extern DMA_TypeDef model_dma;
+extern DMA_Request_TypeDef model_dma_cselr;
+extern RCC_TypeDef model_rcc;
+extern FLASH_TypeDef model_flash;
+extern SYSCFG_TypeDef model_syscfg;
+extern EXTI_TypeDef model_exti;
+
+#define I2C1          (&model_i2c[0])
+#define I2C2          (&model_i2c[1])
+#define I2C3          (&model_i2c[2])
+#define DMA1          (&model_dma)
+#define DMA1_CSELR    (&model_dma_cselr)
+#define DMA1_Channel1 (&model_dma_channel[0])
+#define DMA1_Channel2 (&model_dma_channel[1])
+#define DMA1_Channel3 (&model_dma_channel[2])
+#define DMA1_Channel4 (&model_dma_channel[3])
+#define DMA1_Channel5 (&model_dma_channel[4])
+#define DMA1_Channel6 (&model_dma_channel[5])
+#define DMA1_Channel7 (&model_dma_channel[6])
+#define RCC           (&model_rcc)
+#define FLASH         (&model_flash)
+#define SYSCFG        (&model_syscfg)
+#define EXTI          (&model_exti)
+
+extern uint32_t model_nvic_pending, model_nvic_enabled;
+
+static inline void NVIC_SetPendingIRQ(int irq) { model_nvic_pending |= (1u << irq); }
+static inline void NVIC_EnableIRQ(int irq) { model_nvic_enabled |= (1u << irq); }
+static inline void NVIC_DisableIRQ(int irq) { model_nvic_enabled &= ~(1u << irq); }
+static inline void NVIC_SetPriority(int irq, uint32_t priority) { }
+
+#endif
+'''
+
+GPIO = r'''
+#if !defined(_STM32L0_GPIO_H)
+#define _STM32L0_GPIO_H
+
+#include "armv6m.h"
+
+%s
+
+#define STM32L0_GPIO_PIN_PB8_I2C1_SCL 0x0118
+#define STM32L0_GPIO_PIN_PB9_I2C1_SDA 0x0119
+
+static inline void stm32l0_gpio_pin_configure(uint32_t pin, uint32_t mode) { }
+static inline void stm32l0_gpio_pin_input(uint32_t pin) { }
+static inline void stm32l0_gpio_pin_output(uint32_t pin) { }
+static inline void stm32l0_gpio_pin_write(uint32_t pin, uint32_t data) { }
+static inline uint32_t stm32l0_gpio_pin_read(uint32_t pin) { return 1; }
+
+#endif
+'''
+
+# Wire.cpp and Callback.cpp only see these few parts of the core
+ARDUINO = r'''
+#pragma once
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_system.h"
+#include "stm32l0_i2c.h"
+#include "stm32l0_rtc.h"
+#include "stm32l0_timestamp.h"
+#include "Callback.h"
+'''
+
+STREAM = r'''
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Print {
+public:
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) { size_t n = 0; while (size--) { n += write(*buffer++); } return n; }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() { }
+};
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_dma.c"
+#include "stm32l0_i2c.c"
+#include "stm32l0_timestamp.h"
+#include "Wire.h"
+#include <stdio.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d, %.3f s)\n", #_c, __LINE__, (double)model_time / 1e9); fflush(stdout); _exit(1); } } while (0)
+
+
+I2C_TypeDef model_i2c[3];
+DMA_Channel_TypeDef model_dma_channel[7];
+DMA_TypeDef model_dma;
+DMA_Request_TypeDef model_dma_cselr;
+RCC_TypeDef model_rcc;
+FLASH_TypeDef model_flash;
+SYSCFG_TypeDef model_syscfg;
+EXTI_TypeDef model_exti;
+uint32_t model_primask, model_nvic_pending, model_nvic_enabled;
+int model_irq = -16;
+armv6m_pendsv_event_t *model_event;
+
+static uint64_t model_time;             /* nanoseconds */
+
+stm32l0_i2c_t g_Wire;
+
+extern const stm32l0_i2c_params_t g_WireParams = {
+    STM32L0_I2C_INSTANCE_I2C1,
+    0,
+    STM32L0_DMA_CHANNEL_DMA1_CH7_I2C1_RX,
+    STM32L0_DMA_CHANNEL_NONE,
+    {
+        STM32L0_GPIO_PIN_PB8_I2C1_SCL,
+        STM32L0_GPIO_PIN_PB9_I2C1_SDA,
+    },
+};
+
+/* ---- system ---- */
+
+static uint32_t locks, periph;
+
+void stm32l0_system_lock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_SLEEP); locks++; }
+void stm32l0_system_unlock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_SLEEP); CHECK(locks); locks--; }
+void stm32l0_system_periph_enable(unsigned int index) { CHECK(index == STM32L0_SYSTEM_PERIPH_I2C1); periph++; }
+void stm32l0_system_periph_disable(unsigned int index) { CHECK(index == STM32L0_SYSTEM_PERIPH_I2C1); CHECK(periph); periph--; }
+void stm32l0_system_hsi16_enable(void) { }
+void stm32l0_system_hsi16_disable(void) { }
+void stm32l0_system_reference(uint32_t reference) { }
+void stm32l0_system_unreference(uint32_t reference) { }
+void stm32l0_system_register(stm32l0_system_notify_t *notify, stm32l0_system_callback_t callback, void *context, uint32_t mask) { notify->callback = callback; }
+void stm32l0_system_wakeup(uint32_t events) { }
+uint32_t stm32l0_system_pclk1(void) { return 32000000; }
+
+uint64_t stm32l0_timestamp_read(void) { return model_time; }
+
+/* TwoWireSchedule is linked in, but not used */
+uint64_t stm32l0_rtc_clock_read(void) { return 0; }
+void stm32l0_rtc_timer_create(stm32l0_rtc_timer_t *timer, stm32l0_rtc_timer_callback_t callback, void *context) { }
+bool stm32l0_rtc_timer_destroy(stm32l0_rtc_timer_t *timer) { return true; }
+void stm32l0_rtc_timer_start(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_t mode) { abort(); }
+void stm32l0_rtc_timer_stop(stm32l0_rtc_timer_t *timer) { }
+
+/* ---- slaves ---- */
+
+/* A register addressed slave. The first "pointer" bytes of a write set the
+ * register address. The FIFO returns the next entry of its queue on every
+ * read; the EEPROM auto increments, takes writes a page at a time and does
+ * not acknowledge its address during the write cycle.
+ */
+typedef struct {
+    uint8_t address;
+    uint8_t pointer;
+    bool fifo;
+    uint32_t page;
+    uint64_t write_time;
+    uint32_t offset, written, popped, cycles;
+    uint64_t busy;
+    uint8_t memory[65536];
+} slave_t;
+
+#define FIFO_ADDRESS    0x68
+#define EEPROM_ADDRESS  0x50
+
+static slave_t slaves[2];
+
+static uint8_t fifo_data(uint32_t index) { return (uint8_t)((index * 13 + 5) ^ (index >> 8)); }
+static uint8_t eeprom_data(uint32_t index) { return (uint8_t)((index * 7 + 3) ^ (index >> 8)); }
+
+static slave_t *slave_lookup(uint32_t address)
+{
+    for (uint32_t index = 0; index < 2; index++)
+    {
+        if ((slaves[index].address == address) && (model_time >= slaves[index].busy))
+        {
+            return &slaves[index];
+        }
+    }
+
+    return NULL;
+}
+
+static void slave_start(slave_t *slave, bool read)
+{
+    if (!read)
+    {
+        slave->written = 0;
+    }
+}
+
+static void slave_write(slave_t *slave, uint8_t data)
+{
+    if (slave->written < slave->pointer)
+    {
+        slave->offset = ((slave->written ? slave->offset : 0) << 8) | data;
+    }
+    else
+    {
+        CHECK(!slave->fifo);
+
+        /* a page write does not cross into the next page */
+        CHECK((slave->written == slave->pointer) || (slave->offset % slave->page));
+
+        slave->memory[slave->offset] = data;
+        slave->offset = (slave->offset + 1) & 0xffff;
+    }
+
+    slave->written++;
+}
+
+static uint8_t slave_read(slave_t *slave)
+{
+    if (slave->fifo)
+    {
+        return fifo_data(slave->popped++);
+    }
+    else
+    {
+        uint8_t data = slave->memory[slave->offset];
+
+        slave->offset = (slave->offset + 1) & 0xffff;
+
+        return data;
+    }
+}
+
+static void slave_stop(slave_t *slave)
+{
+    if (!slave->fifo && (slave->written > slave->pointer))
+    {
+        slave->cycles++;
+        slave->busy = model_time + slave->write_time;
+    }
+
+    slave->written = 0;
+}
+
+/* ---- I2C1 master ---- */
+
+#define BUS_IDLE      0
+#define BUS_ADDRESS   1
+#define BUS_WRITE     2
+#define BUS_READ      3
+#define BUS_WAIT_TXDR 4
+#define BUS_WAIT_RXDR 5
+#define BUS_TCR       6
+#define BUS_TC        7
+#define BUS_STOP      8
+
+static struct {
+    uint32_t phase;
+    uint64_t until;
+    uint64_t byte;                      /* nanoseconds per byte, ACK included */
+    slave_t *slave;
+    uint32_t address, nbytes, count;
+    bool read, reload, autoend;
+    uint8_t txdr, shift, rxdr, held;
+    bool txdr_full, rxne;
+    uint32_t flags;                     /* TXIS, TC, TCR, STOPF, NACKF */
+} bus;
+
+static void dma_service(void);
+
+static void bus_end_of_count(void)
+{
+    if (bus.reload)
+    {
+        bus.flags |= I2C_ISR_TCR;
+        bus.phase = BUS_TCR;
+    }
+    else if (bus.autoend)
+    {
+        bus.phase = BUS_STOP;
+        bus.until = model_time + bus.byte / 9;
+    }
+    else
+    {
+        bus.flags |= I2C_ISR_TC;
+        bus.phase = BUS_TC;
+    }
+}
+
+static void bus_transmit(void)
+{
+    if (bus.count == bus.nbytes)
+    {
+        bus.flags &= ~I2C_ISR_TXIS;
+
+        bus_end_of_count();
+    }
+    else if (bus.txdr_full)
+    {
+        bus.shift = bus.txdr;
+        bus.txdr_full = false;
+        bus.phase = BUS_WRITE;
+        bus.until = model_time + bus.byte;
+
+        if ((bus.count + 1) < bus.nbytes)
+        {
+            bus.flags |= I2C_ISR_TXIS;
+        }
+    }
+    else
+    {
+        bus.flags |= I2C_ISR_TXIS;
+        bus.phase = BUS_WAIT_TXDR;
+    }
+}
+
+static void bus_received(uint8_t data)
+{
+    if (bus.rxne)
+    {
+        /* SCL is stretched until RXDR is read */
+        bus.held = data;
+        bus.phase = BUS_WAIT_RXDR;
+    }
+    else
+    {
+        bus.rxdr = data;
+        bus.rxne = true;
+        bus.count++;
+
+        if (bus.count == bus.nbytes)
+        {
+            bus_end_of_count();
+        }
+        else
+        {
+            bus.phase = BUS_READ;
+            bus.until = model_time + bus.byte;
+        }
+    }
+}
+
+static void bus_event(void)
+{
+    switch (bus.phase) {
+    case BUS_ADDRESS:
+        bus.slave = slave_lookup(bus.address);
+
+        if (!bus.slave)
+        {
+            bus.flags |= I2C_ISR_NACKF;
+            bus.phase = BUS_STOP;
+            bus.until = model_time + bus.byte / 9;
+        }
+        else
+        {
+            slave_start(bus.slave, bus.read);
+
+            bus.count = 0;
+
+            if (bus.read)
+            {
+                bus.phase = BUS_READ;
+                bus.until = model_time + bus.byte;
+            }
+            else
+            {
+                bus_transmit();
+            }
+        }
+        break;
+
+    case BUS_WRITE:
+        slave_write(bus.slave, bus.shift);
+        bus.count++;
+        bus_transmit();
+        break;
+
+    case BUS_READ:
+        bus_received(slave_read(bus.slave));
+        break;
+
+    case BUS_STOP:
+        if (bus.slave)
+        {
+            slave_stop(bus.slave);
+        }
+
+        bus.flags |= I2C_ISR_STOPF;
+        bus.phase = BUS_IDLE;
+        bus.slave = NULL;
+        break;
+    }
+
+    dma_service();
+}
+
+static bool bus_pending(void)
+{
+    return ((bus.phase == BUS_ADDRESS) || (bus.phase == BUS_WRITE) || (bus.phase == BUS_READ) || (bus.phase == BUS_STOP));
+}
+
+static bool i2c_irq(void)
+{
+    uint32_t cr1 = model_i2c[0].CR1.value;
+
+    return (((cr1 & I2C_CR1_TXIE) && (bus.flags & I2C_ISR_TXIS)) ||
+            ((cr1 & I2C_CR1_RXIE) && bus.rxne) ||
+            ((cr1 & I2C_CR1_TCIE) && (bus.flags & (I2C_ISR_TC | I2C_ISR_TCR))) ||
+            ((cr1 & I2C_CR1_STOPIE) && (bus.flags & I2C_ISR_STOPF)) ||
+            ((cr1 & I2C_CR1_NACKIE) && (bus.flags & I2C_ISR_NACKF)));
+}
+
+static void i2c_cr1_write(model_register_t *reg, uint32_t data)
+{
+    if (!(data & I2C_CR1_PE))
+    {
+        /* a software reset, only ever done with the bus idle */
+        CHECK(bus.phase == BUS_IDLE);
+
+        bus.flags = 0;
+        bus.rxne = false;
+        bus.txdr_full = false;
+    }
+    else
+    {
+        CHECK(periph);
+    }
+
+    reg->value = data;
+
+    dma_service();
+}
+
+static void i2c_cr2_write(model_register_t *reg, uint32_t data)
+{
+    reg->value = data & ~(I2C_CR2_START | I2C_CR2_STOP);
+
+    if (data & I2C_CR2_START)
+    {
+        CHECK(model_i2c[0].CR1.value & I2C_CR1_PE);
+        CHECK((bus.phase == BUS_IDLE) || (bus.phase == BUS_TC));
+        CHECK(!(bus.flags & I2C_ISR_STOPF));
+
+        bus.address = (data & I2C_CR2_SADD) >> 1;
+        bus.read = !!(data & I2C_CR2_RD_WRN);
+        bus.nbytes = (data & I2C_CR2_NBYTES) >> I2C_CR2_NBYTES_Pos;
+        bus.reload = !!(data & I2C_CR2_RELOAD);
+        bus.autoend = !!(data & I2C_CR2_AUTOEND);
+        bus.flags &= ~I2C_ISR_TC;
+        bus.phase = BUS_ADDRESS;
+        bus.until = model_time + bus.byte;
+
+        /* a write of no bytes is an address only, as in ACK polling */
+        CHECK(bus.nbytes || !bus.read);
+    }
+    else if (bus.phase == BUS_TCR)
+    {
+        bus.nbytes = (data & I2C_CR2_NBYTES) >> I2C_CR2_NBYTES_Pos;
+        bus.reload = !!(data & I2C_CR2_RELOAD);
+        bus.autoend = !!(data & I2C_CR2_AUTOEND);
+        bus.flags &= ~I2C_ISR_TCR;
+        bus.count = 0;
+
+        CHECK(bus.nbytes);
+
+        if (bus.read)
+        {
+            bus.phase = BUS_READ;
+            bus.until = model_time + bus.byte;
+        }
+        else
+        {
+            bus_transmit();
+        }
+    }
+    else if ((data & I2C_CR2_STOP) && (bus.phase == BUS_TC))
+    {
+        bus.flags &= ~I2C_ISR_TC;
+        bus.phase = BUS_STOP;
+        bus.until = model_time + bus.byte / 9;
+    }
+
+    dma_service();
+}
+
+static uint32_t i2c_isr_read(model_register_t *reg)
+{
+    return ((bus.txdr_full ? 0 : I2C_ISR_TXE) | (bus.rxne ? I2C_ISR_RXNE : 0) | bus.flags |
+            ((bus.phase != BUS_IDLE) ? I2C_ISR_BUSY : 0) | (bus.read ? I2C_ISR_DIR : 0));
+}
+
+static void i2c_isr_write(model_register_t *reg, uint32_t data)
+{
+    /* setting TXE flushes TXDR */
+    if (data & I2C_ISR_TXE)
+    {
+        bus.txdr_full = false;
+    }
+}
+
+static void i2c_icr_write(model_register_t *reg, uint32_t data)
+{
+    if (data & I2C_ICR_STOPCF)
+    {
+        bus.flags &= ~I2C_ISR_STOPF;
+    }
+
+    if (data & I2C_ICR_NACKCF)
+    {
+        bus.flags &= ~I2C_ISR_NACKF;
+    }
+}
+
+static void i2c_txdr_write(model_register_t *reg, uint32_t data)
+{
+    CHECK(!bus.txdr_full);
+
+    bus.txdr = data;
+    bus.txdr_full = true;
+    bus.flags &= ~I2C_ISR_TXIS;
+
+    if (bus.phase == BUS_WAIT_TXDR)
+    {
+        bus_transmit();
+    }
+}
+
+static uint32_t i2c_rxdr_read(model_register_t *reg)
+{
+    uint8_t data = bus.rxdr;
+
+    CHECK(bus.rxne);
+
+    bus.rxne = false;
+
+    if (bus.phase == BUS_WAIT_RXDR)
+    {
+        bus_received(bus.held);
+    }
+
+    return data;
+}
+
+/* ---- DMA1 ---- */
+
+static uint32_t dma_reload[7], dma_flags;
+
+static void dma_ccr_write(model_register_t *reg, uint32_t data)
+{
+    reg->value = data;
+
+    dma_service();
+}
+
+static void dma_cndtr_write(model_register_t *reg, uint32_t data)
+{
+    DMA_Channel_TypeDef *DMA = (DMA_Channel_TypeDef*)((uint8_t*)reg - offsetof(DMA_Channel_TypeDef, CNDTR));
+
+    CHECK(!(DMA->CCR.value & DMA_CCR_EN));
+
+    reg->value = data & 0xffff;
+    dma_reload[DMA - &model_dma_channel[0]] = data & 0xffff;
+}
+
+static uint32_t dma_isr_read(model_register_t *reg) { return dma_flags; }
+static void dma_ifcr_write(model_register_t *reg, uint32_t data) { dma_flags &= ~data; }
+
+static void dma_service(void)
+{
+    DMA_Channel_TypeDef *DMA;
+    uint32_t channel, index;
+    bool busy;
+
+    do
+    {
+        busy = false;
+
+        for (channel = 0; channel < 7; channel++)
+        {
+            DMA = &model_dma_channel[channel];
+
+            if (!(DMA->CCR.value & DMA_CCR_EN) || !DMA->CNDTR.value)
+            {
+                continue;
+            }
+
+            index = dma_reload[channel] - DMA->CNDTR.value;
+
+            if ((DMA->CPAR.value == (uint32_t)(uintptr_t)&model_i2c[0].RXDR) && (model_i2c[0].CR1.value & I2C_CR1_RXDMAEN) && bus.rxne)
+            {
+                CHECK(!(DMA->CCR.value & DMA_CCR_DIR));
+                CHECK(((model_dma_cselr.CSELR >> (channel * 4)) & 15) == 6);
+
+                ((uint8_t*)(uintptr_t)DMA->CMAR.value)[index] = (uint8_t)model_i2c[0].RXDR;
+            }
+            else if ((DMA->CPAR.value == (uint32_t)(uintptr_t)&model_i2c[0].TXDR) && (model_i2c[0].CR1.value & I2C_CR1_TXDMAEN) && (bus.flags & I2C_ISR_TXIS))
+            {
+                CHECK(DMA->CCR.value & DMA_CCR_DIR);
+                CHECK(((model_dma_cselr.CSELR >> (channel * 4)) & 15) == 6);
+
+                model_i2c[0].TXDR = ((const uint8_t*)(uintptr_t)DMA->CMAR.value)[index];
+            }
+            else
+            {
+                continue;
+            }
+
+            DMA->CNDTR.value--;
+
+            if (!DMA->CNDTR.value)
+            {
+                dma_flags |= ((DMA_ISR_GIF1 | DMA_ISR_TCIF1) << (channel * 4));
+            }
+
+            busy = true;
+        }
+    }
+    while (busy);
+}
+
+/* ---- transfers ---- */
+
+#define MODE_VARIANT    0                       /* RX DMA only, as in the variants */
+#define MODE_NO_DMA     1
+#define MODE_TX_DMA     2
+
+static uint32_t mode, irqs, mark_irqs;
+static uint64_t mark_time;
+static uint8_t data[65536 + 2], source[256];
+
+/* The driver keeps pointers in 32 bit registers and atomics. TwoWire puts its
+ * transactions on the stack, so the test runs on a static stack, which like
+ * all other data of a -no-pie binary lies below 4 GiB.
+ */
+static uint8_t test_stack[256 * 1024] __attribute__((aligned(16)));
+static ucontext_t main_context, test_context;
+
+static uint32_t run_interrupts(void)
+{
+    uint32_t storm = 0, count = 0;
+
+    while ((model_nvic_enabled & (1u << I2C1_IRQn)) && ((model_nvic_pending & (1u << I2C1_IRQn)) || i2c_irq()))
+    {
+        model_nvic_pending &= ~(1u << I2C1_IRQn);
+
+        model_irq = I2C1_IRQn;
+        I2C1_IRQHandler();
+        model_irq = -16;
+
+        irqs++;
+        count++;
+
+        /* an interrupt that keeps coming without the bus moving on */
+        CHECK(++storm < 64);
+    }
+
+    return count;
+}
+
+void armv6m_task_wfe(void)
+{
+    if (!run_interrupts())
+    {
+        /* nothing else would wake the task */
+        CHECK(bus_pending());
+
+        model_time = bus.until;
+
+        bus_event();
+        run_interrupts();
+    }
+}
+
+static void settle(void)
+{
+    run_interrupts();
+
+    while (bus_pending())
+    {
+        model_time = bus.until;
+
+        bus_event();
+        run_interrupts();
+    }
+}
+
+static void mark(void)
+{
+    settle();
+
+    mark_time = model_time;
+    mark_irqs = irqs;
+}
+
+static uint32_t report(const char *name, uint32_t size)
+{
+    uint64_t time;
+
+    settle();
+
+    time = model_time - mark_time;
+
+    printf("%-22s %5u bytes %9.3f ms %5.1f%% payload %6u irqs\n", name, size, time / 1e6, (100.0 * size * bus.byte) / time, irqs - mark_irqs);
+
+    return irqs - mark_irqs;
+}
+
+/* ACK polling, as EEPROM drivers wait out the write cycle */
+static void eeprom_poll(void)
+{
+    uint8_t status;
+
+    while (true)
+    {
+        Wire.beginTransmission(EEPROM_ADDRESS);
+
+        if ((status = Wire.endTransmission()) != 2)
+        {
+            break;
+        }
+
+        model_time += 100000;
+    }
+
+    CHECK(status == 0);
+}
+
+static void run(void)
+{
+    uint8_t pointer[2];
+    uint32_t index, offset, count, popped, cycles, chunked, direct, taken;
+
+    /* FIFO, 256 bytes */
+    popped = slaves[0].popped;
+
+    mark();
+
+    for (index = 0; index < 256; index += BUFFER_LENGTH)
+    {
+        Wire.beginTransmission(FIFO_ADDRESS);
+        Wire.write(0x74);
+        CHECK(Wire.endTransmission(false) == 0);
+        CHECK(Wire.requestFrom(FIFO_ADDRESS, (size_t)BUFFER_LENGTH) == BUFFER_LENGTH);
+
+        for (offset = 0; offset < BUFFER_LENGTH; offset++)
+        {
+            CHECK(Wire.read() == fifo_data(popped + index + offset));
+        }
+
+        CHECK(Wire.read() == -1);
+    }
+
+    chunked = report("fifo read, chunks", 256);
+
+    popped = slaves[0].popped;
+
+    mark();
+
+    Wire.beginTransmission(FIFO_ADDRESS);
+    Wire.write(0x74);
+    CHECK(Wire.endTransmission(false) == 0);
+    CHECK(Wire.requestFrom(FIFO_ADDRESS, &data[0], 256) == 256);
+    CHECK(Wire.available() == 256);
+
+    for (offset = 0; offset < 256; offset++)
+    {
+        CHECK(Wire.read() == fifo_data(popped + offset));
+    }
+
+    CHECK(Wire.read() == -1);
+
+    direct = report("fifo read", 256);
+
+    CHECK(direct < chunked);
+
+    /* EEPROM, 512 bytes */
+    mark();
+
+    for (index = 0; index < 512; index += BUFFER_LENGTH)
+    {
+        Wire.beginTransmission(EEPROM_ADDRESS);
+        Wire.write((0x1000 + index) >> 8);
+        Wire.write((0x1000 + index) & 0xff);
+        CHECK(Wire.endTransmission(false) == 0);
+        CHECK(Wire.requestFrom(EEPROM_ADDRESS, (size_t)BUFFER_LENGTH) == BUFFER_LENGTH);
+        CHECK(Wire.read(&data[index], BUFFER_LENGTH) == BUFFER_LENGTH);
+    }
+
+    CHECK(!memcmp(&data[0], &slaves[1].memory[0x1000], 512));
+
+    report("eeprom read, chunks", 512);
+
+    memset(data, 0, sizeof(data));
+
+    mark();
+
+    pointer[0] = 0x10;
+    pointer[1] = 0x00;
+
+    CHECK(Wire.transfer(EEPROM_ADDRESS, pointer, 2, &data[0], 512) == 0);
+    CHECK(!memcmp(&data[0], &slaves[1].memory[0x1000], 512));
+
+    report("eeprom read", 512);
+
+    /* EEPROM, all of it; requestFrom() takes at most 65535 bytes */
+    memset(data, 0, sizeof(data));
+
+    pointer[0] = 0x00;
+    pointer[1] = 0x00;
+
+    CHECK(Wire.transfer(EEPROM_ADDRESS, pointer, 2, NULL, 0, false) == 0);
+
+    mark();
+
+    CHECK(Wire.requestFrom(EEPROM_ADDRESS, &data[0], 65536) == 65535);
+    CHECK(Wire.available() == 65535);
+    CHECK(!memcmp(&data[0], &slaves[1].memory[0], 65535));
+    CHECK(!data[65535]);
+
+    taken = report("eeprom read, 64 KiB", 65535);
+
+    /* With RX DMA only the leading bytes are reloaded one by one, the last
+     * I2C_CR2_NBYTES_MAX come in one go. Add the interrupt that starts the
+     * transaction and the one at STOP.
+     */
+    if (g_Wire.rx_dma != STM32L0_DMA_CHANNEL_NONE)
+    {
+        CHECK(taken == ((65535 - I2C_CR2_NBYTES_MAX) + 2));
+    }
+
+    /* EEPROM page write, 256 bytes */
+    for (index = 0; index < 256; index++)
+    {
+        source[index] = (uint8_t)(index * 5 + 1);
+    }
+
+    cycles = slaves[1].cycles;
+
+    mark();
+
+    for (index = 0; index < 256; index += count)
+    {
+        count = ((256 - index) < (BUFFER_LENGTH - 2)) ? (256 - index) : (BUFFER_LENGTH - 2);
+
+        Wire.beginTransmission(EEPROM_ADDRESS);
+        Wire.write((0x2000 + index) >> 8);
+        Wire.write((0x2000 + index) & 0xff);
+        CHECK(Wire.write(&source[index], 256 - index) == count);
+        CHECK(Wire.endTransmission() == 0);
+
+        eeprom_poll();
+    }
+
+    CHECK(!memcmp(&slaves[1].memory[0x2000], source, 256));
+    CHECK((slaves[1].cycles - cycles) == ((256 + BUFFER_LENGTH - 3) / (BUFFER_LENGTH - 2)));
+
+    report("eeprom write, chunks", 256);
+
+    cycles = slaves[1].cycles;
+
+    mark();
+
+    Wire.beginTransmission(EEPROM_ADDRESS, &data[0], 258);
+    Wire.write(0x30);
+    Wire.write(0x00);
+    CHECK(Wire.write(source, 256) == 256);
+    CHECK(Wire.write(0) == 0);
+    CHECK(Wire.endTransmission() == 0);
+
+    eeprom_poll();
+
+    CHECK(!memcmp(&slaves[1].memory[0x3000], source, 256));
+    CHECK((slaves[1].cycles - cycles) == 1);
+
+    report("eeprom write", 256);
+
+    /* limits */
+    CHECK(Wire.transfer(EEPROM_ADDRESS, pointer, 2, &data[0], 65536) == 1);
+    CHECK(Wire.transfer(EEPROM_ADDRESS, &data[0], 65536, NULL, 0) == 1);
+
+    Wire.beginTransmission(EEPROM_ADDRESS, &data[0], 65536);
+    CHECK(Wire.write(0) == 0);
+    CHECK(Wire.endTransmission() == 1);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t index;
+
+    mode = strtoul(argv[1], NULL, 0);
+
+    /* Wire's constructor has already taken the variant's channels */
+    if (mode == MODE_NO_DMA)
+    {
+        g_Wire.rx_dma = STM32L0_DMA_CHANNEL_NONE;
+    }
+
+    if (mode == MODE_TX_DMA)
+    {
+        g_Wire.tx_dma = STM32L0_DMA_CHANNEL_DMA1_CH6_I2C1_TX;
+    }
+
+    model_i2c[0].CR1.write = i2c_cr1_write;
+    model_i2c[0].CR2.write = i2c_cr2_write;
+    model_i2c[0].ISR.read = i2c_isr_read;
+    model_i2c[0].ISR.write = i2c_isr_write;
+    model_i2c[0].ICR.write = i2c_icr_write;
+    model_i2c[0].TXDR.write = i2c_txdr_write;
+    model_i2c[0].RXDR.read = i2c_rxdr_read;
+
+    for (index = 0; index < 7; index++)
+    {
+        model_dma_channel[index].CCR.write = dma_ccr_write;
+        model_dma_channel[index].CNDTR.write = dma_cndtr_write;
+    }
+
+    model_dma.ISR.read = dma_isr_read;
+    model_dma.IFCR.write = dma_ifcr_write;
+
+    bus.byte = (9 * 1000000000ull) / 400000;
+
+    slaves[0].address = FIFO_ADDRESS;
+    slaves[0].pointer = 1;
+    slaves[0].fifo = true;
+
+    slaves[1].address = EEPROM_ADDRESS;
+    slaves[1].pointer = 2;
+    slaves[1].page = 256;
+    slaves[1].write_time = 5000000;
+
+    for (index = 0; index < 65536; index++)
+    {
+        slaves[1].memory[index] = eeprom_data(index);
+    }
+
+    model_time = 1000000000ull;
+
+    Wire.begin();
+    Wire.setClock(400000);
+    run_interrupts();
+
+    getcontext(&test_context);
+    test_context.uc_stack.ss_sp = test_stack;
+    test_context.uc_stack.ss_size = sizeof(test_stack);
+    test_context.uc_link = &main_context;
+    makecontext(&test_context, run, 0);
+
+    CHECK(swapcontext(&main_context, &test_context) == 0);
+
+    settle();
+
+    CHECK(bus.phase == BUS_IDLE);
+    CHECK(!locks);
+    CHECK(!periph);
+
+    return 0;
+}
+'''
+
+MODES = ("variant", "no dma", "tx dma")
+
+def main():
+    device = open(DEVICE).read()
+    gpio = open(os.path.join(INCLUDE, "stm32l0_gpio.h")).read()
+    defines = "\n".join(re.findall(r"^#define (?:I2C|DMA|RCC_AHBENR|RCC_AHBSMENR|FLASH_ACR|SYSCFG_CFGR2|EXTI_IMR)_\w*[ \t]+[^\n]*", device, flags=re.M))
+    files = (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX % defines),
+             ("stm32l0_gpio.h", GPIO % "\n".join(sorted(set(re.findall(r"^#define STM32L0_GPIO_(?:PARK|PUPD|OSPEED|OTYPE|MODE)_\w*[ \t]+[^\n]*", gpio, flags=re.M))))),
+             ("Arduino.h", ARDUINO), ("wiring_private.h", "#pragma once\n"), ("variant.h", "#pragma once\n#define WIRE_INTERFACES_COUNT 1\n"),
+             ("Stream.h", STREAM), ("harness.cpp", HARNESS))
+    with tempfile.TemporaryDirectory() as directory:
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        # copied, so that their includes resolve to the stand-ins
+        for source in SOURCES + ("cores/arduino/Callback.cpp", "cores/arduino/Callback.h"):
+            shutil.copy(os.path.join(ROOT, source), directory)
+        flags = [ "g++", "-O2", "-g", "-w", "-std=gnu++11", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory,
+                  "-I" + os.path.join(ROOT, "libraries/Wire/src"), "-I" + INCLUDE ]
+        objects = []
+        for source in (os.path.join(ROOT, "libraries/Wire/src/Wire.cpp"), os.path.join(directory, "Callback.cpp")):
+            objects.append(os.path.join(directory, os.path.basename(source) + ".o"))
+            subprocess.check_call(flags + [ "-c", source, "-o", objects[-1] ])
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call(flags + [ os.path.join(directory, "harness.cpp") ] + objects + [ "-o", binary ])
+        failed = False
+        for index, name in enumerate(MODES):
+            run = subprocess.run([ binary, str(index) ], capture_output=True, text=True)
+            output = run.stdout.strip()
+            print("%s:\n  %s" % (name, output.replace("\n", "\n  ")))
+            if run.returncode or "fail:" in output:
+                failed = True
+    assert not failed
+    print("OK")
+
+if __name__ == "__main__":
+    main()
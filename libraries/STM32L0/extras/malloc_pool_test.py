@@ -0,0 +1,483 @@
+#!/usr/bin/env python3
+#
+# Host stress test of the size class pool in syscalls_stm32l0.c. The pool
+# and the malloc()/free()/calloc()/realloc() front ends are taken from the
+# source (renamed, so that they do not replace the host's), and compiled
+# with the host gcc against a small armv6m.h stand-in. The newlib heap
+# behind them is a first fit allocator over a static arena, so that all
+# pointers fit the 32 bit casts the code does.
+#
+# A preemption point follows every statement of malloc_pool_alloc() and
+# malloc_pool_free(), where an interrupt handler may come in and allocate
+# or free pool blocks itself, nesting up to three levels deep. Thread mode
+# and the handlers run a random mix of all front ends with sizes around
+# and above the largest class, filling each block with a pattern.
+#
+# Checked are: no block is handed out while it is live (the ABA case of a
+# pop interrupted by a pop and push of the same block included), contents
+# survive realloc(), malloc_usable_size() covers the request, calloc()
+# zeroes, small requests fall back to the heap only once the pool is used
+# up, the pool itself never goes through an SVCall, and once everything is
+# freed the statistics add up.
+#
+#   python3 malloc_pool_test.py [operations] [seed]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = "cores/arduino/syscalls_stm32l0.c"
+
+SHIM = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+extern uint32_t model_ipsr, model_svcalls;
+extern void model_preempt(void);
+
+static inline uint32_t __get_IPSR(void) { return model_ipsr; }
+
+static inline uint32_t __armv6m_atomic_add(volatile uint32_t *p_data, uint32_t data) { uint32_t data_return = *p_data; *p_data = data_return + data; return data_return; }
+static inline uint32_t __armv6m_atomic_sub(volatile uint32_t *p_data, uint32_t data) { uint32_t data_return = *p_data; *p_data = data_return - data; return data_return; }
+static inline uint32_t __armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data) { uint32_t data_return = *p_data; if (data_return == data_expected) { *p_data = data; } return data_return; }
+
+static inline uint32_t armv6m_svcall_2(uint32_t routine, uint32_t r0, uint32_t r1)
+{
+    model_svcalls++;
+    return (uint32_t)((uintptr_t (*)(uintptr_t, uintptr_t))(uintptr_t)routine)(r0, r1);
+}
+
+static inline uint32_t armv6m_svcall_3(uint32_t routine, uint32_t r0, uint32_t r1, uint32_t r2)
+{
+    model_svcalls++;
+    return (uint32_t)((uintptr_t (*)(uintptr_t, uintptr_t, uintptr_t))(uintptr_t)routine)(r0, r1, r2);
+}
+
+#define _REENT ((void*)0)
+
+extern void *_malloc_r(void *reent, size_t nbytes);
+extern void _free_r(void *reent, void *aptr);
+extern void *_realloc_r(void *reent, void *aptr, size_t nbytes);
+extern void *_memalign_r(void *reent, size_t align, size_t nbytes);
+extern size_t _malloc_usable_size_r(void *reent, void *aptr);
+
+#define malloc             pool_malloc
+#define free               pool_free
+#define calloc             pool_calloc
+#define realloc            pool_realloc
+#define reallocf           pool_reallocf
+#define memalign           pool_memalign
+#define malloc_usable_size pool_malloc_usable_size
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "malloc_pool.h"
+#include "pool.c"
+#include <stdio.h>
+
+#define FAIL(...) do { printf("fail\t" __VA_ARGS__); printf("\n"); exit(1); } while (0)
+#define CHECK(c) do { if (!(c)) FAIL("%s:%d\t%s", __FILE__, __LINE__, #c); } while (0)
+
+uint32_t model_ipsr, model_svcalls;
+
+/* newlib heap: exact fit free lists per 16 byte size over a static arena,
+ * a header word holds the size
+ */
+#define ARENA_SIZE (4 * 1024 * 1024)
+#define ARENA_LISTS 256
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(16)));
+static uint32_t arena_top;
+static uint32_t *arena_free[ARENA_LISTS];
+
+void *_malloc_r(void *reent, size_t nbytes)
+{
+    uint32_t *block, size;
+
+    if (nbytes > ((ARENA_LISTS - 1) * 16))
+    {
+        return NULL;
+    }
+
+    size = (nbytes + 15) & ~15u;
+
+    block = arena_free[size / 16];
+
+    if (block)
+    {
+        arena_free[size / 16] = *(uint32_t**)&block[2];
+        return &block[4];
+    }
+
+    if (arena_top + 16 + size > ARENA_SIZE)
+    {
+        return NULL;
+    }
+
+    block = (uint32_t*)&arena[arena_top];
+    block[0] = size;
+    arena_top += 16 + size;
+
+    return &block[4];
+}
+
+void _free_r(void *reent, void *aptr)
+{
+    uint32_t *block = (uint32_t*)aptr - 4;
+
+    if (aptr)
+    {
+        CHECK(((uint8_t*)aptr > arena) && ((uint8_t*)aptr < &arena[ARENA_SIZE]));
+        *(uint32_t**)&block[2] = arena_free[block[0] / 16];
+        arena_free[block[0] / 16] = block;
+    }
+}
+
+size_t _malloc_usable_size_r(void *reent, void *aptr)
+{
+    return ((uint32_t*)aptr)[-4];
+}
+
+void *_realloc_r(void *reent, void *aptr, size_t nbytes)
+{
+    void *nptr;
+
+    if (aptr && (_malloc_usable_size_r(reent, aptr) >= nbytes))
+    {
+        return aptr;
+    }
+
+    nptr = _malloc_r(reent, nbytes);
+
+    if (nptr && aptr)
+    {
+        memcpy(nptr, aptr, _malloc_usable_size_r(reent, aptr));
+        _free_r(reent, aptr);
+    }
+
+    return nptr;
+}
+
+void *_memalign_r(void *reent, size_t align, size_t nbytes)
+{
+    return _malloc_r(reent, nbytes);
+}
+
+/* live blocks, with the pattern they were filled with */
+#define LIVE 512
+
+typedef struct {
+    uint8_t *ptr;
+    uint32_t size;
+    uint8_t  fill;
+} live_t;
+
+static live_t live[LIVE];
+static unsigned int live_count, level, rate, depth_max;
+static uint32_t rng_state = 1;
+static uint64_t operations, irqs, pooled, fallbacks;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static bool in_pool(const void *ptr)
+{
+    return malloc_pool.base && ((const uint8_t*)ptr >= malloc_pool.base) && ((const uint8_t*)ptr < (malloc_pool.base + STM32L0_MALLOC_POOL_SIZE));
+}
+
+static void verify(const live_t *l)
+{
+    uint32_t i;
+
+    for (i = 0; i < l->size; i++)
+    {
+        if (l->ptr[i] != (uint8_t)(l->fill + i))
+        {
+            FAIL("block %p (%u bytes) corrupted at %u", l->ptr, l->size, i);
+        }
+    }
+}
+
+static void fill(live_t *l)
+{
+    uint32_t i;
+
+    for (i = 0; i < l->size; i++)
+    {
+        l->ptr[i] = (uint8_t)(l->fill + i);
+    }
+}
+
+static void add(uint8_t *ptr, uint32_t size)
+{
+    unsigned int i;
+
+    CHECK(live_count < LIVE);
+
+    for (i = 0; i < live_count; i++)
+    {
+        if ((ptr < (live[i].ptr + (live[i].size ? live[i].size : 1))) && (live[i].ptr < (ptr + (size ? size : 1))))
+        {
+            FAIL("%p (%u bytes) overlaps live %p (%u bytes)", ptr, size, live[i].ptr, live[i].size);
+        }
+    }
+
+    if (in_pool(ptr))
+    {
+        CHECK(size <= MALLOC_POOL_BLOCK_MAX);
+
+        pooled++;
+    }
+
+    CHECK(pool_malloc_usable_size(ptr) >= size);
+
+    live[live_count].ptr = ptr;
+    live[live_count].size = size;
+    live[live_count].fill = rng();
+    fill(&live[live_count]);
+    live_count++;
+}
+
+static live_t take(unsigned int index)
+{
+    live_t l = live[index];
+
+    live[index] = live[--live_count];
+    verify(&l);
+
+    return l;
+}
+
+static uint32_t size_random(void)
+{
+    switch (rng() % 8) {
+    case 0:  return rng() % 1024;
+    case 1:  return 256 + (rng() % 8) - 4;
+    default: return rng() % 96;
+    }
+}
+
+static void operation(void)
+{
+    uint32_t size, svcalls;
+    uint8_t *ptr, *base;
+    int class;
+    live_t l;
+    unsigned int i;
+
+    operations++;
+
+    if (live_count && ((live_count >= (LIVE - 8)) || ((rng() % 100) < 45)))
+    {
+        l = take(rng() % live_count);
+
+        if (rng() & 1)
+        {
+            svcalls = model_svcalls;
+            pool_free(l.ptr);
+            CHECK(!in_pool(l.ptr) || (model_svcalls == svcalls));
+        }
+        else
+        {
+            /* realloc() keeps the contents up to the smaller size */
+            size = size_random();
+            ptr = (uint8_t*)pool_realloc(l.ptr, size);
+
+            if (size == 0 && in_pool(l.ptr))
+            {
+                CHECK(ptr == NULL);
+                return;
+            }
+
+            CHECK(ptr);
+
+            for (i = 0; (i < size) && (i < l.size); i++)
+            {
+                CHECK(ptr[i] == (uint8_t)(l.fill + i));
+            }
+
+            add(ptr, size);
+        }
+        return;
+    }
+
+    size = size_random();
+    base = malloc_pool.base;
+    svcalls = model_svcalls;
+
+    if (rng() & 1)
+    {
+        ptr = (uint8_t*)pool_malloc(size);
+        CHECK(ptr);
+    }
+    else
+    {
+        ptr = (uint8_t*)pool_calloc(1, size);
+        CHECK(ptr);
+        for (i = 0; i < size; i++)
+        {
+            CHECK(ptr[i] == 0);
+        }
+    }
+
+    /* only taking the region from the heap needs an SVCall */
+    CHECK(!in_pool(ptr) || (model_svcalls == svcalls) || (base == NULL));
+
+    class = malloc_pool_class(size);
+
+    if ((class >= 0) && !in_pool(ptr))
+    {
+        fallbacks++;
+
+        /* without interrupts, only once the pool is used up for the class */
+        if (rate == 0)
+        {
+            CHECK(((malloc_pool.head[class] & 0xffff) == 0) && ((malloc_pool.carved + malloc_pool_class_size[class]) > STM32L0_MALLOC_POOL_SIZE));
+        }
+    }
+
+    add(ptr, size);
+}
+
+void model_preempt(void)
+{
+    uint32_t ipsr;
+
+    if ((level < 3) && ((rng() % 100) < rate))
+    {
+        level++;
+        irqs++;
+
+        if (level > depth_max)
+        {
+            depth_max = level;
+        }
+
+        ipsr = model_ipsr;
+        model_ipsr = 16 + level;
+
+        operation();
+
+        model_ipsr = ipsr;
+        level--;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct malloc_pool_stats stats;
+    unsigned long count = strtoul(argv[1], NULL, 0);
+    unsigned int class;
+    uint32_t used, blocks, heap;
+    unsigned long n;
+
+    rng_state = strtoul(argv[2], NULL, 0);
+    rate = strtoul(argv[3], NULL, 0);
+
+    /* the first small request takes the pool region from the heap */
+    CHECK(pool_malloc_usable_size(pool_malloc(300)) >= 300);
+    malloc_pool_stats(&stats);
+    CHECK(stats.size == 0);
+
+    for (n = 0; n < count; n++)
+    {
+        operation();
+
+        malloc_pool_stats(&stats);
+
+        for (class = 0, used = 0; class < MALLOC_POOL_CLASS_COUNT; class++)
+        {
+            CHECK(stats.classes[class].used <= stats.classes[class].blocks);
+            CHECK(stats.classes[class].used <= stats.classes[class].used_max);
+            CHECK(stats.classes[class].used_max <= stats.classes[class].blocks);
+            used += stats.classes[class].used * stats.classes[class].size;
+        }
+        CHECK(used <= stats.carved && stats.carved <= stats.size);
+    }
+
+    CHECK(pool_calloc(2, ((size_t)~0 / 2) + 1) == NULL && errno == ENOMEM);
+
+    while (live_count)
+    {
+        pool_free(take(0).ptr);
+    }
+
+    malloc_pool_stats(&stats);
+
+    CHECK(stats.size == STM32L0_MALLOC_POOL_SIZE);
+    CHECK(stats.fallbacks >= fallbacks);
+    CHECK(stats.granted >= stats.requested);
+
+    for (class = 0, used = 0, blocks = 0; class < MALLOC_POOL_CLASS_COUNT; class++)
+    {
+        CHECK(stats.classes[class].used == 0);
+        used += stats.classes[class].allocs;
+        blocks += stats.classes[class].blocks * stats.classes[class].size;
+    }
+    CHECK(blocks == stats.carved);
+
+    printf("operations\t%llu (%llu in interrupt handlers, nesting %u deep)\n", (unsigned long long)operations, (unsigned long long)irqs, depth_max);
+    printf("pool\t%u of %u bytes carved, %u allocations, %llu served from the pool, %u fell back to the heap\n",
+           stats.carved, stats.size, used, (unsigned long long)pooled, stats.fallbacks);
+    printf("classes");
+    for (class = 0; class < MALLOC_POOL_CLASS_COUNT; class++)
+    {
+        printf("\t%u: %u blocks, used_max %u", stats.classes[class].size, stats.classes[class].blocks, stats.classes[class].used_max);
+    }
+    printf("\nrounding\t%u bytes requested, %u granted\n", stats.requested, stats.granted);
+
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+def main():
+    count = sys.argv[1] if len(sys.argv) > 1 else "200000"
+    seeds = [ int(sys.argv[2]) ] if len(sys.argv) > 2 else range(1, 5)
+    source = open(os.path.join(ROOT, SOURCE)).read()
+    start = source.index("/* Small blocks come from a pool")
+    end = source.index("\n}\n", source.index("\nsize_t malloc_usable_size(")) + 3
+    pool = source[start:end]
+    pool = instrument(pool, "malloc_pool_alloc")
+    pool = instrument(pool, "malloc_pool_free")
+    with tempfile.TemporaryDirectory() as directory:
+        for name, text in (("armv6m.h", SHIM), ("pool.c", pool), ("harness.c", HARNESS)):
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "gcc", "-O2", "-g", "-w", "-fno-pie", "-no-pie", "-I" + directory,
+                                "-I" + os.path.join(ROOT, "cores/arduino"), os.path.join(directory, "harness.c"), "-o", binary ])
+        for seed in seeds:
+            for rate in (0, 5, 20):
+                run = subprocess.run([ binary, count, str(seed), str(rate) ], capture_output=True, text=True)
+                print("seed %d, preemption rate %d%%" % (seed, rate))
+                print("  " + run.stdout.rstrip().replace("\n", "\n  "))
+                assert run.returncode == 0 and "fail" not in run.stdout, run.returncode
+    print("OK")
+
+if __name__ == "__main__":
+    main()
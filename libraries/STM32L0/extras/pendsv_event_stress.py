@@ -0,0 +1,387 @@
+#!/usr/bin/env python3
+#
+# Host stress test of the caller owned PendSV events in armv6m_pendsv.c.
+# armv6m_pendsv_event_post() and armv6m_pendsv_event_process() are compiled
+# from the source with the host gcc, against a small armv6m.h stand-in; the
+# naked PendSV_Handler() is replaced by the model.
+#
+# The model runs thread mode, PendSV and three interrupt priorities on one
+# host thread. A preemption point follows every statement of the post and
+# process routines (and every atomic operation), so an interrupt may come
+# in anywhere PRIMASK is clear, and PendSV is taken as soon as the model is
+# back in thread mode. Producers at all three interrupt priorities and in
+# thread mode post a shared set of events with increasing data, so posts
+# of the same event nest within each other and with its routine. Some
+# routines post events again, including their own.
+#
+# Checked are: each post that returned true leads to exactly one routine
+# call and each coalesced post (false) to none, matching the
+# "event_coalesced" statistic; a routine is never entered while it is
+# already running, and only from PendSV; every call passes a value that
+# was posted to that event; and once the model goes idle, nothing is
+# pending and the last value delivered for each event is the last value
+# stored into it, i.e. no update gets lost.
+#
+#   python3 pendsv_event_stress.py [steps] [seed]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+SHIM = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARMV6M_TRACE_EVENT(_type, _id, _data)
+
+typedef struct { volatile uint32_t ICSR; } model_scb_t;
+extern model_scb_t model_scb;
+extern uint32_t model_primask;
+extern void model_preempt(void);
+
+#define SCB (&model_scb)
+#define SCB_ICSR_PENDSVSET_Msk (1ul << 28)
+#define PendSV_IRQn (-2)
+#define ARMV6M_IRQ_PRIORITY_PENDSV 3
+#define NVIC_SetPriority(_irq, _priority)
+#define HardFault_Handler abort
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __disable_irq(void) { model_preempt(); model_primask = 1; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; model_preempt(); }
+
+static inline uint32_t __armv6m_atomic_swap(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_previous;
+
+    model_preempt();
+    data_previous = *p_data;
+    *p_data = data;
+    model_preempt();
+    return data_previous;
+}
+
+static inline uint32_t __armv6m_atomic_or(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_previous;
+
+    model_preempt();
+    data_previous = *p_data;
+    *p_data = data_previous | data;
+    model_preempt();
+    return data_previous;
+}
+
+static inline uint32_t __armv6m_atomic_and(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_previous;
+
+    model_preempt();
+    data_previous = *p_data;
+    *p_data = data_previous & data;
+    model_preempt();
+    return data_previous;
+}
+
+static inline uint32_t __armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_previous;
+
+    model_preempt();
+    data_previous = *p_data;
+    if (data_previous == data_expected)
+    {
+        *p_data = data;
+    }
+    model_preempt();
+    return data_previous;
+}
+
+static inline uint32_t armv6m_atomic_add(volatile uint32_t *p_data, uint32_t data)
+{
+    return (*p_data += data) - data;
+}
+
+#include "armv6m_pendsv.h"
+
+#endif /* _ARMV6M_H */
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include <stdio.h>
+
+#include "pendsv.c"
+
+#define EVENTS      12
+#define LEVELS      5   /* thread, PendSV, IRQ 1..3 */
+#define LEVEL_PENDSV 1
+
+#define FAIL(...) do { printf("fail\t" __VA_ARGS__); printf("\n"); exit(1); } while (0)
+#define CHECK(c) do { if (!(c)) FAIL("%s:%d\t%s", __FILE__, __LINE__, #c); } while (0)
+
+model_scb_t model_scb;
+uint32_t model_primask;
+
+static unsigned int level, depth;
+static unsigned int rate;
+
+typedef struct {
+    armv6m_pendsv_event_t event;
+    uint32_t delivered;      /* last value delivered */
+    uint32_t queued;         /* posts returning true */
+    uint32_t coalesced;      /* posts returning false */
+    uint32_t calls;
+    bool     running;
+} model_event_t;
+
+static model_event_t events[EVENTS];
+static uint32_t value_next = 1;
+static uint32_t posted_owner[1 << 25];
+static uint64_t irqs[LEVELS], pendsvs, nested_posts;
+static unsigned int posting[EVENTS];
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void post(unsigned int index)
+{
+    model_event_t *e = &events[index];
+    uint32_t value;
+
+    value = value_next++;
+    if (value >= (1u << 25))
+    {
+        FAIL("value range");
+    }
+    posted_owner[value] = index + 1;
+    if (posting[index])
+    {
+        nested_posts++;
+    }
+    posting[index]++;
+    if (armv6m_pendsv_event_post(&e->event, value))
+    {
+        e->queued++;
+    }
+    else
+    {
+        e->coalesced++;
+    }
+    posting[index]--;
+}
+
+static void irq(unsigned int irq_level)
+{
+    unsigned int n, count, level_previous = level;
+
+    level = irq_level;
+    irqs[irq_level]++;
+
+    count = 1 + (rng() % 3);
+    for (n = 0; n < count; n++)
+    {
+        post(rng() % EVENTS);
+        model_preempt();
+    }
+
+    level = level_previous;
+}
+
+static void pendsv(void)
+{
+    unsigned int level_previous = level;
+
+    level = LEVEL_PENDSV;
+    pendsvs++;
+
+    /* same checks as PendSV_Handler() for the event part */
+    if (armv6m_pendsv_control.event_submit != ARMV6M_PENDSV_EVENT_TAIL)
+    {
+        armv6m_pendsv_event_process();
+    }
+
+    level = level_previous;
+}
+
+void model_preempt(void)
+{
+    unsigned int irq_level;
+
+    if (model_primask)
+    {
+        return;
+    }
+
+    if (depth > 64)
+    {
+        return;
+    }
+    depth++;
+
+    if ((rng() % 100) < rate)
+    {
+        irq_level = 2 + (rng() % 3);
+
+        if (irq_level > level)
+        {
+            irq(irq_level);
+        }
+    }
+
+    /* PendSV tail chains once nothing above thread mode is active */
+    while ((level == 0) && (model_scb.ICSR & SCB_ICSR_PENDSVSET_Msk))
+    {
+        model_scb.ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+        pendsv();
+    }
+
+    depth--;
+}
+
+static void routine(void *context, uint32_t data)
+{
+    model_event_t *e = (model_event_t*)context;
+    unsigned int index = e - &events[0];
+
+    CHECK(level == LEVEL_PENDSV);
+    CHECK(!e->running);
+    CHECK(posted_owner[data] == index + 1);
+
+    e->running = true;
+    e->calls++;
+    e->delivered = data;
+
+    model_preempt();
+
+    /* some routines chain into other events, or post themselves again */
+    if ((rng() % 8) == 0)
+    {
+        post((rng() & 1) ? index : (rng() % EVENTS));
+    }
+
+    model_preempt();
+
+    e->running = false;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int index, step, steps, seed;
+    uint64_t queued = 0, coalesced = 0, calls = 0;
+    armv6m_pendsv_statistics_t statistics;
+
+    steps = (argc > 1) ? atoi(argv[1]) : 200000;
+    seed = (argc > 2) ? atoi(argv[2]) : 1;
+    rate = (argc > 3) ? atoi(argv[3]) : 30;
+
+    rng_state = 0x9e3779b9u ^ (seed * 2654435761u);
+
+    __armv6m_pendsv_initialize();
+
+    for (index = 0; index < EVENTS; index++)
+    {
+        armv6m_pendsv_event_create(&events[index].event, routine, &events[index]);
+    }
+
+    for (step = 0; step < steps; step++)
+    {
+        if ((rng() % 4) == 0)
+        {
+            post(rng() % EVENTS);
+        }
+        model_preempt();
+        if (value_next > (1u << 24))
+        {
+            break;
+        }
+    }
+
+    /* drain */
+    rate = 0;
+    model_preempt();
+
+    CHECK(armv6m_pendsv_control.event_submit == ARMV6M_PENDSV_EVENT_TAIL);
+    CHECK(!(model_scb.ICSR & SCB_ICSR_PENDSVSET_Msk));
+
+    for (index = 0; index < EVENTS; index++)
+    {
+        model_event_t *e = &events[index];
+
+        CHECK(!armv6m_pendsv_event_pending(&e->event));
+        CHECK(!e->running);
+        CHECK(e->calls == e->queued);
+        if (e->queued)
+        {
+            CHECK(e->delivered == e->event.data);
+        }
+        queued += e->queued;
+        coalesced += e->coalesced;
+        calls += e->calls;
+    }
+
+    armv6m_pendsv_statistics(&statistics);
+    CHECK(statistics.event_coalesced == coalesced);
+
+    printf("posts\t%llu (%llu queued, %llu coalesced, %llu nested in a post of the same event)\n",
+           (unsigned long long)(queued + coalesced), (unsigned long long)queued, (unsigned long long)coalesced, (unsigned long long)nested_posts);
+    printf("calls\t%llu\n", (unsigned long long)calls);
+    printf("irqs\t%llu / %llu / %llu (priority 1/2/3), %llu PendSV\n",
+           (unsigned long long)irqs[2], (unsigned long long)irqs[3], (unsigned long long)irqs[4], (unsigned long long)pendsvs);
+
+    CHECK(coalesced && nested_posts && irqs[2] && irqs[3] && irqs[4]);
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+def main():
+    steps = sys.argv[1] if len(sys.argv) > 1 else "100000"
+    seeds = [ int(sys.argv[2]) ] if len(sys.argv) > 2 else range(1, 9)
+    source = open(os.path.join(ROOT, "system/STM32L0xx/Source/armv6m_pendsv.c")).read()
+    source, count = re.subn(r"\n(static )?void __attribute__\(\(naked\)\) (PendSV|Default)_Handler\(void\)\n\{.*?\n\}\n", "\n", source, flags=re.S)
+    assert count == 2
+    source = re.sub(r"\nvoid SWI\d+_IRQHandler\(void\) __attribute__ \(\(weak, alias\(\"Default_Handler\"\)\)\);", "", source)
+    source += "".join("void SWI%d_IRQHandler(void) { abort(); }\n" % n for n in range(32))
+    source = instrument(source, "armv6m_pendsv_event_post")
+    source = instrument(source, "armv6m_pendsv_event_process")
+    with tempfile.TemporaryDirectory() as directory:
+        for name, text in (("armv6m.h", SHIM), ("pendsv.c", source), ("harness.c", HARNESS)):
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "gcc", "-O2", "-g", "-w", "-fno-pie", "-no-pie", "-I" + directory,
+                                "-I" + os.path.join(ROOT, "system/STM32L0xx/Include"), os.path.join(directory, "harness.c"), "-o", binary ])
+        for seed in seeds:
+            for rate in (2, 6):
+                run = subprocess.run([ binary, steps, str(seed), str(rate) ], capture_output=True, text=True)
+                print("seed %d, preemption rate %d%%" % (seed, rate))
+                print("  " + run.stdout.rstrip().replace("\n", "\n  "))
+                assert run.returncode == 0 and "fail" not in run.stdout, run.returncode
+    print("OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+#
+# Host output-equivalence tests and benchmark for the number formatting in
+# cores/arduino/Print.cpp. The real Print.cpp is compiled with the host g++
+# together with a harness, which also carries a copy of the previous
+# printNumber() / printFloat() (double arithmetic, one write() per digit).
+#
+# Checked:
+#   - print() of integers in bases 2..36 against a reference
+#   - print(double, digits) against the old code, which adds 0.5 / 10^digits
+#     in double arithmetic and so rounds print(0.285, 2) to "0.29"; only a
+#     value below 2^-11 with more than 9 digits may differ in its last digits
+#   - printf() against the host snprintf() over a grid of formats
+#
+# The benchmark counts write() calls and times both versions on the host.
+# The host has an FPU and a hardware divider, so its times say little about
+# the Cortex-M0+, where the old code runs on soft-float double routines and
+# __aeabi_uidivmod(). For that, a cycle estimate from assumed per routine
+# costs is printed as well.
+#
+# The host "long" is 64 bits, so print(long) is only fed 32 bit values.
+#
+#   python3 print_test.py [cases]
+
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+from fractions import Fraction
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+HARNESS = r'''
+#include "Print.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+class Capture : public Print {
+  public:
+    char data[4096];
+    size_t count;
+    unsigned long calls;
+    Capture() : count(0), calls(0) {}
+    size_t write(uint8_t c) { calls++; data[count++] = c; return 1; }
+    size_t write(const uint8_t *buffer, size_t size) { calls++; memcpy(&data[count], buffer, size); count += size; return size; }
+    void reset() { count = 0; }
+    void line(const char *tag) { data[count] = 0; fprintf(stdout, "%s\t%s\n", tag, data); count = 0; }
+};
+
+// the previous Print::printNumber() / Print::printFloat()
+static size_t oldPrintNumber(Print &p, unsigned long n, uint8_t base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while(n);
+  return p.write(str);
+}
+
+static size_t oldPrintFloat(Print &p, double number, uint8_t digits)
+{
+  size_t n = 0;
+  if (isnan(number)) return p.write("nan");
+  if (isinf(number)) return p.write("inf");
+  if (number > 4294967040.0) return p.write("ovf");
+  if (number <-4294967040.0) return p.write("ovf");
+  if (number < 0.0) {
+     n += p.write((uint8_t)'-');
+     number = -number;
+  }
+  double rounding = 0.5;
+  for (uint8_t i=0; i<digits; ++i)
+    rounding /= 10.0;
+  number += rounding;
+  unsigned long int_part = (unsigned long)number;
+  double remainder = number - (double)int_part;
+  n += oldPrintNumber(p, int_part, 10);
+  if (digits > 0) {
+    n += p.write((uint8_t)'.');
+  }
+  while (digits-- > 0) {
+    remainder *= 10.0;
+    unsigned int toPrint = (unsigned int)(remainder);
+    n += oldPrintNumber(p, toPrint, 10);
+    remainder -= toPrint;
+  }
+  return n;
+}
+
+static double value(const char *hex)
+{
+  unsigned long long bits = strtoull(hex, NULL, 16);
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+int main(int argc, char **argv)
+{
+  Capture p;
+  char line[256];
+
+  while (fgets(line, sizeof(line), stdin)) {
+    char kind[16], arg0[64], arg1[64];
+    if (sscanf(line, "%15s %63s %63s", kind, arg0, arg1) < 2) continue;
+
+    if (!strcmp(kind, "int")) {
+      long n = strtol(arg0, NULL, 10);
+      int base = atoi(arg1);
+      p.print((long)(int32_t)n, base); p.line("new");
+      if (base == 10 && (int32_t)n < 0) { p.write((uint8_t)'-'); oldPrintNumber(p, 0u - (uint32_t)(int32_t)n, 10); }
+      else oldPrintNumber(p, (uint32_t)n, base);
+      p.line("old");
+    } else if (!strcmp(kind, "float")) {
+      double d = value(arg0);
+      int digits = atoi(arg1);
+      p.print(d, digits); p.line("new");
+      oldPrintFloat(p, d, digits); p.line("old");
+    } else if (!strcmp(kind, "fmt")) {
+      // arg0 is the format with '~' for ' ', arg1 the value type
+      char format[64], reference[512];
+      strcpy(format, arg0);
+      for (char *s = format; *s; s++) if (*s == '~') *s = ' ';
+      char *rest = strchr(line, '|') + 1;
+      rest[strcspn(rest, "\n")] = 0;
+      if (!strcmp(arg1, "int")) { long long v = strtoll(rest, NULL, 10); snprintf(reference, sizeof(reference), format, (int)v); p.printf(format, (int)v); }
+      else if (!strcmp(arg1, "ll")) { long long v = strtoll(rest, NULL, 10); snprintf(reference, sizeof(reference), format, v); p.printf(format, v); }
+      else if (!strcmp(arg1, "str")) { snprintf(reference, sizeof(reference), format, rest); p.printf(format, rest); }
+      else if (!strcmp(arg1, "chr")) { snprintf(reference, sizeof(reference), format, rest[0]); p.printf(format, rest[0]); }
+      else { double v = value(rest); snprintf(reference, sizeof(reference), format, v); p.printf(format, v); }
+      p.line("new");
+      printf("ref\t%s\n", reference);
+    } else if (!strcmp(kind, "bench")) {
+      int count = atoi(arg0);
+      double *values = (double *)malloc(count * sizeof(double));
+      srand(1);
+      for (int i = 0; i < count; i++) values[i] = (rand() / (double)RAND_MAX - 0.5) * 200.0;
+      for (int version = 0; version < 2; version++) {
+        p.calls = 0;
+        clock_t start = clock();
+        for (int i = 0; i < count; i++) {
+          if (version) p.print(values[i], 2); else oldPrintFloat(p, values[i], 2);
+          if (version) p.print((long)(i * 7919), 10); else oldPrintNumber(p, i * 7919, 10);
+          p.reset();
+        }
+        double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+        printf("bench\t%s\t%lu\t%.3f\n", version ? "new" : "old", p.calls, elapsed * 1e9 / count);
+      }
+      p.calls = 0;
+      clock_t start = clock();
+      for (int i = 0; i < count; i++) {
+        p.printf("%d,%.2f\r\n", i, values[i]);
+        p.reset();
+      }
+      printf("bench\tprintf\t%lu\t%.3f\n", p.calls, (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / count);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
+'''
+
+def build(directory):
+    harness = os.path.join(directory, "harness.cpp")
+    with open(harness, "w") as f:
+        f.write(HARNESS)
+    includes = [ "system/CMSIS/Include", "system/CMSIS/Device/ST/STM32L0xx/Include", "system/STM32L0xx/Include",
+                 "variants/Grasshopper-L082CZ", "cores/arduino" ]
+    binary = os.path.join(directory, "harness")
+    subprocess.check_call([ "g++", "-O2", "-std=gnu++11", "-DSTM32L082xx", "-w" ] + [ "-I" + os.path.join(ROOT, path) for path in includes ]
+                          + [ harness, os.path.join(ROOT, "cores/arduino/Print.cpp"), "-o", binary ])
+    return binary
+
+def run(binary, commands):
+    output = subprocess.run([ binary ], input="".join(commands), capture_output=True, text=True, check=True).stdout
+    return [ line.split("\t", 1)[1] for line in output.splitlines() if not line.startswith("bench") ], output
+
+def bits(d):
+    return "%016x" % struct.unpack("<Q", struct.pack("<d", d))[0]
+
+def exact(d, digits):
+    # the exact decimal value of d rounded half up, "ovf" beyond 4294967040
+    if d != d:
+        return "nan"
+    if d in (float("inf"), float("-inf")):
+        return "inf"
+    if d > 4294967040.0 or d < -4294967040.0:
+        return "ovf"
+    value = Fraction(d)
+    negative = value < 0
+    scaled = abs(value) * 10 ** digits
+    rounded = int(scaled + Fraction(1, 2))
+    text = str(rounded).rjust(digits + 1, "0")
+    text = text[:len(text) - digits] + ("." + text[len(text) - digits:] if digits else "")
+    return ("-" if negative else "") + text
+
+# Cortex-M0+ estimates: libgcc soft-float and division routines, and the virtual write()
+# into a buffered Uart. The host has an FPU and a divider, so its times do not carry over.
+CYCLES = { "dadd": 120, "dmul": 160, "ddiv": 500, "dcmp": 60, "d2u": 50, "u2d": 50, "udiv": 90, "write": 60 }
+
+def m0_cycles(number, digits):
+    c = CYCLES
+    integer = len(str(int(number)))
+    # isnan/isinf, two "ovf" compares, < 0.0, the rounding divides, +rounding, int part
+    old = 3 * c["dcmp"] + digits * c["ddiv"] + c["dadd"] + c["d2u"] + c["u2d"] + c["dadd"]
+    old += integer * c["udiv"] + c["write"]
+    old += c["write"] if digits else 0
+    # per digit: *= 10.0, (unsigned int), -= toPrint, a printNumber() with one write()
+    old += digits * (c["dmul"] + c["d2u"] + c["u2d"] + c["dadd"] + c["udiv"] + c["write"])
+    # the same range checks and rounding in double arithmetic, then bit extraction, a 64 bit
+    # shift/add and the 53 bit rounding per digit, subtraction loop per integer digit, one write()
+    new = 3 * c["dcmp"] + digits * c["ddiv"] + c["dadd"]
+    new += 60 + digits * 40 + integer * 25 + c["write"]
+    return old, new
+
+def reference_int(n, base):
+    if base == 10:
+        return str(n)
+    n &= 0xffffffff
+    text = ""
+    while True:
+        c = n % base
+        text = (chr(c + 48) if c < 10 else chr(c + 55)) + text
+        n //= base
+        if not n:
+            return text
+
+def main():
+    cases = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+    rng = random.Random(1)
+    with tempfile.TemporaryDirectory() as directory:
+        binary = build(directory)
+
+        # integers
+        commands, expected = [], []
+        for _ in range(cases // 4):
+            n = rng.choice([ rng.randrange(-2 ** 31, 2 ** 31), rng.randrange(-1000, 1000), rng.choice([ 0, -1, 2 ** 31 - 1, -2 ** 31, 10 ** 9, 999999999 ]) ])
+            base = rng.choice([ 10, 10, 16, 8, 2, rng.randrange(2, 37) ])
+            commands.append("int %d %d\n" % (n, base))
+            expected.append(reference_int(n, base))
+        lines, _ = run(binary, commands)
+        for index, reference in enumerate(expected):
+            new, old = lines[2 * index], lines[2 * index + 1]
+            assert new == reference == old, "%s: new %s old %s expected %s" % (commands[index].strip(), new, old, reference)
+        print("print(long, base)   %6d cases, identical to the old code" % len(expected))
+
+        # floats
+        values = []
+        for _ in range(cases):
+            kind = rng.random()
+            if kind < 0.4:
+                d = struct.unpack("<f", struct.pack("<f", rng.uniform(-1000, 1000)))[0]   # a float sensor value
+            elif kind < 0.6:
+                d = rng.randrange(-100000, 100000) / rng.choice([ 10, 100, 1000, 8, 16, 1024 ])  # decimal and binary ties
+            elif kind < 0.8:
+                d = rng.uniform(-1, 1) * 10 ** rng.randrange(-12, 10)
+            else:
+                d = rng.choice([ 0.0, -0.0, 0.5, 1.5, 2.5, 0.125, 1.005, 2.675, 9.995, 0.05, 4294967040.0, 4294967040.5, 4294967295.0,
+                                 -4294967040.0, 1e-320, 5e-324, 2 ** -11, 2 ** -12, 0.1, 1 / 3.0, float("inf"), float("-inf"), float("nan") ])
+            values.append((d, rng.choice([ 0, 1, 2, 2, 2, 3, 4, 6, 9, rng.randrange(0, 20) ])))
+        commands = [ "float %s %d\n" % (bits(d), digits) for d, digits in values ]
+        lines, _ = run(binary, commands)
+        same = inexact = tiny = 0
+        for index, (d, digits) in enumerate(values):
+            new, old = lines[2 * index], lines[2 * index + 1]
+            if new != old:
+                # formatFloat() keeps 64 fraction bits, the old code all 53 bits of a tiny value
+                assert abs(d) < 2 ** -11 and digits > 9, "print(%r, %d): new %s old %s" % (d, digits, new, old)
+                assert new[:-3] == old[:-3], "print(%r, %d): new %s old %s" % (d, digits, new, old)
+                tiny += 1
+                continue
+            same += 1
+            if new != exact(d, digits):
+                inexact += 1
+        fixed = [ (0.285, 2, "0.29"), (9.995, 2, "10.00"), (-0.845, 2, "-0.85"), (1.005, 2, "1.00"), (-0.0, 1, "0.0"),
+                  (4294967040.0, 0, "4294967040"), (4294967040.5, 0, "ovf") ]
+        lines, _ = run(binary, [ "float %s %d\n" % (bits(d), digits) for d, digits, _ in fixed ])
+        for index, (d, digits, text) in enumerate(fixed):
+            assert lines[2 * index] == lines[2 * index + 1] == text, "print(%r, %d): %s old %s" % (d, digits, lines[2 * index], lines[2 * index + 1])
+        print("print(double, n)    %6d cases, %d identical to the old code (%d of them off the exact value by the double rounding), "
+              "%d below 2^-11 with more than 9 digits that differ in the last digits" % (len(values), same, inexact, tiny))
+
+        # printf
+        commands = []
+        for _ in range(cases // 2):
+            kind = rng.choice([ "int", "int", "ll", "str", "chr", "dbl", "dbl" ])
+            flags = "".join(rng.sample("-+ 0#", rng.randrange(0, 3)))
+            width = rng.choice([ "", "", "5", "12" ])
+            precision = rng.choice([ "", "", ".0", ".3", ".10" ])
+            if kind == "int":
+                conversion = rng.choice([ "d", "i", "u", "x", "X", "o", "hd", "hhu", "ld", "lx" ])
+                value = str(rng.choice([ rng.randrange(-2 ** 31, 2 ** 31), rng.randrange(-300, 300), 0 ]))
+            elif kind == "ll":
+                conversion = rng.choice([ "lld", "llu", "llx", "llo" ])
+                value = str(rng.choice([ rng.randrange(-2 ** 63, 2 ** 63), rng.randrange(-10 ** 12, 10 ** 12), 0 ]))
+            elif kind == "str":
+                conversion, value = "s", rng.choice([ "hello", "", "a somewhat longer string" ])
+                flags = flags.replace("0", "").replace("#", "").replace("+", "").replace(" ", "")
+            elif kind == "chr":
+                conversion, value, precision = "c", rng.choice("xyz"), ""
+                flags = flags.replace("0", "").replace("#", "").replace("+", "").replace(" ", "")
+            else:
+                conversion = rng.choice([ "f", "F" ])
+                d = rng.choice([ rng.uniform(-1e6, 1e6), rng.randrange(-4000, 4000) / 8, rng.uniform(-1, 1) * 1e-3, 0.5, 2.5, -0.0,
+                                 float("inf"), float("-inf"), 4294967040.0 ])
+                value = bits(d)
+            if conversion in ("c", "s") or "x" in conversion or "X" in conversion or "o" in conversion or "u" in conversion:
+                flags = flags.replace("+", "").replace(" ", "")
+            format = ("%" + flags + width + precision + conversion).replace(" ", "~")
+            commands.append("fmt [%s] %s |%s\n" % (format, kind, value))
+        commands += [ "fmt [%%|%5%|%-5%] int |0\n", "fmt [%p] int |0\n" ]
+        lines, _ = run(binary, [ command.replace("[", "").replace("]", "") for command in commands ])
+        for index in range(len(commands)):
+            new, reference = lines[2 * index], lines[2 * index + 1]
+            if "%p" in commands[index] or "%5%" in commands[index]:
+                continue
+            assert new == reference, "printf(%s): %r expected %r" % (commands[index].strip(), new, reference)
+        print("printf()            %6d cases, identical to the host snprintf()" % (len(commands) - 2))
+
+        _, output = run(binary, [ "bench 200000 0\n" ])
+        bench = { line.split("\t")[1]: line.split("\t")[2:] for line in output.splitlines() if line.startswith("bench") }
+        for version in ("old", "new"):
+            calls, time = bench[version]
+            print("print(x, 2) + print(i) %s: %4.1f write() calls per pair, %6.1f ns on the host" % (version, int(calls) / 200000, float(time)))
+        calls, time = bench["printf"]
+        print("printf(\"%%d,%%.2f\\r\\n\")    : %4.1f write() calls, %6.1f ns on the host" % (int(calls) / 200000, float(time)))
+        assert int(bench["new"][0]) == 2 * 200000
+    for digits in (2, 4):
+        old, new = m0_cycles(123.456, digits)
+        print("print(123.456, %d) on a Cortex-M0+, estimated: old %5d cycles, new %4d cycles" % (digits, old, new))
+    print("OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+#
+# Host stress test for RingBufferN<N> in cores/arduino/RingBuffer.h. A
+# producer and a consumer thread run concurrently on one ring, standing in
+# for thread mode and an interrupt handler. The producer sends a counting
+# byte sequence using a random mix of store_char(), write() and
+# writeSpan()/commitWrite(); the consumer checks it using read_char(),
+# read(), peek() and readSpan()/commitRead() with random sizes (the way
+# Uart/CDC hand spans of at most a packet to DMA). Any lost, duplicated or
+# reordered byte fails the test. A small ring forces wrap arounds and the
+# full/empty corners; a large one the bulk paths. Single character calls
+# that find the ring full or empty yield, so that the test also makes
+# progress on a single CPU.
+#
+# Build it with -fsanitize=thread to have the data race detector check the
+# acquire/release pairing as well:
+#
+#   python3 ring_test.py [bytes] [tsan]
+
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+HARNESS = r'''
+#include "RingBuffer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned long total;
+
+static uint32_t next(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+template <size_t N>
+struct Test {
+	RingBufferN<N> ring;
+	unsigned long errors, full, empty;
+
+	static void *producer(void *arg)
+	{
+		Test *t = (Test *)arg;
+		uint32_t seed = 1;
+		uint8_t data[3 * N];
+		unsigned long sent = 0;
+
+		while (sent < total) {
+			size_t size = 1 + next(&seed) % (3 * N);
+			if (size > total - sent) size = total - sent;
+			switch (next(&seed) % 3) {
+			case 0:
+				if (t->ring.isFull()) { t->full++; sched_yield(); break; }
+				t->ring.store_char((uint8_t)sent);
+				sent++;
+				break;
+			case 1: {
+				for (size_t i = 0; i < size; i++) data[i] = (uint8_t)(sent + i);
+				sent += t->ring.write(data, size);
+				break;
+			}
+			case 2: {
+				size_t count;
+				uint8_t *span = t->ring.writeSpan(count);
+				if (count > size) count = size;
+				if (count > (size_t)t->ring.availableForStore()) abort();
+				for (size_t i = 0; i < count; i++) span[i] = (uint8_t)(sent + i);
+				t->ring.commitWrite(count);
+				sent += count;
+				break;
+			}
+			}
+		}
+		return NULL;
+	}
+
+	static void *consumer(void *arg)
+	{
+		Test *t = (Test *)arg;
+		uint32_t seed = 2;
+		uint8_t data[3 * N];
+		unsigned long received = 0;
+
+		while (received < total) {
+			size_t size = 1 + next(&seed) % (3 * N);
+			switch (next(&seed) % 3) {
+			case 0: {
+				int p = t->ring.peek();
+				int c = t->ring.read_char();
+				if (c < 0) { t->empty++; sched_yield(); break; }
+				if (p != c || c != (uint8_t)received) t->errors++;
+				received++;
+				break;
+			}
+			case 1: {
+				size_t count = t->ring.read(data, size);
+				for (size_t i = 0; i < count; i++) if (data[i] != (uint8_t)(received + i)) t->errors++;
+				received += count;
+				break;
+			}
+			case 2: {
+				size_t count;
+				const uint8_t *span = t->ring.readSpan(count);
+				if (count > size) count = size;
+				if (count > (size_t)t->ring.available()) abort();
+				for (size_t i = 0; i < count; i++) if (span[i] != (uint8_t)(received + i)) t->errors++;
+				t->ring.commitRead(count);
+				received += count;
+				break;
+			}
+			}
+		}
+		return NULL;
+	}
+
+	void run(void)
+	{
+		pthread_t p, c;
+		errors = full = empty = 0;
+		pthread_create(&p, NULL, producer, this);
+		pthread_create(&c, NULL, consumer, this);
+		pthread_join(p, NULL);
+		pthread_join(c, NULL);
+		if (ring.available() != 0) errors++;
+		printf("N=%-5u %lu bytes, %lu errors, producer saw full %lu times, consumer saw empty %lu times\n",
+		       (unsigned)N, total, errors, full, empty);
+		if (errors) exit(1);
+	}
+};
+
+int main(int argc, char **argv)
+{
+	total = (argc > 1) ? strtoul(argv[1], NULL, 0) : 2000000;
+
+	RingBufferN<4> r;
+	uint8_t out[8];
+	if (r.write((const uint8_t *)"abcdef", 6) != 4 || !r.isFull() || r.availableForStore() != 0) return 1;
+	r.store_char('x');
+	if (r.read(out, 2) != 2 || r.write((const uint8_t *)"gh", 2) != 2 || r.read(out, 8) != 4 || memcmp(out, "cdgh", 4)) return 1;
+	r.store_char('y');
+	r.clear();
+	if (r.available() != 0 || r.read_char() != -1 || r.peek() != -1) return 1;
+
+	static Test<4> small;
+	static Test<64> serial;
+	static Test<256> cdc;
+	small.run();
+	serial.run();
+	cdc.run();
+	return 0;
+}
+'''
+
+def main():
+    total = sys.argv[1] if len(sys.argv) > 1 else "2000000"
+    sanitize = [ "-fsanitize=thread" ] if "tsan" in sys.argv[2:] else []
+    with tempfile.TemporaryDirectory() as directory:
+        harness = os.path.join(directory, "harness.cpp")
+        with open(harness, "w") as f:
+            f.write(HARNESS)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O2", "-g", "-std=gnu++11", "-Wall", "-pthread", "-I" + os.path.join(ROOT, "cores/arduino") ]
+                              + sanitize + [ harness, "-o", binary ])
+        subprocess.check_call([ binary, total ])
+    print("OK")
+
+if __name__ == "__main__":
+    main()
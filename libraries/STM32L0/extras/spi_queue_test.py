@@ -0,0 +1,833 @@
+#!/usr/bin/env python3
+#
+# Host stress test of the SPI transaction queue in stm32l0_spi.c. The
+# driver is compiled with the host g++ against register stand-ins: SPI1 is
+# a model that shifts bytes to and from the device whose CS pin is low, the
+# DMA channels move a whole segment at once and then raise the transfer
+# done interrupt, and GPIO, EXTI and the system locks are counted.
+#
+# A preemption point follows every statement of stm32l0_spi_submit(),
+# stm32l0_spi_acquire(), stm32l0_spi_release() and the queue functions,
+# and every read of SPI_SR. There an interrupt may come in: the DMA
+# interrupt, or a second interrupt, above or below the DMA one, that
+# submits transactions or calls stm32l0_spi_acquire() itself. Thread mode
+# submits, runs synchronous acquire()/stm32l0_spi_data()/release() blocks,
+# and tries acquire() with PRIMASK set.
+#
+# The devices (an SX1276, a SPI flash and an SD card) answer with data that
+# depends on the bytes they were sent, so that misrouted data is caught.
+# Checked are: only one CS is low, a device is selected with its own clock
+# and mode, settings only change with all CS high and BSY clear, CS is only
+# released once BSY cleared, each transaction gets its own data and
+# completes with SUCCESS in the DMA interrupt, in the order submitted, none
+# is stranded, and stm32l0_spi_acquire() in handler mode or with PRIMASK
+# set fails instead of waiting on the DMA interrupt. Given a git revision,
+# the driver from there is run over the same seeds.
+#
+#   python3 spi_queue_test.py [revision]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = "system/STM32L0xx/Source/stm32l0_spi.c"
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+DEVICE = os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern uint32_t model_primask, model_level;
+
+extern void model_preempt(void);
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; }
+static inline void __disable_irq(void) { model_primask = 1; }
+static inline uint32_t __get_IPSR(void) { return model_level ? (16 + model_level) : 0; }
+
+/* Preemption only happens between statements, so these are atomic. */
+static inline uint32_t armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+static inline uint32_t armv6m_atomic_casb(volatile uint8_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+static inline uint32_t armv6m_atomic_incb(volatile uint8_t *p_data) { return (*p_data)++; }
+static inline uint32_t armv6m_atomic_decb(volatile uint8_t *p_data) { return (*p_data)--; }
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+    model_register_t &operator|=(uint32_t data) { return *this = ((uint32_t)*this | data); }
+    model_register_t &operator&=(uint32_t data) { return *this = ((uint32_t)*this & data); }
+};
+
+typedef struct { model_register_t CR1, CR2, SR, DR, CRCPR, RXCRCR, TXCRCR, I2SCFGR, I2SPR; } SPI_TypeDef;
+
+extern SPI_TypeDef model_spi1, model_spi2;
+
+#define SPI1 (&model_spi1)
+#define SPI2 (&model_spi2)
+
+#endif
+'''
+
+GPIO = r'''
+#if !defined(_STM32L0_GPIO_H)
+#define _STM32L0_GPIO_H
+
+#include "armv6m.h"
+
+%s
+
+extern void stm32l0_gpio_pin_configure(uint32_t pin, uint32_t mode);
+extern void stm32l0_gpio_pin_write(uint32_t pin, uint32_t data);
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "stm32l0_spi.c"
+#include <stdio.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d)\n", #_c, __LINE__); exit(1); } } while (0)
+
+#define DMA_LEVEL      2
+#define STEP_LIMIT     100000
+#define TRANSACTIONS   3000
+#define DATA_SIZE      40
+
+uint32_t model_primask, model_level;
+SPI_TypeDef model_spi1, model_spi2;
+
+static stm32l0_spi_t spi;
+static uint32_t rng_state, app_level, app_rate;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+
+    return rng_state;
+}
+
+/* ---- devices on the bus ---- */
+
+typedef struct {
+    const char *name;
+    uint16_t pin;
+    uint32_t clock;
+    uint32_t mode;
+    uint32_t sum;
+    uint32_t count;
+} device_t;
+
+static device_t devices[3] = {
+    { "sx1276", 10,  8000000, STM32L0_SPI_OPTION_MODE_0 },
+    { "flash",  11, 32000000, STM32L0_SPI_OPTION_MODE_3 },
+    { "sdcard", 12,  4000000, STM32L0_SPI_OPTION_MODE_0 },
+};
+
+static device_t *selected;
+static uint32_t busy, rx_byte, switches, periph, locks, exti;
+static bool rxne;
+
+static uint8_t device_response(const device_t *device, uint32_t sum, uint32_t count)
+{
+    return (uint8_t)(device->pin * 37 + sum * 31 + count * 7);
+}
+
+static uint8_t device_exchange(uint8_t data)
+{
+    uint8_t response;
+
+    CHECK(selected);
+    CHECK(periph && locks);
+    CHECK(model_spi1.CR1.value & SPI_CR1_SPE);
+
+    response = device_response(selected, selected->sum, selected->count);
+
+    selected->sum += data;
+    selected->count++;
+
+    return response;
+}
+
+static device_t *device_lookup(uint32_t pin)
+{
+    for (unsigned int index = 0; index < 3; index++)
+    {
+        if (devices[index].pin == pin)
+        {
+            return &devices[index];
+        }
+    }
+
+    return NULL;
+}
+
+void stm32l0_gpio_pin_configure(uint32_t pin, uint32_t mode) { }
+
+void stm32l0_gpio_pin_write(uint32_t pin, uint32_t data)
+{
+    device_t *device = device_lookup(pin);
+    uint32_t cr1 = model_spi1.CR1.value, clock;
+
+    CHECK(device);
+
+    if (!data)
+    {
+        /* one CS at a time, and the device's own settings */
+        CHECK(!selected);
+
+        clock = 16000000 >> ((cr1 & SPI_CR1_BR) >> SPI_CR1_BR_Pos);
+
+        CHECK((cr1 & (SPI_CR1_CPOL | SPI_CR1_CPHA)) == device->mode);
+        CHECK((clock <= device->clock) && ((clock == 16000000) || ((clock * 2) > device->clock)));
+
+        selected = device;
+        selected->sum = 0;
+        selected->count = 0;
+    }
+    else
+    {
+        CHECK(selected == device);
+        CHECK(!busy);
+
+        selected = NULL;
+    }
+}
+
+void stm32l0_exti_block(uint32_t mask) { CHECK(!(exti & mask)); exti |= mask; }
+void stm32l0_exti_unblock(uint32_t mask) { CHECK((exti & mask) == mask); exti &= ~mask; }
+
+void stm32l0_system_lock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); locks++; }
+void stm32l0_system_unlock(uint32_t lock) { CHECK(lock == STM32L0_SYSTEM_LOCK_RUN); CHECK(locks); locks--; }
+void stm32l0_system_periph_enable(unsigned int index) { CHECK(index == STM32L0_SYSTEM_PERIPH_SPI1); periph++; }
+void stm32l0_system_periph_disable(unsigned int index) { CHECK(index == STM32L0_SYSTEM_PERIPH_SPI1); CHECK(periph); periph--; }
+uint32_t stm32l0_system_pclk1(void) { return 32000000; }
+uint32_t stm32l0_system_pclk2(void) { return 32000000; }
+
+/* ---- SPI1 ---- */
+
+static void spi_cr1_write(model_register_t *reg, uint32_t data)
+{
+    if ((reg->value ^ data) & (SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_LSBFIRST))
+    {
+        /* settings only change with all CS high and BSY clear */
+        CHECK(!selected);
+        CHECK(!busy);
+
+        switches++;
+    }
+
+    reg->value = data;
+}
+
+static uint32_t spi_sr_read(model_register_t *reg)
+{
+    uint32_t sr = SPI_SR_TXE;
+
+    model_preempt();
+
+    if (rxne)
+    {
+        sr |= SPI_SR_RXNE;
+    }
+
+    if (busy)
+    {
+        busy--;
+
+        sr |= SPI_SR_BSY;
+    }
+
+    return sr;
+}
+
+static void spi_dr_write(model_register_t *reg, uint32_t data)
+{
+    rx_byte = device_exchange(data);
+    rxne = true;
+    busy = 1;
+}
+
+static uint32_t spi_dr_read(model_register_t *reg)
+{
+    rxne = false;
+
+    return rx_byte;
+}
+
+/* ---- DMA, a whole segment per start ---- */
+
+typedef struct {
+    uint16_t channel;
+    bool started;
+    bool done;
+    stm32l0_dma_callback_t callback;
+    void *context;
+    uint32_t memory;
+    uint32_t count;
+    uint32_t option;
+} dma_t;
+
+static dma_t dma[8];
+static bool dma_pending, app_pending;
+
+bool stm32l0_dma_channel(uint16_t channel)
+{
+    return (channel != STM32L0_DMA_CHANNEL_NONE) && (dma[channel & 7].channel == channel);
+}
+
+bool stm32l0_dma_enable(uint16_t channel, stm32l0_dma_callback_t callback, void *context)
+{
+    CHECK(dma[channel & 7].channel == STM32L0_DMA_CHANNEL_NONE);
+
+    dma[channel & 7].channel = channel;
+    dma[channel & 7].callback = callback;
+    dma[channel & 7].context = context;
+
+    return true;
+}
+
+void stm32l0_dma_disable(uint16_t channel)
+{
+    CHECK(dma[channel & 7].channel == channel);
+    CHECK(!dma[channel & 7].started);
+
+    dma[channel & 7].channel = STM32L0_DMA_CHANNEL_NONE;
+}
+
+void stm32l0_dma_start(uint16_t channel, uint32_t tx_data, uint32_t rx_data, uint16_t xf_count, uint32_t option)
+{
+    dma_t *rx = &dma[spi.rx_dma & 7], *tx = &dma[spi.tx_dma & 7];
+    uint8_t data;
+
+    CHECK(dma[channel & 7].channel == channel);
+    CHECK(!dma[channel & 7].started && xf_count);
+
+    if (channel == spi.rx_dma)
+    {
+        CHECK(rx_data == (uint32_t)&model_spi1.DR);
+        CHECK(!(option & STM32L0_DMA_OPTION_MEMORY_TO_PERIPHERAL));
+
+        rx->memory = tx_data;
+    }
+    else
+    {
+        CHECK(channel == spi.tx_dma);
+        CHECK(tx_data == (uint32_t)&model_spi1.DR);
+        CHECK(option & STM32L0_DMA_OPTION_MEMORY_TO_PERIPHERAL);
+
+        tx->memory = rx_data;
+    }
+
+    dma[channel & 7].started = true;
+    dma[channel & 7].done = false;
+    dma[channel & 7].count = xf_count;
+    dma[channel & 7].option = option;
+
+    if (rx->started && tx->started && !rx->done)
+    {
+        CHECK(rx->count == tx->count);
+        CHECK((model_spi1.CR2.value & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)) == (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN));
+
+        for (uint32_t index = 0; index < rx->count; index++)
+        {
+            data = device_exchange(((const uint8_t*)(uintptr_t)tx->memory)[(tx->option & STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT) ? index : 0]);
+
+            ((uint8_t*)(uintptr_t)rx->memory)[(rx->option & STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT) ? index : 0] = data;
+        }
+
+        rx->done = true;
+        tx->done = true;
+
+        /* the last byte is still being shifted out */
+        busy = 2;
+
+        if (rx->option & STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE)
+        {
+            CHECK(rx->callback);
+
+            dma_pending = true;
+        }
+    }
+}
+
+uint16_t stm32l0_dma_stop(uint16_t channel)
+{
+    CHECK(dma[channel & 7].channel == channel);
+
+    dma[channel & 7].started = false;
+    dma[channel & 7].done = false;
+
+    return 0;
+}
+
+bool stm32l0_dma_done(uint16_t channel)
+{
+    return dma[channel & 7].done;
+}
+
+/* ---- interrupts ---- */
+
+static uint32_t steps, handler_steps, primask_steps, submitted;
+
+static void app_interrupt(void);
+
+static void dma_interrupt(void)
+{
+    dma_t *rx = &dma[spi.rx_dma & 7];
+
+    dma_pending = false;
+
+    (*rx->callback)(rx->context, STM32L0_DMA_EVENT_TRANSFER_DONE);
+}
+
+static void dispatch(uint32_t level, void (*routine)(void))
+{
+    uint32_t level_save = model_level, steps_save = handler_steps;
+
+    model_level = level;
+    handler_steps = 0;
+
+    (*routine)();
+
+    model_level = level_save;
+    handler_steps = steps_save;
+}
+
+void model_preempt(void)
+{
+    CHECK(++steps < (TRANSACTIONS * 10000));
+
+    if (model_primask)
+    {
+        /* nothing can come in to end a wait */
+        CHECK(++primask_steps < STEP_LIMIT);
+
+        return;
+    }
+
+    if (model_level)
+    {
+        /* a wait in handler mode */
+        CHECK(++handler_steps < STEP_LIMIT);
+    }
+
+    if (!app_pending && !model_level && (submitted < TRANSACTIONS) && !(rng() % app_rate))
+    {
+        app_pending = true;
+    }
+
+    while (true)
+    {
+        if (dma_pending && (DMA_LEVEL > model_level) && (rng() & 1))
+        {
+            dispatch(DMA_LEVEL, dma_interrupt);
+        }
+        else if (app_pending && (app_level > model_level) && (rng() & 1))
+        {
+            dispatch(app_level, app_interrupt);
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+/* ---- transactions ---- */
+
+typedef struct {
+    stm32l0_spi_transaction_t transaction;
+    stm32l0_spi_segment_t segments[2];
+    uint8_t command[4];
+    uint8_t data[DATA_SIZE];
+    uint8_t expect[DATA_SIZE];
+    uint32_t origin;
+    uint32_t sequence;
+    bool done;
+} entry_t;
+
+static entry_t entries[TRANSACTIONS];
+static uint32_t completed, sequence[2], completion[2];
+static uint32_t thread_waits, handler_acquires, handler_refused, primask_acquires, primask_refused, synchronous;
+
+/* What the device answers to the transaction's segments. */
+static void expect(uint16_t pin, const stm32l0_spi_segment_t *segments, uint32_t segment_count, uint8_t *data)
+{
+    const device_t *device = device_lookup(pin);
+    uint32_t sum = 0, count = 0;
+
+    for (uint32_t index = 0; index < segment_count; index++)
+    {
+        for (uint32_t offset = 0; offset < segments[index].count; offset++, count++)
+        {
+            if (segments[index].rx_data)
+            {
+                data[offset] = device_response(device, sum, count);
+            }
+
+            sum += segments[index].tx_data ? segments[index].tx_data[offset] : 0xff;
+        }
+    }
+}
+
+static void done_callback(void *context)
+{
+    entry_t *entry = (entry_t*)context;
+    const stm32l0_spi_segment_t *segment = &entry->segments[entry->transaction.segment_count - 1];
+
+    CHECK(model_level == DMA_LEVEL);
+    CHECK(!entry->done);
+    CHECK(entry->transaction.status == STM32L0_SPI_STATUS_SUCCESS);
+    CHECK(entry->sequence == completion[entry->origin]);
+
+    if (segment->rx_data)
+    {
+        CHECK(!memcmp(segment->rx_data, entry->expect, segment->count));
+    }
+
+    completion[entry->origin]++;
+    completed++;
+
+    entry->done = true;
+}
+
+static void submit(uint32_t origin)
+{
+    entry_t *entry;
+    const device_t *device;
+    uint32_t count, index;
+
+    if (submitted == TRANSACTIONS)
+    {
+        return;
+    }
+
+    entry = &entries[submitted++];
+    device = &devices[rng() % 3];
+    count = 1 + rng() % DATA_SIZE;
+
+    entry->origin = origin;
+    entry->sequence = sequence[origin]++;
+
+    entry->command[0] = device->pin;
+    entry->command[1] = submitted;
+    entry->command[2] = submitted >> 8;
+    entry->command[3] = rng();
+
+    for (index = 0; index < DATA_SIZE; index++)
+    {
+        entry->data[index] = rng();
+    }
+
+    entry->segments[0].tx_data = entry->command;
+    entry->segments[0].rx_data = NULL;
+    entry->segments[0].count = 4;
+
+    switch (rng() % 3) {
+    case 0:
+        /* command, then read */
+        entry->segments[1].tx_data = NULL;
+        entry->segments[1].rx_data = entry->data;
+        entry->segments[1].count = count;
+        entry->transaction.segment_count = 2;
+        break;
+    case 1:
+        /* command, then write */
+        entry->segments[1].tx_data = entry->data;
+        entry->segments[1].rx_data = NULL;
+        entry->segments[1].count = count;
+        entry->transaction.segment_count = 2;
+        break;
+    default:
+        /* one full duplex segment, in place */
+        entry->segments[0].tx_data = entry->data;
+        entry->segments[0].rx_data = entry->data;
+        entry->segments[0].count = count;
+        entry->transaction.segment_count = 1;
+        break;
+    }
+
+    expect(device->pin, entry->segments, entry->transaction.segment_count, entry->expect);
+
+    entry->transaction.pin = device->pin;
+    entry->transaction.clock = device->clock;
+    entry->transaction.option = device->mode;
+    entry->transaction.segments = entry->segments;
+    entry->transaction.callback = done_callback;
+    entry->transaction.context = entry;
+
+    CHECK(stm32l0_spi_submit(&spi, &entry->transaction));
+}
+
+/* A stm32l0_spi_data() block on a device while the SPI is acquired. */
+static void synchronous_transfer(const device_t *device)
+{
+    static uint8_t tx_data[DATA_SIZE], rx_data[DATA_SIZE], data[DATA_SIZE];
+    stm32l0_spi_segment_t segment;
+    uint32_t count = 1 + rng() % DATA_SIZE, index;
+
+    for (index = 0; index < count; index++)
+    {
+        tx_data[index] = rng();
+    }
+
+    segment.tx_data = (rng() & 1) ? tx_data : NULL;
+    segment.rx_data = rx_data;
+    segment.count = count;
+
+    expect(device->pin, &segment, 1, data);
+
+    stm32l0_gpio_pin_write(device->pin, 0);
+    stm32l0_spi_data(&spi, segment.tx_data, rx_data, count);
+    stm32l0_gpio_pin_write(device->pin, 1);
+
+    CHECK(!memcmp(rx_data, data, count));
+
+    synchronous++;
+}
+
+/* Submits, and now and then an acquire in handler mode, which has to fail
+ * rather than wait while the queue owns the SPI.
+ */
+static void app_interrupt(void)
+{
+    const device_t *device;
+
+    app_pending = false;
+
+    if (rng() % 4)
+    {
+        submit(1);
+    }
+    else
+    {
+        device = &devices[rng() % 3];
+
+        if (stm32l0_spi_acquire(&spi, device->clock, device->mode))
+        {
+            synchronous_transfer(device);
+
+            CHECK(stm32l0_spi_release(&spi));
+
+            handler_acquires++;
+        }
+        else
+        {
+            handler_refused++;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static stm32l0_spi_transaction_t empty;
+    stm32l0_spi_params_t params;
+    const device_t *device;
+    uint32_t state, index;
+
+    rng_state = strtoul(argv[1], NULL, 0);
+    app_level = strtoul(argv[2], NULL, 0);
+    app_rate = strtoul(argv[3], NULL, 0);
+
+    model_spi1.CR1.write = spi_cr1_write;
+    model_spi1.SR.read = spi_sr_read;
+    model_spi1.DR.write = spi_dr_write;
+    model_spi1.DR.read = spi_dr_read;
+
+    memset(&params, 0, sizeof(params));
+    params.instance = STM32L0_SPI_INSTANCE_SPI1;
+    params.rx_dma = STM32L0_DMA_CHANNEL_DMA1_CH2_SPI1_RX;
+    params.tx_dma = STM32L0_DMA_CHANNEL_DMA1_CH3_SPI1_TX;
+
+    CHECK(stm32l0_spi_create(&spi, &params));
+    CHECK(stm32l0_spi_enable(&spi));
+    CHECK(stm32l0_spi_block(&spi, 5));
+
+    /* argument checks */
+    CHECK(!stm32l0_spi_submit(&spi, &empty));
+
+    while (submitted < TRANSACTIONS)
+    {
+        switch (rng() % 8) {
+        case 0:
+        case 1:
+        case 2:
+            submit(0);
+            break;
+
+        case 3:
+            /* waits for the queue to hand the SPI back */
+            device = &devices[rng() % 3];
+            state = spi.state;
+
+            CHECK(stm32l0_spi_acquire(&spi, device->clock, device->mode));
+
+            synchronous_transfer(device);
+
+            CHECK(stm32l0_spi_release(&spi));
+
+            if (state == STM32L0_SPI_STATE_QUEUE)
+            {
+                thread_waits++;
+            }
+            break;
+
+        case 4:
+            /* with PRIMASK set the DMA interrupt cannot hand it back */
+            device = &devices[rng() % 3];
+            state = spi.state;
+
+            __disable_irq();
+
+            if (stm32l0_spi_acquire(&spi, device->clock, device->mode))
+            {
+                CHECK(state == STM32L0_SPI_STATE_READY);
+
+                synchronous_transfer(device);
+
+                CHECK(stm32l0_spi_release(&spi));
+
+                primask_acquires++;
+            }
+            else
+            {
+                primask_refused++;
+            }
+
+            __set_PRIMASK(0);
+            primask_steps = 0;
+            break;
+
+        default:
+            for (index = rng() % 8; index; index--)
+            {
+                model_preempt();
+            }
+            break;
+        }
+    }
+
+    /* nothing stranded */
+    for (index = 0; completed != submitted; index++)
+    {
+        CHECK(index < STEP_LIMIT);
+
+        model_preempt();
+    }
+
+    CHECK(spi.state == STM32L0_SPI_STATE_READY);
+    CHECK(!spi.xf_queue && !spi.xf_transaction && !spi.rq_acquire);
+    CHECK(!selected && !locks && !periph && !exti && !dma_pending);
+    CHECK(!stm32l0_dma_channel(spi.rx_dma) && !stm32l0_dma_channel(spi.tx_dma));
+    CHECK((sequence[0] + sequence[1]) == TRANSACTIONS);
+
+    printf("transactions %u (thread %u, interrupt %u), synchronous %u (waited %u), handler mode %u acquired %u refused, PRIMASK %u acquired %u refused, %u settings changes\n",
+           submitted, sequence[0], sequence[1], synchronous, thread_waits, handler_acquires, handler_refused, primask_acquires, primask_refused, switches);
+
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+def build(directory, source):
+    for name in ("stm32l0_spi_queue_segment", "stm32l0_spi_queue_next", "stm32l0_spi_queue_start", "stm32l0_spi_queue_callback",
+                 "stm32l0_spi_acquire", "stm32l0_spi_release", "stm32l0_spi_submit"):
+        source = instrument(source, name)
+    device = open(DEVICE).read()
+    gpio = open(os.path.join(INCLUDE, "stm32l0_gpio.h")).read()
+    files = (("armv6m.h", ARMV6M),
+             ("stm32l0xx.h", STM32L0XX % "\n".join(re.findall(r"^#define SPI_(?:CR1|CR2|SR)_\w*[ \t]+[^\n]*", device, flags=re.M))),
+             ("stm32l0_gpio.h", GPIO % "\n".join(sorted(set(re.findall(r"^#define STM32L0_GPIO_(?:PARK|PUPD|OSPEED|OTYPE|MODE|PIN_INDEX)_\w*[ \t]+[^\n]*|^#define STM32L0_GPIO_PIN_NONE[ \t]+[^\n]*", gpio, flags=re.M))))),
+             ("stm32l0_spi.c", source),
+             ("harness.cpp", HARNESS))
+    for name, text in files:
+        with open(os.path.join(directory, name), "w") as f:
+            f.write(text)
+    binary = os.path.join(directory, "harness")
+    subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory, "-I" + INCLUDE,
+                            os.path.join(directory, "harness.cpp"), "-o", binary ])
+    return binary
+
+def run(binary):
+    results = []
+    for seed in range(1, 5):
+        # the submitting interrupt below and above the DMA interrupt
+        for level in (1, 3):
+            for rate in (5, 20):
+                result = subprocess.run([ binary, str(seed), str(level), str(rate) ], capture_output=True, text=True)
+                results.append(("seed %d, interrupt %s DMA, 1/%d" % (seed, "below" if level < 2 else "above", rate), result.returncode, result.stdout.strip()))
+    return results
+
+def main():
+    revision = sys.argv[1] if len(sys.argv) > 1 else None
+    with tempfile.TemporaryDirectory() as directory:
+        new = run(build(directory, open(os.path.join(ROOT, SOURCE)).read()))
+        old = None
+        if revision:
+            source = subprocess.check_output([ "git", "-C", ROOT, "show", "%s:%s" % (revision, SOURCE) ], text=True)
+            os.mkdir(os.path.join(directory, "old"))
+            old = run(build(os.path.join(directory, "old"), source))
+    for index, (name, returncode, output) in enumerate(new):
+        print(name)
+        print("  " + output.replace("\n", "\n  "))
+        if old is not None:
+            print("  %s: %s" % (revision, old[index][2] if old[index][1] == 0 else (old[index][2] or "crashed")))
+    for name, returncode, output in new:
+        assert returncode == 0 and "fail:" not in output, name
+    print("OK")
+
+if __name__ == "__main__":
+    main()
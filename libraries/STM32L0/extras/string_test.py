@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# Host allocation-count tests and benchmark for String in
+# cores/arduino/WString.cpp. The harness is built twice with the host g++,
+# once against the working tree WString.cpp and once against the one in a
+# git revision (HEAD, or one given from before the inline storage), with
+# malloc(), realloc() and free() wrapped by the linker to count the calls
+# made by String.
+#
+# Each workload (JSON and AT command building, a line read character by
+# character, short names and tokens, an operator + chain into a reserve()d
+# String, ...) has to produce the same text with both builds; the number of
+# allocator calls and the host time per iteration are printed side by side.
+# A set of edge cases (appending a String to itself, assigning a substring
+# of itself, moves, invalid Strings) is checked on the current build only.
+#
+# The host pointers are 64 bits, so sizeof(String) is larger than the 24
+# bytes (12 before) on the Cortex-M0+.
+#
+#   python3 string_test.py [revision]
+
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+HARNESS = r'''
+#include "WString.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern "C" {
+void *__real_malloc(size_t);
+void *__real_realloc(void *, size_t);
+void __real_free(void *);
+
+static unsigned long allocs, live;
+
+void *__wrap_malloc(size_t size) { allocs++; live++; return __real_malloc(size); }
+void *__wrap_realloc(void *p, size_t size) { allocs++; if (!p) live++; return __real_realloc(p, size); }
+void __wrap_free(void *p) { if (p) live--; __real_free(p); }
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout)
+{
+	sprintf(sout, "%*.*f", width, prec, val);
+	return sout;
+}
+}
+
+static String json(int i)
+{
+	String s = "{";
+	s += "\"id\":";
+	s += i;
+	s += ",\"temp\":";
+	s += 20 + (i % 7);
+	s += ",\"name\":\"";
+	s += "sensor-";
+	s += (i & 15);
+	s += "\",\"ok\":true}";
+	return s;
+}
+
+static String at(int i)
+{
+	String payload = "0A1B2C3D";
+	return String("AT+SEND=") + (i % 224) + "," + payload.length() / 2 + "," + payload + "\r\n";
+}
+
+static String line(int i)
+{
+	static const char text[] = "+CGNSINF: 1,1,20261017120000.000,48.137154,11.576124,519.4,0.00,0.0,1,,1.1,1.4,0.9,,12,7,,,41,,";
+	String s;
+	for (unsigned int n = 0; n < sizeof(text) - 1; n++) s += text[n];
+	s += (char)('0' + i % 10);
+	return s;
+}
+
+static String tokens(int i)
+{
+	String csv = "dev,42,3.3V,ok";
+	String out;
+	int start = 0;
+	for (int comma; (comma = csv.indexOf(',', start)) >= 0; start = comma + 1) {
+		String field = csv.substring(start, comma);
+		field.toUpperCase();
+		out += field.length();
+	}
+	String name = String("node") + (i & 7);
+	out += name;
+	return out;
+}
+
+static String reserved(int i)
+{
+	String s;
+	s.reserve(64);
+	String a = "temperature";
+	String b = "humidity";
+	s = a + "=" + (i % 40) + ";" + b + "=" + (i % 100);
+	return s;
+}
+
+static String chain(int i)
+{
+	String a = "GET /api/v1/", b = "/status", c = " HTTP/1.1\r\nHost: example.com\r\n\r\n";
+	String s = a + "devices/" + (i % 1000) + b + c;
+	return s;
+}
+
+typedef String (*workload)(int);
+
+static const struct { const char *name; workload fn; } workloads[] = {
+	{ "json", json },
+	{ "at", at },
+	{ "line", line },
+	{ "tokens", tokens },
+	{ "reserved", reserved },
+	{ "chain", chain },
+};
+
+#define CHECK(c) do { if (!(c)) { fprintf(stdout, "fail\t%s:%d %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+static void edges(void)
+{
+	String s = "abc";
+	s += s;
+	CHECK(s == "abcabc");
+	s += s;
+	s += s;
+	CHECK(s.length() == 24 && s.startsWith("abcabcabc") && s.endsWith("cabc"));
+	s.concat(s.c_str() + 20);
+	CHECK(s.length() == 28 && s.endsWith("abcabccabc"));
+	String t = "0123456789abcdefghij";
+	t = t.c_str() + 5;
+	CHECK(t == "56789abcdefghij");
+	t = t.c_str() + 10;
+	CHECK(t == "fghij");
+	String u = "short";
+	String v = static_cast<String &&>(u);
+	CHECK(v == "short" && u.length() == 0 && u.c_str() && u.c_str()[0] == 0);
+	String w = "a long string that lives on the heap";
+	String x = static_cast<String &&>(w);
+	CHECK(x == "a long string that lives on the heap" && !w.c_str());
+	x = static_cast<String &&>(v);
+	CHECK(x == "short");
+	String y((const char *)NULL);
+	CHECK(!y.c_str());
+	y += "now valid";
+	CHECK(y == "now valid");
+	String z;
+	z = y + "";
+	CHECK(z == "now valid");
+	String r = "x";
+	r.replace("x", "a longer replacement than the inline space");
+	CHECK(r == "a longer replacement than the inline space");
+	r.replace("a longer replacement than the inline space", "y");
+	CHECK(r == "y");
+	String n = "exactly15chars!";
+	CHECK(n.length() == 15);
+	n += "!";
+	CHECK(n == "exactly15chars!!");
+	String e;
+	e.reserve(40);
+	e = String("k") + "=" + 1234567;
+	CHECK(e == "k=1234567");
+	fprintf(stdout, "edges\tdone\n");
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = (argc > 1) ? atol(argv[1]) : 100000;
+	fprintf(stdout, "sizeof\t%u\n", (unsigned)sizeof(String));
+	if (argc > 2) edges();
+	for (unsigned int k = 0; k < sizeof(workloads) / sizeof(workloads[0]); k++) {
+		unsigned long a0 = allocs, l0 = live;
+		for (int i = 0; i < 16; i++) {
+			String s = workloads[k].fn(i);
+			fprintf(stdout, "out\t%s\t%s\n", workloads[k].name, s.c_str());
+		}
+		a0 = allocs - a0;
+		if (live != l0) fprintf(stdout, "fail\t%s leaks %lu\n", workloads[k].name, live - l0);
+		struct timespec t0, t1;
+		unsigned long sum = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (long i = 0; i < iterations; i++) sum += workloads[k].fn((int)i).length();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / iterations;
+		fprintf(stdout, "count\t%s\t%lu\t%.1f\t%lu\n", workloads[k].name, a0, ns, sum);
+	}
+	return 0;
+}
+'''
+
+def build(directory, name, source):
+    harness = os.path.join(directory, "harness.cpp")
+    with open(harness, "w") as f:
+        f.write(HARNESS)
+    includes = [ "system/CMSIS/Include", "system/CMSIS/Device/ST/STM32L0xx/Include", "system/STM32L0xx/Include",
+                 "variants/Grasshopper-L082CZ", "cores/arduino" ]
+    binary = os.path.join(directory, name)
+    subprocess.check_call([ "gcc", "-O2", "-c", "-w", os.path.join(ROOT, "cores/arduino/itoa.c"), "-o", binary + "-itoa.o" ])
+    subprocess.check_call([ "g++", "-O2", "-std=gnu++11", "-DSTM32L082xx", "-w", "-I" + source ]
+                          + [ "-I" + os.path.join(ROOT, path) for path in includes ]
+                          + [ harness, os.path.join(source, "WString.cpp"), binary + "-itoa.o", "-o", binary,
+                              "-Wl,--wrap=malloc,--wrap=realloc,--wrap=free" ])
+    return binary
+
+def run(binary, *args):
+    output = subprocess.run([ binary ] + list(args), capture_output=True, text=True, check=True).stdout
+    records = [ line.split("\t") for line in output.splitlines() ]
+    fails = [ record for record in records if record[0] == "fail" ]
+    assert not fails, fails
+    return records
+
+def main():
+    revision = sys.argv[1] if len(sys.argv) > 1 else "HEAD"
+    with tempfile.TemporaryDirectory() as directory:
+        old = os.path.join(directory, revision.replace("/", "_"))
+        os.mkdir(old)
+        for name in ("WString.h", "WString.cpp"):
+            with open(os.path.join(old, name), "wb") as f:
+                f.write(subprocess.check_output([ "git", "-C", ROOT, "show", "%s:cores/arduino/%s" % (revision, name) ]))
+        new_records = run(build(directory, "new", os.path.join(ROOT, "cores/arduino")), "100000", "edges")
+        old_records = run(build(directory, "old", old), "100000")
+    assert [ "edges", "done" ] in new_records
+    assert [ r for r in new_records if r[0] == "out" ] == [ r for r in old_records if r[0] == "out" ], "output differs"
+    print("sizeof(String) on the host: %s bytes before, %s bytes now" % (old_records[0][1], new_records[0][1]))
+    print("%-10s %20s %24s" % ("workload", "allocator calls/16", "ns/iteration (host)"))
+    old_counts = { r[1]: r for r in old_records if r[0] == "count" }
+    for record in (r for r in new_records if r[0] == "count"):
+        before = old_counts[record[1]]
+        assert before[4] == record[4]
+        assert int(record[2]) <= int(before[2]), record[1]
+        print("%-10s %9s -> %-9s %11s -> %-11s" % (record[1], before[2], record[2], before[3], record[3]))
+    print("OK")
+
+if __name__ == "__main__":
+    main()
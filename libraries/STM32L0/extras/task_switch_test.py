@@ -0,0 +1,642 @@
+#!/usr/bin/env python3
+#
+# Host tests for the cooperative tasks in armv6m_task.c. The source is
+# compiled with the host gcc against a small armv6m.h stand-in. Only the two
+# naked routines are replaced: armv6m_task_switch() by a ucontext based
+# shim, and armv6m_task_start() by a marker. When the shim switches to a
+# task for the first time it reads the routine and context from the frame
+# that armv6m_task_create() laid out (r8-r11, r4-r7, pc), so the frame
+# layout and alignment are checked as well. The shim also checks that the
+# main task is entered with CONTROL 0 (MSP) and every other task with
+# CONTROL.SPSEL (PSP).
+#
+# __WFE() is modelled with the event register: if __SEV() has set it, WFE
+# clears it and returns. Otherwise the core sleeps until the next pending
+# model interrupt (semaphore give, flag) is delivered. A sleeping WFE with
+# nothing pending, or a WFE while another task is still ready, fails the
+# test.
+#
+# Covered are: round robin order of armv6m_task_yield(), each task running
+# on its own stack, semaphore ping-pong between tasks, wakeup of parked
+# tasks from interrupt context, armv6m_task_exit() and re-creating a task
+# on the same stack, calls from handler mode or a work item (no switch),
+# and the minimum stack size.
+#
+# With an idle routine installed (the role of stm32l0_system_idle()), the
+# idle tests check that armv6m_task_sleep() only calls it once every other
+# task is parked, only on the main task, with the lowest policy of all
+# parked tasks, and that a task that is ready when another task goes to
+# sleep (and might use a device NOTIFY_SLEEP powers down) always runs
+# first.
+#
+#   python3 task_switch_test.py
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+SHIM = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*armv6m_core_routine_t)(void *context);
+
+typedef struct _armv6m_core_callback_t {
+    armv6m_core_routine_t  routine;
+    void                   *context;
+} armv6m_core_callback_t;
+
+#define CONTROL_SPSEL_Msk (1ul << 1)
+
+extern uint32_t model_ipsr, model_work;
+extern void model_wfe(void);
+extern void model_sev(void);
+
+#define __get_IPSR() (model_ipsr)
+#define __WFE() model_wfe()
+#define __SEV() model_sev()
+
+static inline bool armv6m_work_is_executing(void)
+{
+    return model_work;
+}
+
+extern uint32_t armv6m_atomic_inc(volatile uint32_t *p_data, uint32_t data_limit);
+extern uint32_t armv6m_atomic_dec(volatile uint32_t *p_data);
+
+#include "armv6m_task.h"
+
+#endif /* _ARMV6M_H */
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include <stdio.h>
+#include <ucontext.h>
+
+static void armv6m_task_switch(armv6m_task_t *task, armv6m_task_t *task_next);
+static void armv6m_task_start(void);
+
+#include "task.c"
+
+#define TASKS       6
+#define STACK_SIZE  32768
+
+#define FAIL(...) do { printf("fail\t" __VA_ARGS__); printf("\n"); exit(1); } while (0)
+#define CHECK(c) do { if (!(c)) FAIL("%s:%d\t%s", __FILE__, __LINE__, #c); } while (0)
+
+uint32_t model_ipsr, model_work;
+
+typedef struct {
+    armv6m_task_t *task;
+    ucontext_t    context;
+    bool          started;
+} shim_t;
+
+static shim_t shims[TASKS + 1];
+static uint8_t stacks[TASKS][STACK_SIZE] __attribute__((aligned(8)));
+static armv6m_task_t tasks[TASKS];
+static armv6m_core_routine_t start_routine;
+static void *start_context;
+static unsigned int switches, wfes, sleeps;
+static bool event_register;
+
+/* model interrupts, delivered one per WFE */
+typedef struct { armv6m_task_semaphore_t *semaphore; volatile uint32_t *flag; } irq_t;
+static irq_t irqs[64];
+static unsigned int irq_head, irq_tail;
+
+static void irq_give(armv6m_task_semaphore_t *semaphore)
+{
+    irqs[irq_tail++ % 64] = (irq_t){ semaphore, NULL };
+}
+
+static void irq_flag(volatile uint32_t *flag)
+{
+    irqs[irq_tail++ % 64] = (irq_t){ NULL, flag };
+}
+
+uint32_t armv6m_atomic_inc(volatile uint32_t *p_data, uint32_t data_limit)
+{
+    uint32_t data = *p_data;
+    if (data < data_limit)
+    {
+        *p_data = data + 1;
+    }
+    return data;
+}
+
+uint32_t armv6m_atomic_dec(volatile uint32_t *p_data)
+{
+    uint32_t data = *p_data;
+    if (data != 0)
+    {
+        *p_data = data - 1;
+    }
+    return data;
+}
+
+void model_sev(void)
+{
+    event_register = true;
+}
+
+static void check_all_parked(void)
+{
+    armv6m_task_t *task = armv6m_task_control.current, *task_next;
+
+    if (model_ipsr || model_work)
+    {
+        return;
+    }
+
+    for (task_next = task->next; task_next != task; task_next = task_next->next)
+    {
+        if (task_next->state == ARMV6M_TASK_STATE_READY)
+        {
+            FAIL("wfe with a ready task");
+        }
+    }
+}
+
+void model_wfe(void)
+{
+    irq_t irq;
+
+    wfes++;
+    check_all_parked();
+
+    if (event_register)
+    {
+        event_register = false;
+        return;
+    }
+
+    sleeps++;
+
+    if (irq_head == irq_tail)
+    {
+        FAIL("wfe with nothing pending (deadlock)");
+    }
+
+    irq = irqs[irq_head++ % 64];
+
+    if (irq.semaphore)
+    {
+        model_ipsr = 16;
+        armv6m_task_semaphore_give(irq.semaphore);
+        model_ipsr = 0;
+    }
+    if (irq.flag)
+    {
+        *irq.flag = 1;
+    }
+}
+
+static shim_t *shim(armv6m_task_t *task)
+{
+    unsigned int index;
+
+    for (index = 0; index <= TASKS; index++)
+    {
+        if (shims[index].task == task)
+        {
+            return &shims[index];
+        }
+    }
+    for (index = 0; index <= TASKS; index++)
+    {
+        if (shims[index].task == NULL)
+        {
+            shims[index].task = task;
+            shims[index].started = (task == &armv6m_task_control.main);
+            return &shims[index];
+        }
+    }
+    FAIL("shim");
+    return NULL;
+}
+
+static void armv6m_task_start(void)
+{
+}
+
+static void shim_entry(void)
+{
+    armv6m_core_routine_t routine = start_routine;
+    void *context = start_context;
+
+    (*routine)(context);
+    armv6m_task_exit();
+}
+
+static void armv6m_task_switch(armv6m_task_t *task, armv6m_task_t *task_next)
+{
+    shim_t *shim_this = shim(task), *shim_next = shim(task_next);
+    uint32_t *frame;
+    unsigned int index;
+
+    switches++;
+
+    CHECK(task_next->control == ((task_next == &armv6m_task_control.main) ? 0 : CONTROL_SPSEL_Msk));
+    CHECK(armv6m_task_control.current == task_next);
+
+    if (!shim_next->started)
+    {
+        frame = (uint32_t*)task_next->stack;
+
+        CHECK(frame[0] == 0 && frame[1] == 0 && frame[2] == 0 && frame[3] == 0 && frame[6] == 0 && frame[7] == 0);
+        CHECK(frame[8] == (uint32_t)(uintptr_t)&armv6m_task_start);
+        CHECK(((uintptr_t)&frame[9] & 7) == 0);
+
+        for (index = 0; index < TASKS; index++)
+        {
+            if (((uint8_t*)frame > stacks[index]) && ((uint8_t*)&frame[9] <= (stacks[index] + STACK_SIZE)))
+            {
+                break;
+            }
+        }
+        CHECK(index < TASKS);
+
+        start_routine = (armv6m_core_routine_t)(uintptr_t)frame[4];
+        start_context = (void*)(uintptr_t)frame[5];
+
+        getcontext(&shim_next->context);
+        shim_next->context.uc_stack.ss_sp = stacks[index];
+        shim_next->context.uc_stack.ss_size = (uint8_t*)frame - stacks[index];
+        shim_next->context.uc_link = NULL;
+        makecontext(&shim_next->context, shim_entry, 0);
+        shim_next->started = true;
+    }
+
+    swapcontext(&shim_this->context, &shim_next->context);
+}
+
+static bool create(unsigned int index, armv6m_core_routine_t routine, void *context)
+{
+    if (!armv6m_task_create(&tasks[index], routine, context, stacks[index], STACK_SIZE))
+    {
+        return false;
+    }
+    shim(&tasks[index])->started = false;
+    return true;
+}
+
+static unsigned int ring(void)
+{
+    armv6m_task_t *task = armv6m_task_control.current, *task_next;
+    unsigned int count = 1;
+
+    for (task_next = task->next; task_next != task; task_next = task_next->next)
+    {
+        count++;
+    }
+    return count;
+}
+
+/* round robin */
+
+static char trace[256];
+static unsigned int trace_count;
+static volatile uint32_t done;
+
+static void round_robin(void *context)
+{
+    unsigned int n, index = (uintptr_t)context;
+    uint8_t local;
+
+    CHECK((&local > stacks[index]) && (&local < (stacks[index] + STACK_SIZE)));
+    CHECK(armv6m_task_self() == &tasks[index]);
+    CHECK(!armv6m_task_is_main());
+
+    for (n = 0; n < 4; n++)
+    {
+        trace[trace_count++] = 'A' + index;
+        armv6m_task_yield();
+    }
+    done++;
+}
+
+static void test_round_robin(void)
+{
+    unsigned int index;
+
+    trace_count = 0;
+    done = 0;
+    for (index = 0; index < 3; index++)
+    {
+        CHECK(create(index, round_robin, (void*)(uintptr_t)index));
+    }
+    CHECK(ring() == 4);
+    while (done != 3)
+    {
+        trace[trace_count++] = 'm';
+        armv6m_task_yield();
+    }
+    trace[trace_count] = 0;
+    /* tasks are linked in after the creator, so the last one created runs first */
+    CHECK(!strcmp(trace, "mCBAmCBAmCBAmCBAm"));
+    CHECK(ring() == 1);
+    printf("round robin\t%s\n", trace);
+}
+
+/* semaphore ping-pong between two tasks, main parked */
+
+static armv6m_task_semaphore_t ping, pong;
+static unsigned int rounds;
+
+static void pinger(void *context)
+{
+    unsigned int n;
+
+    for (n = 0; n < 1000; n++)
+    {
+        armv6m_task_semaphore_give(&ping);
+        armv6m_task_semaphore_take(&pong);
+        rounds++;
+    }
+    done++;
+}
+
+static void ponger(void *context)
+{
+    unsigned int n;
+
+    for (n = 0; n < 1000; n++)
+    {
+        armv6m_task_semaphore_take(&ping);
+        CHECK(rounds == n);
+        armv6m_task_semaphore_give(&pong);
+    }
+    done++;
+}
+
+static void test_ping_pong(void)
+{
+    unsigned int sleeps_start = sleeps;
+
+    done = 0;
+    rounds = 0;
+    armv6m_task_semaphore_create(&ping, 0);
+    armv6m_task_semaphore_create(&pong, 0);
+    CHECK(create(0, ponger, NULL));
+    CHECK(create(1, pinger, NULL));
+    while (done != 2)
+    {
+        armv6m_task_wfe();
+    }
+    CHECK(rounds == 1000);
+    CHECK(sleeps == sleeps_start);
+    printf("ping pong\t%u rounds, %u switches, no sleep\n", rounds, switches);
+}
+
+/* a task parked on a semaphore given from an interrupt, main parked on a
+ * flag the task sets */
+
+static armv6m_task_semaphore_t event;
+static volatile uint32_t flag;
+
+static void waiter(void *context)
+{
+    unsigned int n;
+
+    for (n = 0; n < 10; n++)
+    {
+        armv6m_task_semaphore_take(&event);
+    }
+    flag = 1;
+}
+
+static void test_interrupt_wakeup(void)
+{
+    unsigned int n, sleeps_start = sleeps;
+
+    flag = 0;
+    armv6m_task_semaphore_create(&event, 0);
+    CHECK(create(2, waiter, NULL));
+    for (n = 0; n < 10; n++)
+    {
+        irq_give(&event);
+    }
+    while (!flag)
+    {
+        armv6m_task_wfe();
+    }
+    CHECK(sleeps - sleeps_start == 10);
+    CHECK(irq_head == irq_tail);
+    while (ring() != 1)
+    {
+        armv6m_task_yield();
+    }
+    printf("interrupt wakeup\t%u sleeps for 10 gives\n", sleeps - sleeps_start);
+}
+
+/* exit and re-create on the same stack */
+
+static unsigned int runs;
+
+static void once(void *context)
+{
+    runs++;
+}
+
+static void test_recreate(void)
+{
+    unsigned int n;
+
+    runs = 0;
+    for (n = 0; n < 100; n++)
+    {
+        CHECK(create(3, once, NULL));
+        CHECK(ring() == 2);
+        armv6m_task_yield();
+        CHECK(ring() == 1);
+        CHECK(tasks[3].state == ARMV6M_TASK_STATE_TERMINATED);
+    }
+    CHECK(runs == 100);
+    printf("recreate\t%u\n", runs);
+}
+
+/* handler mode and work items do not switch */
+
+static void test_not_schedulable(void)
+{
+    unsigned int switches_start;
+    uint32_t *mode;
+    uint32_t *modes[] = { &model_ipsr, &model_work };
+
+    for (mode = NULL; mode != modes[1]; )
+    {
+        mode = (mode == NULL) ? modes[0] : modes[1];
+
+        CHECK(create(4, once, NULL));
+        switches_start = switches;
+        *mode = (mode == &model_ipsr) ? 15 : 1;
+        armv6m_task_yield();
+        model_sev();
+        armv6m_task_sleep(2);
+        CHECK(!create(5, once, NULL));
+        *mode = 0;
+        CHECK(switches == switches_start);
+        armv6m_task_yield();
+        CHECK(ring() == 1);
+    }
+    CHECK(!armv6m_task_create(&tasks[5], once, NULL, stacks[5], ARMV6M_TASK_STACK_MINIMUM - 1));
+    printf("not schedulable\tok\n");
+}
+
+/* idle routine, checked against the policy each live task last asked for */
+
+static unsigned int idle_calls, idle_policy, idle_policies[3];
+static uint32_t wish[TASKS], wish_main;
+static bool started[TASKS], alive[TASKS];
+
+static void idle(uint32_t policy)
+{
+    unsigned int index, expected;
+
+    idle_calls++;
+    idle_policy = policy;
+    idle_policies[policy]++;
+
+    if (!model_ipsr && !model_work)
+    {
+        CHECK(armv6m_task_is_main());
+
+        expected = wish_main;
+        for (index = 0; index < TASKS; index++)
+        {
+            if (alive[index])
+            {
+                CHECK(started[index]);
+                if (expected > wish[index])
+                {
+                    expected = wish[index];
+                }
+            }
+        }
+        CHECK(policy == expected);
+    }
+    check_all_parked();
+    model_wfe();
+}
+
+static void sleeper(void *context)
+{
+    unsigned int index = (uintptr_t)context;
+
+    started[index] = true;
+    wish[index] = 0;
+    armv6m_task_semaphore_take(&event);
+    wish[index] = 1 + (index & 1);
+    while (!armv6m_task_semaphore_try_take(&ping))
+    {
+        armv6m_task_sleep(wish[index]);
+    }
+    alive[index] = false;
+}
+
+static void test_idle(void)
+{
+    unsigned int index, calls_start;
+
+    armv6m_task_idle(idle);
+    armv6m_task_semaphore_create(&event, 0);
+    armv6m_task_semaphore_create(&ping, 0);
+
+    /* main alone */
+    calls_start = idle_calls;
+    wish_main = 2;
+    flag = 0;
+    irq_flag(&flag);
+    while (!flag)
+    {
+        armv6m_task_sleep(2);
+    }
+    CHECK(idle_calls - calls_start == 1);
+
+    /* tasks created right before main sleeps run before the idle routine */
+    for (index = 0; index < 4; index++)
+    {
+        started[index] = false;
+        alive[index] = true;
+        CHECK(create(index, sleeper, (void*)(uintptr_t)index));
+    }
+    for (index = 0; index < 4; index++)
+    {
+        irq_give(&event);
+    }
+    for (index = 0; index < 4; index++)
+    {
+        irq_give(&ping);
+    }
+    flag = 0;
+    irq_flag(&flag);
+    calls_start = idle_calls;
+    while (!flag || (ring() != 1))
+    {
+        armv6m_task_sleep(2);
+    }
+    CHECK(idle_calls - calls_start >= 9);
+    CHECK(idle_policies[0] && idle_policies[1] && idle_policies[2]);
+
+    /* handler mode and work items go straight to the idle routine */
+    model_ipsr = 15;
+    model_sev();
+    armv6m_task_sleep(2);
+    CHECK(idle_policy == 2);
+    model_ipsr = 0;
+
+    armv6m_task_idle(NULL);
+    printf("idle\t%u idle calls (policy 0/1/2: %u/%u/%u)\n", idle_calls, idle_policies[0], idle_policies[1], idle_policies[2]);
+}
+
+int main(void)
+{
+    if ((uintptr_t)&stacks[TASKS] > 0xffffffffu)
+    {
+        FAIL("address");
+    }
+
+    __armv6m_task_initialize();
+    CHECK(armv6m_task_is_main());
+
+    test_round_robin();
+    test_ping_pong();
+    test_interrupt_wakeup();
+    test_recreate();
+    test_not_schedulable();
+    test_idle();
+    return 0;
+}
+'''
+
+def main():
+    source = open(os.path.join(ROOT, "system/STM32L0xx/Source/armv6m_task.c")).read()
+    for name in ("armv6m_task_switch", "armv6m_task_start"):
+        source, count = re.subn(r"static __attribute__\(\([^)]*\)\) void %s\([^)]*\)\n\{.*?\n\}\n" % name, "", source, flags=re.S)
+        assert count == 1, name
+    with tempfile.TemporaryDirectory() as directory:
+        for name, text in (("armv6m.h", SHIM), ("task.c", source), ("harness.c", HARNESS)):
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "gcc", "-O2", "-g", "-w", "-fno-pie", "-no-pie", "-I" + directory,
+                                "-I" + os.path.join(ROOT, "system/STM32L0xx/Include"), os.path.join(directory, "harness.c"), "-o", binary ])
+        run = subprocess.run([ binary ], capture_output=True, text=True)
+    print(run.stdout, end="")
+    assert run.returncode == 0 and "fail" not in run.stdout, run.returncode
+    print("OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1001 @@
+#!/usr/bin/env python3
+#
+# Host benchmark of the active timer queue in stm32l0_rtc.c. The queue code
+# is taken verbatim from the sources: the pairing heap (meld, combine,
+# insert, remove) from the working tree, and the sorted list (insert and the
+# "timer_reclaim" walk) from a git revision before the heap (given, or the
+# baseline). Each is compiled with the host gcc against a stub
+# "stm32l0_rtc_device", and driven the way stm32l0_rtc_timer_routine()
+# drives it:
+#
+#   restart   a random armed timer is started again at a new deadline
+#             (TimerMillis::start(), LoRaMac TimerStart()); the list version
+#             reclaims it by a walk and inserts it again, the heap version
+#             unlinks it and melds it back in
+#   stop      a random timer is stopped and started again later
+#   expire    the earliest timer expires and is rearmed as a periodic one
+#
+# Before timing, every operation is checked against a brute force search for
+# the earliest armed timer, and the expiry order of both queues has to be
+# the same. Host nanoseconds per operation are printed for a range of queue
+# sizes; on the Cortex-M0+ the ratio is what matters, not the numbers.
+#
+# The second part runs the whole timer path of stm32l0_rtc.c on the host:
+# the declarations, the clock capture and conversion, the heap, routine,
+# modify and start/stop code, the alarm B branch of RTC_IRQHandler() and
+# SWI_RTC_TIMER_IRQHandler(), compiled with g++ against an RTC stand-in.
+# The stand-in derives SSR/TR/DR from a tick counter, and raises ALRBF when
+# the calendar fields match ALRMBR/ALRMBSSR, so an alarm that is programmed
+# for a point that has already passed is lost as on the hardware. ALRBWF is
+# only set with ALRBE clear. SVC and PendSV are modelled by calling the
+# routine in the respective context. A preemption point follows every
+# statement of stm32l0_rtc_timer_routine(), where time may pass and another
+# interrupt handler may stop or restart a timer.
+#
+# Periodic TimerMillis users with unrelated phases (sensor polls, GNSS
+# checks, LoRaWAN link checks, ...) rearm themselves from their nominal
+# expiry via stm32l0_rtc_timer_start_slack() in the callback; a callback
+# takes a few ticks, during which the alarm may come in. The "ui" timer is
+# in addition stopped and restarted from thread mode and from interrupts at
+# random. This runs for a few simulated hours over a month boundary, once
+# with exact timers (slack 0) and once per slack setting. No expiry may
+# come before its window or for a stopped timer, no armed timer may be
+# overdue while the core sleeps (other than by the 2 tick minimum timeout
+# after the routine last ran), an armed heap always needs alarm B and the
+# DEEPSLEEP lock, and no expiry may be lost. Reported are wakeups
+# per hour (RTC alarms that take the chip out of STOP) and the mean and
+# worst lateness against the nominal expiry.
+#
+#   python3 timer_bench.py [revision]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCE = "system/STM32L0xx/Source/stm32l0_rtc.c"
+ROUTINE = 'static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)'
+TICKS = 2048                        # STM32L0_RTC_CLOCK_TICKS_PER_SECOND
+
+PRELUDE = r'''
+#include "stm32l0_rtc.h"
+
+static struct {
+    stm32l0_rtc_timer_t                    *timer_active;
+    stm32l0_rtc_timer_t                    *timer_heap;
+    stm32l0_rtc_timer_t * volatile         timer_modify;
+    volatile uint8_t                       timer_reclaim;
+} stm32l0_rtc_device;
+
+#define STM32L0_RTC_TIMER_NULL   ((stm32l0_rtc_timer_t*)0)
+#define STM32L0_RTC_TIMER_TAIL   ((stm32l0_rtc_timer_t*)1)
+#define STM32L0_RTC_TIMER_HEAP   ((stm32l0_rtc_timer_t*)2)
+'''
+
+LIST = r'''
+void list_init(void)
+{
+    stm32l0_rtc_device.timer_active = STM32L0_RTC_TIMER_TAIL;
+    stm32l0_rtc_device.timer_modify = STM32L0_RTC_TIMER_TAIL;
+}
+
+void list_start(stm32l0_rtc_timer_t *timer, uint64_t clock)
+{
+    /* stm32l0_rtc_timer_modify() of a queued timer: mark it, reclaim it,
+     * then insert it from the "timer_modify" list */
+    if (timer->next != STM32L0_RTC_TIMER_NULL)
+    {
+        timer->callback = (stm32l0_rtc_timer_callback_t)((uintptr_t)timer->callback & ~1);
+        stm32l0_rtc_timer_reclaim();
+        stm32l0_rtc_device.timer_modify = STM32L0_RTC_TIMER_TAIL;
+    }
+    timer->clock[0] = (uint32_t)(clock >> 0);
+    timer->clock[1] = (uint32_t)(clock >> 32);
+    timer->callback = (stm32l0_rtc_timer_callback_t)((uintptr_t)timer->callback | 1);
+    stm32l0_rtc_timer_insert(timer, clock);
+}
+
+void list_stop(stm32l0_rtc_timer_t *timer)
+{
+    timer->callback = (stm32l0_rtc_timer_callback_t)((uintptr_t)timer->callback & ~1);
+    stm32l0_rtc_timer_reclaim();
+    stm32l0_rtc_device.timer_modify = STM32L0_RTC_TIMER_TAIL;
+    timer->next = STM32L0_RTC_TIMER_NULL;
+}
+
+stm32l0_rtc_timer_t *list_first(void)
+{
+    return (stm32l0_rtc_device.timer_active != STM32L0_RTC_TIMER_TAIL) ? stm32l0_rtc_device.timer_active : NULL;
+}
+
+void list_expire(void)
+{
+    stm32l0_rtc_timer_t *timer = stm32l0_rtc_device.timer_active;
+
+    stm32l0_rtc_device.timer_active = timer->next;
+    timer->next = STM32L0_RTC_TIMER_NULL;
+}
+'''
+
+HEAP = r'''
+void heap_init(void)
+{
+    stm32l0_rtc_device.timer_heap = NULL;
+}
+
+void heap_start(stm32l0_rtc_timer_t *timer, uint64_t clock)
+{
+    if ((timer == stm32l0_rtc_device.timer_heap) || timer->previous)
+    {
+        stm32l0_rtc_timer_remove(timer);
+    }
+    stm32l0_rtc_timer_insert(timer, clock, 0);
+    timer->next = STM32L0_RTC_TIMER_HEAP;
+}
+
+void heap_stop(stm32l0_rtc_timer_t *timer)
+{
+    stm32l0_rtc_timer_remove(timer);
+    timer->next = STM32L0_RTC_TIMER_NULL;
+}
+
+stm32l0_rtc_timer_t *heap_first(void)
+{
+    return stm32l0_rtc_device.timer_heap;
+}
+
+void heap_expire(void)
+{
+    stm32l0_rtc_timer_t *timer = stm32l0_rtc_device.timer_heap;
+
+    stm32l0_rtc_timer_remove(timer);
+    timer->next = STM32L0_RTC_TIMER_NULL;
+}
+'''
+
+DRIVER = r'''
+#include "stm32l0_rtc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+uint32_t armv6m_atomic_swap(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_previous = *p_data;
+    *p_data = data;
+    return data_previous;
+}
+
+#define QUEUE(name) \
+    extern void name##_init(void); \
+    extern void name##_start(stm32l0_rtc_timer_t *timer, uint64_t clock); \
+    extern void name##_stop(stm32l0_rtc_timer_t *timer); \
+    extern stm32l0_rtc_timer_t *name##_first(void); \
+    extern void name##_expire(void);
+
+QUEUE(list)
+QUEUE(heap)
+
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void (*start)(stm32l0_rtc_timer_t *timer, uint64_t clock);
+    void (*stop)(stm32l0_rtc_timer_t *timer);
+    stm32l0_rtc_timer_t *(*first)(void);
+    void (*expire)(void);
+} queue_t;
+
+static const queue_t queues[] = {
+    { "list", list_init, list_start, list_stop, list_first, list_expire },
+    { "heap", heap_init, heap_start, heap_stop, heap_first, heap_expire },
+};
+
+static stm32l0_rtc_timer_t *timers;
+static uint64_t *deadline;                  /* 0 if stopped */
+static uint32_t *period;
+static uint64_t now, order;
+static uint32_t seed;
+
+static uint32_t random32(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) | ((seed & 0xffff) << 16);
+}
+
+static uint64_t unique(uint64_t clock, unsigned int count)
+{
+    /* low bits carry the timer index, so deadlines never tie */
+    return ((clock / count) + 1) * count;
+}
+
+static void check(const queue_t *q, unsigned int count)
+{
+    unsigned int i, best = count;
+
+    for (i = 0; i < count; i++)
+    {
+        if (deadline[i] && ((best == count) || (deadline[i] < deadline[best])))
+        {
+            best = i;
+        }
+    }
+
+    if (q->first() != ((best == count) ? NULL : &timers[best]))
+    {
+        printf("fail\t%s\tfirst\n", q->name);
+        exit(1);
+    }
+}
+
+static void step(const queue_t *q, unsigned int count, unsigned int kind)
+{
+    stm32l0_rtc_timer_t *timer;
+    unsigned int i;
+
+    switch (kind) {
+    case 0:
+        i = random32() % count;
+        deadline[i] = unique(now + 1 + random32() % (count * 64), count) + i;
+        q->start(&timers[i], deadline[i]);
+        break;
+
+    case 1:
+        i = random32() % count;
+        if (deadline[i])
+        {
+            deadline[i] = 0;
+            q->stop(&timers[i]);
+        }
+        else
+        {
+            deadline[i] = unique(now + 1 + random32() % (count * 64), count) + i;
+            q->start(&timers[i], deadline[i]);
+        }
+        break;
+
+    default:
+        timer = q->first();
+        if (timer)
+        {
+            i = timer - timers;
+            now = deadline[i];
+            order = order * 31 + i;
+            q->expire();
+            deadline[i] = unique(now + period[i], count) + i;
+            q->start(timer, deadline[i]);
+        }
+        break;
+    }
+}
+
+static void setup(const queue_t *q, unsigned int count)
+{
+    unsigned int i;
+
+    memset(timers, 0, count * sizeof(stm32l0_rtc_timer_t));
+    q->init();
+    seed = count;
+    now = 0;
+    order = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        period[i] = 1 + random32() % (count * 64);
+        deadline[i] = unique(now + period[i], count) + i;
+        q->start(&timers[i], deadline[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int counts[] = { 8, 32, 128, 256, 512, 1024 };
+    static const char *kinds[] = { "restart", "stop", "expire" };
+    unsigned int c, k, n, operations = (argc > 1) ? strtoul(argv[1], NULL, 0) : 200000;
+    struct timespec t0, t1;
+
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        unsigned int count = counts[c];
+        uint64_t orders[2];
+
+        timers = calloc(count, sizeof(stm32l0_rtc_timer_t));
+        deadline = calloc(count, sizeof(uint64_t));
+        period = calloc(count, sizeof(uint32_t));
+
+        for (k = 0; k < 2; k++)
+        {
+            setup(&queues[k], count);
+            for (n = 0; n < 20000; n++)
+            {
+                step(&queues[k], count, random32() % 3);
+                check(&queues[k], count);
+            }
+            orders[k] = order;
+        }
+
+        if (orders[0] != orders[1])
+        {
+            printf("fail\torder\t%u\n", count);
+            return 1;
+        }
+
+        for (k = 0; k < 2; k++)
+        {
+            unsigned int kind;
+
+            for (kind = 0; kind < 3; kind++)
+            {
+                unsigned int steps = operations / ((count < 64) ? 1 : (count / 64));
+
+                setup(&queues[k], count);
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                for (n = 0; n < steps; n++)
+                {
+                    step(&queues[k], count, kind);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                printf("time\t%u\t%s\t%s\t%.1f\n", count, queues[k].name, kinds[kind],
+                       ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / steps);
+            }
+        }
+
+        free(timers);
+        free(deadline);
+        free(period);
+    }
+    return 0;
+}
+'''
+
+SLACK_ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    ThreadMode_EXCn = 0,
+    SVCall_EXCn     = 11,
+    PendSV_EXCn     = 14,
+    IRQ0_EXCn       = 16,
+} EXCn_Type;
+
+extern EXCn_Type model_ipsr;
+
+static inline EXCn_Type __get_IPSR(void) { return model_ipsr; }
+static inline void __NOP(void) { }
+
+/* The RTC alarm only comes in between statements, so these are atomic. */
+static inline uint32_t armv6m_atomic_swap(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = data; return o; }
+static inline uint32_t armv6m_atomic_or(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_and(volatile uint32_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+static inline uint32_t armv6m_atomic_incb(volatile uint8_t *p_data) { uint32_t o = *p_data; *p_data = o + 1; return o; }
+static inline uint32_t armv6m_atomic_decb(volatile uint8_t *p_data) { uint32_t o = *p_data; *p_data = o - 1; return o; }
+
+static inline uint32_t armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return = *p_data;
+
+    if (data_return == data_expected) { *p_data = data; }
+
+    return data_return;
+}
+
+static inline uint32_t __armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data) { return armv6m_atomic_cas(p_data, data_expected, data); }
+
+static inline void armv6m_core_store_2(volatile uint32_t *p, uint32_t data_0, uint32_t data_1) { p[0] = data_0; p[1] = data_1; }
+
+extern uint32_t armv6m_svcall_4(uint32_t routine, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+extern bool armv6m_pendsv_raise(uint32_t index);
+
+#define ARMV6M_PENDSV_SWI_RTC_TIMER 5
+
+#define ARMV6M_TRACE_IRQ_ENTER()
+#define ARMV6M_TRACE_IRQ_LEAVE()
+
+#endif
+'''
+
+SLACK_STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+%s
+
+%s
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+};
+
+static inline uint32_t armv6m_atomic_or(model_register_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o | data; return o; }
+static inline uint32_t armv6m_atomic_and(model_register_t *p_data, uint32_t data) { uint32_t o = *p_data; *p_data = o & data; return o; }
+
+typedef struct { model_register_t TR, DR, CR, ISR, ALRMBR, SSR, ALRMBSSR; } RTC_TypeDef;
+
+extern RTC_TypeDef model_rtc;
+
+#define RTC (&model_rtc)
+
+extern void stm32l0_system_lock(uint32_t lock);
+extern void stm32l0_system_unlock(uint32_t lock);
+
+#endif
+'''
+
+SLACK_DRIVER = r'''
+#include <stdio.h>
+#include <unistd.h>
+
+#define CHECK(_expr) do { if (!(_expr)) { printf("fail\tslack\t%d\t%s\n", __LINE__, #_expr); fflush(stdout); _exit(1); } } while (0)
+
+#define TICKS STM32L0_RTC_CLOCK_TICKS_PER_SECOND
+
+EXCn_Type model_ipsr = ThreadMode_EXCn;
+RTC_TypeDef model_rtc;
+
+static uint64_t model_clock;            /* ticks since 1 Jan 2000 */
+static uint64_t model_woken;            /* when the core last left STOP */
+static uint64_t model_slept;            /* when it last went back into STOP */
+static uint32_t model_swi_pending;
+static uint32_t model_locks;
+static uint32_t model_spin;
+static uint64_t model_wakeups, model_alarms;
+static bool model_interrupts;
+static uint32_t seed;
+
+static uint32_t random32(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) | ((seed & 0xffff) << 16);
+}
+
+/* An own calendar, so that the conversions of the driver are checked against it. */
+static void model_tod(uint32_t *p_year, uint32_t *p_month, uint32_t *p_day, uint32_t *p_seconds)
+{
+    static const uint8_t days_in_month[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    uint32_t days, year, month;
+
+    days = model_clock / (86400ull * TICKS);
+
+    for (year = 0; days >= ((year & 3) ? 365 : 366); year++)
+    {
+        days -= ((year & 3) ? 365 : 366);
+    }
+
+    for (month = 0; days >= (days_in_month[month] + ((month == 1) && !(year & 3))); month++)
+    {
+        days -= (days_in_month[month] + ((month == 1) && !(year & 3)));
+    }
+
+    *p_year = year;
+    *p_month = month + 1;
+    *p_day = days + 1;
+    *p_seconds = (model_clock / TICKS) % 86400;
+}
+
+static uint32_t bcd(uint32_t n)
+{
+    return ((n / 10) << 4) | (n % 10);
+}
+
+static uint32_t rtc_ssr_read(model_register_t *reg)
+{
+    return (STM32L0_RTC_PREDIV_S - 1) - (model_clock & (STM32L0_RTC_PREDIV_S - 1));
+}
+
+static uint32_t rtc_tr_read(model_register_t *reg)
+{
+    uint32_t year, month, day, seconds;
+
+    model_tod(&year, &month, &day, &seconds);
+
+    return ((bcd(seconds / 3600) << RTC_TR_HU_Pos) | (bcd((seconds / 60) % 60) << RTC_TR_MNU_Pos) | (bcd(seconds % 60) << RTC_TR_SU_Pos));
+}
+
+static uint32_t rtc_dr_read(model_register_t *reg)
+{
+    uint32_t year, month, day, seconds;
+
+    model_tod(&year, &month, &day, &seconds);
+
+    return ((bcd(year) << RTC_DR_YU_Pos) | (bcd(month) << RTC_DR_MU_Pos) | (bcd(day) << RTC_DR_DU_Pos));
+}
+
+static uint32_t rtc_isr_read(model_register_t *reg)
+{
+    /* ALRMBR and ALRMBSSR can only be written with alarm B disabled */
+    if (model_rtc.CR.value & RTC_CR_ALRBE)
+    {
+        CHECK(++model_spin < 1000);
+
+        return reg->value;
+    }
+
+    model_spin = 0;
+
+    return reg->value | RTC_ISR_ALRBWF;
+}
+
+static void rtc_isr_write(model_register_t *reg, uint32_t data)
+{
+    /* rc_w0 */
+    reg->value &= (data | ~RTC_ISR_ALRBF);
+}
+
+static void rtc_alarm_write(model_register_t *reg, uint32_t data)
+{
+    CHECK(!(model_rtc.CR.value & RTC_CR_ALRBE));
+
+    reg->value = data;
+}
+
+static bool rtc_alarm_match(void)
+{
+    uint32_t alrmr = model_rtc.ALRMBR.value, alrmssr = model_rtc.ALRMBSSR.value;
+    uint32_t mask = (1u << ((alrmssr & RTC_ALRMBSSR_MASKSS) >> RTC_ALRMBSSR_MASKSS_Pos)) - 1;
+    uint32_t tr, dr;
+
+    if (((uint32_t)model_rtc.SSR & mask) != (alrmssr & mask))
+    {
+        return false;
+    }
+
+    CHECK(!(alrmr & (RTC_ALRMBR_MSK4 | RTC_ALRMBR_MSK3 | RTC_ALRMBR_MSK2 | RTC_ALRMBR_MSK1 | RTC_ALRMBR_WDSEL | RTC_ALRMBR_PM)));
+
+    tr = model_rtc.TR;
+    dr = model_rtc.DR;
+
+    return ((((alrmr & (RTC_ALRMBR_DT | RTC_ALRMBR_DU)) >> RTC_ALRMBR_DU_Pos) == ((dr & (RTC_DR_DT | RTC_DR_DU)) >> RTC_DR_DU_Pos)) &&
+            ((alrmr & (RTC_ALRMBR_HT | RTC_ALRMBR_HU | RTC_ALRMBR_MNT | RTC_ALRMBR_MNU | RTC_ALRMBR_ST | RTC_ALRMBR_SU)) ==
+             (tr & (RTC_TR_HT | RTC_TR_HU | RTC_TR_MNT | RTC_TR_MNU | RTC_TR_ST | RTC_TR_SU))));
+}
+
+void stm32l0_system_lock(uint32_t lock)
+{
+    CHECK(lock == STM32L0_SYSTEM_LOCK_DEEPSLEEP);
+    CHECK(model_locks == 0);
+
+    model_locks++;
+}
+
+void stm32l0_system_unlock(uint32_t lock)
+{
+    CHECK(lock == STM32L0_SYSTEM_LOCK_DEEPSLEEP);
+    CHECK(model_locks == 1);
+
+    model_locks--;
+}
+
+bool armv6m_pendsv_raise(uint32_t index)
+{
+    CHECK(index == ARMV6M_PENDSV_SWI_RTC_TIMER);
+
+    if (model_swi_pending & (1u << index))
+    {
+        return false;
+    }
+
+    model_swi_pending |= (1u << index);
+
+    return true;
+}
+
+/* PendSV runs once the core is back to thread mode. */
+static void model_dispatch(void)
+{
+    while (model_swi_pending & (1u << ARMV6M_PENDSV_SWI_RTC_TIMER))
+    {
+        model_swi_pending &= ~(1u << ARMV6M_PENDSV_SWI_RTC_TIMER);
+
+        model_ipsr = PendSV_EXCn;
+        SWI_RTC_TIMER_IRQHandler();
+        model_ipsr = ThreadMode_EXCn;
+    }
+
+    model_slept = model_clock;
+}
+
+uint32_t armv6m_svcall_4(uint32_t routine, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    CHECK(model_ipsr == ThreadMode_EXCn);
+
+    model_ipsr = SVCall_EXCn;
+    (*(void (*)(uintptr_t, uint32_t, uint32_t, uint32_t))(uintptr_t)routine)(a0, a1, a2, a3);
+    model_ipsr = ThreadMode_EXCn;
+
+    model_dispatch();
+
+    return 0;
+}
+
+static void model_advance(uint32_t ticks)
+{
+    EXCn_Type ipsr;
+
+    while (ticks--)
+    {
+        model_clock++;
+
+        if ((model_rtc.CR.value & RTC_CR_ALRBE) && !(model_rtc.ISR.value & RTC_ISR_ALRBF) && rtc_alarm_match())
+        {
+            model_rtc.ISR.value |= RTC_ISR_ALRBF;
+            model_alarms++;
+
+            if (model_rtc.CR.value & RTC_CR_ALRBIE)
+            {
+                ipsr = model_ipsr;
+
+                if (ipsr == ThreadMode_EXCn)
+                {
+                    model_woken = model_clock;
+                    model_wakeups++;
+                }
+
+                model_ipsr = (EXCn_Type)(IRQ0_EXCn + 2);
+                model_rtc_alarm_b();
+                model_ipsr = ipsr;
+
+                if (ipsr == ThreadMode_EXCn)
+                {
+                    model_dispatch();
+                }
+            }
+        }
+    }
+}
+
+typedef struct {
+    const char           *name;
+    uint32_t             period;        /* ms */
+    uint32_t             slack;         /* ms, for "tasks" */
+    uint32_t             work;          /* ticks the callback takes */
+    stm32l0_rtc_timer_t  timer;
+    uint64_t             clock, window, nominal, first;
+    bool                 armed;
+    uint64_t             count, late, late_max;
+} task_t;
+
+static task_t tasks[] = {
+    { "iwdg kick",        4000,    500,  1 },
+    { "accelerometer",    1000,     50,  2 },
+    { "sensor poll",     10000,   2000,  8 },
+    { "environment",     15000,   3000,  4 },
+    { "gnss check",      30000,   5000,  4 },
+    { "battery",         60000,  15000,  2 },
+    { "ui blink",         7000,    700,  2 },
+    { "lorawan link",   300000,  60000,  6 },
+    { "lorawan uplink", 600000, 120000, 16 },
+};
+
+#define TASK_COUNT (sizeof(tasks) / sizeof(tasks[0]))
+#define TASK_UI    6
+
+static uint64_t millis_to_ticks(uint64_t millis)
+{
+    return (millis * TICKS + 999) / 1000;
+}
+
+static void task_callback(void *context)
+{
+    task_t *task = (task_t*)context;
+    uint64_t late;
+
+    CHECK(model_ipsr != ThreadMode_EXCn);
+    CHECK(task->armed && stm32l0_rtc_timer_done(&task->timer));
+    CHECK(stm32l0_rtc_clock_read() == model_clock);
+
+    /* Never before the window opens. The core has to wake up by the end of
+     * the window, or 2 ticks after the routine last ran if that is later,
+     * and past that only the callbacks that ran first delay it.
+     */
+    CHECK(model_clock >= task->nominal);
+    late = model_clock - task->nominal;
+    CHECK(model_woken <= (task->nominal + task->window) || model_woken <= (model_slept + 2));
+
+    task->count++;
+    task->late += late;
+    if (task->late_max < late)
+    {
+        task->late_max = late;
+    }
+
+    model_advance(task->work);
+
+    task->nominal += task->clock;
+    stm32l0_rtc_timer_start_slack(&task->timer, task->nominal, task->window, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
+}
+
+static void task_start(task_t *task, uint64_t clock)
+{
+    task->nominal = task->first = model_clock + clock;
+    task->armed = true;
+    stm32l0_rtc_timer_start_slack(&task->timer, clock, task->window, STM32L0_RTC_TIMER_MODE_RELATIVE);
+    CHECK(!task->armed || ((((uint64_t)task->timer.clock[1] << 32) | task->timer.clock[0]) == task->nominal));
+}
+
+/* Between two statements of stm32l0_rtc_timer_routine() time passes, and
+ * another interrupt handler may stop or restart the "ui" timer.
+ */
+static void model_preempt(void)
+{
+    EXCn_Type ipsr = model_ipsr;
+    task_t *task = &tasks[TASK_UI];
+
+    if (ipsr >= IRQ0_EXCn)
+    {
+        return;
+    }
+
+    if (!(random32() % 16))
+    {
+        model_advance(1);
+    }
+
+    if (model_interrupts && !(random32() % 64))
+    {
+        model_ipsr = (EXCn_Type)(IRQ0_EXCn + 7);
+
+        if (task->armed && !(random32() % 3))
+        {
+            task->armed = false;
+            stm32l0_rtc_timer_stop(&task->timer);
+        }
+        else
+        {
+            task_start(task, 1 + random32() % task->clock);
+        }
+
+        model_ipsr = ipsr;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t percents[] = { 0, 1, 5, 10, 25, 0 };
+    uint32_t setting = strtoul(argv[1], NULL, 0), hours = strtoul(argv[3], NULL, 0);
+    uint64_t end, control;
+    task_t *task;
+    unsigned int i;
+
+    seed = strtoul(argv[2], NULL, 0);
+    model_interrupts = true;
+
+    model_rtc.TR.read = rtc_tr_read;
+    model_rtc.DR.read = rtc_dr_read;
+    model_rtc.SSR.read = rtc_ssr_read;
+    model_rtc.ISR.read = rtc_isr_read;
+    model_rtc.ISR.write = rtc_isr_write;
+    model_rtc.ALRMBR.write = rtc_alarm_write;
+    model_rtc.ALRMBSSR.write = rtc_alarm_write;
+
+    /* __stm32l0_rtc_initialize() */
+    stm32l0_rtc_device.timer_heap = NULL;
+    stm32l0_rtc_device.timer_modify = STM32L0_RTC_TIMER_TAIL;
+
+    /* 29 Feb 2020 21:00:00, so that the alarm has to cross into March */
+    model_clock = ((7364ull * 86400 + 21 * 3600) * TICKS) + (random32() % TICKS);
+    model_woken = model_clock;
+    model_slept = model_clock;
+    end = model_clock + (hours * 3600ull * TICKS);
+
+    for (i = 0; i < TASK_COUNT; i++)
+    {
+        task = &tasks[i];
+        task->clock = millis_to_ticks(task->period);
+        task->window = millis_to_ticks((setting == 5) ? task->slack : ((task->period * percents[setting]) / 100));
+
+        stm32l0_rtc_timer_create(&task->timer, task_callback, task);
+        CHECK(stm32l0_rtc_timer_done(&task->timer));
+    }
+
+    for (i = 0; i < TASK_COUNT; i++)
+    {
+        task = &tasks[i];
+
+        task_start(task, 1 + random32() % task->clock);
+        CHECK(!stm32l0_rtc_timer_done(&task->timer) || !task->armed);
+    }
+
+    for (control = model_clock + TICKS; model_clock < end; model_advance(1))
+    {
+        /* asleep in STOP: nothing overdue, and alarm B armed for the heap */
+        CHECK(model_ipsr == ThreadMode_EXCn);
+        CHECK(!model_swi_pending && !stm32l0_rtc_device.timer_events);
+        CHECK(model_locks == stm32l0_rtc_device.timer_busy);
+        CHECK(!stm32l0_rtc_device.timer_heap || (stm32l0_rtc_device.timer_busy && (model_rtc.CR.value & RTC_CR_ALRBIE)));
+
+        for (i = 0; i < TASK_COUNT; i++)
+        {
+            task = &tasks[i];
+
+            if (task->armed)
+            {
+                CHECK(model_clock <= (task->nominal + task->window) || model_clock <= (model_slept + 2));
+            }
+        }
+
+        if (model_clock >= control)
+        {
+            /* thread mode stops or restarts the "ui" timer */
+            model_woken = model_clock;
+            control = model_clock + TICKS + random32() % (20 * TICKS);
+            task = &tasks[TASK_UI];
+
+            if (task->armed && !(random32() % 3))
+            {
+                task->armed = false;
+                stm32l0_rtc_timer_stop(&task->timer);
+
+                /* unless an interrupt restarted it while the stop went through */
+                CHECK(stm32l0_rtc_timer_done(&task->timer) || task->armed);
+            }
+            else
+            {
+                task_start(task, 1 + random32() % task->clock);
+            }
+        }
+    }
+
+    for (i = 0; i < TASK_COUNT; i++)
+    {
+        task = &tasks[i];
+
+        if (i != TASK_UI)
+        {
+            CHECK(task->count == ((task->nominal - task->first) / task->clock));
+        }
+    }
+
+    model_interrupts = false;
+
+    for (i = 0; i < TASK_COUNT; i++)
+    {
+        task = &tasks[i];
+
+        if (task->armed)
+        {
+            stm32l0_rtc_timer_stop(&task->timer);
+            CHECK(stm32l0_rtc_timer_done(&task->timer));
+        }
+    }
+
+    CHECK(stm32l0_rtc_device.timer_heap == NULL);
+    CHECK(!stm32l0_rtc_device.timer_busy && !model_locks && !(model_rtc.CR.value & RTC_CR_ALRBE));
+
+    uint64_t count = 0, late = 0, late_max = 0;
+
+    for (i = 0; i < TASK_COUNT; i++)
+    {
+        count += tasks[i].count;
+        late += tasks[i].late;
+        if (late_max < tasks[i].late_max)
+        {
+            late_max = tasks[i].late_max;
+        }
+    }
+
+    printf("slack\t%u\t%llu\t%llu\t%llu\t%llu\t%llu\n", setting, (unsigned long long)model_wakeups, (unsigned long long)model_alarms,
+           (unsigned long long)count, (unsigned long long)late, (unsigned long long)late_max);
+    return 0;
+}
+'''
+
+SLACK_SETTINGS = ("exact (before)", "1% of period", "5% of period", "10% of period", "25% of period", "per task")
+
+def extract(text, start, end=ROUTINE):
+    begin = text.index(start)
+    return text[begin:text.index(end, begin)]
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+def block(text, start):
+    # the statement at "start" up to its matching closing brace
+    begin = text.index(start)
+    depth, index = 0, text.index("{", begin)
+    while True:
+        depth += { "{": 1, "}": -1 }.get(text[index], 0)
+        index += 1
+        if depth == 0:
+            return text[begin:index]
+
+def slack(directory, current, hours, seeds):
+    device = open(os.path.join(ROOT, "system/CMSIS/Device/ST/STM32L0xx/Include/stm32l082xx.h")).read()
+    defines = "\n".join(re.findall(r"^#define RTC_\w*[ \t]+[^\n]*", device, flags=re.M))
+    system = "\n".join(re.findall(r"^#define STM32L0_SYSTEM_LOCK_\w*[ \t]+[^\n]*", open(os.path.join(ROOT, "system/STM32L0xx/Include/stm32l0_system.h")).read(), flags=re.M))
+    current = instrument(current, "stm32l0_rtc_timer_routine")
+    harness = "\n".join([
+        '#include "armv6m.h"\n#include "stm32l0xx.h"\n#include "stm32l0_rtc.h"\n\nstatic void model_preempt(void);\n',
+        extract(current, "typedef void (*stm32l0_rtc_modify_routine_t)(void);", "void __stm32l0_rtc_initialize(void)"),
+        extract(current, 'static inline __attribute__((optimize("O3"),always_inline)) void __stm32l0_rtc_clock_capture', "void stm32l0_rtc_clock_to_time("),
+        extract(current, "static inline __attribute__((always_inline)) stm32l0_rtc_timer_t *stm32l0_rtc_timer_meld", "bool stm32l0_rtc_wakeup_start("),
+        "static void model_rtc_alarm_b(void)\n{\n" + block(current[current.index("void RTC_IRQHandler(void)"):], "if (RTC->ISR & RTC_ISR_ALRBF)") + "\n}\n",
+        extract(current, "void SWI_RTC_TIMER_IRQHandler(void)", "\n}\n") + "\n}\n",
+        SLACK_DRIVER ])
+    directory = os.path.join(directory, "slack")
+    os.mkdir(directory)
+    for name, text in (("armv6m.h", SLACK_ARMV6M), ("stm32l0xx.h", SLACK_STM32L0XX % (defines, system)), ("harness.cpp", harness)):
+        with open(os.path.join(directory, name), "w") as f:
+            f.write(text)
+    binary = os.path.join(directory, "harness")
+    subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-fno-pie", "-no-pie", "-DSTM32L082xx", "-I" + directory,
+                            "-I" + os.path.join(ROOT, "system/STM32L0xx/Include"), os.path.join(directory, "harness.cpp"), "-o", binary ])
+    records = []
+    for setting in range(len(SLACK_SETTINGS)):
+        for seed in range(1, seeds + 1):
+            output = subprocess.run([ binary, str(setting), str(seed), str(hours) ], capture_output=True, text=True).stdout
+            records += [ line.split("\t") for line in output.splitlines() ]
+            assert records and records[-1][0] == "slack" and int(records[-1][1]) == setting, output
+    return records
+
+def main():
+    hours, seeds = 6, 3
+    revision = sys.argv[1] if len(sys.argv) > 1 else subprocess.check_output(
+        [ "git", "-C", ROOT, "rev-list", "--max-parents=0", "HEAD" ], text=True).split()[0]
+    current = open(os.path.join(ROOT, SOURCE)).read()
+    previous = subprocess.check_output([ "git", "-C", ROOT, "show", "%s:%s" % (revision, SOURCE) ], text=True)
+    units = {
+        "list.c": PRELUDE + extract(previous, "static void stm32l0_rtc_timer_reclaim(void)") + LIST,
+        "heap.c": PRELUDE + extract(current, "static inline __attribute__((always_inline)) stm32l0_rtc_timer_t *stm32l0_rtc_timer_meld") + HEAP,
+        "driver.c": DRIVER,
+    }
+    includes = [ "system/CMSIS/Include", "system/CMSIS/Device/ST/STM32L0xx/Include", "system/STM32L0xx/Include" ]
+    with tempfile.TemporaryDirectory() as directory:
+        for name, text in units.items():
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "bench")
+        subprocess.check_call([ "gcc", "-O2", "-w", "-DSTM32L082xx" ] + [ "-I" + os.path.join(ROOT, path) for path in includes ]
+                              + [ os.path.join(directory, name) for name in units ] + [ "-o", binary ])
+        output = subprocess.run([ binary ], capture_output=True, text=True, check=True).stdout
+        slacks = slack(directory, current, hours, seeds)
+    records = [ line.split("\t") for line in output.splitlines() ]
+    fails = [ record for record in records if record[0] == "fail" ]
+    assert not fails, fails
+    times = { (int(r[1]), r[2], r[3]): float(r[4]) for r in records if r[0] == "time" }
+    print("ns per operation on the host, sorted list (%s) against pairing heap" % revision[:7])
+    print("%7s %26s %26s %26s" % ("timers", "restart", "stop/start", "expire+rearm"))
+    for count in sorted(set(key[0] for key in times)):
+        print("%7d" % count + "".join(" %10.1f -> %6.1f (%5.1fx)" % (times[count, "list", kind], times[count, "heap", kind],
+                                                                     times[count, "list", kind] / times[count, "heap", kind])
+                                      for kind in ("restart", "stop", "expire")))
+    print()
+    print("stm32l0_rtc_timer_start_slack(), %d hours x %d random phase sets" % (hours, seeds))
+    print("%-16s %14s %14s %14s %14s" % ("slack", "wakeups/hour", "expiries/hour", "mean late ms", "worst late ms"))
+    results = []
+    for setting, label in enumerate(SLACK_SETTINGS):
+        runs = [ [ int(field) for field in record[2:] ] for record in slacks if int(record[1]) == setting ]
+        wakeups, alarms, count, late = (sum(run[index] for run in runs) for index in range(4))
+        result = (wakeups / (hours * seeds), count / (hours * seeds), late * 1000.0 / (count * TICKS), max(run[4] for run in runs) * 1000.0 / TICKS)
+        results.append(result)
+        print("%-16s %14.1f %14.1f %14.2f %14.1f" % ((label,) + result))
+    exact = results[0]
+    for result in results[1:]:
+        # the harness counts each timer's expiries exactly; only the windows open at the end differ
+        assert abs(result[1] - exact[1]) <= exact[1] * 0.01, "expiries must not be lost or added"
+        assert result[0] < exact[0], "slack must not add wakeups"
+    print("per task slack: %.1f%% fewer wakeups" % (100.0 * (1.0 - results[-1][0] / exact[0])))
+    print("OK")
+
+if __name__ == "__main__":
+    main()
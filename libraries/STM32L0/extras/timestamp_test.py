@@ -0,0 +1,538 @@
+#!/usr/bin/env python3
+#
+# Host test of stm32l0_timestamp.c and armv6m_systick.c. Both are compiled
+# with the host g++ against a SysTick model (a down counter with LOAD, VAL,
+# COUNTFLAG and the interrupt, running off a core clock with its own error
+# and halted in STOP) and an RTC clock running off an LSE with a small
+# error. The system notifications for STOP and clock changes are sent the
+# way stm32l0_system.c sends them: clock changes leave SysTick running at
+# the new rate until armv6m_systick_enable() picks up the new
+# SystemCoreClock.
+#
+# A preemption point follows every statement of armv6m_systick_nanos(),
+# armv6m_systick_micros(), the fold and stm32l0_timestamp_read(), where
+# time moves on: up to 2us and the SysTick interrupt, or a few cycles with
+# PRIMASK set. Reads are also placed right at the SysTick wraparound on
+# purpose, with time standing still for them, so that they see SysTick->VAL
+# one cycle before, at and one cycle after 0.
+#
+# Checked is that armv6m_systick_nanos() and armv6m_systick_micros() follow
+# the SysTick cycles to within one cycle between any two reads, each cycle
+# at the scale SysTick was last started with (so the cycles a clock change
+# runs ahead of armv6m_systick_enable() are counted at the old scale, as
+# intended), and that stm32l0_timestamp_read() is monotonic and follows
+# true time to within the rate limit and a SysTick cycle, plus 1ms across
+# STOP and clock changes. The drift of the timeline against true time is printed for RTC
+# only, STOP, clock changes and PPS, with limits of 200ppm and 5ppm with
+# PPS.
+#
+#   python3 timestamp_test.py [seconds]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+SOURCES = ("system/STM32L0xx/Source/armv6m_systick.c", "system/STM32L0xx/Source/stm32l0_timestamp.c")
+INCLUDE = os.path.join(ROOT, "system/STM32L0xx/Include")
+
+ARMV6M = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Registers with side effects call into the model on access. */
+struct model_register_t {
+    uint32_t value;
+    void (*write)(model_register_t *reg, uint32_t data);
+    uint32_t (*read)(model_register_t *reg);
+
+    operator uint32_t() { return read ? (*read)(this) : value; }
+    model_register_t &operator=(uint32_t data) { if (write) { (*write)(this, data); } else { value = data; } return *this; }
+};
+
+typedef struct { model_register_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+
+extern SysTick_Type model_systick;
+
+#define SysTick (&model_systick)
+
+#define SysTick_CTRL_ENABLE_Msk     (1ul << 0)
+#define SysTick_CTRL_TICKINT_Msk    (1ul << 1)
+#define SysTick_CTRL_CLKSOURCE_Msk  (1ul << 2)
+#define SysTick_CTRL_COUNTFLAG_Msk  (1ul << 16)
+
+#define SysTick_IRQn                -1
+#define ARMV6M_IRQ_PRIORITY_SYSTICK 1
+
+static inline void NVIC_SetPriority(int irq, uint32_t priority) { }
+
+extern uint32_t SystemCoreClock;
+
+extern uint32_t model_primask;
+
+extern void model_preempt(void);
+extern void model_interrupt(void);
+
+static inline uint32_t __get_PRIMASK(void) { return model_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { model_primask = primask; model_interrupt(); }
+static inline void __disable_irq(void) { model_primask = 1; }
+
+#include "armv6m_systick.h"
+
+#endif
+'''
+
+STM32L0XX = r'''
+#if !defined(__STM32L0xx_H)
+#define __STM32L0xx_H
+
+#include "armv6m.h"
+
+#endif
+'''
+
+RTC = r'''
+#if !defined(_STM32L0_RTC_H)
+#define _STM32L0_RTC_H
+
+#include "armv6m.h"
+
+%s
+
+extern uint64_t stm32l0_rtc_clock_read();
+
+#endif
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include "stm32l0xx.h"
+#include "armv6m_systick.c"
+#include "stm32l0_timestamp.c"
+#include <stdio.h>
+#include <math.h>
+
+#define CHECK(_c) do { if (!(_c)) { printf("fail: %s (line %d, %.6f s)\n", #_c, __LINE__, hw_time * 1e-9); exit(1); } } while (0)
+
+#define SETTLE_CYCLES  8
+
+uint32_t SystemCoreClock;
+uint32_t model_primask;
+SysTick_Type model_systick;
+static bool model_quiet;
+
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+
+    return rng_state;
+}
+
+/* ---- hardware ---- */
+
+static double hw_time;                  /* true time in ns */
+static double hw_fraction;              /* part of a core clock cycle */
+static uint32_t hw_clock;               /* nominal core clock */
+static double hw_error;                 /* of the core clock */
+static bool hw_stopped;
+static double lse_error;
+
+/* what armv6m_systick_nanos() has to return: SysTick cycles in ns, each at
+ * the scale of the SystemCoreClock SysTick was last started with */
+static double expect_nanos;
+static uint32_t expect_clock;
+
+/* expect_nanos and the true time as of the last SysTick->VAL read */
+static double expect_val, time_val;
+
+static uint32_t systick_val, countflag, pending, wraps, zero_reads;
+
+static void systick_count(uint64_t count)
+{
+    uint64_t step;
+
+    if (!(model_systick.CTRL.value & SysTick_CTRL_ENABLE_Msk))
+    {
+        return;
+    }
+
+    expect_nanos += (double)count * 1e9 / expect_clock;
+
+    while (count)
+    {
+        if (systick_val == 0)
+        {
+            systick_val = model_systick.LOAD.value;
+            count--;
+            continue;
+        }
+
+        step = (count < systick_val) ? count : systick_val;
+        systick_val -= step;
+        count -= step;
+
+        /* COUNTFLAG and the interrupt come with the 1 to 0 transition */
+        if (systick_val == 0)
+        {
+            CHECK(!pending);
+
+            countflag = 1;
+            pending = 1;
+            wraps++;
+        }
+    }
+}
+
+static void hw_advance(double nanos)
+{
+    double cycles;
+
+    hw_time += nanos;
+
+    if (!hw_stopped)
+    {
+        cycles = hw_fraction + nanos * (hw_clock * (1.0 + hw_error)) * 1e-9;
+
+        hw_fraction = cycles - floor(cycles);
+
+        systick_count((uint64_t)floor(cycles));
+    }
+}
+
+static void hw_advance_cycles(uint32_t cycles)
+{
+    hw_time += cycles * 1e9 / (hw_clock * (1.0 + hw_error));
+
+    systick_count(cycles);
+}
+
+static uint32_t systick_ctrl_read(model_register_t *reg)
+{
+    uint32_t data = reg->value | (countflag ? SysTick_CTRL_COUNTFLAG_Msk : 0);
+
+    countflag = 0;
+
+    return data;
+}
+
+static uint32_t systick_val_read(model_register_t *reg)
+{
+    if (systick_val == 0)
+    {
+        zero_reads++;
+    }
+
+    expect_val = expect_nanos;
+    time_val = hw_time;
+
+    return systick_val;
+}
+
+static void systick_val_write(model_register_t *reg, uint32_t data)
+{
+    /* armv6m_systick_enable() folds the count into "nanos", then restarts
+     * SysTick; the cycles in between are not counted */
+    if (model_systick.CTRL.value & SysTick_CTRL_ENABLE_Msk)
+    {
+        expect_nanos = expect_val;
+    }
+
+    expect_clock = SystemCoreClock;
+
+    systick_val = 0;
+    countflag = 0;
+}
+
+uint64_t stm32l0_rtc_clock_read()
+{
+    return (uint64_t)floor(hw_time * (1.0 + lse_error) * STM32L0_RTC_CLOCK_TICKS_PER_SECOND * 1e-9);
+}
+
+void model_interrupt(void)
+{
+    if (!model_primask && pending)
+    {
+        pending = 0;
+
+        SysTick_Handler();
+    }
+}
+
+void model_preempt(void)
+{
+    if (model_quiet)
+    {
+        model_interrupt();
+    }
+    else if (model_primask)
+    {
+        hw_advance_cycles(1 + (rng() % 4));
+    }
+    else
+    {
+        hw_advance(rng() % 2000);
+
+        model_interrupt();
+    }
+}
+
+/* ---- system ---- */
+
+static stm32l0_system_callback_t notify_callback;
+static void *notify_context;
+static uint32_t notify_mask;
+
+void stm32l0_system_register(stm32l0_system_notify_t *notify, stm32l0_system_callback_t callback, void *context, uint32_t mask)
+{
+    notify_callback = callback;
+    notify_context = context;
+    notify_mask = mask;
+}
+
+uint32_t stm32l0_system_sysclk(void)
+{
+    return SystemCoreClock;
+}
+
+static void system_notify(uint32_t notify)
+{
+    if (notify_mask & notify)
+    {
+        (*notify_callback)(notify_context, notify);
+    }
+}
+
+/* stm32l0_system_sysclk_configure(): the new clock runs for a few cycles
+ * before armv6m_systick_enable() sees it */
+static void system_clock(uint32_t clock, double error)
+{
+    hw_clock = clock;
+    hw_error = error;
+
+    hw_advance_cycles(SETTLE_CYCLES);
+
+    SystemCoreClock = clock;
+
+    armv6m_systick_enable();
+
+    system_notify(STM32L0_SYSTEM_NOTIFY_CLOCKS);
+}
+
+static void system_stop(double nanos)
+{
+    system_notify(STM32L0_SYSTEM_NOTIFY_STOP_ENTER);
+
+    hw_stopped = true;
+    hw_advance(nanos);
+    hw_stopped = false;
+
+    system_notify(STM32L0_SYSTEM_NOTIFY_STOP_LEAVE);
+}
+
+/* ---- test ---- */
+
+static const uint32_t clocks[3] = { 32000000, 2097152, 65536 };
+static const double errors[3] = { 0.007, -0.003, -0.003 };
+
+int main(int argc, char **argv)
+{
+    uint32_t pps = strtoul(argv[1], NULL, 0);
+    uint32_t stop = strtoul(argv[2], NULL, 0);
+    uint32_t change = strtoul(argv[3], NULL, 0);
+    double seconds = strtod(argv[4], NULL);
+    uint64_t timestamp, timestamp_last, nanos, nanos_last;
+    uint32_t micros, micros_last, reads, stops, changes, index;
+    double timestamp_time, timestamp_time_last, nanos_expect, nanos_expect_last, micros_expect, micros_expect_last;
+    double step, tolerance, start, next_pps, drift_time, drift_error;
+    bool settle;
+    stm32l0_timestamp_status_t status;
+
+    rng_state = strtoul(argv[5], NULL, 0);
+    lse_error = 0.00002;
+
+    model_systick.CTRL.read = systick_ctrl_read;
+    model_systick.VAL.read = systick_val_read;
+    model_systick.VAL.write = systick_val_write;
+
+    /* stm32l0_system_initialize() */
+    model_primask = 1;
+    hw_time = 1e9 * (rng() % 1000);
+    hw_clock = clocks[0];
+    hw_error = errors[0];
+    SystemCoreClock = hw_clock;
+    armv6m_systick_enable();
+    __stm32l0_timestamp_initialize();
+    __set_PRIMASK(0);
+
+    timestamp_last = stm32l0_timestamp_read();
+    timestamp_time_last = time_val;
+    nanos_last = armv6m_systick_nanos();
+    nanos_expect_last = expect_val;
+    micros_last = armv6m_systick_micros();
+    micros_expect_last = expect_val;
+
+    reads = 0;
+    stops = 0;
+    changes = 0;
+    tolerance = 0;
+    settle = false;
+    start = hw_time;
+    next_pps = ceil(hw_time * 1e-9 + 1) * 1e9;
+    drift_time = 0;
+    drift_error = 0;
+
+    while (hw_time < (start + seconds * 1e9))
+    {
+        step = 500000 + (rng() % 1500000);
+
+        if (pps && ((hw_time + step + 1e6) >= next_pps))
+        {
+            /* the PPS edge, taken with up to 2us of interrupt latency */
+            hw_advance(next_pps - hw_time + (rng() % 2000));
+            model_interrupt();
+
+            stm32l0_timestamp_pps(stm32l0_timestamp_read());
+
+            next_pps += 1e9;
+        }
+        else if (!(rng() % 16) && (systick_val >= 2) && (!pps || ((hw_time + (systick_val + 2) * 1e9 / (hw_clock * (1.0 + hw_error)) + 1e6) < next_pps)))
+        {
+            /* right before, at or right after the SysTick wraparound */
+            hw_advance_cycles(systick_val + 1 - (rng() % 3));
+
+            model_quiet = true;
+        }
+        else
+        {
+            hw_advance(step);
+        }
+
+        model_interrupt();
+
+        timestamp = stm32l0_timestamp_read();
+        timestamp_time = time_val;
+        nanos = armv6m_systick_nanos();
+        nanos_expect = expect_val;
+        micros = armv6m_systick_micros();
+        micros_expect = expect_val;
+        reads++;
+
+        model_quiet = false;
+
+        tolerance += 1e9 / SystemCoreClock;
+
+        CHECK(timestamp >= timestamp_last);
+        CHECK(fabs((double)(timestamp - timestamp_last) - (timestamp_time - timestamp_time_last)) <= (0.03 * (timestamp_time - timestamp_time_last) + tolerance + 2000 + (settle ? 1e6 : 0)));
+
+        CHECK(fabs((double)(int64_t)(nanos - nanos_last) - (nanos_expect - nanos_expect_last)) <= (tolerance + 1000));
+        CHECK(fabs((double)(uint32_t)(micros - micros_last) - (micros_expect - micros_expect_last) * 1e-3) <= ((tolerance + 2000) * 1e-3));
+
+        timestamp_last = timestamp;
+        timestamp_time_last = timestamp_time;
+        nanos_last = nanos;
+        nanos_expect_last = nanos_expect;
+        micros_last = micros;
+        micros_expect_last = micros_expect;
+        tolerance = 0;
+        settle = false;
+
+        if (stop && !(rng() % 500))
+        {
+            __disable_irq();
+            system_stop(1e6 * (10 + (rng() % 3000)));
+            __set_PRIMASK(0);
+
+            stops++;
+
+            /* across STOP the timeline comes from the RTC */
+            settle = true;
+        }
+
+        if (change && !(rng() % 200))
+        {
+            index = rng() % 3;
+
+            __disable_irq();
+            settle = true;
+            tolerance = 1e9 / SystemCoreClock;
+            system_clock(clocks[index], errors[index]);
+            __set_PRIMASK(0);
+
+            changes++;
+        }
+
+        if (!drift_time && (hw_time >= (start + (seconds - 10) * 1e9)))
+        {
+            drift_time = timestamp_time;
+            drift_error = (double)timestamp - timestamp_time;
+        }
+    }
+
+    timestamp = stm32l0_timestamp_read();
+    timestamp_time = time_val;
+
+    stm32l0_timestamp_status(&status);
+
+    printf("correction %9.1f ppm, drift %7.2f ppm, pps %s, %u reads, %u wraps, %u at zero, %u stops, %u clock changes\n",
+           status.correction * 1e-3, (((double)timestamp - timestamp_time) - drift_error) / (timestamp_time - drift_time) * 1e6,
+           status.locked ? "locked" : "-", reads, wraps, zero_reads, stops, changes);
+
+    return 0;
+}
+'''
+
+def instrument(source, name):
+    # a preemption point after every statement of the function body
+    match = re.search(r"\n[^\n]*\b%s\([^)]*\)\n\{\n(.*?)\n\}\n" % name, source, flags=re.S)
+    assert match, name
+    body = re.sub(r";[ \t]*\n", "; model_preempt();\n", match.group(1))
+    return source[:match.start(1)] + body + source[match.end(1):]
+
+SCENARIOS = (("rtc only", 0, 0, 0), ("rtc, stop", 0, 1, 0), ("rtc, stop, clocks", 0, 1, 1), ("pps", 1, 0, 0))
+
+def main():
+    seconds = sys.argv[1] if len(sys.argv) > 1 else "300"
+    systick = open(os.path.join(ROOT, SOURCES[0])).read()
+    for name in ("armv6m_systick_fold", "armv6m_systick_micros", "armv6m_systick_nanos"):
+        systick = instrument(systick, name)
+    timestamp = instrument(open(os.path.join(ROOT, SOURCES[1])).read(), "stm32l0_timestamp_read")
+    rtc = "\n".join(re.findall(r"^#define STM32L0_RTC_(?:PREDIV_S|CLOCK_TICKS_PER_SECOND)[ \t]+[^\n]*", open(os.path.join(INCLUDE, "stm32l0_rtc.h")).read(), flags=re.M))
+    with tempfile.TemporaryDirectory() as directory:
+        files = (("armv6m.h", ARMV6M), ("stm32l0xx.h", STM32L0XX), ("stm32l0_rtc.h", RTC % rtc),
+                 ("armv6m_systick.c", systick), ("stm32l0_timestamp.c", timestamp), ("harness.cpp", HARNESS))
+        for name, text in files:
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "g++", "-O2", "-g", "-w", "-fpermissive", "-DSTM32L082xx", "-I" + directory, "-I" + INCLUDE,
+                                os.path.join(directory, "harness.cpp"), "-o", binary ])
+        failed = False
+        for name, pps, stop, change in SCENARIOS:
+            for seed in (1, 2):
+                run = subprocess.run([ binary, str(pps), str(stop), str(change), seconds, str(seed) ], capture_output=True, text=True)
+                output = run.stdout.strip()
+                print("%-18s seed %d: %s" % (name, seed, output))
+                if run.returncode or "fail:" in output:
+                    failed = True
+                    continue
+                drift = abs(float(re.search(r"drift +(-?[\d.]+)", output).group(1)))
+                if drift > (5.0 if pps else 200.0):
+                    print("fail: drift")
+                    failed = True
+    assert not failed
+    print("OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+#
+# Converts the output of STM32L0.dumpTrace() into the Chrome trace JSON
+# format (chrome://tracing, ui.perfetto.dev).
+#
+#   python3 trace2chrome.py trace.txt > trace.json
+#
+# Timestamps are armv6m_systick_micros(), which restart at 0 on a system
+# clock change and wrap at 2^32. Both are unwrapped here so that the
+# resulting timeline is monotonic.
+
+import json
+import sys
+
+TYPES = {
+    1:  ("irq",    "B"),
+    2:  ("irq",    "E"),
+    3:  ("pendsv", "B"),
+    4:  ("pendsv", "E"),
+    5:  ("work",   "B"),
+    6:  ("work",   "E"),
+    7:  ("sleep",  "B"),
+    8:  ("sleep",  "E"),
+    9:  ("radio",  "i"),
+    10: ("clock",  "i"),
+}
+
+SLEEP = { 0: "WFE", 1: "SLEEP", 2: "STOP" }
+
+THREADS = { "irq": 1, "pendsv": 2, "work": 3, "sleep": 4, "radio": 5, "clock": 5, "user": 6 }
+
+def name(category, ident, data):
+    if category == "irq":
+        return "IRQ %d" % (ident - 16) if ident >= 16 else "EXC %d" % ident
+    if category in ("pendsv", "work"):
+        return "0x%08x" % data
+    if category == "sleep":
+        return SLEEP.get(ident, str(ident))
+    if category == "radio":
+        return "DIO%d" % ident
+    if category == "clock":
+        return "%d Hz" % data
+    return "USER %d" % ident
+
+def convert(lines):
+    events = []
+    offset = 0
+    last = None
+    for line in lines:
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue
+        timestamp, kind, ident, data = line.split(",")
+        timestamp, kind, ident, data = int(timestamp), int(kind), int(ident), int(data, 16)
+        if last is not None and timestamp < last:
+            offset += (last - timestamp) if kind == 10 else (1 << 32)
+        last = timestamp
+        category, phase = TYPES.get(kind, ("user", "i"))
+        event = {
+            "name": name(category, ident, data),
+            "cat":  category,
+            "ph":   phase,
+            "ts":   timestamp + offset,
+            "pid":  0,
+            "tid":  THREADS[category],
+        }
+        if phase == "i":
+            event["s"] = "t"
+        if category == "user":
+            event["args"] = { "type": kind, "data": data }
+        events.append(event)
+    return { "traceEvents": events }
+
+def main():
+    with (open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin) as f:
+        json.dump(convert(f), sys.stdout, indent=1)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+#
+# Host model of the priority classes in armv6m_work.c. The scheduler code
+# (armv6m_work_submit(), armv6m_work_schedule(), armv6m_work_dispatch()) is
+# compiled from the source with the host gcc, against a small armv6m.h
+# stand-in; only the naked armv6m_work_execute() is replaced by the model.
+#
+# The model runs a thread, PendSV and up to three nested interrupt levels
+# on one host thread. Every atomic operation is a preemption point (before
+# and after), where an interrupt may come in and submit work. A pending
+# PendSV, and with it SWI_WORK_SCHEDULE and the work items, runs as soon as
+# the model is back in thread mode, also in the middle of a thread mode
+# armv6m_work_submit(). Work items take a random time in slices, each slice
+# being a preemption point, and may submit more work. NORMAL items stand
+# for DOSFS flushes (up to 3ms), HIGH for MAC processing, URGENT for radio
+# interrupts deferred to work.
+#
+# Checked are: every successful submit executes exactly once; items of a
+# class run in the order their submit linked them in; no item starts while
+# a higher class item is ready; armv6m_work_statistics() matches the
+# observed worst case latency. The same load is then run with all items in
+# one class (the single FIFO before) to show the latency that URGENT work
+# sees behind NORMAL work. With classes, the URGENT latency from the point
+# the item got linked in has to stay below the bound of the longest item
+# plus the URGENT backlog.
+#
+#   python3 work_latency_model.py [steps] [seed]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", ".."))
+
+SHIM = r'''
+#if !defined(_ARMV6M_H)
+#define _ARMV6M_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*armv6m_core_routine_t)(void *context);
+
+typedef struct _armv6m_core_callback_t {
+    armv6m_core_routine_t  routine;
+    void                   *context;
+} armv6m_core_callback_t;
+
+typedef void (*armv6m_pendsv_callback_t)(void);
+
+#define ARMV6M_PENDSV_SWI_WORK_SCHEDULE 9
+
+#define ARMV6M_TRACE_EVENT(_type, _id, _data)
+
+extern void model_preempt(void);
+extern void model_link(volatile uint32_t *p_data, uint32_t data);
+
+extern uint32_t armv6m_systick_micros(void);
+extern void armv6m_pendsv_hook(armv6m_pendsv_callback_t callback);
+extern bool armv6m_pendsv_raise(uint32_t index);
+extern uint32_t armv6m_atomic_swap(volatile uint32_t *p_data, uint32_t data);
+
+static inline uint32_t __armv6m_atomic_swap(volatile uint32_t *p_data, uint32_t data)
+{
+    uint32_t data_return;
+
+    model_preempt();
+    data_return = *p_data;
+    *p_data = data;
+    model_link(p_data, data);
+    model_preempt();
+    return data_return;
+}
+
+static inline uint32_t __armv6m_atomic_cas(volatile uint32_t *p_data, uint32_t data_expected, uint32_t data)
+{
+    uint32_t data_return;
+
+    model_preempt();
+    data_return = *p_data;
+    if (data_return == data_expected)
+    {
+        *p_data = data;
+        model_link(p_data, data);
+    }
+    model_preempt();
+    return data_return;
+}
+
+static inline uint32_t __armv6m_atomic_inc(volatile uint32_t *p_data, uint32_t data_limit)
+{
+    uint32_t data_return;
+
+    model_preempt();
+    data_return = *p_data;
+    if (data_return < data_limit)
+    {
+        *p_data = data_return + 1;
+    }
+    model_preempt();
+    return data_return;
+}
+
+static inline uint32_t __armv6m_atomic_dec(volatile uint32_t *p_data)
+{
+    uint32_t data_return;
+
+    model_preempt();
+    data_return = *p_data;
+    if (data_return != 0)
+    {
+        *p_data = data_return - 1;
+    }
+    model_preempt();
+    return data_return;
+}
+
+#include "armv6m_work.h"
+
+#endif /* _ARMV6M_H */
+'''
+
+HARNESS = r'''
+#include "armv6m.h"
+#include <stdio.h>
+
+static void armv6m_work_execute(void);
+
+#include "work.c"
+
+#define CLASSES   ARMV6M_WORK_PRIORITY_COUNT
+#define ITEMS     6
+#define IRQ_COST  8
+
+typedef struct {
+    uint64_t    seq;              /* submit order, taken when linked into "submit" */
+    uint32_t    link;             /* time when linked into "submit" */
+    uint32_t    irq;              /* interrupt time at that point */
+    uint32_t    submitted, executed;
+} item_t;
+
+static armv6m_work_t work[CLASSES][ITEMS];
+static item_t item[CLASSES][ITEMS];
+
+static uint32_t now, irq_total, seed;
+static int level;                 /* 0 thread, 1 PendSV/SVCall, 2.. interrupts */
+static bool pendsv_pending;
+static armv6m_pendsv_callback_t hooked;
+static uint64_t seq, seq_last[CLASSES];
+static uint32_t rate, single, errors;
+static uint32_t latency_max[CLASSES], latency_model[CLASSES], execution_max[CLASSES];
+static uint64_t latency_sum[CLASSES], count[CLASSES];
+
+static uint32_t random32(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+#define FAIL(...) do { printf("fail\t" __VA_ARGS__); printf("\n"); errors++; } while (0)
+
+uint32_t armv6m_systick_micros(void)
+{
+    return now;
+}
+
+bool armv6m_pendsv_raise(uint32_t index)
+{
+    pendsv_pending = true;
+    return true;
+}
+
+void armv6m_pendsv_hook(armv6m_pendsv_callback_t callback)
+{
+    hooked = callback;
+}
+
+uint32_t armv6m_atomic_swap(volatile uint32_t *p_data, uint32_t data)
+{
+    return __armv6m_atomic_swap(p_data, data);
+}
+
+void model_link(volatile uint32_t *p_data, uint32_t data)
+{
+    unsigned int priority;
+
+    for (priority = 0; priority < CLASSES; priority++)
+    {
+        if (p_data == (volatile uint32_t*)&armv6m_work_control.submit[priority] && (data != (uint32_t)ARMV6M_WORK_TAIL))
+        {
+            armv6m_work_t *w = (armv6m_work_t*)(uintptr_t)data;
+            item_t *i = &item[0][0] + (w - &work[0][0]);
+            i->seq = ++seq;
+            i->link = now;
+            i->irq = irq_total;
+        }
+    }
+}
+
+static void submit(void)
+{
+    unsigned int priority = random32() % CLASSES, index = random32() % ITEMS;
+    armv6m_work_t *w = &work[priority][index];
+
+    if (armv6m_work_submit(w))
+    {
+        item[priority][index].submitted++;
+    }
+}
+
+static void irq(void)
+{
+    unsigned int n;
+
+    level++;
+    now += IRQ_COST;
+    irq_total += IRQ_COST;
+    for (n = random32() % 3; n; n--)
+    {
+        submit();
+    }
+    level--;
+}
+
+static void routine(void *context);
+
+static void pendsv(void)
+{
+    /* PendSV, then the hooked armv6m_work_execute() in thread mode, then
+     * SVCall into armv6m_work_dispatch(), which may hook the next item */
+    while (pendsv_pending)
+    {
+        pendsv_pending = false;
+        level = 1;
+        SWI_WORK_SCHEDULE_IRQHandler();
+        level = 0;
+
+        while (hooked)
+        {
+            armv6m_core_callback_t callback = armv6m_work_control.callback;
+
+            hooked = NULL;
+            (*callback.routine)(callback.context);
+            level = 1;
+            armv6m_work_control.callback.routine = NULL;
+            armv6m_work_dispatch();
+            level = 0;
+        }
+    }
+}
+
+void model_preempt(void)
+{
+    now++;
+
+    if ((level < 4) && ((random32() % 10000) < rate))
+    {
+        irq();
+    }
+
+    if ((level == 0) && pendsv_pending)
+    {
+        pendsv();
+    }
+}
+
+static void armv6m_work_execute(void)
+{
+}
+
+static void routine(void *context)
+{
+    armv6m_work_t *w = (armv6m_work_t*)context;
+    unsigned int priority = (w - &work[0][0]) / ITEMS, index = (w - &work[0][0]) % ITEMS, higher;
+    item_t *i = &item[priority][index];
+    uint32_t cost, start = now, latency, irq_start = irq_total;
+
+    if (i->seq <= seq_last[w->priority])
+    {
+        FAIL("order\t%u\t%u", priority, index);
+    }
+    seq_last[w->priority] = i->seq;
+
+    for (higher = w->priority + 1; higher < CLASSES; higher++)
+    {
+        if (armv6m_work_control.head[higher] != NULL)
+        {
+            FAIL("priority\t%u\t%u", priority, higher);
+        }
+    }
+
+    latency = now - w->timestamp;
+    if (latency > latency_max[w->priority])
+    {
+        latency_max[w->priority] = latency;
+    }
+    latency = (now - i->link) - (irq_total - i->irq);
+    if (latency > latency_model[priority])
+    {
+        latency_model[priority] = latency;
+    }
+    latency_sum[priority] += latency;
+    count[priority]++;
+    i->executed++;
+
+    switch (priority) {
+    case ARMV6M_WORK_PRIORITY_NORMAL: cost = 500 + random32() % 2500; break;
+    case ARMV6M_WORK_PRIORITY_HIGH:   cost = 50 + random32() % 250;   break;
+    default:                          cost = 10 + random32() % 50;    break;
+    }
+
+    while ((now - start) < cost)
+    {
+        now += 9;
+        model_preempt();
+        if ((random32() % 512) == 0)
+        {
+            submit();
+        }
+    }
+
+    cost = (now - start) - (irq_total - irq_start);
+    if (cost > execution_max[priority])
+    {
+        execution_max[priority] = cost;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int steps = strtoul(argv[1], NULL, 0), priority, index, n;
+    armv6m_work_statistics_t statistics;
+
+    seed = strtoul(argv[2], NULL, 0);
+    rate = strtoul(argv[3], NULL, 0);
+    single = strtoul(argv[4], NULL, 0);
+
+    if ((uintptr_t)&work[CLASSES][0] > 0xffffffffu)
+    {
+        printf("fail\taddress\n");
+        return 1;
+    }
+
+    __armv6m_work_initialize();
+
+    for (priority = 0; priority < CLASSES; priority++)
+    {
+        for (index = 0; index < ITEMS; index++)
+        {
+            armv6m_work_create_priority(&work[priority][index], routine, &work[priority][index], single ? 0 : priority);
+        }
+    }
+
+    for (n = 0; n < steps; n++)
+    {
+        now += 9;
+        model_preempt();
+        if ((random32() % 256) == 0)
+        {
+            submit();
+        }
+    }
+
+    rate = 0;
+
+    while (pendsv_pending)
+    {
+        pendsv();
+    }
+
+    if (armv6m_work_control.busy)
+    {
+        FAIL("busy");
+    }
+
+    for (priority = 0; priority < CLASSES; priority++)
+    {
+        for (index = 0; index < ITEMS; index++)
+        {
+            if (item[priority][index].submitted != item[priority][index].executed)
+            {
+                FAIL("count\t%u\t%u\t%u\t%u", priority, index, item[priority][index].submitted, item[priority][index].executed);
+            }
+        }
+
+        armv6m_work_statistics(priority, &statistics);
+        if (statistics.latency != latency_max[priority])
+        {
+            FAIL("statistics\t%u\t%u\t%u", priority, statistics.latency, latency_max[priority]);
+        }
+    }
+
+    for (priority = 0; priority < CLASSES; priority++)
+    {
+        printf("class\t%u\t%llu\t%u\t%.1f\t%u\n", priority, (unsigned long long)count[priority], latency_model[priority],
+               count[priority] ? (double)latency_sum[priority] / count[priority] : 0.0, execution_max[priority]);
+    }
+    printf("errors\t%u\n", errors);
+    return errors ? 1 : 0;
+}
+'''
+
+def main():
+    steps = sys.argv[1] if len(sys.argv) > 1 else "2000000"
+    seed = sys.argv[2] if len(sys.argv) > 2 else "1"
+    source = open(os.path.join(ROOT, "system/STM32L0xx/Source/armv6m_work.c")).read()
+    source = re.sub(r"static __attribute__\(\(naked, used\)\) void armv6m_work_execute\(void\)\n\{.*?\n\}\n", "", source, flags=re.S)
+    with tempfile.TemporaryDirectory() as directory:
+        for name, text in (("armv6m.h", SHIM), ("work.c", source), ("harness.c", HARNESS)):
+            with open(os.path.join(directory, name), "w") as f:
+                f.write(text)
+        binary = os.path.join(directory, "harness")
+        subprocess.check_call([ "gcc", "-O2", "-g", "-w", "-fno-pie", "-no-pie", "-I" + directory,
+                                "-I" + os.path.join(ROOT, "system/STM32L0xx/Include"), os.path.join(directory, "harness.c"), "-o", binary ])
+        results = {}
+        for single in (0, 1):
+            run = subprocess.run([ binary, steps, seed, "60", str(single) ], capture_output=True, text=True)
+            records = [ line.split("\t") for line in run.stdout.splitlines() ]
+            fails = [ record for record in records if record[0] == "fail" ]
+            assert run.returncode == 0 and not fails, (run.returncode, fails[:10])
+            results[single] = { int(r[1]): (int(r[2]), int(r[3]), float(r[4]), int(r[5])) for r in records if r[0] == "class" }
+    names = [ "NORMAL", "HIGH", "URGENT" ]
+    print("%d steps, worst/mean submit to start latency in us, interrupt time excluded" % int(steps))
+    print("%-8s %10s %22s %22s %12s" % ("class", "items", "single FIFO (before)", "priority classes", "worst exec"))
+    for priority in range(3):
+        before, after = results[1][priority], results[0][priority]
+        print("%-8s %10d %12d / %7.1f %12d / %7.1f %12d" % (names[priority], after[0], before[1], before[2], after[1], after[2], after[3]))
+    # an URGENT item waits for at most the item that is executing, any class,
+    # plus the URGENT items queued ahead of it
+    bound = max(result[3] for result in results[0].values()) + 6 * results[0][2][3]
+    assert results[0][2][1] <= bound, (results[0][2][1], bound)
+    assert results[0][2][1] < results[1][2][1]
+    print("URGENT worst case %d us <= bound %d us (longest item + URGENT backlog)" % (results[0][2][1], bound))
+    print("OK")
+
+if __name__ == "__main__":
+    main()
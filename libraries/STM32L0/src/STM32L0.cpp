@@ -115,6 +115,16 @@ void STM32L0Class::setClocks(uint32_t &hclk, uint32_t &pclk1, uint32_t &pclk2)
     pclk2 = stm32l0_system_pclk2();
 }
 
+uint64_t STM32L0Class::timestamp()
+{
+    return stm32l0_timestamp_read();
+}
+
+void STM32L0Class::pps()
+{
+    stm32l0_timestamp_pps(stm32l0_timestamp_read());
+}
+
 void STM32L0Class::enablePowerSave()
 {
     g_defaultPolicy = STM32L0_SYSTEM_POLICY_SLEEP;
@@ -125,6 +135,26 @@ void STM32L0Class::disablePowerSave()
     g_defaultPolicy = STM32L0_SYSTEM_POLICY_RUN;
 }
 
+void STM32L0Class::enableGovernor(uint32_t hclkLow, uint32_t hclkHigh)
+{
+    stm32l0_system_governor(hclkLow, hclkHigh);
+}
+
+void STM32L0Class::disableGovernor()
+{
+    stm32l0_system_governor(0, 0);
+}
+
+void STM32L0Class::enablePerformance()
+{
+    stm32l0_system_reference(STM32L0_SYSTEM_REFERENCE_PERFORMANCE);
+}
+
+void STM32L0Class::disablePerformance()
+{
+    stm32l0_system_unreference(STM32L0_SYSTEM_REFERENCE_PERFORMANCE);
+}
+
 void STM32L0Class::wakeup()
 {
     stm32l0_system_wakeup(STM32L0_SYSTEM_EVENT_APPLICATION);
@@ -197,6 +227,8 @@ void STM32L0Class::wdtReset()
 
 bool STM32L0Class::flashErase(uint32_t address, uint32_t count)
 {
+    bool success;
+
     if (address & 127) {
         return false;
     }
@@ -208,14 +240,16 @@ bool STM32L0Class::flashErase(uint32_t address, uint32_t count)
     }
 
     stm32l0_flash_unlock();
-    stm32l0_flash_erase(address, count);
+    success = stm32l0_flash_erase(address, count);
     stm32l0_flash_lock();
     
-    return true;
+    return success;
 }
 
 bool STM32L0Class::flashProgram(uint32_t address, const void *data, uint32_t count)
 {
+    bool success = true;
+
     if ((address & 3) || (count & 3)) {
         return false;
     }
@@ -226,11 +260,192 @@ bool STM32L0Class::flashProgram(uint32_t address, const void *data, uint32_t cou
 
     if (count) {
         stm32l0_flash_unlock();
-        stm32l0_flash_program(address, (const uint8_t*)data, count);
+        success = stm32l0_flash_program(address, (const uint8_t*)data, count);
         stm32l0_flash_lock();
     }
 
-    return true;
+    return success;
+}
+
+size_t STM32L0Class::dumpTrace(Print &output)
+{
+    armv6m_trace_entry_t entries[16];
+    uint32_t index, count, lost, total;
+    size_t size = 0;
+
+    total = 0;
+
+    do {
+        count = armv6m_trace_read(&entries[0], 16, &lost);
+
+        total += lost;
+
+        for (index = 0; index < count; index++) {
+            size += output.print(entries[index].timestamp);
+            size += output.print(',');
+            size += output.print(entries[index].type);
+            size += output.print(',');
+            size += output.print(entries[index].id);
+            size += output.print(",0x");
+            size += output.println(entries[index].data, HEX);
+        }
+    } while (count);
+
+    if (total) {
+        size += output.print("# lost ");
+        size += output.println(total);
+    }
+
+    return size;
+}
+
+uint64_t STM32L0Class::residency(uint32_t mode)
+{
+    stm32l0_system_profile_t profile;
+
+    if (mode >= STM32L0_SYSTEM_MODE_COUNT) {
+        return 0;
+    }
+
+    stm32l0_system_profile(&profile);
+
+    return (profile.residency[mode] * 1000000ull) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND;
+}
+
+uint64_t STM32L0Class::blocked(uint32_t lock)
+{
+    stm32l0_system_profile_t profile;
+
+    if (lock >= STM32L0_SYSTEM_LOCK_COUNT) {
+        return 0;
+    }
+
+    stm32l0_system_profile(&profile);
+
+    return (profile.blocked[lock] * 1000000ull) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND;
+}
+
+uint32_t STM32L0Class::wakeups(uint32_t irq)
+{
+    stm32l0_system_profile_t profile;
+
+    if (irq >= 32) {
+        return 0;
+    }
+
+    stm32l0_system_profile(&profile);
+
+    return profile.wakeup[irq];
+}
+
+void STM32L0Class::resetProfile()
+{
+    stm32l0_system_profile_reset();
+}
+
+size_t STM32L0Class::dumpProfile(Print &output)
+{
+    stm32l0_system_profile_t profile;
+    uint32_t index;
+    size_t size = 0;
+
+    stm32l0_system_profile(&profile);
+
+    size += output.print("hclk,");
+    size += output.println(stm32l0_system_hclk());
+
+    for (index = 0; index < STM32L0_SYSTEM_MODE_COUNT; index++) {
+        size += output.print("residency,");
+        size += output.print(index);
+        size += output.print(',');
+        size += output.println((uint32_t)((profile.residency[index] * 1000ull) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND));
+    }
+
+    for (index = 0; index < STM32L0_SYSTEM_LOCK_COUNT; index++) {
+        if (profile.blocked[index]) {
+            size += output.print("blocked,");
+            size += output.print(index);
+            size += output.print(',');
+            size += output.println((uint32_t)((profile.blocked[index] * 1000ull) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND));
+        }
+    }
+
+    for (index = 0; index < 32; index++) {
+        if (profile.wakeup[index]) {
+            size += output.print("wakeup,");
+            size += output.print(index);
+            size += output.print(',');
+            size += output.println(profile.wakeup[index]);
+        }
+    }
+
+    for (index = 0; index < STM32L0_SYSTEM_FREQUENCY_COUNT; index++) {
+        if (profile.frequency[index].hclk) {
+            size += output.print("frequency,");
+            size += output.print(profile.frequency[index].hclk);
+            size += output.print(',');
+            size += output.print((uint32_t)((profile.frequency[index].residency * 1000ull) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND));
+            size += output.print(',');
+            size += output.println(profile.frequency[index].count);
+        }
+    }
+
+    return size;
 }
 
 STM32L0Class STM32L0;
+
+FirmwareUpdate::FirmwareUpdate()
+{
+    _update.status = STM32L0_UPDATE_STATUS_NONE;
+}
+
+bool FirmwareUpdate::begin()
+{
+    return stm32l0_update_begin(&_update);
+}
+
+size_t FirmwareUpdate::write(const uint8_t *data, size_t size)
+{
+    if (!stm32l0_update_write(&_update, data, size)) {
+        return 0;
+    }
+
+    return size;
+}
+
+bool FirmwareUpdate::write(Stream &stream)
+{
+    uint8_t data[64];
+    size_t count;
+
+    while (_update.status == STM32L0_UPDATE_STATUS_BUSY) {
+        count = stream.available();
+
+        if (!count) {
+            break;
+        }
+
+        if (count > sizeof(data)) {
+            count = sizeof(data);
+        }
+
+        count = stream.readBytes(&data[0], count);
+
+        stm32l0_update_write(&_update, &data[0], count);
+    }
+
+    return (_update.status == STM32L0_UPDATE_STATUS_BUSY);
+}
+
+bool FirmwareUpdate::end()
+{
+    return stm32l0_update_end(&_update);
+}
+
+void FirmwareUpdate::swap()
+{
+    if (_update.status == STM32L0_UPDATE_STATUS_SUCCESS) {
+        stm32l0_system_swap();
+    }
+}
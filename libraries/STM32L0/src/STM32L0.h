@@ -30,6 +30,7 @@
 #define STM32L0_H
 
 #include <Arduino.h>
+#include "stm32l0_update.h"
 
 #define RESET_POWERON        0
 #define RESET_EXTERNAL       1
@@ -48,6 +49,16 @@
 #define WAKEUP_WATCHDOG      0x00002000
 #define WAKEUP_RESET         0x00004000
 
+#define MODE_RUN             0
+#define MODE_IDLE            1
+#define MODE_SLEEP           2
+#define MODE_STOP            3
+
+#define LOCK_RUN             0
+#define LOCK_SLEEP           1
+#define LOCK_REGULATOR       3
+#define LOCK_VREFINT         4
+
 #define FLASHSTART           ((uint32_t)(&__FlashBase))
 #define FLASHEND             ((uint32_t)(&__FlashLimit))
 
@@ -65,9 +76,16 @@ public:
 
     bool  setClocks(uint32_t hclk, uint32_t pclk1 = 0, uint32_t pclk2 = 0);
     void  setClocks(uint32_t &hclk, uint32_t &pclk1, uint32_t &pclk2);
+
+    uint64_t timestamp();
+    void     pps();
     
     void  enablePowerSave();
     void  disablePowerSave();
+    void  enableGovernor(uint32_t hclkLow = 4200000, uint32_t hclkHigh = 32000000);
+    void  disableGovernor();
+    void  enablePerformance();
+    void  disablePerformance();
     void  wakeup();
     void  sleep(uint32_t timeout = 0xffffffff);
     void  deepsleep(uint32_t timeout = 0xffffffff);
@@ -84,6 +102,14 @@ public:
     bool  flashErase(uint32_t address, uint32_t count);
     bool  flashProgram(uint32_t address, const void *data, uint32_t count);
 
+    size_t dumpTrace(Print &output);
+
+    uint64_t residency(uint32_t mode);
+    uint64_t blocked(uint32_t lock);
+    uint32_t wakeups(uint32_t irq);
+    void     resetProfile();
+    size_t   dumpProfile(Print &output);
+
  public:
     void  stop(uint32_t timeout = 0xffffffff) __attribute__((deprecated("use STM32L0.deepsleep() instead"))) { deepsleep(timeout); }
 #if defined(USBCON)
@@ -93,4 +119,26 @@ public:
 
 extern STM32L0Class STM32L0;
 
+// Applies a firmware patch (see stm32l0_update.h) to the running image,
+// writing the result into the inactive flash bank of a dual bank part.
+// The patch can be fed in pieces of any size, or drained from a Stream
+// (e.g. a DOSFS File). swap() reboots into the new image once end()
+// verified it.
+class FirmwareUpdate {
+public:
+    FirmwareUpdate();
+
+    bool begin();
+    size_t write(const uint8_t *data, size_t size);
+    bool write(Stream &stream);
+    bool end();
+    void swap();
+
+    // One of STM32L0_UPDATE_STATUS_*
+    int status() { return _update.status; }
+
+private:
+    stm32l0_update_t _update;
+};
+
 #endif // STM32L0_H
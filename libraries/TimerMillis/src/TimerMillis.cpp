@@ -35,6 +35,7 @@ TimerMillis::TimerMillis()
     stm32l0_rtc_timer_create(&_timer, (stm32l0_rtc_timer_callback_t)TimerMillis::timeout, (void*)this);
 
     _clock = 0;
+    _slack = 0;
 }
 
 TimerMillis::~TimerMillis()
@@ -44,12 +45,12 @@ TimerMillis::~TimerMillis()
     }
 }
 
-int TimerMillis::start(void(*callback)(void), uint32_t delay, uint32_t period)
+int TimerMillis::start(void(*callback)(void), uint32_t delay, uint32_t period, uint32_t slack)
 {
-    return start(Callback(callback), delay, period);
+    return start(Callback(callback), delay, period, slack);
 }
 
-int TimerMillis::start(Callback callback, uint32_t delay, uint32_t period)
+int TimerMillis::start(Callback callback, uint32_t delay, uint32_t period, uint32_t slack)
 {
     uint64_t clock;
     uint32_t seconds, ticks;
@@ -73,14 +74,15 @@ int TimerMillis::start(Callback callback, uint32_t delay, uint32_t period)
     _clock = clock + (seconds * STM32L0_RTC_CLOCK_TICKS_PER_SECOND);
     _millis = delay - (seconds * 1000);
     _period = period;
+    _slack = stm32l0_rtc_millis_to_ticks(slack);
     _callback = callback;
     
-    stm32l0_rtc_timer_start(&_timer, _clock + ticks, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
+    stm32l0_rtc_timer_start_slack(&_timer, _clock + ticks, _slack, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
 
     return 1;
 }
 
-int TimerMillis::restart(uint32_t delay, uint32_t period)
+int TimerMillis::restart(uint32_t delay, uint32_t period, uint32_t slack)
 {
     uint64_t clock;
     uint32_t seconds, ticks;
@@ -102,8 +104,9 @@ int TimerMillis::restart(uint32_t delay, uint32_t period)
     _clock = clock + (seconds * STM32L0_RTC_CLOCK_TICKS_PER_SECOND);
     _millis = delay - (seconds * 1000);
     _period = period;
+    _slack = stm32l0_rtc_millis_to_ticks(slack);
 
-    stm32l0_rtc_timer_start(&_timer, _clock + ticks, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
+    stm32l0_rtc_timer_start_slack(&_timer, _clock + ticks, _slack, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
 
     return 1;
 }
@@ -136,7 +139,7 @@ void TimerMillis::timeout(class TimerMillis *self)
 	    self->_clock += (seconds * STM32L0_RTC_CLOCK_TICKS_PER_SECOND);
 	    self->_millis -= (seconds * 1000);
 	    
-	    stm32l0_rtc_timer_start(&self->_timer, self->_clock + ticks, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
+	    stm32l0_rtc_timer_start_slack(&self->_timer, self->_clock + ticks, self->_slack, STM32L0_RTC_TIMER_MODE_ABSOLUTE);
 	} else {
 	    self->_clock = 0;
 	}
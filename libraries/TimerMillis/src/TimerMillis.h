@@ -37,9 +37,9 @@ public:
     TimerMillis();
     ~TimerMillis();
 
-    int start(void(*callback)(void), uint32_t delay, uint32_t period = 0);
-    int start(Callback callback, uint32_t delay, uint32_t period = 0);
-    int restart(uint32_t delay, uint32_t period = 0);
+    int start(void(*callback)(void), uint32_t delay, uint32_t period = 0, uint32_t slack = 0);
+    int start(Callback callback, uint32_t delay, uint32_t period = 0, uint32_t slack = 0);
+    int restart(uint32_t delay, uint32_t period = 0, uint32_t slack = 0);
     int stop();
     bool active();
 
@@ -48,7 +48,8 @@ private:
     uint64_t            _clock;
     uint32_t            _millis;
     uint32_t            _period;
-    Callback            _callback;
+    uint32_t            _slack;
+    Callback            _callback { Callback::TYPE_TIMER };
     static void         timeout(class TimerMillis *self);
 };
 
@@ -0,0 +1,96 @@
+/* Scheduled Wire Sensor example
+ *    
+ * The code polls a LPS22HB pressure sensor at 10Hz and its
+ * temperature at 1Hz via a TwoWireSchedule. Both polls are
+ * declared once; every tenth batch carries both reads in one
+ * bus wakeup, and one callback delivers the whole batch.
+ *
+ * The LPS22HB is configured for 10Hz continuous mode, so
+ * there is no need to poll the status register.
+ *
+ * This here is not meant to provide a useful library
+ * or anything generic, it's just here to show how
+ * to use the Wire library to poll sensors periodically.
+ *
+ *    
+ * This example code is in the public domain.
+ */
+
+#include "STM32L0.h"
+#include "Wire.h"
+
+#define LPS22HB_I2C_ADDRESS 0x5C
+
+static const uint8_t lps22hb_pressure_register[] = { 0x28 };
+static const uint8_t lps22hb_temperature_register[] = { 0x2B };
+
+uint8_t lps22hb_pressure_data[3];
+uint8_t lps22hb_temperature_data[2];
+
+TwoWireSchedule schedule(Wire);
+TwoWirePoll pressurePoll;
+TwoWirePoll temperaturePoll;
+
+volatile bool pressureReady = false;
+volatile bool temperatureReady = false;
+uint64_t pressureTimestamp;
+
+void setup()
+{
+    Serial.begin(9600);
+    
+    while (!Serial) { }
+
+    Wire.begin();
+
+    Wire.transfer(LPS22HB_I2C_ADDRESS, (const uint8_t[]){ 0x10, 0x22 }, 2, NULL, 0);
+    Wire.transfer(LPS22HB_I2C_ADDRESS, (const uint8_t[]){ 0x11, 0x10 }, 2, NULL, 0);
+
+    schedule.add(pressurePoll, LPS22HB_I2C_ADDRESS, lps22hb_pressure_register, 1, lps22hb_pressure_data, 3, 100, 10);
+    schedule.add(temperaturePoll, LPS22HB_I2C_ADDRESS, lps22hb_temperature_register, 1, lps22hb_temperature_data, 2, 1000, 100);
+
+    schedule.start(batchCallback);
+}
+
+void loop()
+{
+    float temperature, pressure;
+
+    if (pressureReady) {
+        pressureReady = false;
+
+        pressure = (float)((uint32_t)(((uint32_t)lps22hb_pressure_data[0] << 0) | ((uint32_t)lps22hb_pressure_data[1] << 8) | ((uint32_t)lps22hb_pressure_data[2] << 16))) / 4096.0;
+
+        Serial.print("Pressure = ");
+        Serial.print(pressure);
+        Serial.print(" hPa @ ");
+        Serial.print((uint32_t)(pressureTimestamp / 1000000));
+        Serial.println(" ms");
+    }
+
+    if (temperatureReady) {
+        temperatureReady = false;
+
+        temperature = (float)((int16_t)(((uint16_t)lps22hb_temperature_data[0] << 0) | ((uint16_t)lps22hb_temperature_data[1] << 8))) / 100.0;
+
+        Serial.print("Temperature = ");
+        Serial.print(temperature);
+        Serial.println(" *C");
+    }
+
+    STM32L0.deepsleep();
+}
+
+void batchCallback()
+{
+    if (pressurePoll.ready() && (pressurePoll.status() == 0)) {
+        pressureTimestamp = pressurePoll.timestamp();
+        pressureReady = true;
+    }
+
+    if (temperaturePoll.ready() && (temperaturePoll.status() == 0)) {
+        temperatureReady = true;
+    }
+
+    STM32L0.wakeup();
+}
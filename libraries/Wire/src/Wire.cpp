@@ -41,9 +41,12 @@ TwoWire::TwoWire(struct _stm32l0_i2c_t *i2c, const struct _stm32l0_i2c_params_t
     _ev_address = 0;
     _xf_address = 0;
 
+    _rx_data = &_rx_buffer[0];
     _rx_read = 0;
     _rx_write = 0;
 
+    _tx_data = &_tx_buffer[0];
+    _tx_size = BUFFER_LENGTH;
     _tx_write = 0;
     _tx_active = false;
 
@@ -104,6 +107,11 @@ void TwoWire::setClock(uint32_t clock)
 }
 
 void TwoWire::beginTransmission(uint8_t address)
+{
+    beginTransmission(address, &_tx_buffer[0], BUFFER_LENGTH);
+}
+
+void TwoWire::beginTransmission(uint8_t address, uint8_t *buffer, size_t size)
 {
     if (__get_IPSR() != 0) {
         return;
@@ -117,6 +125,12 @@ void TwoWire::beginTransmission(uint8_t address)
         return;
     }
 
+    if (!buffer || (size > 65535)) {
+        return;
+    }
+
+    _tx_data = buffer;
+    _tx_size = size;
     _tx_write = 0;
     _tx_address = address;
     _tx_active = true;
@@ -147,7 +161,7 @@ uint8_t TwoWire::endTransmission(bool stopBit)
     transaction.status = STM32L0_I2C_STATUS_SUCCESS;
     transaction.control = stopBit ? 0 : STM32L0_I2C_CONTROL_RESTART;
     transaction.address = _tx_address;
-    transaction.tx_data = &_tx_data[0];
+    transaction.tx_data = _tx_data;
     transaction.rx_data = NULL;
     transaction.tx_count = _tx_write;
     transaction.rx_count = 0;
@@ -161,7 +175,7 @@ uint8_t TwoWire::endTransmission(bool stopBit)
     _xf_address = 0;
 
     while (transaction.status == STM32L0_I2C_STATUS_BUSY) {
-        __WFE();
+        armv6m_task_wfe();
     }
 
     if (transaction.status == STM32L0_I2C_STATUS_SUCCESS) {
@@ -174,6 +188,15 @@ uint8_t TwoWire::endTransmission(bool stopBit)
 }
 
 size_t TwoWire::requestFrom(uint8_t address, size_t size, bool stopBit)
+{
+    if (size > BUFFER_LENGTH) {
+        size = BUFFER_LENGTH;
+    }
+
+    return requestFrom(address, &_rx_buffer[0], size, stopBit);
+}
+
+size_t TwoWire::requestFrom(uint8_t address, uint8_t *buffer, size_t size, bool stopBit)
 {
     stm32l0_i2c_transaction_t transaction;
 
@@ -189,19 +212,19 @@ size_t TwoWire::requestFrom(uint8_t address, size_t size, bool stopBit)
         return 0;
     }
 
-    if (size == 0) {
+    if (!buffer || (size == 0)) {
         return 0;
     }
 
-    if (size > BUFFER_LENGTH) {
-        size = BUFFER_LENGTH;
+    if (size > 65535) {
+        size = 65535;
     }
 
     transaction.status = STM32L0_I2C_STATUS_SUCCESS;
     transaction.control = stopBit ? 0 : STM32L0_I2C_CONTROL_RESTART;
     transaction.address = address;
     transaction.tx_data = NULL;
-    transaction.rx_data = &_rx_data[0];
+    transaction.rx_data = buffer;
     transaction.tx_count = 0;
     transaction.rx_count = size;
     transaction.callback = NULL;
@@ -213,11 +236,12 @@ size_t TwoWire::requestFrom(uint8_t address, size_t size, bool stopBit)
 
     _xf_address = 0;
 
+    _rx_data = buffer;
     _rx_read = 0;
     _rx_write = 0;
 
     while (transaction.status == STM32L0_I2C_STATUS_BUSY) {
-        __WFE();
+        armv6m_task_wfe();
     }
 
 
@@ -238,7 +262,7 @@ size_t TwoWire::write(uint8_t data)
         return 0;
     }
 
-    if (_tx_write >= BUFFER_LENGTH) {
+    if (_tx_write >= _tx_size) {
         return 0;
     }
 
@@ -253,8 +277,8 @@ size_t TwoWire::write(const uint8_t *data, size_t size)
         return 0;
     }
 
-    if (size > (unsigned int)(BUFFER_LENGTH - _tx_write)) {
-        size = BUFFER_LENGTH - _tx_write;
+    if (size > (unsigned int)(_tx_size - _tx_write)) {
+        size = _tx_size - _tx_write;
     }
 
     memcpy(&_tx_data[_tx_write], data, size);
@@ -360,7 +384,7 @@ uint8_t TwoWire::transfer(uint8_t address, const uint8_t *txBuffer, size_t txSiz
         return 1;
     }
 
-    if ((txSize > 65535) || (rxSize > 65536))  {
+    if ((txSize > 65535) || (rxSize > 65535))  {
         return 1;
     }
 
@@ -379,7 +403,7 @@ uint8_t TwoWire::transfer(uint8_t address, const uint8_t *txBuffer, size_t txSiz
     }
 
     while (transaction.status == STM32L0_I2C_STATUS_BUSY) {
-        __WFE();
+        armv6m_task_wfe();
     }
 
     if (transaction.status == STM32L0_I2C_STATUS_SUCCESS) {
@@ -399,7 +423,7 @@ void TwoWire::reset()
 
     if (stm32l0_i2c_suspend(_i2c, NULL, NULL)) {
         while (_i2c->state != STM32L0_I2C_STATE_SUSPENDED) {
-            __WFE();
+            armv6m_task_wfe();
         }
     }
 
@@ -435,7 +459,7 @@ uint8_t TwoWire::scan(uint8_t address)
         transaction.status = STM32L0_I2C_STATUS_SUCCESS;
         transaction.control = 0;
         transaction.address = address;
-        transaction.tx_data = &_tx_data[0];
+        transaction.tx_data = &_tx_buffer[0];
         transaction.rx_data = NULL;
         transaction.tx_count = 0;
         transaction.rx_count = 0;
@@ -447,7 +471,7 @@ uint8_t TwoWire::scan(uint8_t address)
         }
         
         while (transaction.status == STM32L0_I2C_STATUS_BUSY) {
-            __WFE();
+            armv6m_task_wfe();
         }
         
         if (transaction.status == STM32L0_I2C_STATUS_SUCCESS) {
@@ -466,7 +490,7 @@ bool TwoWire::suspend()
 
     if (stm32l0_i2c_suspend(_i2c, NULL, NULL)) {
         while (_i2c->state != STM32L0_I2C_STATE_SUSPENDED) {
-            __WFE();
+            armv6m_task_wfe();
         }
     }
 
@@ -502,6 +526,8 @@ void TwoWire::_eventCallback(class TwoWire *self, uint32_t events)
     if (events & STM32L0_I2C_EVENT_RECEIVE_REQUEST) {
         self->_rx_address = (events & STM32L0_I2C_EVENT_ADDRESS_MASK) >> STM32L0_I2C_EVENT_ADDRESS_SHIFT;
 
+        self->_rx_data = &self->_rx_buffer[0];
+
         stm32l0_i2c_receive(self->_i2c, &self->_rx_data[0], BUFFER_LENGTH);
     }
 
@@ -515,6 +541,8 @@ void TwoWire::_eventCallback(class TwoWire *self, uint32_t events)
     }
     
     if (events & STM32L0_I2C_EVENT_TRANSMIT_REQUEST) {
+        self->_tx_data = &self->_tx_buffer[0];
+        self->_tx_size = BUFFER_LENGTH;
         self->_tx_active = true;
         self->_tx_write = 0;
 
@@ -565,7 +593,7 @@ bool TwoWireTransaction::submit(class TwoWire &wire, uint8_t address, const uint
         return false;
     }
 
-    if ((txSize > 65535) || (rxSize > 65536))  {
+    if ((txSize > 65535) || (rxSize > 65535))  {
         return false;
     }
 
@@ -622,6 +650,268 @@ void TwoWireTransaction::_doneCallback(class TwoWireTransaction *self)
     self->_callback.queue(false);
 }
 
+TwoWirePoll::TwoWirePoll()
+{
+    _transaction.status = STM32L0_I2C_STATUS_SUCCESS;
+    _next = nullptr;
+    _schedule = nullptr;
+    _timestamp = 0;
+    _missed = 0;
+    _ready = false;
+    _batch = false;
+    _last = false;
+}
+
+TwoWirePoll::~TwoWirePoll()
+{
+    if (_transaction.status == STM32L0_I2C_STATUS_BUSY) {
+        __BKPT();
+    }
+
+    if (_schedule && !_schedule->remove(*this)) {
+        __BKPT();
+    }
+}
+
+bool TwoWirePoll::ready()
+{
+    if (!_ready) {
+        return false;
+    }
+
+    _ready = false;
+
+    return true;
+}
+
+uint8_t TwoWirePoll::status()
+{
+    return _transaction.status;
+}
+
+uint64_t TwoWirePoll::timestamp()
+{
+    uint64_t timestamp;
+
+    do {
+        timestamp = _timestamp;
+    } while (timestamp != _timestamp);
+
+    return timestamp;
+}
+
+uint32_t TwoWirePoll::missed()
+{
+    return _missed;
+}
+
+void TwoWirePoll::_doneCallback(class TwoWirePoll *self)
+{
+    self->_timestamp = stm32l0_timestamp_read();
+    self->_ready = true;
+
+    if (self->_last) {
+        self->_schedule->_callback.queue(false);
+    }
+}
+
+TwoWireSchedule::TwoWireSchedule(class TwoWire &wire)
+{
+    stm32l0_rtc_timer_create(&_timer, (stm32l0_rtc_timer_callback_t)TwoWireSchedule::timeout, (void*)this);
+
+    _wire = &wire;
+    _polls = nullptr;
+    _clock = 0;
+    _batches = 0;
+    _active = false;
+}
+
+TwoWireSchedule::~TwoWireSchedule()
+{
+    stop();
+
+    while (_polls) {
+        remove(*_polls);
+    }
+
+    if (!stm32l0_rtc_timer_destroy(&_timer)) {
+        __BKPT();
+    }
+}
+
+bool TwoWireSchedule::add(class TwoWirePoll &poll, uint8_t address, const uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, uint32_t period, uint32_t slack)
+{
+    if (_active || poll._schedule || !period) {
+        return false;
+    }
+
+    if (!txBuffer && txSize)  {
+        return false;
+    }
+
+    if (!rxBuffer || !rxSize)  {
+        return false;
+    }
+
+    if ((txSize > 65535) || (rxSize > 65535))  {
+        return false;
+    }
+
+    poll._transaction.status = STM32L0_I2C_STATUS_SUCCESS;
+    poll._transaction.control = 0;
+    poll._transaction.address = address;
+    poll._transaction.tx_data = txSize ? txBuffer : nullptr;
+    poll._transaction.rx_data = rxBuffer;
+    poll._transaction.tx_count = txSize;
+    poll._transaction.rx_count = rxSize;
+    poll._transaction.callback = (stm32l0_i2c_done_callback_t)TwoWirePoll::_doneCallback;
+    poll._transaction.context = (void*)&poll;
+
+    poll._schedule = this;
+    poll._period = period;
+    poll._slack = slack;
+    poll._timestamp = 0;
+    poll._missed = 0;
+    poll._ready = false;
+
+    poll._next = _polls;
+    _polls = &poll;
+
+    return true;
+}
+
+bool TwoWireSchedule::remove(class TwoWirePoll &poll)
+{
+    TwoWirePoll **pp_poll;
+
+    if (_active || (poll._schedule != this)) {
+        return false;
+    }
+
+    for (pp_poll = &_polls; *pp_poll; pp_poll = &(*pp_poll)->_next) {
+        if (*pp_poll == &poll) {
+            *pp_poll = poll._next;
+
+            poll._next = nullptr;
+            poll._schedule = nullptr;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool TwoWireSchedule::start(void(*callback)(void))
+{
+    return start(Callback(callback));
+}
+
+bool TwoWireSchedule::start(Callback callback)
+{
+    TwoWirePoll *poll;
+
+    if (_active || !_polls || _wire->_ev_address) {
+        return false;
+    }
+
+    _callback = callback;
+    _clock = stm32l0_rtc_clock_read();
+    _batches = 0;
+    _active = true;
+
+    // All polls start on a common grid at the time of start(), so that polls
+    // with harmonic periods naturally fall due together.
+    for (poll = _polls; poll; poll = poll->_next) {
+        poll->_due = poll->_period;
+    }
+
+    timeout(this);
+
+    return true;
+}
+
+void TwoWireSchedule::stop()
+{
+    _active = false;
+
+    stm32l0_rtc_timer_stop(&_timer);
+}
+
+bool TwoWireSchedule::active()
+{
+    return _active;
+}
+
+uint32_t TwoWireSchedule::batches()
+{
+    return _batches;
+}
+
+uint64_t TwoWireSchedule::millis(uint64_t clock)
+{
+    return ((clock - _clock) * 1000) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND;
+}
+
+void TwoWireSchedule::timeout(class TwoWireSchedule *self)
+{
+    TwoWirePoll *poll, *last;
+    uint64_t now, next;
+
+    if (!self->_active) {
+        return;
+    }
+
+    now = self->millis(stm32l0_rtc_clock_read());
+
+    // Collect everything that is due. A poll whose previous transaction is
+    // still on the bus is skipped rather than queued twice. The due time
+    // advances on the poll's own grid, so rates do not drift with batching.
+    for (poll = self->_polls, last = nullptr; poll; poll = poll->_next) {
+        if (poll->_due <= now) {
+            if (poll->_transaction.status == STM32L0_I2C_STATUS_BUSY) {
+                poll->_missed++;
+            } else {
+                poll->_batch = true;
+
+                last = poll;
+            }
+
+            do {
+                poll->_due += poll->_period;
+            } while (poll->_due <= now);
+        }
+    }
+
+    // The driver completes a chain in submission order, so the batch is done
+    // when its last transaction is. The mark stays valid while that poll is
+    // busy, even if further batches are already queued behind it.
+    if (last) {
+        self->_batches++;
+
+        for (poll = self->_polls; poll; poll = poll->_next) {
+            if (poll->_batch) {
+                poll->_batch = false;
+                poll->_last = (poll == last);
+
+                if (!stm32l0_i2c_submit(self->_wire->_i2c, &poll->_transaction) && poll->_last) {
+                    self->_callback.queue(false);
+                }
+            }
+        }
+    }
+
+    // Defer the next batch as long as every poll stays within its slack, so
+    // that as many polls as possible are due at that point.
+    for (poll = self->_polls, next = ~0ull; poll; poll = poll->_next) {
+        if (next > (poll->_due + poll->_slack)) {
+            next = poll->_due + poll->_slack;
+        }
+    }
+
+    stm32l0_rtc_timer_start(&self->_timer, self->_clock + ((next * STM32L0_RTC_CLOCK_TICKS_PER_SECOND + 999) / 1000), STM32L0_RTC_TIMER_MODE_ABSOLUTE);
+}
+
 #if WIRE_INTERFACES_COUNT > 0
 
 extern stm32l0_i2c_t g_Wire;
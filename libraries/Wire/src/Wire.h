@@ -24,6 +24,7 @@
 #include "Stream.h"
 #include "variant.h"
 #include "stm32l0_i2c.h"
+#include "stm32l0_rtc.h"
 
 #define BUFFER_LENGTH 32
 
@@ -47,6 +48,13 @@ public:
 
     size_t requestFrom(uint8_t address, size_t size, bool stopBit = true);
 
+    // STM32L0 EXTENSTION: caller owned buffers of up to 65535 bytes, used in place of
+    // the internal BUFFER_LENGTH buffers. write() appends to "buffer" up to "size" and
+    // endTransmission() sends straight from it. requestFrom() receives straight into
+    // "buffer", which then also backs available()/read()/peek().
+    void beginTransmission(uint8_t address, uint8_t *buffer, size_t size);
+    size_t requestFrom(uint8_t address, uint8_t *buffer, size_t size, bool stopBit = true);
+
     size_t write(uint8_t data);
     size_t write(const uint8_t *buffer, size_t size);
 
@@ -91,16 +99,20 @@ public:
     uint8_t _ev_address;
     uint8_t _xf_address;
 
-    uint8_t _rx_data[BUFFER_LENGTH];
-    uint8_t _rx_read;
-    uint8_t _rx_write;
+    uint8_t *_rx_data;
+    uint16_t _rx_read;
+    uint16_t _rx_write;
     uint8_t _rx_address;
 
-    uint8_t _tx_data[BUFFER_LENGTH];
-    uint8_t _tx_write;
+    uint8_t *_tx_data;
+    uint16_t _tx_size;
+    uint16_t _tx_write;
     uint8_t _tx_address;
     bool _tx_active;
 
+    uint8_t _rx_buffer[BUFFER_LENGTH];
+    uint8_t _tx_buffer[BUFFER_LENGTH];
+
     void (*_receiveCallback)(int);
     void (*_requestCallback)(void);
     void (*_transmitCallback)(int);
@@ -110,6 +122,7 @@ public:
     static const uint32_t TWI_CLOCK = 100000;
 
     friend class TwoWireTransaction;
+    friend class TwoWireSchedule;
 };
 
 class TwoWireTransaction {
@@ -126,10 +139,77 @@ public:
 
 private:
     stm32l0_i2c_transaction_t _transaction;
-    Callback _callback;
+    Callback _callback { Callback::TYPE_BUS };
     static void _doneCallback(class TwoWireTransaction *self);
 };
 
+// STM32L0 EXTENSTION: periodic register read, owned by a TwoWireSchedule
+class TwoWirePoll {
+public:
+    TwoWirePoll();
+    ~TwoWirePoll();
+    TwoWirePoll(const TwoWirePoll&) = delete;
+    TwoWirePoll& operator=(const TwoWirePoll&) = delete;
+
+    bool ready();          // new data since the last call
+    uint8_t status();      // status of the last poll, same as TwoWireTransaction::status()
+    uint64_t timestamp();  // stm32l0_timestamp_read() nanoseconds when the last poll completed
+    uint32_t missed();     // polls skipped because the previous one was still in progress
+
+private:
+    stm32l0_i2c_transaction_t _transaction;
+    class TwoWirePoll *_next;
+    class TwoWireSchedule *_schedule;
+    uint32_t _period;
+    uint32_t _slack;
+    uint64_t _due;
+    volatile uint64_t _timestamp;
+    volatile uint32_t _missed;
+    volatile bool _ready;
+    bool _batch;
+    bool _last;
+    static void _doneCallback(class TwoWirePoll *self);
+
+    friend class TwoWireSchedule;
+};
+
+// STM32L0 EXTENSTION: polls a set of sensors at their own rates. Polls that are due
+// together (within their slack) are submitted as one chain of transactions, so they share
+// a single bus wakeup, and one callback is queued after the whole batch completed.
+class TwoWireSchedule {
+public:
+    TwoWireSchedule(class TwoWire &wire);
+    ~TwoWireSchedule();
+    TwoWireSchedule(const TwoWireSchedule&) = delete;
+    TwoWireSchedule& operator=(const TwoWireSchedule&) = delete;
+
+    // "period" and "slack" are in milliseconds. A poll may be delayed by up to "slack"
+    // to share a batch with other polls. Polls can only be added or removed while stopped.
+    bool add(class TwoWirePoll &poll, uint8_t address, const uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, uint32_t period, uint32_t slack = 0);
+    bool remove(class TwoWirePoll &poll);
+
+    bool start(void(*callback)(void));
+    bool start(Callback callback);
+    void stop();
+    bool active();
+
+    uint32_t batches();    // number of bus wakeups since start()
+
+private:
+    class TwoWire *_wire;
+    class TwoWirePoll *_polls;
+    stm32l0_rtc_timer_t _timer;
+    uint64_t _clock;
+    volatile uint32_t _batches;
+    bool _active;
+    Callback _callback { Callback::TYPE_BUS };
+
+    uint64_t millis(uint64_t clock);
+    static void timeout(class TwoWireSchedule *self);
+
+    friend class TwoWirePoll;
+};
+
 #if WIRE_INTERFACES_COUNT > 0
   extern TwoWire Wire;
 #endif
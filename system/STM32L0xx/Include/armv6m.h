@@ -42,6 +42,8 @@
 #include "armv6m_pendsv.h"
 #include "armv6m_svcall.h"
 #include "armv6m_systick.h"
+#include "armv6m_task.h"
+#include "armv6m_trace.h"
 #include "armv6m_work.h"
 
 #endif /* _ARMV6M_H */
@@ -36,10 +36,35 @@ extern "C" {
 typedef void (*armv6m_pendsv_callback_t)(void);
 typedef void (*armv6m_pendsv_routine_t)(void *context, uint32_t data);
 
+/* Caller owned deferred call. A posted event is pending until its routine
+ * gets called from PendSV. Posting it again while pending only updates
+ * "data", so the routine is called once with the latest value. As there
+ * is no shared storage involved, a post can never fail.
+ */
+typedef struct _armv6m_pendsv_event_t {
+    struct _armv6m_pendsv_event_t * volatile next;
+    armv6m_pendsv_routine_t                  routine;
+    void                                     *context;
+    volatile uint32_t                        data;
+} armv6m_pendsv_event_t;
+
+#define ARMV6M_PENDSV_EVENT_INIT(_routine, _context) { NULL, (armv6m_pendsv_routine_t)(_routine), (void*)(_context), 0 }
+
+typedef struct _armv6m_pendsv_statistics_t {
+    uint32_t                                 queue_high_water; /* max entries in use by armv6m_pendsv_enqueue() */
+    uint32_t                                 queue_overflow;   /* failed armv6m_pendsv_enqueue() calls */
+    uint32_t                                 event_coalesced;  /* armv6m_pendsv_event_post() calls merged into a pending post */
+} armv6m_pendsv_statistics_t;
+
 extern void __armv6m_pendsv_initialize(void);
 
 extern void armv6m_pendsv_hook(armv6m_pendsv_callback_t callback);
 extern bool armv6m_pendsv_enqueue(armv6m_pendsv_routine_t routine, void *context, uint32_t data);
+extern void armv6m_pendsv_event_create(armv6m_pendsv_event_t *event, armv6m_pendsv_routine_t routine, void *context);
+extern bool armv6m_pendsv_event_post(armv6m_pendsv_event_t *event, uint32_t data);
+extern bool armv6m_pendsv_event_pending(armv6m_pendsv_event_t *event);
+extern void armv6m_pendsv_statistics(armv6m_pendsv_statistics_t *p_statistics_return);
+extern void armv6m_pendsv_statistics_reset(void);
 extern bool armv6m_pendsv_raise(uint32_t index);
 extern void armv6m_pendsv_block(uint32_t mask);
 extern void armv6m_pendsv_unblock(uint32_t mask);
@@ -38,6 +38,7 @@ extern void __armv6m_systick_initialize(void);
 extern void armv6m_systick_enable(void);
 extern void armv6m_systick_disable(void);
 extern uint32_t armv6m_systick_micros(void);
+extern uint64_t armv6m_systick_nanos(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#if !defined(_ARMV6M_TASK_H)
+#define _ARMV6M_TASK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARMV6M_TASK_STATE_READY       0
+#define ARMV6M_TASK_STATE_WAITING     1
+#define ARMV6M_TASK_STATE_TERMINATED  2
+
+#define ARMV6M_TASK_STACK_MINIMUM     256
+
+typedef struct _armv6m_task_t {
+    struct _armv6m_task_t            *next;
+    void                             *stack;     /* saved stack pointer while switched out */
+    uint32_t                         control;    /* CONTROL, MSP for the main task, PSP otherwise */
+    volatile uint32_t                state;
+    uint32_t                         policy;     /* sleep policy while parked in armv6m_task_sleep() */
+    armv6m_core_callback_t           callback;
+} armv6m_task_t;
+
+typedef void (*armv6m_task_idle_routine_t)(uint32_t policy);
+
+typedef struct _armv6m_task_semaphore_t {
+    volatile uint32_t                count;
+} armv6m_task_semaphore_t;
+
+extern void __armv6m_task_initialize(void);
+
+extern bool armv6m_task_create(armv6m_task_t *task, armv6m_core_routine_t routine, void *context, void *stack, uint32_t size);
+extern void armv6m_task_exit(void) __attribute__((noreturn));
+extern armv6m_task_t *armv6m_task_self(void);
+extern bool armv6m_task_is_main(void);
+extern void armv6m_task_yield(void);
+extern void armv6m_task_sleep(uint32_t policy);
+extern void armv6m_task_idle(armv6m_task_idle_routine_t routine);
+
+extern void armv6m_task_semaphore_create(armv6m_task_semaphore_t *semaphore, uint32_t count);
+extern bool armv6m_task_semaphore_try_take(armv6m_task_semaphore_t *semaphore);
+extern void armv6m_task_semaphore_take(armv6m_task_semaphore_t *semaphore);
+extern void armv6m_task_semaphore_give(armv6m_task_semaphore_t *semaphore);
+
+/* Drop in replacement for __WFE() in "while (busy) { ... }" loops. Other
+ * tasks are run first, and only if all of them are parked as well the
+ * core waits for the next event.
+ */
+static inline void armv6m_task_wfe(void)
+{
+    armv6m_task_sleep(0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ARMV6M_TASK_H */
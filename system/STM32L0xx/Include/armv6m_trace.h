@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#if !defined(_ARMV6M_TRACE_H)
+#define _ARMV6M_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tracing is compiled out unless ARMV6M_TRACE is defined to 1 (i.e. via
+ * the "-DARMV6M_TRACE=1" compiler option). Timestamps are armv6m_systick_micros(),
+ * which does not advance while in STOP mode, and restarts at 0 when the
+ * system clock gets reconfigured (ARMV6M_TRACE_TYPE_CLOCK).
+ */
+#if !defined(ARMV6M_TRACE)
+#define ARMV6M_TRACE 0
+#endif
+
+#if !defined(ARMV6M_TRACE_ENTRY_COUNT)
+#define ARMV6M_TRACE_ENTRY_COUNT      128  /* power of 2 */
+#endif
+
+#define ARMV6M_TRACE_TYPE_IRQ_ENTER    1   /* id = exception number */
+#define ARMV6M_TRACE_TYPE_IRQ_LEAVE    2   /* id = exception number */
+#define ARMV6M_TRACE_TYPE_PENDSV_ENTER 3   /* data = routine */
+#define ARMV6M_TRACE_TYPE_PENDSV_LEAVE 4   /* data = routine */
+#define ARMV6M_TRACE_TYPE_WORK_ENTER   5   /* id = priority, data = routine */
+#define ARMV6M_TRACE_TYPE_WORK_LEAVE   6   /* id = priority, data = routine */
+#define ARMV6M_TRACE_TYPE_SLEEP_ENTER  7   /* id = 0 WFE, 1 SLEEP, 2 STOP */
+#define ARMV6M_TRACE_TYPE_SLEEP_LEAVE  8   /* id = 0 WFE, 1 SLEEP, 2 STOP */
+#define ARMV6M_TRACE_TYPE_RADIO_DIO    9   /* id = DIO index */
+#define ARMV6M_TRACE_TYPE_CLOCK        10  /* data = SystemCoreClock */
+#define ARMV6M_TRACE_TYPE_USER         128
+
+typedef struct _armv6m_trace_entry_t {
+    uint32_t                         timestamp;
+    uint16_t                         type;
+    uint16_t                         id;
+    uint32_t                         data;
+} armv6m_trace_entry_t;
+
+extern void armv6m_trace_event(uint32_t type, uint32_t id, uint32_t data);
+extern uint32_t armv6m_trace_read(armv6m_trace_entry_t *entries, uint32_t count, uint32_t *p_lost_return);
+extern void armv6m_trace_reset(void);
+
+#if (ARMV6M_TRACE == 1)
+
+#define ARMV6M_TRACE_EVENT(_type, _id, _data) armv6m_trace_event((_type), (_id), (uint32_t)(_data))
+#define ARMV6M_TRACE_IRQ_ENTER()              armv6m_trace_event(ARMV6M_TRACE_TYPE_IRQ_ENTER, __get_IPSR(), 0)
+#define ARMV6M_TRACE_IRQ_LEAVE()              armv6m_trace_event(ARMV6M_TRACE_TYPE_IRQ_LEAVE, __get_IPSR(), 0)
+
+#else /* ARMV6M_TRACE == 1 */
+
+#define ARMV6M_TRACE_EVENT(_type, _id, _data)
+#define ARMV6M_TRACE_IRQ_ENTER()
+#define ARMV6M_TRACE_IRQ_LEAVE()
+
+#endif /* ARMV6M_TRACE == 1 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ARMV6M_TRACE_H */
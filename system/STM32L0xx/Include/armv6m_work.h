@@ -33,23 +33,51 @@
 extern "C" {
 #endif
 
+#define ARMV6M_WORK_PRIORITY_NORMAL  0
+#define ARMV6M_WORK_PRIORITY_HIGH    1
+#define ARMV6M_WORK_PRIORITY_URGENT  2
+#define ARMV6M_WORK_PRIORITY_COUNT   3
+
 typedef struct _armv6m_work_t {
     struct _armv6m_work_t * volatile next;
     armv6m_core_callback_t           callback;
+    uint32_t                         priority;
+    volatile uint32_t                timestamp;  /* submit time in micros */
+    uint32_t                         execution;  /* worst case execution time in micros */
 } armv6m_work_t;
 
+typedef struct _armv6m_work_statistics_t {
+    uint32_t                         count;
+    uint32_t                         latency;    /* worst case submit to start in micros */
+    uint32_t                         execution;  /* worst case execution time in micros */
+} armv6m_work_statistics_t;
+
+typedef void (*armv6m_work_notify_routine_t)(bool busy);
+
 #define ARMV6M_WORK_INIT(_routine, _context) {	           \
     .callback.routine = (armv6m_core_routine_t)(_routine), \
     .callback.context = (void*)(_context),	  	   \
 }
 
+#define ARMV6M_WORK_INIT_PRIORITY(_routine, _context, _priority) { \
+    .callback.routine = (armv6m_core_routine_t)(_routine),         \
+    .callback.context = (void*)(_context),	  	           \
+    .priority = (_priority),	  	                           \
+}
+
 extern void __armv6m_work_initialize(void);
 
 extern void armv6m_work_create(armv6m_work_t *work, armv6m_core_routine_t routine, void *context);
+extern void armv6m_work_create_priority(armv6m_work_t *work, armv6m_core_routine_t routine, void *context, uint32_t priority);
 extern bool armv6m_work_destory(armv6m_work_t *work);
 extern bool armv6m_work_submit(armv6m_work_t *work);
 extern void armv6m_work_block(void);
 extern void armv6m_work_unblock(void);
+extern bool armv6m_work_is_executing(void);
+extern bool armv6m_work_is_busy(void);
+extern void armv6m_work_notify(armv6m_work_notify_routine_t routine);
+extern void armv6m_work_statistics(uint32_t priority, armv6m_work_statistics_t *p_statistics_return);
+extern void armv6m_work_statistics_reset(void);
   
 #ifdef __cplusplus
 }
@@ -109,6 +109,12 @@ extern "C" {
 
 typedef void (*stm32l0_adc_done_callback_t)(void *context, uint32_t count);
 
+#define STM32L0_ADC_EVENT_HALF                      0x00000001 /* lower half of the ring */
+#define STM32L0_ADC_EVENT_FULL                      0x00000002 /* upper half of the ring */
+#define STM32L0_ADC_EVENT_OVERRUN                   0x00000004
+
+typedef void (*stm32l0_adc_scan_callback_t)(void *context, void *data, uint32_t count, uint32_t events);
+
 #define STM32L0_ADC_VREFINT_CAL                     (*((const uint16_t*)0x1ff80078))
 #define STM32L0_ADC_TSENSE_CAL1                     (*((const uint16_t*)0x1ff8007a))
 #define STM32L0_ADC_TSENSE_CAL2                     (*((const uint16_t*)0x1ff8007e))
@@ -120,6 +126,8 @@ extern bool stm32l0_adc_enable(void);
 extern bool stm32l0_adc_disable(void);
 extern uint32_t stm32l0_adc_read(unsigned int channel, uint16_t period);
 extern bool stm32l0_adc_convert(void *data, uint32_t count, uint16_t mask, uint16_t period, uint32_t control, stm32l0_adc_done_callback_t callback, void *context);
+extern bool stm32l0_adc_scan(void *data, uint32_t count, uint16_t mask, uint16_t period, uint32_t control, stm32l0_adc_scan_callback_t callback, void *context);
+extern uint32_t stm32l0_adc_overruns(void);
 extern void stm32l0_adc_cancel(void);
 extern bool stm32l0_adc_done(void);
 
@@ -44,6 +44,7 @@ extern void stm32l0_aes_ecb_decrypt(const uint8_t *in, uint8_t *out, uint32_t n)
 extern void stm32l0_aes_cbc_encrypt(const uint8_t *iv, const uint8_t *in, uint8_t *out, uint32_t n);
 extern void stm32l0_aes_cbc_decrypt(const uint8_t *iv, const uint8_t *in, uint8_t *out, uint32_t n);
 extern void stm32l0_aes_ctr_xcrypt(const uint8_t *ctr, const uint8_t *in, uint8_t *out, uint32_t n);
+extern void stm32l0_aes_ctr_keystream(const uint8_t *key, const uint8_t *ctr, uint8_t *out, uint32_t n);
 extern void stm32l0_aes_ccm_encrypt(uint32_t msize, const uint8_t *nonce, const uint8_t *adata, uint32_t asize, const uint8_t *in, uint8_t *out, uint32_t n);
 extern bool stm32l0_aes_ccm_decrypt(uint32_t msize, const uint8_t *nonce, const uint8_t *adata, uint32_t asize, const uint8_t *in, uint8_t *out, uint32_t n);
 extern void stm32l0_aes_cmac_init(void);
@@ -60,10 +60,18 @@ extern "C" {
 
 typedef void (*stm32l0_dac_done_callback_t)(void *context, uint32_t count);
 
+#define STM32L0_DAC_EVENT_HALF                           0x00000001 /* lower half of the buffer */
+#define STM32L0_DAC_EVENT_FULL                           0x00000002 /* upper half of the buffer */
+#define STM32L0_DAC_EVENT_UNDERRUN                       0x00000004
+
+typedef void (*stm32l0_dac_stream_callback_t)(void *context, void *data, uint32_t count, uint32_t events);
+
 extern bool stm32l0_dac_enable(uint32_t channels);
 extern bool stm32l0_dac_disable(uint32_t channels);
 extern void stm32l0_dac_write(uint32_t channels, uint32_t output);
 extern bool stm32l0_dac_convert(const void *data, uint32_t count, uint32_t control, stm32l0_dac_done_callback_t callback, void *context);
+extern bool stm32l0_dac_stream(const void *data, uint32_t count, uint32_t control, stm32l0_dac_stream_callback_t callback, void *context);
+extern uint32_t stm32l0_dac_underruns(void);
 extern void stm32l0_dac_cancel(void);
 
 #ifdef __cplusplus
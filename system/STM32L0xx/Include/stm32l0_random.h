@@ -36,7 +36,25 @@
 extern "C" {
 #endif
 
+/* stm32l0_random() serves bytes from an AES-128 CTR_DRBG (SP 800-90A,
+ * no derivation function, 32 bit counter), seeded from the RNG. The RNG
+ * (and HSI48) is only powered up for a burst of 32 bytes at each reseed,
+ * every STM32L0_RANDOM_RESEED_INTERVAL requests, instead of for each
+ * request. The raw RNG output passes the SP 800-90B repetition count and
+ * adaptive proportion tests, after a startup test of 1024 bytes.
+ *
+ * stm32l0_random_entropy() returns health tested RNG output directly.
+ * stm32l0_random_reseed() forces a reseed, say before deriving keys.
+ *
+ * All of them return false on an RNG error or a failed health test, or
+ * if called while another call is in progress (from an interrupt).
+ */
+
+#define STM32L0_RANDOM_RESEED_INTERVAL 1024
+
 extern bool stm32l0_random(uint8_t *data, uint32_t count);
+extern bool stm32l0_random_entropy(uint8_t *data, uint32_t count);
+extern bool stm32l0_random_reseed(void);
 
 #ifdef __cplusplus
 }
@@ -68,6 +68,12 @@ typedef struct _stm32l0_rtc_timer_t {
     stm32l0_rtc_timer_callback_t          callback;
     void                                  *context;
     volatile uint32_t                     clock[2];
+    volatile uint32_t                     slack;
+    stm32l0_rtc_timer_t                   *child;     /* pairing heap, owned by SWI_RTC_TIMER */
+    stm32l0_rtc_timer_t                   *sibling;
+    stm32l0_rtc_timer_t                   *previous;
+    uint32_t                              window;
+    uint64_t                              deadline;
 } stm32l0_rtc_timer_t;
 
 #define STM32L0_RTC_IRQ_PRIORITY                2
@@ -89,7 +95,7 @@ typedef struct _stm32l0_rtc_timer_t {
 #define STM32L0_RTC_TIMER_MODE_ABSOLUTE         0x00000000
 #define STM32L0_RTC_TIMER_MODE_RELATIVE         0x00000001
   
-#define STM32L0_RTC_TIMER_INIT(_callback, _context) { NULL, (stm32l0_rtc_timer_callback_t)(_callback), (void*)(_context), { 0, 0 } }
+#define STM32L0_RTC_TIMER_INIT(_callback, _context) { NULL, (stm32l0_rtc_timer_callback_t)(_callback), (void*)(_context), { 0, 0 }, 0, NULL, NULL, NULL, 0, 0 }
 
 #define STM32L0_RTC_PREDIV_S         2048
 #define STM32L0_RTC_PREDIV_A         16
@@ -163,6 +169,7 @@ extern bool stm32l0_rtc_alarm_done();
 extern void stm32l0_rtc_timer_create(stm32l0_rtc_timer_t *timer, stm32l0_rtc_timer_callback_t callback, void *context);
 extern bool stm32l0_rtc_timer_destroy(stm32l0_rtc_timer_t *timer);
 extern void stm32l0_rtc_timer_start(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_t mode);
+extern void stm32l0_rtc_timer_start_slack(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_t slack, uint32_t mode);
 extern void stm32l0_rtc_timer_stop(stm32l0_rtc_timer_t *timer);
 extern bool stm32l0_rtc_timer_done(stm32l0_rtc_timer_t *timer);
 
@@ -58,6 +58,10 @@ enum {
 #define STM32L0_SPI_STATE_READY                2
 #define STM32L0_SPI_STATE_DATA                 3
 #define STM32L0_SPI_STATE_DMA                  4
+#define STM32L0_SPI_STATE_QUEUE                5
+
+#define STM32L0_SPI_STATUS_SUCCESS             0
+#define STM32L0_SPI_STATUS_BUSY                1
 
 typedef struct _stm32l0_spi_pins_t {
     uint16_t                    mosi;
@@ -78,6 +82,31 @@ typedef void (*stm32l0_spi_lock_callback_t)(void *cookie, int acquire);
 
 typedef void (*stm32l0_spi_done_callback_t)(void *context);
 
+/* A segment with a NULL "tx_data" sends 0xff, one with a NULL "rx_data" discards
+ * the received data.
+ */
+typedef struct _stm32l0_spi_segment_t {
+    const uint8_t               *tx_data;
+    uint8_t                     *rx_data;
+    uint16_t                    count;
+} stm32l0_spi_segment_t;
+
+/* "pin" is driven low for the whole transaction and high after it, or left alone
+ * if it is STM32L0_GPIO_PIN_NONE. "clock" and "option" are the same as for 
+ * stm32l0_spi_acquire().
+ */
+typedef struct _stm32l0_spi_transaction_t {
+    struct _stm32l0_spi_transaction_t   *next;
+    volatile uint8_t                    status;
+    uint8_t                             segment_count;
+    uint16_t                            pin;
+    uint32_t                            clock;
+    uint32_t                            option;
+    const stm32l0_spi_segment_t         *segments;
+    stm32l0_spi_done_callback_t         callback;
+    void                                *context;
+} stm32l0_spi_transaction_t;
+
   typedef struct _stm32l0_spi_t {
     SPI_TypeDef                 *SPI;
     volatile uint8_t            state;
@@ -98,6 +127,10 @@ typedef void (*stm32l0_spi_done_callback_t)(void *context);
     stm32l0_spi_done_callback_t xf_callback;
     void                        *xf_context;
     uint8_t                     *rx_data;
+    volatile uint8_t            rq_acquire;
+    uint8_t                     xf_segment;
+    stm32l0_spi_transaction_t   *xf_queue;
+    stm32l0_spi_transaction_t   *xf_transaction;
 } stm32l0_spi_t;
 
 extern bool stm32l0_spi_create(stm32l0_spi_t *spi, const stm32l0_spi_params_t *params);
@@ -117,6 +150,7 @@ extern bool stm32l0_spi_transmit(stm32l0_spi_t *spi, const uint8_t *tx_data, uin
 extern bool stm32l0_spi_transfer(stm32l0_spi_t *spi, const uint8_t *tx_data, uint8_t *rx_data, uint32_t xf_count, stm32l0_spi_done_callback_t callback, void *context);
 extern uint32_t stm32l0_spi_cancel(stm32l0_spi_t *spi);
 extern bool stm32l0_spi_done(stm32l0_spi_t *spi);
+extern bool stm32l0_spi_submit(stm32l0_spi_t *spi, stm32l0_spi_transaction_t *transaction);
 
 #ifdef __cplusplus
 }
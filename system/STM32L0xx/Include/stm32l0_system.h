@@ -100,10 +100,17 @@ enum {
 #define STM32L0_SYSTEM_LOCK_EEPROM             5
 #define STM32L0_SYSTEM_LOCK_COUNT              6
 
+#define STM32L0_SYSTEM_MODE_RUN                0
+#define STM32L0_SYSTEM_MODE_IDLE               1  /* WFE, all clocks running */
+#define STM32L0_SYSTEM_MODE_SLEEP              2
+#define STM32L0_SYSTEM_MODE_STOP               3
+#define STM32L0_SYSTEM_MODE_COUNT              4
+
 #define STM32L0_SYSTEM_REFERENCE_SWD           0x00000001
 #define STM32L0_SYSTEM_REFERENCE_RNG           0x00000002
 #define STM32L0_SYSTEM_REFERENCE_USB           0x00000004  /* force pclk1  >= 16MHz */
 #define STM32L0_SYSTEM_REFERENCE_I2C2          0x00000008  /* force pclk1  >=  4MHz */
+#define STM32L0_SYSTEM_REFERENCE_PERFORMANCE   0x00000010  /* force governor hclk high */
 
 #define STM32L0_SYSTEM_NOTIFY_CLOCKS           0x00000001
 #define STM32L0_SYSTEM_NOTIFY_SLEEP            0x00000002
@@ -115,6 +122,21 @@ enum {
 
 typedef void (*stm32l0_system_fatal_callback_t)(void);
 
+#define STM32L0_SYSTEM_FREQUENCY_COUNT         4
+
+typedef struct _stm32l0_system_frequency_t {
+    uint32_t                        hclk;
+    uint32_t                        count;                                /* switches to this hclk */
+    uint64_t                        residency;                            /* RTC clock ticks */
+} stm32l0_system_frequency_t;
+
+typedef struct _stm32l0_system_profile_t {
+    uint64_t                        residency[STM32L0_SYSTEM_MODE_COUNT]; /* RTC clock ticks */
+    uint64_t                        blocked[STM32L0_SYSTEM_LOCK_COUNT];   /* RTC clock ticks a lock forced a shallower or costlier mode */
+    uint32_t                        wakeup[32];                           /* SLEEP/STOP wakeups per NVIC interrupt */
+    stm32l0_system_frequency_t      frequency[STM32L0_SYSTEM_FREQUENCY_COUNT];
+} stm32l0_system_profile_t;
+
 typedef void (*stm32l0_system_callback_t)(void *context, uint32_t events);
 
 typedef struct _stm32l0_system_notify_t {
@@ -198,11 +220,15 @@ extern void     stm32l0_system_reference(uint32_t reference);
 extern void     stm32l0_system_unreference(uint32_t reference); 
 extern void     stm32l0_system_sleep(uint32_t policy, uint32_t mask, uint32_t timeout);
 extern void     stm32l0_system_wakeup(uint32_t events);
+extern void     stm32l0_system_profile(stm32l0_system_profile_t *p_profile_return);
+extern void     stm32l0_system_profile_reset(void);
+extern void     stm32l0_system_governor(uint32_t hclk_low, uint32_t hclk_high);
 extern void     stm32l0_system_standby(uint32_t control, uint32_t timeout);
 extern void     stm32l0_system_hook(stm32l0_system_fatal_callback_t callback);
 extern void     stm32l0_system_fatal(void) __attribute__((noreturn));
 extern void     stm32l0_system_reset(void) __attribute__((noreturn));
 extern void     stm32l0_system_dfu(void) __attribute__((noreturn));
+extern void     stm32l0_system_swap(void) __attribute__((noreturn));
 
   
 extern void WWDG_IRQHandler(void);
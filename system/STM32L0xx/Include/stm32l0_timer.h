@@ -71,6 +71,7 @@ enum {
 #define STM32L0_TIMER_OPTION_COUNT_CENTER_UP_DOWN        0x00000060
 #define STM32L0_TIMER_OPTION_COUNT_PRELOAD               0x00000080
 
+#define STM32L0_TIMER_EVENT_CAPTURE_DONE                 0x04000000
 #define STM32L0_TIMER_EVENT_PERIOD                       0x08000000
 #define STM32L0_TIMER_EVENT_CHANNEL_1                    0x10000000
 #define STM32L0_TIMER_EVENT_CHANNEL_2                    0x20000000
@@ -120,6 +121,11 @@ typedef struct _stm32l0_timer_t {
     void                        *context;
     uint32_t                    events;
     volatile uint32_t           channels;
+    uint16_t                    capture_dma;
+    uint8_t                     capture_channel;
+    uint16_t                    capture_size;
+    volatile uint16_t           capture_count;
+    uint16_t * volatile         capture_data;
 } stm32l0_timer_t;
 
 extern bool     stm32l0_timer_create(stm32l0_timer_t *timer, unsigned int instance, unsigned int priority, unsigned int mode);
@@ -137,6 +143,14 @@ extern bool     stm32l0_timer_channel(stm32l0_timer_t *timer, unsigned int chann
 extern bool     stm32l0_timer_compare(stm32l0_timer_t *timer, unsigned int channel, uint32_t compare);
 extern uint32_t stm32l0_timer_capture(stm32l0_timer_t *timer, unsigned int channel);
 
+/* Records "count" capture values of "channel" into "data", via DMA if the
+ * channel has a DMA request (TIM2, TIM3), otherwise from the capture
+ * interrupt. STM32L0_TIMER_EVENT_CAPTURE_DONE is reported once "data" is full.
+ */
+extern bool     stm32l0_timer_capture_stream(stm32l0_timer_t *timer, unsigned int channel, uint16_t *data, uint32_t count, uint32_t control);
+extern uint32_t stm32l0_timer_capture_count(stm32l0_timer_t *timer);
+extern uint32_t stm32l0_timer_capture_cancel(stm32l0_timer_t *timer);
+
 #ifdef __cplusplus
 }
 #endif
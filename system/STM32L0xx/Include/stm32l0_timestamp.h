@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#if !defined(_STM32L0_TIMESTAMP_H)
+#define _STM32L0_TIMESTAMP_H
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A 64 bit monotonic nanosecond timeline. SysTick provides the resolution
+ * while running, the RTC carries the timeline across STOP and calibrates the
+ * SysTick rate. An external PPS, if present, takes over the rate calibration.
+ */
+
+#define STM32L0_TIMESTAMP_NANOS_PER_SECOND  1000000000ull
+
+typedef struct _stm32l0_timestamp_status_t {
+    int32_t                   correction;  /* SysTick rate correction in ppb */
+    uint32_t                  pps_count;   /* consecutive valid PPS pulses */
+    bool                      locked;      /* rate is calibrated against PPS */
+} stm32l0_timestamp_status_t;
+
+extern void __stm32l0_timestamp_initialize(void);
+
+extern uint64_t stm32l0_timestamp_read(void);
+extern void stm32l0_timestamp_pps(uint64_t timestamp);
+extern void stm32l0_timestamp_status(stm32l0_timestamp_status_t *p_status_return);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STM32L0_TIMESTAMP_H */
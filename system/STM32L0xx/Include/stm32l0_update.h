@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#if !defined(_STM32L0_UPDATE_H)
+#define _STM32L0_UPDATE_H
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Firmware update into the inactive flash bank of a dual bank part
+ * (STM32L07x/STM32L08x). A patch is streamed in with stm32l0_update_write()
+ * in arbitrary pieces, and applied against the running image. The new
+ * image is programmed half-page by half-page into the inactive bank.
+ * stm32l0_update_end() verifies it, and stm32l0_system_swap() reboots
+ * into it.
+ *
+ * Patch format, all values little endian:
+ *
+ *   header:  uint32_t magic, source_size, source_crc, target_size, target_crc, header_crc
+ *   ADD:     0x01, uvarint length, svarint seek, then runs of
+ *            { uvarint zeros, uvarint (count << 1) | repeat, count bytes unless repeat }
+ *   INSERT:  0x02, uvarint length, length bytes
+ *   END:     0x00
+ *
+ * ADD moves the source position by "seek", and then outputs "length" bytes
+ * of source plus a difference (bsdiff style, so that code which only moved
+ * costs little). The difference is coded as runs of zero bytes (unchanged)
+ * followed by difference bytes. "repeat" reuses the previous difference
+ * bytes (up to 8), as relocated code changes many addresses and branch
+ * offsets by the same amount. INSERT outputs new bytes. The CRCs are CRC-32 (as zlib), the header_crc covers the first
+ * 5 header words. libraries/STM32L0/extras/fwpatch.py builds patches.
+ */
+
+#define STM32L0_UPDATE_MAGIC                  0x31505746 /* "FWP1" */
+
+#define STM32L0_UPDATE_STATUS_NONE            0
+#define STM32L0_UPDATE_STATUS_BUSY            1
+#define STM32L0_UPDATE_STATUS_SUCCESS         2
+#define STM32L0_UPDATE_STATUS_ERROR_FORMAT    3 /* malformed patch */
+#define STM32L0_UPDATE_STATUS_ERROR_SOURCE    4 /* patch is not for the running image */
+#define STM32L0_UPDATE_STATUS_ERROR_SIZE      5 /* image does not fit into a bank */
+#define STM32L0_UPDATE_STATUS_ERROR_FLASH     6 /* erase or program failed */
+#define STM32L0_UPDATE_STATUS_ERROR_VERIFY    7 /* target CRC mismatch */
+
+typedef struct _stm32l0_update_t {
+    volatile uint8_t              status;
+    uint8_t                       state;
+    uint8_t                       next;
+    uint8_t                       shift;
+    uint32_t                      value;
+    uint32_t                      length;
+    uint32_t                      count;
+    uint32_t                      source;
+    uint32_t                      target;
+    uint8_t                       delta_count;
+    uint8_t                       delta[8];
+    uint32_t                      header[6];
+    uint32_t                      data[16];
+} stm32l0_update_t;
+
+extern uint32_t stm32l0_update_bank_size(void);
+extern bool stm32l0_update_begin(stm32l0_update_t *update);
+extern bool stm32l0_update_write(stm32l0_update_t *update, const uint8_t *data, uint32_t count);
+extern bool stm32l0_update_end(stm32l0_update_t *update);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STM32L0_UPDATE_H */
@@ -67,6 +67,7 @@ void SWI_RADIO_IRQHandler(void)
 static void SX1272OnRadioDone( void )
 {
     // ### CAPUTRE RTC here
+    ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_RADIO_DIO, 0, 0);
     armv6m_pendsv_raise(ARMV6M_PENDSV_SWI_RADIO);
 }
 
@@ -40,6 +40,7 @@ void __armv6m_core_initialize(void)
     __armv6m_svcall_initialize();
     __armv6m_pendsv_initialize();
     __armv6m_systick_initialize();
+    __armv6m_task_initialize();
     __armv6m_work_initialize();
 }
 
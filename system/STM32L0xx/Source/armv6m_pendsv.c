@@ -42,11 +42,15 @@ typedef struct _armv6m_pendsv_control_t {
     armv6m_pendsv_callback_t         hook_callback;
     volatile armv6m_pendsv_entry_t   *queue_read;
     volatile armv6m_pendsv_entry_t   *queue_write;
+    armv6m_pendsv_event_t * volatile event_submit;
+    armv6m_pendsv_statistics_t       statistics;
     armv6m_pendsv_entry_t            queue_data[ARMV6M_PENDSV_ENTRY_COUNT];
 } armv6m_pendsv_control_t;
 
 static armv6m_pendsv_control_t armv6m_pendsv_control;
 
+#define ARMV6M_PENDSV_EVENT_TAIL ((armv6m_pendsv_event_t*)1)
+
 static const armv6m_pendsv_callback_t armv6m_pendsv_swi_callback[] = {
     SWI0_IRQHandler,
     SWI1_IRQHandler,
@@ -88,6 +92,7 @@ void __armv6m_pendsv_initialize(void)
     armv6m_pendsv_control.swi_mask = ~0ul;
     armv6m_pendsv_control.queue_read = &armv6m_pendsv_control.queue_data[0];
     armv6m_pendsv_control.queue_write = &armv6m_pendsv_control.queue_data[0];
+    armv6m_pendsv_control.event_submit = ARMV6M_PENDSV_EVENT_TAIL;
 
     NVIC_SetPriority(PendSV_IRQn, ARMV6M_IRQ_PRIORITY_PENDSV);
 }
@@ -133,6 +138,7 @@ __attribute__((optimize("O3"))) void armv6m_pendsv_hook(armv6m_pendsv_callback_t
 __attribute__((optimize("O3"))) bool armv6m_pendsv_enqueue(armv6m_pendsv_routine_t routine, void *context, uint32_t data)
 {
     volatile armv6m_pendsv_entry_t *queue_write, *queue_write_next;
+    uint32_t queue_count, queue_high_water;
 
     do
     {
@@ -146,6 +152,8 @@ __attribute__((optimize("O3"))) bool armv6m_pendsv_enqueue(armv6m_pendsv_routine
         
         if (queue_write_next == armv6m_pendsv_control.queue_read)
         {
+            armv6m_atomic_add(&armv6m_pendsv_control.statistics.queue_overflow, 1);
+
             return false;
         }
     }
@@ -157,9 +165,83 @@ __attribute__((optimize("O3"))) bool armv6m_pendsv_enqueue(armv6m_pendsv_routine
 
     SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
 
+    queue_count = (queue_write_next - armv6m_pendsv_control.queue_read) & (ARMV6M_PENDSV_ENTRY_COUNT -1);
+
+    do
+    {
+        queue_high_water = armv6m_pendsv_control.statistics.queue_high_water;
+
+        if (queue_count <= queue_high_water)
+        {
+            break;
+        }
+    }
+    while (__armv6m_atomic_cas(&armv6m_pendsv_control.statistics.queue_high_water, queue_high_water, queue_count) != queue_high_water);
+
     return true;
 }
 
+void armv6m_pendsv_event_create(armv6m_pendsv_event_t *event, armv6m_pendsv_routine_t routine, void *context)
+{
+    event->next = NULL;
+    event->routine = routine;
+    event->context = context;
+    event->data = 0;
+}
+
+/* "next" is non-NULL while the event is pending. Linking it into "event_submit"
+ * is done with interrupts disabled, so that PendSV never sees a half linked
+ * list, even when posting from thread mode.
+ */
+__attribute__((optimize("O3"))) bool armv6m_pendsv_event_post(armv6m_pendsv_event_t *event, uint32_t data)
+{
+    uint32_t primask;
+    bool queued;
+
+    event->data = data;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    queued = (event->next == NULL);
+
+    if (queued)
+    {
+        event->next = armv6m_pendsv_control.event_submit;
+
+        armv6m_pendsv_control.event_submit = event;
+    }
+    else
+    {
+        armv6m_pendsv_control.statistics.event_coalesced++;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (queued)
+    {
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+    }
+
+    return queued;
+}
+
+bool armv6m_pendsv_event_pending(armv6m_pendsv_event_t *event)
+{
+    return (event->next != NULL);
+}
+
+void armv6m_pendsv_statistics(armv6m_pendsv_statistics_t *p_statistics_return)
+{
+    *p_statistics_return = armv6m_pendsv_control.statistics;
+}
+
+void armv6m_pendsv_statistics_reset(void)
+{
+    memset(&armv6m_pendsv_control.statistics, 0, sizeof(armv6m_pendsv_statistics_t));
+}
+
 static __attribute__((optimize("O3"), used)) void armv6m_pendsv_swi_process(uint32_t mask)
 {
     uint32_t index;
@@ -197,11 +279,51 @@ static __attribute__((optimize("O3"), used)) void armv6m_pendsv_queue_process(vo
 
         armv6m_pendsv_control.queue_read = queue_read;
 
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_PENDSV_ENTER, 0, routine);
+
         (*routine)(context, data);
+
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_PENDSV_LEAVE, 0, routine);
     }
     while (queue_read != armv6m_pendsv_control.queue_write);
 }
 
+/* Events were pushed LIFO, so reverse them first to call the routines in
+ * post order. "next" is cleared before the routine is called, so that the
+ * routine (or an interrupt) can post the event again.
+ */
+static __attribute__((optimize("O3"), used)) void armv6m_pendsv_event_process(void)
+{
+    armv6m_pendsv_event_t *event, *event_next, *event_head;
+    uint32_t data;
+
+    event = (armv6m_pendsv_event_t*)__armv6m_atomic_swap((volatile uint32_t*)&armv6m_pendsv_control.event_submit, (uint32_t)ARMV6M_PENDSV_EVENT_TAIL);
+
+    for (event_head = ARMV6M_PENDSV_EVENT_TAIL; event != ARMV6M_PENDSV_EVENT_TAIL; event = event_next)
+    {
+        event_next = event->next;
+
+        event->next = event_head;
+
+        event_head = event;
+    }
+
+    for (event = event_head; event != ARMV6M_PENDSV_EVENT_TAIL; event = event_next)
+    {
+        event_next = event->next;
+
+        event->next = NULL;
+
+        data = event->data;
+
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_PENDSV_ENTER, 1, event->routine);
+
+        (*event->routine)(event->context, data);
+
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_PENDSV_LEAVE, 1, event->routine);
+    }
+}
+
 void __attribute__((naked)) PendSV_Handler(void)
 {
     __asm__( 
@@ -223,13 +345,18 @@ void __attribute__((naked)) PendSV_Handler(void)
         "   beq     2f                                   \n"
         "   bl      armv6m_pendsv_queue_process          \n" // R0 is queue_read
         "   ldr     r1, =armv6m_pendsv_control           \n"
-        "2: ldr     r0, [r1, %[offset_HOOK_CALLBACK]]    \n"
+        "2: ldr     r0, [r1, %[offset_EVENT_SUBMIT]]     \n"
+        "   cmp     r0, #1                               \n" // ARMV6M_PENDSV_EVENT_TAIL
+        "   beq     3f                                   \n"
+        "   bl      armv6m_pendsv_event_process          \n"
+        "   ldr     r1, =armv6m_pendsv_control           \n"
+        "3: ldr     r0, [r1, %[offset_HOOK_CALLBACK]]    \n"
         "   pop     { r2, r3 }                           \n"
         "   mov     lr, r3                               \n"
         "   cmp     r0, #0                               \n"
-        "   bne     3f                                   \n"
+        "   bne     4f                                   \n"
         "   bx      lr                                   \n"
-        "3: mov     r2, #0                               \n"
+        "4: mov     r2, #0                               \n"
         "   str     r2, [r1, %[offset_HOOK_CALLBACK]]    \n"
         "   bx      r0                                   \n"
         :
@@ -237,6 +364,7 @@ void __attribute__((naked)) PendSV_Handler(void)
           [offset_SWI_MASK]        "I" (offsetof(armv6m_pendsv_control_t, swi_mask)),
           [offset_QUEUE_READ]      "I" (offsetof(armv6m_pendsv_control_t, queue_read)),
           [offset_QUEUE_WRITE]     "I" (offsetof(armv6m_pendsv_control_t, queue_write)),
+          [offset_EVENT_SUBMIT]    "I" (offsetof(armv6m_pendsv_control_t, event_submit)),
           [offset_HOOK_CALLBACK]   "I" (offsetof(armv6m_pendsv_control_t, hook_callback))
         );
 }
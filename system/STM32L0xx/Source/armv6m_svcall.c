@@ -33,17 +33,27 @@ void __armv6m_svcall_initialize(void)
     NVIC_SetPriority(SVC_IRQn, ARMV6M_IRQ_PRIORITY_SVCALL);
 }
 
+/* Arguments are taken from, and the result is stored to, the exception frame
+ * of the caller. Tasks other than the main task run on PSP, hence bit 2 of
+ * EXC_RETURN selects between PSP and MSP.
+ */
 void __attribute__((naked)) SVC_Handler(void)
 {
     __asm__(
+        "   mov     r2, lr                               \n"
+        "   lsl     r2, r2, #29                          \n"
+        "   bmi     1f                                   \n"
         "   mov     r2, sp                               \n"
-        "   push    { r2, lr }                           \n"
+        "   b       2f                                   \n"
+        "1: mrs     r2, PSP                              \n"
+        "2: push    { r2, lr }                           \n"
         "   .cfi_def_cfa_offset 8                        \n"
         "   .cfi_offset 2, -8                            \n"
         "   .cfi_offset 14, -4                           \n"
         "   ldmia   r2, { r0, r1, r2, r3 }               \n"
         "   blx     r7                                   \n"
-        "   str     r0, [sp, #8]                         \n"
+        "   ldr     r1, [sp, #0]                         \n"
+        "   str     r0, [r1, #0]                         \n"
         "   pop     { r2, pc }                           \n"
         :
         :
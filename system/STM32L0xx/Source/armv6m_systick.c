@@ -30,9 +30,11 @@
 
 typedef struct _armv6m_systick_control_t {
     volatile uint32_t         micros;
+    volatile uint64_t         nanos;
     uint32_t                  clock;
     uint32_t                  cycle;
     uint32_t                  scale;
+    uint32_t                  nscale;
 } armv6m_systick_control_t;
 
 static armv6m_systick_control_t armv6m_systick_control;
@@ -42,8 +44,70 @@ void __armv6m_systick_initialize(void)
     NVIC_SetPriority(SysTick_IRQn, ARMV6M_IRQ_PRIORITY_SYSTICK);
 }
 
+/* Both values have to be taken from the same SysTick->VAL read, as a
+ * wraparound accounted in between would be lost otherwise.
+ *
+ * SysTick->VAL reads 0 for one cycle before the reload, with COUNTFLAG
+ * already set, and right after SysTick->VAL got written. Either way the
+ * period is accounted for already, so 0 counts as the start of the next
+ * one rather than the end of the current one.
+ */
+static void armv6m_systick_fold(void)
+{
+    uint32_t micros, count;
+    uint64_t nanos;
+    
+    do
+    {
+        micros = armv6m_systick_control.micros;
+        nanos = armv6m_systick_control.nanos;
+        count = SysTick->VAL;
+
+        if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
+        {
+            armv6m_systick_control.micros += 125000;
+            armv6m_systick_control.nanos += 125000000;
+        }
+    }
+    while (micros != armv6m_systick_control.micros);
+
+    if (count == 0)
+    {
+        count = armv6m_systick_control.cycle;
+    }
+
+    armv6m_systick_control.micros = micros + (((armv6m_systick_control.cycle - count) * armv6m_systick_control.scale) >> 15);
+    armv6m_systick_control.nanos = nanos + (((uint64_t)(armv6m_systick_control.cycle - count) * armv6m_systick_control.nscale) >> 8);
+}
+
+/* Reading SysTick->CTRL clears COUNTFLAG, so a wraparound seen while
+ * checking for SysTick_CTRL_ENABLE_Msk has to be accounted for right away.
+ */
+static bool armv6m_systick_running(void)
+{
+    uint32_t ctrl;
+
+    ctrl = SysTick->CTRL;
+
+    if (ctrl & SysTick_CTRL_COUNTFLAG_Msk)
+    {
+        armv6m_systick_control.micros += 125000;
+        armv6m_systick_control.nanos += 125000000;
+    }
+
+    return !!(ctrl & SysTick_CTRL_ENABLE_Msk);
+}
+
 void armv6m_systick_enable()
 {
+    /* If SysTick kept running through a clock change, fold the elapsed part
+     * of the period into "micros" and "nanos" using the old scale.
+     */
+    if (armv6m_systick_running())
+    {
+        armv6m_systick_fold();
+    }
+
     if (armv6m_systick_control.clock != SystemCoreClock)
     {
         armv6m_systick_control.clock = SystemCoreClock;
@@ -56,10 +120,12 @@ void armv6m_systick_enable()
         
         armv6m_systick_control.cycle = SystemCoreClock / 8 -1;
         armv6m_systick_control.scale = (uint64_t)32768000000ull / (uint64_t)SystemCoreClock;
+
+        /* Nanoseconds per SysTick cycle, scaled by 2^8.
+         */
+        armv6m_systick_control.nscale = (uint64_t)256000000000ull / (uint64_t)SystemCoreClock;
     }
 
-    armv6m_systick_control.micros = 0;
-        
     SysTick->VAL = armv6m_systick_control.cycle;
     SysTick->LOAD = armv6m_systick_control.cycle;
     SysTick->CTRL = (SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk);
@@ -67,6 +133,15 @@ void armv6m_systick_enable()
 
 void armv6m_systick_disable(void)
 {
+    /* Fold the partial period into "micros" and "nanos", so that both stay
+     * continuous across a clock change (minus the time the clocks take to
+     * switch).
+     */
+    if (armv6m_systick_running())
+    {
+        armv6m_systick_fold();
+    }
+
     SysTick->CTRL = 0;
 }
 
@@ -82,19 +157,55 @@ uint32_t armv6m_systick_micros(void)
         if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
         {
             armv6m_systick_control.micros += 125000;
+            armv6m_systick_control.nanos += 125000000;
         }
     }
     while (micros != armv6m_systick_control.micros);
 
+    if (count == 0)
+    {
+        count = armv6m_systick_control.cycle;
+    }
+
     micros += (((armv6m_systick_control.cycle - count) * armv6m_systick_control.scale) >> 15);
 
     return micros;
 }
 
+uint64_t armv6m_systick_nanos(void)
+{
+    uint32_t micros, count;
+    uint64_t nanos;
+    
+    do
+    {
+        micros = armv6m_systick_control.micros;
+        nanos = armv6m_systick_control.nanos;
+        count = SysTick->VAL;
+
+        if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
+        {
+            armv6m_systick_control.micros += 125000;
+            armv6m_systick_control.nanos += 125000000;
+        }
+    }
+    while (micros != armv6m_systick_control.micros);
+
+    if (count == 0)
+    {
+        count = armv6m_systick_control.cycle;
+    }
+
+    nanos += (((uint64_t)(armv6m_systick_control.cycle - count) * armv6m_systick_control.nscale) >> 8);
+
+    return nanos;
+}
+
 void SysTick_Handler(void)
 {
     if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
     {
         armv6m_systick_control.micros += 125000;
+        armv6m_systick_control.nanos += 125000000;
     }
 }
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "armv6m.h"
+
+typedef struct _armv6m_task_control_t {
+    armv6m_task_t                   *current;
+    volatile uint32_t               idle;
+    volatile uint32_t               handoff;
+    armv6m_task_idle_routine_t      routine;
+    armv6m_task_t                   main;
+} armv6m_task_control_t;
+
+static armv6m_task_control_t armv6m_task_control;
+
+/* Tasks are switched cooperatively in thread mode, so there is no need to
+ * route the switch through PendSV. Only the callee saved registers are
+ * pushed onto the outgoing stack. The main task keeps running on MSP, while
+ * all other tasks run on PSP. That way exceptions always use MSP, and the
+ * stack of a task only needs to hold its own frames plus one exception frame.
+ * The new stack pointer is written before CONTROL, so that an interrupt
+ * in between sees a valid stack either way.
+ */
+static __attribute__((naked, noinline)) void armv6m_task_switch(armv6m_task_t *task, armv6m_task_t *task_next)
+{
+    __asm__(
+        "   push    { r4, r5, r6, r7, lr }               \n"
+        "   mov     r2, r8                               \n"
+        "   mov     r3, r9                               \n"
+        "   mov     r4, r10                              \n"
+        "   mov     r5, r11                              \n"
+        "   push    { r2, r3, r4, r5 }                   \n"
+        "   mov     r2, sp                               \n"
+        "   str     r2, [r0, %[offset_TASK_STACK]]       \n"
+        "   ldr     r2, [r1, %[offset_TASK_STACK]]       \n"
+        "   ldr     r3, [r1, %[offset_TASK_CONTROL]]     \n"
+        "   cmp     r3, #0                               \n"
+        "   bne     1f                                   \n"
+        "   msr     MSP, r2                              \n"
+        "   b       2f                                   \n"
+        "1: msr     PSP, r2                              \n"
+        "2: msr     CONTROL, r3                          \n"
+        "   isb                                          \n"
+        "   pop     { r2, r3, r4, r5 }                   \n"
+        "   mov     r8, r2                               \n"
+        "   mov     r9, r3                               \n"
+        "   mov     r10, r4                              \n"
+        "   mov     r11, r5                              \n"
+        "   pop     { r4, r5, r6, r7, pc }               \n"
+        :
+        : [offset_TASK_STACK]   "I" (offsetof(armv6m_task_t, stack)),
+          [offset_TASK_CONTROL] "I" (offsetof(armv6m_task_t, control))
+        );
+}
+
+/* Initial "pc" of a new task. armv6m_task_create() places routine/context
+ * into the r4/r5 slots of the initial stack frame.
+ */
+static __attribute__((naked, used)) void armv6m_task_start(void)
+{
+    __asm__(
+        "   mov     r0, r5                               \n"
+        "   blx     r4                                   \n"
+        "   bl      armv6m_task_exit                     \n"
+        :
+        :
+        );
+}
+
+static inline bool armv6m_task_is_schedulable(void)
+{
+    return ((__get_IPSR() == 0) && !armv6m_work_is_executing());
+}
+
+static void armv6m_task_resume(armv6m_task_t *task, armv6m_task_t *task_next)
+{
+    task_next->state = ARMV6M_TASK_STATE_READY;
+
+    armv6m_task_control.current = task_next;
+
+    armv6m_task_switch(task, task_next);
+}
+
+static void armv6m_task_unpark(armv6m_task_t *task)
+{
+    armv6m_task_t *task_next;
+
+    armv6m_task_control.idle = false;
+
+    for (task_next = task->next; task_next != task; task_next = task_next->next)
+    {
+        task_next->state = ARMV6M_TASK_STATE_READY;
+    }
+}
+
+void __armv6m_task_initialize(void)
+{
+    armv6m_task_control.main.next = &armv6m_task_control.main;
+    armv6m_task_control.main.stack = NULL;
+    armv6m_task_control.main.control = 0;
+    armv6m_task_control.main.state = ARMV6M_TASK_STATE_READY;
+    armv6m_task_control.main.policy = 0;
+    armv6m_task_control.main.callback.routine = NULL;
+    armv6m_task_control.main.callback.context = NULL;
+
+    armv6m_task_control.current = &armv6m_task_control.main;
+    armv6m_task_control.idle = false;
+    armv6m_task_control.handoff = false;
+    armv6m_task_control.routine = NULL;
+}
+
+bool armv6m_task_create(armv6m_task_t *task, armv6m_core_routine_t routine, void *context, void *stack, uint32_t size)
+{
+    uint32_t *frame;
+
+    if (!armv6m_task_is_schedulable())
+    {
+        return false;
+    }
+
+    if (size < ARMV6M_TASK_STACK_MINIMUM)
+    {
+        return false;
+    }
+
+    /* Frame layout matches armv6m_task_switch(): r8-r11, r4-r7, pc.
+     */
+    frame = (uint32_t*)(((uint32_t)stack + size) & ~7) - 9;
+
+    frame[0] = 0;
+    frame[1] = 0;
+    frame[2] = 0;
+    frame[3] = 0;
+    frame[4] = (uint32_t)routine;
+    frame[5] = (uint32_t)context;
+    frame[6] = 0;
+    frame[7] = 0;
+    frame[8] = (uint32_t)&armv6m_task_start;
+
+    task->stack = frame;
+    task->control = CONTROL_SPSEL_Msk;
+    task->state = ARMV6M_TASK_STATE_READY;
+    task->policy = 0;
+    task->callback.routine = routine;
+    task->callback.context = context;
+
+    task->next = armv6m_task_control.current->next;
+    armv6m_task_control.current->next = task;
+
+    return true;
+}
+
+void armv6m_task_exit(void)
+{
+    armv6m_task_t *task, *task_previous, *task_next;
+
+    task = armv6m_task_control.current;
+
+    if (armv6m_task_is_schedulable() && (task != &armv6m_task_control.main))
+    {
+        for (task_previous = task; task_previous->next != task; task_previous = task_previous->next)
+        {
+        }
+
+        task_previous->next = task->next;
+
+        task->state = ARMV6M_TASK_STATE_TERMINATED;
+
+        /* There is always the main task to switch to. If nothing is ready,
+         * resume a parked task, which simply rechecks its condition.
+         */
+        for (task_next = task->next; task_next->state != ARMV6M_TASK_STATE_READY; task_next = task_next->next)
+        {
+            if (task_next->next == task->next)
+            {
+                break;
+            }
+        }
+
+        armv6m_task_resume(task, task_next);
+    }
+
+    while (1)
+    {
+        armv6m_task_wfe();
+    }
+}
+
+armv6m_task_t *armv6m_task_self(void)
+{
+    return armv6m_task_control.current;
+}
+
+bool armv6m_task_is_main(void)
+{
+    return (armv6m_task_control.current == &armv6m_task_control.main);
+}
+
+void armv6m_task_yield(void)
+{
+    armv6m_task_t *task;
+
+    if (!armv6m_task_is_schedulable())
+    {
+        return;
+    }
+
+    task = armv6m_task_control.current;
+
+    if (task->next != task)
+    {
+        /* A yielding task is busy, so every parked task gets another chance
+         * to poll its condition.
+         */
+        armv6m_task_unpark(task);
+
+        armv6m_task_resume(task, task->next);
+    }
+}
+
+/* A parked task is only resumed after an event may have happened, i.e. after
+ * some task found nobody else ready and went to sleep (armv6m_task_wait()
+ * returned false), or some task yielded. Hence the first call after such a
+ * sleep unparks all tasks again.
+ */
+static bool armv6m_task_wait(void)
+{
+    armv6m_task_t *task, *task_next;
+
+    if (!armv6m_task_is_schedulable())
+    {
+        return false;
+    }
+
+    task = armv6m_task_control.current;
+
+    if (armv6m_task_control.idle)
+    {
+        armv6m_task_unpark(task);
+    }
+
+    for (task_next = task->next; task_next != task; task_next = task_next->next)
+    {
+        if (task_next->state == ARMV6M_TASK_STATE_READY)
+        {
+            break;
+        }
+    }
+
+    if (task_next == task)
+    {
+        armv6m_task_control.idle = true;
+
+        return false;
+    }
+
+    task->state = ARMV6M_TASK_STATE_WAITING;
+
+    armv6m_task_resume(task, task_next);
+
+    return true;
+}
+
+static void armv6m_task_idle_enter(uint32_t policy)
+{
+    if (armv6m_task_control.routine)
+    {
+        (*armv6m_task_control.routine)(policy);
+    }
+    else
+    {
+        __WFE();
+    }
+}
+
+/* This is the only place where the core goes to sleep. Other tasks are run
+ * first. If all of them are parked as well, a task other than the main task
+ * hands over to the main task, so that the idle routine always runs on MSP
+ * and only once per idle period. The main task then sleeps with the lowest
+ * policy any parked task asked for.
+ */
+void armv6m_task_sleep(uint32_t policy)
+{
+    armv6m_task_t *task, *task_next;
+
+    if (!armv6m_task_is_schedulable())
+    {
+        armv6m_task_idle_enter(policy);
+
+        return;
+    }
+
+    task = armv6m_task_control.current;
+
+    task->policy = policy;
+
+    if (armv6m_task_wait())
+    {
+        if ((task != &armv6m_task_control.main) || !armv6m_task_control.handoff)
+        {
+            return;
+        }
+
+        armv6m_task_control.handoff = false;
+    }
+    else
+    {
+        if (task != &armv6m_task_control.main)
+        {
+            armv6m_task_control.handoff = true;
+
+            task->state = ARMV6M_TASK_STATE_WAITING;
+
+            armv6m_task_resume(task, &armv6m_task_control.main);
+
+            return;
+        }
+    }
+
+    for (task_next = task->next; task_next != task; task_next = task_next->next)
+    {
+        if (policy > task_next->policy)
+        {
+            policy = task_next->policy;
+        }
+    }
+
+    armv6m_task_idle_enter(policy);
+}
+
+void armv6m_task_idle(armv6m_task_idle_routine_t routine)
+{
+    armv6m_task_control.routine = routine;
+}
+
+void armv6m_task_semaphore_create(armv6m_task_semaphore_t *semaphore, uint32_t count)
+{
+    semaphore->count = count;
+}
+
+bool armv6m_task_semaphore_try_take(armv6m_task_semaphore_t *semaphore)
+{
+    return (armv6m_atomic_dec(&semaphore->count) != 0);
+}
+
+void armv6m_task_semaphore_take(armv6m_task_semaphore_t *semaphore)
+{
+    while (!armv6m_task_semaphore_try_take(semaphore))
+    {
+        armv6m_task_wfe();
+    }
+}
+
+/* Can be called from interrupt context. The __SEV() takes care of a
+ * task sleeping in armv6m_task_wfe() when given from thread mode.
+ */
+void armv6m_task_semaphore_give(armv6m_task_semaphore_t *semaphore)
+{
+    armv6m_atomic_inc(&semaphore->count, 0xffffffff);
+
+    __SEV();
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "armv6m.h"
+
+typedef struct _armv6m_trace_control_t {
+    volatile uint32_t                write;
+    uint32_t                         read;
+    armv6m_trace_entry_t             entries[ARMV6M_TRACE_ENTRY_COUNT];
+} armv6m_trace_control_t;
+
+#if (ARMV6M_TRACE == 1)
+
+static armv6m_trace_control_t armv6m_trace_control;
+
+/* A slot is claimed with an atomic increment, so events can be recorded from
+ * any priority level. Once the ring wraps the oldest entries are overwritten.
+ */
+__attribute__((optimize("O3"))) void armv6m_trace_event(uint32_t type, uint32_t id, uint32_t data)
+{
+    armv6m_trace_entry_t *entry;
+    uint32_t timestamp;
+
+    timestamp = armv6m_systick_micros();
+
+    entry = &armv6m_trace_control.entries[__armv6m_atomic_add(&armv6m_trace_control.write, 1) & (ARMV6M_TRACE_ENTRY_COUNT -1)];
+
+    entry->timestamp = timestamp;
+    entry->type = type;
+    entry->id = id;
+    entry->data = data;
+}
+
+uint32_t armv6m_trace_read(armv6m_trace_entry_t *entries, uint32_t count, uint32_t *p_lost_return)
+{
+    uint32_t primask, write, lost, index;
+
+    lost = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        primask = __get_PRIMASK();
+
+        __disable_irq();
+
+        write = armv6m_trace_control.write;
+
+        if ((write - armv6m_trace_control.read) > ARMV6M_TRACE_ENTRY_COUNT)
+        {
+            lost += ((write - armv6m_trace_control.read) - ARMV6M_TRACE_ENTRY_COUNT);
+
+            armv6m_trace_control.read = write - ARMV6M_TRACE_ENTRY_COUNT;
+        }
+
+        if (armv6m_trace_control.read == write)
+        {
+            __set_PRIMASK(primask);
+
+            break;
+        }
+
+        entries[index] = armv6m_trace_control.entries[armv6m_trace_control.read & (ARMV6M_TRACE_ENTRY_COUNT -1)];
+
+        armv6m_trace_control.read++;
+
+        __set_PRIMASK(primask);
+    }
+
+    if (p_lost_return)
+    {
+        *p_lost_return = lost;
+    }
+
+    return index;
+}
+
+void armv6m_trace_reset(void)
+{
+    armv6m_trace_control.read = armv6m_trace_control.write;
+}
+
+#else /* ARMV6M_TRACE == 1 */
+
+void armv6m_trace_event(uint32_t type, uint32_t id, uint32_t data)
+{
+}
+
+uint32_t armv6m_trace_read(armv6m_trace_entry_t *entries, uint32_t count, uint32_t *p_lost_return)
+{
+    if (p_lost_return)
+    {
+        *p_lost_return = 0;
+    }
+
+    return 0;
+}
+
+void armv6m_trace_reset(void)
+{
+}
+
+#endif /* ARMV6M_TRACE == 1 */
@@ -30,10 +30,15 @@
 
 typedef struct _armv6m_work_control_t {
     volatile armv6m_core_callback_t callback;
-    armv6m_work_t                   *head;
-    armv6m_work_t                   *tail;
-    armv6m_work_t * volatile        submit;
+    armv6m_work_t * volatile        current;
+    uint32_t                        start;
     volatile uint32_t               lock;
+    volatile uint8_t                busy;
+    armv6m_work_notify_routine_t    notify;
+    armv6m_work_t                   *head[ARMV6M_WORK_PRIORITY_COUNT];
+    armv6m_work_t                   *tail[ARMV6M_WORK_PRIORITY_COUNT];
+    armv6m_work_t * volatile        submit[ARMV6M_WORK_PRIORITY_COUNT];
+    armv6m_work_statistics_t        statistics[ARMV6M_WORK_PRIORITY_COUNT];
 } armv6m_work_control_t;
 
 static armv6m_work_control_t armv6m_work_control;
@@ -78,31 +83,99 @@ static __attribute__((naked, used)) void armv6m_work_execute(void)
         );
 }
 
+/* Work items are not preempted by other work items. The dispatcher simply picks
+ * the oldest item of the highest priority class that is ready once the current
+ * item has completed. Hence the worst case latency of a class is bounded by the
+ * longest execution time of any item, which is tracked in "statistics".
+ */
+
 static __attribute__((optimize("O3"), used)) void armv6m_work_dispatch(void)
 {
     armv6m_work_t *work;
+    armv6m_work_statistics_t *statistics;
+    uint32_t priority, micros, elapsed;
 
-    if (armv6m_work_control.lock == 0)
+    micros = armv6m_systick_micros();
+
+    work = armv6m_work_control.current;
+
+    if (work != NULL)
     {
-        work = armv6m_work_control.head;
+        elapsed = micros - armv6m_work_control.start;
+        
+        if (work->execution < elapsed)
+        {
+            work->execution = elapsed;
+        }
+
+        statistics = &armv6m_work_control.statistics[work->priority];
 
-        if (work != NULL)
+        if (statistics->execution < elapsed)
         {
-            if (armv6m_work_control.head == armv6m_work_control.tail)
+            statistics->execution = elapsed;
+        }
+
+        armv6m_work_control.current = NULL;
+
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_WORK_LEAVE, work->priority, work->callback.routine);
+    }
+
+    if (armv6m_work_control.lock == 0)
+    {
+        for (priority = ARMV6M_WORK_PRIORITY_COUNT -1; ; priority--)
+        {
+            work = armv6m_work_control.head[priority];
+
+            if (work != NULL)
             {
-                armv6m_work_control.head = NULL;
-                armv6m_work_control.tail = NULL;
+                if (armv6m_work_control.head[priority] == armv6m_work_control.tail[priority])
+                {
+                    armv6m_work_control.head[priority] = NULL;
+                    armv6m_work_control.tail[priority] = NULL;
+                }
+                else
+                {
+                    armv6m_work_control.head[priority] = work->next;
+                }
+
+                statistics = &armv6m_work_control.statistics[priority];
+
+                elapsed = micros - work->timestamp;
+
+                if (statistics->latency < elapsed)
+                {
+                    statistics->latency = elapsed;
+                }
+
+                statistics->count++;
+
+                armv6m_work_control.callback = work->callback;
+                armv6m_work_control.current = work;
+                armv6m_work_control.start = micros;
+
+                work->next = NULL;
+
+                ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_WORK_ENTER, priority, work->callback.routine);
+
+                armv6m_pendsv_hook(armv6m_work_execute);
+
+                break;
             }
-            else
+
+            if (priority == 0)
             {
-                armv6m_work_control.head = work->next;
+                break;
             }
+        }
 
-            armv6m_work_control.callback = work->callback;
-
-            work->next = NULL;
+        if ((armv6m_work_control.current == NULL) && armv6m_work_control.busy)
+        {
+            armv6m_work_control.busy = false;
 
-            armv6m_pendsv_hook(armv6m_work_execute);
+            if (armv6m_work_control.notify)
+            {
+                (*armv6m_work_control.notify)(false);
+            }
         }
     }
 }
@@ -110,30 +183,50 @@ static __attribute__((optimize("O3"), used)) void armv6m_work_dispatch(void)
 static __attribute__((optimize("O3"))) void armv6m_work_schedule(void)
 {
     armv6m_work_t *work, *work_next, *work_head, *work_tail;
-    
-    work = (armv6m_work_t*)__armv6m_atomic_swap((volatile uint32_t*)&armv6m_work_control.submit, (uint32_t)ARMV6M_WORK_TAIL);
+    uint32_t priority;
+    bool schedule = false;
 
-    if (work != ARMV6M_WORK_TAIL)
+    for (priority = 0; priority < ARMV6M_WORK_PRIORITY_COUNT; priority++)
     {
-        for (work_head = ARMV6M_WORK_TAIL, work_tail = work; work != ARMV6M_WORK_TAIL; work = work_next)
+        work = (armv6m_work_t*)__armv6m_atomic_swap((volatile uint32_t*)&armv6m_work_control.submit[priority], (uint32_t)ARMV6M_WORK_TAIL);
+
+        if (work != ARMV6M_WORK_TAIL)
         {
-            work_next = work->next;
+            for (work_head = ARMV6M_WORK_TAIL, work_tail = work; work != ARMV6M_WORK_TAIL; work = work_next)
+            {
+                work_next = work->next;
             
-            work->next = work_head;
+                work->next = work_head;
             
-            work_head = work;
-        }
+                work_head = work;
+            }
 
-        if (armv6m_work_control.head == NULL)
-        {
-            armv6m_work_control.head = work_head;
+            if (armv6m_work_control.head[priority] == NULL)
+            {
+                armv6m_work_control.head[priority] = work_head;
+            }
+            else
+            {
+                armv6m_work_control.tail[priority]->next = work_head;
+            }
+
+            armv6m_work_control.tail[priority] = work_tail;
+
+            schedule = true;
         }
-        else
+    }
+
+    if (schedule)
+    {
+        if (!armv6m_work_control.busy)
         {
-            armv6m_work_control.tail->next = work_head;
-        }
+            armv6m_work_control.busy = true;
 
-        armv6m_work_control.tail = work_tail;
+            if (armv6m_work_control.notify)
+            {
+                (*armv6m_work_control.notify)(true);
+            }
+        }
 
         if (armv6m_work_control.callback.routine == NULL)
         {
@@ -144,22 +237,39 @@ static __attribute__((optimize("O3"))) void armv6m_work_schedule(void)
 
 void __armv6m_work_initialize()
 {
-    armv6m_work_control.head = NULL;
-    armv6m_work_control.tail = NULL;
-    armv6m_work_control.submit = ARMV6M_WORK_TAIL;
+    uint32_t priority;
+
+    armv6m_work_control.current = NULL;
     armv6m_work_control.lock = 0;
+    armv6m_work_control.busy = false;
+    armv6m_work_control.notify = NULL;
+
+    for (priority = 0; priority < ARMV6M_WORK_PRIORITY_COUNT; priority++)
+    {
+        armv6m_work_control.head[priority] = NULL;
+        armv6m_work_control.tail[priority] = NULL;
+        armv6m_work_control.submit[priority] = ARMV6M_WORK_TAIL;
+    }
 }
 
 void armv6m_work_create(armv6m_work_t *work, armv6m_core_routine_t routine, void *context)
+{
+    armv6m_work_create_priority(work, routine, context, ARMV6M_WORK_PRIORITY_NORMAL);
+}
+
+void armv6m_work_create_priority(armv6m_work_t *work, armv6m_core_routine_t routine, void *context, uint32_t priority)
 {
     work->next = NULL;
     work->callback.routine = routine;
     work->callback.context = context;
+    work->priority = (priority < ARMV6M_WORK_PRIORITY_COUNT) ? priority : (ARMV6M_WORK_PRIORITY_COUNT -1);
+    work->timestamp = 0;
+    work->execution = 0;
 }
 
 bool armv6m_work_destroy(armv6m_work_t *work)
 {
-    return (work->next == NULL);
+    return ((work->next == NULL) && (work != armv6m_work_control.current));
 }
 
 __attribute__((optimize("O3"))) bool armv6m_work_submit(armv6m_work_t *work)
@@ -168,9 +278,19 @@ __attribute__((optimize("O3"))) bool armv6m_work_submit(armv6m_work_t *work)
 
     if (__armv6m_atomic_cas((volatile uint32_t*)&work->next, (uint32_t)NULL, (uint32_t)ARMV6M_WORK_TAIL) == (uint32_t)NULL)
     {
-        work_next = (armv6m_work_t*)armv6m_atomic_swap((volatile uint32_t*)&armv6m_work_control.submit, (uint32_t)work);
+        work->timestamp = armv6m_systick_micros();
 
-        work->next = work_next;
+        /* "next" has to be valid before "work" gets published, as a PendSV
+         * tail chained to an interrupt that preempts a thread mode submit would
+         * otherwise take over a half linked list.
+         */
+        do
+        {
+            work_next = armv6m_work_control.submit[work->priority];
+
+            work->next = work_next;
+        }
+        while (__armv6m_atomic_cas((volatile uint32_t*)&armv6m_work_control.submit[work->priority], (uint32_t)work_next, (uint32_t)work) != (uint32_t)work_next);
 
         if (armv6m_work_control.lock == 0)
         {
@@ -196,6 +316,42 @@ __attribute__((optimize("O3"))) void armv6m_work_unblock()
     }
 }
 
+bool armv6m_work_is_executing(void)
+{
+    return (armv6m_work_control.callback.routine != NULL);
+}
+
+bool armv6m_work_is_busy(void)
+{
+    return armv6m_work_control.busy;
+}
+
+/* The notify routine is called from the PendSV/SVCALL level whenever the
+ * work queues transition between empty and non-empty. A "busy" notification
+ * is delivered before the first queued item gets dispatched.
+ */
+void armv6m_work_notify(armv6m_work_notify_routine_t routine)
+{
+    armv6m_work_control.notify = routine;
+}
+
+void armv6m_work_statistics(uint32_t priority, armv6m_work_statistics_t *p_statistics_return)
+{
+    if (priority < ARMV6M_WORK_PRIORITY_COUNT)
+    {
+        *p_statistics_return = armv6m_work_control.statistics[priority];
+    }
+    else
+    {
+        memset(p_statistics_return, 0, sizeof(armv6m_work_statistics_t));
+    }
+}
+
+void armv6m_work_statistics_reset(void)
+{
+    memset(&armv6m_work_control.statistics[0], 0, sizeof(armv6m_work_control.statistics));
+}
+
 void SWI_WORK_SCHEDULE_IRQHandler(void)
 {
     armv6m_work_schedule();
@@ -50,6 +50,26 @@
      STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |     \
      STM32L0_DMA_OPTION_PRIORITY_HIGH)
 
+#define STM32L0_ADC_DMA_OPTION_SCAN_8               \
+    (STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE |       \
+     STM32L0_DMA_OPTION_EVENT_TRANSFER_HALF |       \
+     STM32L0_DMA_OPTION_PERIPHERAL_TO_MEMORY |      \
+     STM32L0_DMA_OPTION_CIRCULAR |                  \
+     STM32L0_DMA_OPTION_PERIPHERAL_DATA_SIZE_32 |   \
+     STM32L0_DMA_OPTION_MEMORY_DATA_SIZE_8 |        \
+     STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |     \
+     STM32L0_DMA_OPTION_PRIORITY_HIGH)
+
+#define STM32L0_ADC_DMA_OPTION_SCAN_16              \
+    (STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE |       \
+     STM32L0_DMA_OPTION_EVENT_TRANSFER_HALF |       \
+     STM32L0_DMA_OPTION_PERIPHERAL_TO_MEMORY |      \
+     STM32L0_DMA_OPTION_CIRCULAR |                  \
+     STM32L0_DMA_OPTION_PERIPHERAL_DATA_SIZE_32 |   \
+     STM32L0_DMA_OPTION_MEMORY_DATA_SIZE_16 |       \
+     STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |     \
+     STM32L0_DMA_OPTION_PRIORITY_HIGH)
+
 #define ADC_CFGR2_CKMODE_HSI16      0
 #define ADC_CFGR2_CKMODE_PCLK_DIV_2 (ADC_CFGR2_CKMODE_0)
 #define ADC_CFGR2_CKMODE_PCLK_DIV_4 (ADC_CFGR2_CKMODE_1)
@@ -81,6 +101,7 @@
 #define STM32L0_ADC_STATE_READY   1
 #define STM32L0_ADC_STATE_CONVERT 2
 #define STM32L0_ADC_STATE_DONE    3
+#define STM32L0_ADC_STATE_SCAN    4
 
 typedef struct _stm32l0_adc_device_t {
     volatile uint8_t             state;
@@ -91,10 +112,18 @@ typedef struct _stm32l0_adc_device_t {
     uint32_t                     control;
     stm32l0_adc_done_callback_t  xf_callback;
     void                         *xf_context;
+    stm32l0_adc_scan_callback_t  scan_callback;
+    uint8_t                      *scan_data;
+    uint32_t                     scan_size;
+    uint16_t                     scan_count;
+    uint8_t                      scan_half;
+    volatile uint32_t            scan_overruns;
 } stm32l0_adc_device_t;
 
 static stm32l0_adc_device_t stm32l0_adc_device;
 
+static void stm32l0_adc_dma_callback(void *context, uint32_t events);
+
 bool stm32l0_adc_enable(void)
 {
     uint32_t hclk, pclk, adcclk;
@@ -302,15 +331,25 @@ uint32_t stm32l0_adc_read(unsigned int channel, uint16_t period)
     return data;
 }
 
-bool stm32l0_adc_convert(void *data, uint32_t count, uint16_t mask, uint16_t period, uint32_t control, stm32l0_adc_done_callback_t callback, void *context)
+static uint32_t stm32l0_adc_channels(uint16_t mask)
 {
-    uint32_t hclk, pclk, adcclk, adc_cfgr1, adc_cfgr2, adc_smpr, adc_ccr, threshold, channels, option;
+    uint32_t channels;
 
-    if ((stm32l0_adc_device.state != STM32L0_ADC_STATE_READY) && (stm32l0_adc_device.state != STM32L0_ADC_STATE_DONE))
+    for (channels = 0; mask; mask >>= 1)
     {
-        return false;
+        if (mask & 1) 
+        {
+            channels++;
+        }
     }
 
+    return channels;
+}
+
+static bool stm32l0_adc_configure(uint16_t mask, uint16_t period, uint32_t control)
+{
+    uint32_t hclk, pclk, adcclk, adc_cfgr1, adc_cfgr2, adc_smpr, adc_ccr, threshold;
+
     hclk = stm32l0_system_hclk();
     pclk = stm32l0_system_pclk2();
 
@@ -323,7 +362,7 @@ bool stm32l0_adc_convert(void *data, uint32_t count, uint16_t mask, uint16_t per
 
         if (stm32l0_adc_device.state == STM32L0_ADC_STATE_READY)
         {
-            if (!stm32l0_dma_enable(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC, (stm32l0_dma_callback_t)stm32l0_adc_cancel, NULL))
+            if (!stm32l0_dma_enable(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC, stm32l0_adc_dma_callback, NULL))
             {
                 return false;
             }
@@ -470,19 +509,40 @@ bool stm32l0_adc_convert(void *data, uint32_t count, uint16_t mask, uint16_t per
         ADC1->SMPR = adc_smpr;
         ADC1->CHSELR = mask & 0xffff;
 
-        stm32l0_adc_device.period = period;
-        stm32l0_adc_device.mask = mask;
-        stm32l0_adc_device.control = control;
+        ADC1->ISR = ADC_ISR_ADRDY;
 
-        for (mask &= 0xffff, channels = 0; mask; mask >>= 1)
+        ADC1->CR |= ADC_CR_ADEN;
+
+        /* With AUTOFF the ADC powers up per conversion, and ADRDY never gets set.
+         */
+        if (!(adc_cfgr1 & ADC_CFGR1_AUTOFF))
         {
-            if (mask & 1) 
+            while (!(ADC1->ISR & ADC_ISR_ADRDY))
             {
-                channels++;
             }
         }
 
-        stm32l0_adc_device.channels = channels;
+        stm32l0_adc_device.period = period;
+        stm32l0_adc_device.mask = mask;
+        stm32l0_adc_device.control = control;
+        stm32l0_adc_device.channels = stm32l0_adc_channels(mask);
+    }
+
+    return true;
+}
+
+bool stm32l0_adc_convert(void *data, uint32_t count, uint16_t mask, uint16_t period, uint32_t control, stm32l0_adc_done_callback_t callback, void *context)
+{
+    uint32_t option;
+
+    if ((stm32l0_adc_device.state != STM32L0_ADC_STATE_READY) && (stm32l0_adc_device.state != STM32L0_ADC_STATE_DONE))
+    {
+        return false;
+    }
+
+    if (!stm32l0_adc_configure(mask, period, control))
+    {
+        return false;
     }
 
     if (stm32l0_adc_device.control & STM32L0_ADC_CONTROL_BYTE_PACKED)
@@ -514,24 +574,172 @@ bool stm32l0_adc_convert(void *data, uint32_t count, uint16_t mask, uint16_t per
     return true;
 }
 
+/* Continuous scan of "mask" into a circular buffer of "count" bytes. The 
+ * buffer is split into two halves, each of which is handed to "callback"
+ * once the DMA has filled it, while the DMA continues into the other half.
+ * The callback is called from the DMA interrupt, and owns the half until
+ * the next callback. Pacing comes either from a timer trigger (MODE_SINGLE)
+ * or from the free running CONTINUOUS modes. With RATIO/SHIFT the hardware
+ * oversampler produces one averaged sample per channel and trigger.
+ */
+bool stm32l0_adc_scan(void *data, uint32_t count, uint16_t mask, uint16_t period, uint32_t control, stm32l0_adc_scan_callback_t callback, void *context)
+{
+    uint32_t channels, option;
+
+    if ((stm32l0_adc_device.state != STM32L0_ADC_STATE_READY) && (stm32l0_adc_device.state != STM32L0_ADC_STATE_DONE))
+    {
+        return false;
+    }
+
+    if ((control & STM32L0_ADC_CONTROL_MODE_MASK) == STM32L0_ADC_CONTROL_MODE_ONESHOT)
+    {
+        return false;
+    }
+
+    channels = stm32l0_adc_channels(mask);
+
+    if (control & STM32L0_ADC_CONTROL_BYTE_PACKED)
+    {
+        count = ((count / 2) / channels) * channels;
+
+        option = STM32L0_ADC_DMA_OPTION_SCAN_8;
+    }
+    else
+    {
+        count = (((count / 2) / 2) / channels) * channels;
+
+        option = STM32L0_ADC_DMA_OPTION_SCAN_16;
+    }
+
+    /* "count" is the number of samples in one half of the ring, which 
+     * must hold at least one full scan, and both halves need to fit
+     * into one DMA transfer.
+     */
+    if ((count == 0) || (count > 32767))
+    {
+        return false;
+    }
+
+    if (!stm32l0_adc_configure(mask, period, control))
+    {
+        return false;
+    }
+
+    stm32l0_adc_device.scan_callback = callback;
+    stm32l0_adc_device.xf_context = context;
+    stm32l0_adc_device.scan_data = (uint8_t*)data;
+    stm32l0_adc_device.scan_size = (control & STM32L0_ADC_CONTROL_BYTE_PACKED) ? count : (count * 2);
+    stm32l0_adc_device.scan_count = count;
+    stm32l0_adc_device.scan_half = 0;
+    stm32l0_adc_device.scan_overruns = 0;
+    stm32l0_adc_device.state = STM32L0_ADC_STATE_SCAN;
+
+    /* In the DMA one shot mode the ADC stops requesting at the first
+     * transfer complete, so the circular DMA needs DMACFG.
+     */
+    ADC1->CFGR1 |= ADC_CFGR1_DMACFG;
+
+    stm32l0_dma_start(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC, (uint32_t)data, (uint32_t)&ADC1->DR, (count * 2), option);
+
+    /* ADSTART also arms the hardware trigger in MODE_SINGLE.
+     */
+    ADC1->ISR = ADC_ISR_EOC;
+    
+    ADC1->CR |= ADC_CR_ADSTART;
+
+    return true;
+}
+
+uint32_t stm32l0_adc_overruns(void)
+{
+    return stm32l0_adc_device.scan_overruns;
+}
+
+static void stm32l0_adc_dma_callback(void *context, uint32_t events)
+{
+    uint32_t offset, position;
+
+    if (stm32l0_adc_device.state != STM32L0_ADC_STATE_SCAN)
+    {
+        stm32l0_adc_cancel();
+
+        return;
+    }
+
+    /* The DMA fills one half of the ring while the other half is handed
+     * to the callback. If both HT and TC are pending, at least one half
+     * was missed, and the most recently completed half (the one the DMA
+     * is not in) is reported. If the DMA has already advanced into the
+     * half that is reported, the callback was entered too late and the
+     * data is being overwritten.
+     */
+    position = stm32l0_dma_count(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC);
+
+    if ((events & (STM32L0_DMA_EVENT_TRANSFER_HALF | STM32L0_DMA_EVENT_TRANSFER_DONE)) == (STM32L0_DMA_EVENT_TRANSFER_HALF | STM32L0_DMA_EVENT_TRANSFER_DONE))
+    {
+        events = ((position >= stm32l0_adc_device.scan_count) ? STM32L0_ADC_EVENT_HALF : STM32L0_ADC_EVENT_FULL) | STM32L0_ADC_EVENT_OVERRUN;
+    }
+    else
+    {
+        if (events & STM32L0_DMA_EVENT_TRANSFER_DONE)
+        {
+            events = (position >= stm32l0_adc_device.scan_count) ? (STM32L0_ADC_EVENT_FULL | STM32L0_ADC_EVENT_OVERRUN) : STM32L0_ADC_EVENT_FULL;
+        }
+        else
+        {
+            events = (position < stm32l0_adc_device.scan_count) ? (STM32L0_ADC_EVENT_HALF | STM32L0_ADC_EVENT_OVERRUN) : STM32L0_ADC_EVENT_HALF;
+        }
+
+        /* The previous callback picked the half by position, and the DMA
+         * completed it only after the flags had been cleared. This half
+         * has been reported already.
+         */
+        if ((events & (STM32L0_ADC_EVENT_HALF | STM32L0_ADC_EVENT_FULL)) == stm32l0_adc_device.scan_half)
+        {
+            return;
+        }
+    }
+
+    stm32l0_adc_device.scan_half = events & (STM32L0_ADC_EVENT_HALF | STM32L0_ADC_EVENT_FULL);
+
+    offset = (events & STM32L0_ADC_EVENT_HALF) ? 0 : stm32l0_adc_device.scan_size;
+
+    if (events & STM32L0_ADC_EVENT_OVERRUN)
+    {
+        stm32l0_adc_device.scan_overruns++;
+    }
+
+    if (stm32l0_adc_device.scan_callback)
+    {
+        (*stm32l0_adc_device.scan_callback)(stm32l0_adc_device.xf_context, (stm32l0_adc_device.scan_data + offset), stm32l0_adc_device.scan_size, events);
+    }
+}
+
 void stm32l0_adc_cancel(void)
 {
     uint32_t count;
 
-    if (stm32l0_adc_device.state == STM32L0_ADC_STATE_CONVERT)
+    if ((stm32l0_adc_device.state == STM32L0_ADC_STATE_CONVERT) || (stm32l0_adc_device.state == STM32L0_ADC_STATE_SCAN))
     {
         count = stm32l0_dma_stop(STM32L0_DMA_CHANNEL_DMA1_CH1_ADC);
 
-        stm32l0_adc_device.state = STM32L0_ADC_STATE_DONE;
-
-        if (!(stm32l0_adc_device.control & STM32L0_ADC_CONTROL_BYTE_PACKED))
+        if (stm32l0_adc_device.state == STM32L0_ADC_STATE_CONVERT)
         {
-            count = count * 2;
-        }
+            stm32l0_adc_device.state = STM32L0_ADC_STATE_DONE;
+
+            if (!(stm32l0_adc_device.control & STM32L0_ADC_CONTROL_BYTE_PACKED))
+            {
+                count = count * 2;
+            }
 
-        if (stm32l0_adc_device.xf_callback)
+            if (stm32l0_adc_device.xf_callback)
+            {
+                (*stm32l0_adc_device.xf_callback)(stm32l0_adc_device.xf_context, count);
+            }
+        }
+        else
         {
-            (*stm32l0_adc_device.xf_callback)(stm32l0_adc_device.xf_context, count);
+            stm32l0_adc_device.state = STM32L0_ADC_STATE_DONE;
         }
 
         if (stm32l0_adc_device.state == STM32L0_ADC_STATE_DONE)
@@ -566,5 +774,5 @@ void stm32l0_adc_cancel(void)
 
 bool stm32l0_adc_done(void)
 {
-    return (stm32l0_adc_device.state != STM32L0_ADC_STATE_CONVERT);
+    return ((stm32l0_adc_device.state != STM32L0_ADC_STATE_CONVERT) && (stm32l0_adc_device.state != STM32L0_ADC_STATE_SCAN));
 }
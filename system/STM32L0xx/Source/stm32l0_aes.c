@@ -283,6 +283,59 @@ void stm32l0_aes_ctr_xcrypt(const uint8_t *ctr, const uint8_t *in, uint8_t *out,
     stm32l0_aes_engine(ctr, in, out, n, AES_CR_CHMOD_1, false);
 }
 
+/* CTR mode keystream with a key of its own. The key set by
+ * stm32l0_aes_set_key() is left alone, so that this can be used between
+ * a stm32l0_aes_set_key() and the operation that follows. Interrupts are
+ * only disabled for the key swap and one block at a time, so the counter
+ * is stepped here, the same way the peripheral does it (low 32 bits).
+ */
+void stm32l0_aes_ctr_keystream(const uint8_t *key, const uint8_t *ctr, uint8_t *out, uint32_t n)
+{
+    uint32_t K[4], primask, size;
+    uint8_t CTR[16];
+    int i;
+
+    stm32l0_aes_memzero(out, n);
+
+    stm32l0_aes_memcpy(&CTR[0], ctr, 16);
+
+    while (n)
+    {
+        size = (n > 16) ? 16 : n;
+
+        primask = __get_PRIMASK();
+
+        __disable_irq();
+
+        K[0] = stm32l0_aes_device.K[0];
+        K[1] = stm32l0_aes_device.K[1];
+        K[2] = stm32l0_aes_device.K[2];
+        K[3] = stm32l0_aes_device.K[3];
+
+        stm32l0_aes_set_key(key);
+
+        stm32l0_aes_engine(&CTR[0], out, out, size, AES_CR_CHMOD_1, false);
+
+        stm32l0_aes_device.K[0] = K[0];
+        stm32l0_aes_device.K[1] = K[1];
+        stm32l0_aes_device.K[2] = K[2];
+        stm32l0_aes_device.K[3] = K[3];
+
+        __set_PRIMASK(primask);
+
+        out += size;
+        n -= size;
+
+        for (i = 15; i >= 12; i--)
+        {
+            if (++CTR[i] != 0)
+            {
+                break;
+            }
+        }
+    }
+}
+
 static void stm32l0_aes_ccm_authenticate(uint32_t msize, const uint8_t *nonce, const uint8_t *adata, uint32_t asize, const uint8_t *in, uint32_t n)
 {
     unsigned int size;
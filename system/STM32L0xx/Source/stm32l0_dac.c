@@ -57,6 +57,38 @@
      STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |   \
      STM32L0_DMA_OPTION_PRIORITY_LOW)
 
+#define STM32L0_DAC_DMA_OPTION_STREAM_8           \
+    (STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE |     \
+     STM32L0_DMA_OPTION_EVENT_TRANSFER_HALF |     \
+     STM32L0_DMA_OPTION_MEMORY_TO_PERIPHERAL |    \
+     STM32L0_DMA_OPTION_CIRCULAR |                \
+     STM32L0_DMA_OPTION_PERIPHERAL_DATA_SIZE_32 | \
+     STM32L0_DMA_OPTION_MEMORY_DATA_SIZE_8 |      \
+     STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |   \
+     STM32L0_DMA_OPTION_PRIORITY_MEDIUM)
+
+#define STM32L0_DAC_DMA_OPTION_STREAM_16          \
+    (STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE |     \
+     STM32L0_DMA_OPTION_EVENT_TRANSFER_HALF |     \
+     STM32L0_DMA_OPTION_MEMORY_TO_PERIPHERAL |    \
+     STM32L0_DMA_OPTION_CIRCULAR |                \
+     STM32L0_DMA_OPTION_PERIPHERAL_DATA_SIZE_32 | \
+     STM32L0_DMA_OPTION_MEMORY_DATA_SIZE_16 |     \
+     STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |   \
+     STM32L0_DMA_OPTION_PRIORITY_MEDIUM)
+
+#define STM32L0_DAC_DMA_OPTION_STREAM_32          \
+    (STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE |     \
+     STM32L0_DMA_OPTION_EVENT_TRANSFER_HALF |     \
+     STM32L0_DMA_OPTION_MEMORY_TO_PERIPHERAL |    \
+     STM32L0_DMA_OPTION_CIRCULAR |                \
+     STM32L0_DMA_OPTION_PERIPHERAL_DATA_SIZE_32 | \
+     STM32L0_DMA_OPTION_MEMORY_DATA_SIZE_32 |     \
+     STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |   \
+     STM32L0_DMA_OPTION_PRIORITY_MEDIUM)
+
+#define STM32L0_DAC_CONTROL_FORMAT_MASK           0x00000007 /* ALIGNED, BYTE_PACKED, STEREO */
+
 static volatile uint32_t * const stm32l0_dac_xlate_address[] = {
     &DAC->DHR12R1,
     &DAC->DHR12L1,
@@ -74,17 +106,26 @@ static volatile uint32_t * const stm32l0_dac_xlate_address[] = {
 #define STM32L0_DAC_STATE_READY   1
 #define STM32L0_DAC_STATE_CONVERT 2
 #define STM32L0_DAC_STATE_DONE    3
+#define STM32L0_DAC_STATE_STREAM  4
 
 typedef struct _stm32l0_dac_device_t {
-    volatile uint8_t            state;
-    uint8_t                     channels;
-    uint16_t                    control;
-    stm32l0_dac_done_callback_t xf_callback;
-    void                        *xf_context;
+    volatile uint8_t              state;
+    uint8_t                       channels;
+    uint16_t                      control;
+    stm32l0_dac_done_callback_t   xf_callback;
+    void                          *xf_context;
+    stm32l0_dac_stream_callback_t stream_callback;
+    uint8_t                       *stream_data;
+    uint32_t                      stream_size;
+    uint16_t                      stream_count;
+    uint8_t                       stream_half;
+    volatile uint32_t             stream_underruns;
 } stm32l0_dac_device_t;
 
 static stm32l0_dac_device_t stm32l0_dac_device;
 
+static void stm32l0_dac_dma_callback(void *context, uint32_t events);
+
 bool stm32l0_dac_enable(uint32_t channels)
 {
     uint32_t primask;
@@ -179,20 +220,13 @@ void stm32l0_dac_write(uint32_t channels, uint32_t output)
 #endif /* STM32L072xx || STM32L082xx */
 }
 
-bool stm32l0_dac_convert(const void *data, uint32_t count, uint32_t control, stm32l0_dac_done_callback_t callback, void *context)
+static bool stm32l0_dac_configure(uint32_t control)
 {
-    uint32_t option;
-
-    if ((stm32l0_dac_device.state != STM32L0_DAC_STATE_READY) && (stm32l0_dac_device.state != STM32L0_DAC_STATE_DONE))
-    {
-        return false;
-    }
-
     if ((stm32l0_dac_device.state == STM32L0_DAC_STATE_READY) || (stm32l0_dac_device.control != control))
     {
         if (stm32l0_dac_device.state == STM32L0_DAC_STATE_READY)
         {
-            if (!stm32l0_dma_enable(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1, (stm32l0_dma_callback_t)stm32l0_dac_cancel, NULL))
+            if (!stm32l0_dma_enable(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1, stm32l0_dac_dma_callback, NULL))
             {
                 return false;
             }
@@ -225,6 +259,23 @@ bool stm32l0_dac_convert(const void *data, uint32_t count, uint32_t control, stm
         stm32l0_dac_device.control = control;
     }
 
+    return true;
+}
+
+bool stm32l0_dac_convert(const void *data, uint32_t count, uint32_t control, stm32l0_dac_done_callback_t callback, void *context)
+{
+    uint32_t option;
+
+    if ((stm32l0_dac_device.state != STM32L0_DAC_STATE_READY) && (stm32l0_dac_device.state != STM32L0_DAC_STATE_DONE))
+    {
+        return false;
+    }
+
+    if (!stm32l0_dac_configure(control))
+    {
+        return false;
+    }
+
 #if defined(STM32L072xx) || defined(STM32L082xx)
     if (control & STM32L0_DAC_CONTROL_STEREO)
     {
@@ -257,44 +308,187 @@ bool stm32l0_dac_convert(const void *data, uint32_t count, uint32_t control, stm
     stm32l0_dac_device.xf_context = context;
     stm32l0_dac_device.state = STM32L0_DAC_STATE_CONVERT;
 
-    stm32l0_dma_start(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1, (uint32_t)stm32l0_dac_xlate_address[control], (uint32_t)data, count, option);
+    stm32l0_dma_start(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1, (uint32_t)stm32l0_dac_xlate_address[control & STM32L0_DAC_CONTROL_FORMAT_MASK], (uint32_t)data, count, option);
 
     return true;
 }
 
+/* Plays "data" ("count" bytes) as a circular buffer, paced by the trigger
+ * selected in "control". Each time the DMA has finished one half of the
+ * buffer the half is passed to "callback", which can refill it while the 
+ * other half plays. Without a callback the buffer simply loops. The 
+ * callback is called from the DMA interrupt.
+ */
+bool stm32l0_dac_stream(const void *data, uint32_t count, uint32_t control, stm32l0_dac_stream_callback_t callback, void *context)
+{
+    uint32_t size, option;
+
+    if ((stm32l0_dac_device.state != STM32L0_DAC_STATE_READY) && (stm32l0_dac_device.state != STM32L0_DAC_STATE_DONE))
+    {
+        return false;
+    }
+
+#if defined(STM32L072xx) || defined(STM32L082xx)
+    if (control & STM32L0_DAC_CONTROL_STEREO)
+    {
+        if (control & STM32L0_DAC_CONTROL_BYTE_PACKED)
+        {
+            size = 2;
+            option = STM32L0_DAC_DMA_OPTION_STREAM_16;
+        }
+        else
+        {
+            size = 4;
+            option = STM32L0_DAC_DMA_OPTION_STREAM_32;
+        }
+    }
+    else
+#endif /* STM32L072xx || STM32L082xx */
+    {
+        if (control & STM32L0_DAC_CONTROL_BYTE_PACKED)
+        {
+            size = 1;
+            option = STM32L0_DAC_DMA_OPTION_STREAM_8;
+        }
+        else
+        {
+            size = 2;
+            option = STM32L0_DAC_DMA_OPTION_STREAM_16;
+        }
+    }
+
+    /* "count" is the number of samples per half of the buffer. Both halves
+     * need to fit into one DMA transfer.
+     */
+    count = (count / size) / 2;
+
+    if ((count == 0) || (count > 32767))
+    {
+        return false;
+    }
+
+    if (!stm32l0_dac_configure(control))
+    {
+        return false;
+    }
+
+    stm32l0_dac_device.stream_callback = callback;
+    stm32l0_dac_device.xf_context = context;
+    stm32l0_dac_device.stream_data = (uint8_t*)data;
+    stm32l0_dac_device.stream_size = count * size;
+    stm32l0_dac_device.stream_count = count;
+    stm32l0_dac_device.stream_half = 0;
+    stm32l0_dac_device.stream_underruns = 0;
+    stm32l0_dac_device.state = STM32L0_DAC_STATE_STREAM;
+
+    stm32l0_dma_start(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1, (uint32_t)stm32l0_dac_xlate_address[control & STM32L0_DAC_CONTROL_FORMAT_MASK], (uint32_t)data, (count * 2), option);
+
+    return true;
+}
+
+uint32_t stm32l0_dac_underruns(void)
+{
+    return stm32l0_dac_device.stream_underruns;
+}
+
+static void stm32l0_dac_dma_callback(void *context, uint32_t events)
+{
+    uint32_t offset, position;
+
+    if (stm32l0_dac_device.state != STM32L0_DAC_STATE_STREAM)
+    {
+        stm32l0_dac_cancel();
+
+        return;
+    }
+
+    /* The half the DMA just finished is handed back for a refill while
+     * the other half plays. If both HT and TC are pending, the half the 
+     * DMA is not in is handed back. If the DMA has already advanced into 
+     * the half that is handed back, the refill comes too late and stale
+     * samples get replayed.
+     */
+    position = stm32l0_dma_count(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1);
+
+    if ((events & (STM32L0_DMA_EVENT_TRANSFER_HALF | STM32L0_DMA_EVENT_TRANSFER_DONE)) == (STM32L0_DMA_EVENT_TRANSFER_HALF | STM32L0_DMA_EVENT_TRANSFER_DONE))
+    {
+        events = ((position >= stm32l0_dac_device.stream_count) ? STM32L0_DAC_EVENT_HALF : STM32L0_DAC_EVENT_FULL) | STM32L0_DAC_EVENT_UNDERRUN;
+    }
+    else
+    {
+        if (events & STM32L0_DMA_EVENT_TRANSFER_DONE)
+        {
+            events = (position >= stm32l0_dac_device.stream_count) ? (STM32L0_DAC_EVENT_FULL | STM32L0_DAC_EVENT_UNDERRUN) : STM32L0_DAC_EVENT_FULL;
+        }
+        else
+        {
+            events = (position < stm32l0_dac_device.stream_count) ? (STM32L0_DAC_EVENT_HALF | STM32L0_DAC_EVENT_UNDERRUN) : STM32L0_DAC_EVENT_HALF;
+        }
+
+        /* The previous callback picked the half by position, and the DMA
+         * completed it only after the flags had been cleared.
+         */
+        if ((events & (STM32L0_DAC_EVENT_HALF | STM32L0_DAC_EVENT_FULL)) == stm32l0_dac_device.stream_half)
+        {
+            return;
+        }
+    }
+
+    stm32l0_dac_device.stream_half = events & (STM32L0_DAC_EVENT_HALF | STM32L0_DAC_EVENT_FULL);
+
+    offset = (events & STM32L0_DAC_EVENT_HALF) ? 0 : stm32l0_dac_device.stream_size;
+
+    if (events & STM32L0_DAC_EVENT_UNDERRUN)
+    {
+        stm32l0_dac_device.stream_underruns++;
+    }
+
+    if (stm32l0_dac_device.stream_callback)
+    {
+        (*stm32l0_dac_device.stream_callback)(stm32l0_dac_device.xf_context, (stm32l0_dac_device.stream_data + offset), stm32l0_dac_device.stream_size, events);
+    }
+}
+
 void stm32l0_dac_cancel(void)
 {
     uint32_t count;
 
-    if (stm32l0_dac_device.state == STM32L0_DAC_STATE_CONVERT)
+    if ((stm32l0_dac_device.state == STM32L0_DAC_STATE_CONVERT) || (stm32l0_dac_device.state == STM32L0_DAC_STATE_STREAM))
     {
         count = stm32l0_dma_stop(STM32L0_DMA_CHANNEL_DMA1_CH2_DAC1);
 
-        stm32l0_dac_device.state = STM32L0_DAC_STATE_DONE;
+        if (stm32l0_dac_device.state == STM32L0_DAC_STATE_CONVERT)
+        {
+            stm32l0_dac_device.state = STM32L0_DAC_STATE_DONE;
 
 #if defined(STM32L072xx) || defined(STM32L082xx)
-        if (stm32l0_dac_device.control & STM32L0_DAC_CONTROL_STEREO)
-        {
-            if (stm32l0_dac_device.control & STM32L0_DAC_CONTROL_BYTE_PACKED)
+            if (stm32l0_dac_device.control & STM32L0_DAC_CONTROL_STEREO)
             {
-                count = count * 2;
+                if (stm32l0_dac_device.control & STM32L0_DAC_CONTROL_BYTE_PACKED)
+                {
+                    count = count * 2;
+                }
+                else
+                {
+                    count = count * 4;
+                }
             }
             else
+#endif /* STM32L072xx || STM32L082xx */
             {
-                count = count * 4;
+                if (!(stm32l0_dac_device.control & STM32L0_DAC_CONTROL_BYTE_PACKED))
+                {
+                    count = count * 2;
+                }
             }
+
+            (*stm32l0_dac_device.xf_callback)(stm32l0_dac_device.xf_context, count);
         }
         else
-#endif /* STM32L072xx || STM32L082xx */
         {
-            if (!(stm32l0_dac_device.control & STM32L0_DAC_CONTROL_BYTE_PACKED))
-            {
-                count = count * 2;
-            }
+            stm32l0_dac_device.state = STM32L0_DAC_STATE_DONE;
         }
 
-        (*stm32l0_dac_device.xf_callback)(stm32l0_dac_device.xf_context, count);
-
         if (stm32l0_dac_device.state == STM32L0_DAC_STATE_DONE)
         {
 #if defined(STM32L072xx) || defined(STM32L082xx)
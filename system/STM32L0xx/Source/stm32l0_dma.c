@@ -72,7 +72,10 @@ static inline void stm32l0_dma_interrupt(stm32l0_dma_t *dma, DMA_Channel_TypeDef
 
     if (events & DMA->CCR)
     {
-        DMA1->IFCR = (15 << shift);
+        /* Only clear what is reported, as with a circular transfer HT or TC
+         * may have come in since DMA1->ISR was read.
+         */
+        DMA1->IFCR = (events << shift);
 
         (*dma->callback)(dma->context, events);
     }
@@ -284,29 +287,41 @@ __attribute__((optimize("O3"))) void DMA1_Channel1_IRQHandler(void)
 {
     uint32_t dma_isr;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     dma_isr = DMA1->ISR;
 
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[0], DMA1_Channel1, dma_isr, 0);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 __attribute__((optimize("O3"))) void DMA1_Channel2_3_IRQHandler(void)
 {
     uint32_t dma_isr;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     dma_isr = DMA1->ISR;
 
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[1], DMA1_Channel2, dma_isr, 4);
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[2], DMA1_Channel3, dma_isr, 8);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 __attribute__((optimize("O3"))) void DMA1_Channel4_5_6_7_IRQHandler(void)
 {
     uint32_t dma_isr;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     dma_isr = DMA1->ISR;
 
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[3], DMA1_Channel4, dma_isr, 12);
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[4], DMA1_Channel5, dma_isr, 16);
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[5], DMA1_Channel6, dma_isr, 20);
     stm32l0_dma_interrupt(&stm32l0_dma_device.channels[6], DMA1_Channel7, dma_isr, 24);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
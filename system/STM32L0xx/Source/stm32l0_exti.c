@@ -226,6 +226,8 @@ __attribute__((optimize("O3"))) void EXTI0_1_IRQHandler(void)
 {
     uint32_t mask, mask_1, mask_2;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     mask = (EXTI->PR & stm32l0_exti_device.mask) & 0x0003;
     
     EXTI->PR = mask;
@@ -238,12 +240,16 @@ __attribute__((optimize("O3"))) void EXTI0_1_IRQHandler(void)
     mask_2 = mask & ~stm32l0_exti_device.priority[0];
 
     stm32l0_exti_interrupt_2(mask_2);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 __attribute__((optimize("O3"))) void EXTI2_3_IRQHandler(void)
 {
     uint32_t mask, mask_1, mask_2;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     mask = (EXTI->PR & stm32l0_exti_device.mask) & 0x000c;
     
     EXTI->PR = mask;
@@ -256,12 +262,16 @@ __attribute__((optimize("O3"))) void EXTI2_3_IRQHandler(void)
     mask_2 = mask & ~stm32l0_exti_device.priority[0];
 
     stm32l0_exti_interrupt_2(mask_2);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 __attribute__((optimize("O3"))) void EXTI4_15_IRQHandler(void)
 {
     uint32_t mask, mask_1, mask_2;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     mask = (EXTI->PR & stm32l0_exti_device.mask) & 0xfff0;
     
     EXTI->PR = mask;
@@ -284,6 +294,8 @@ __attribute__((optimize("O3"))) void EXTI4_15_IRQHandler(void)
     mask_2 = mask & ~stm32l0_exti_device.priority[0];
 
     stm32l0_exti_interrupt_2(mask_2);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
  __attribute__((optimize("O3"))) void SPI1_IRQHandler(void)
@@ -26,6 +26,8 @@
  * WITH THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include "armv6m.h"
 #include "stm32l0xx.h"
 
@@ -47,14 +49,14 @@ static __attribute__((optimize("O3"), section(".ramfunc.stm32l0_flash_do_erase")
     }
 }
 
-static __attribute__((optimize("O3"), section(".ramfunc.stm32l0_flash_do_program"), long_call)) void stm32l0_flash_do_program(uint32_t address, const uint8_t *data, const uint8_t *data_e)
+static __attribute__((optimize("O3"), section(".ramfunc.stm32l0_flash_do_program"), long_call)) void stm32l0_flash_do_program(uint32_t address, const uint32_t *data, const uint32_t *data_e)
 {
     do
     {
-        *((volatile uint32_t*)address) = ((data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0]);
+        *((volatile uint32_t*)address) = *data;
 
         address += 4;
-        data += 4;
+        data += 1;
     }
     while (data != data_e);
 
@@ -171,11 +173,20 @@ bool stm32l0_flash_erase(uint32_t address, uint32_t count)
     return success;
 }
 
+/* A half-page (16 words, 64 byte aligned) is programmed in one operation,
+ * which takes as long as a single word. This needs the half-page to be
+ * erased, and the 16 words have to be written back to back with no other
+ * flash access. Hence the source is copied to a word aligned buffer in RAM
+ * if it is unaligned or in flash itself. Anything else, a partial half-page
+ * or one that is not erased, falls back to word writes. Words that already
+ * hold the data are skipped, so rewriting the same data is harmless.
+ */
+
 bool stm32l0_flash_program(uint32_t address, const uint8_t *data, uint32_t count)
 {
     bool success = true;
-    const uint8_t *data_e;
-    uint32_t primask, size;
+    const uint32_t *source;
+    uint32_t buffer[16], primask, size, index, written, differ;
 
     if ((address & 3) || (count & 3) || (address < FLASH_BASE) || ((address + count) > (FLASH_BASE + stm32l0_flash_size())))
     {
@@ -201,41 +212,37 @@ bool stm32l0_flash_program(uint32_t address, const uint8_t *data, uint32_t count
             size = ((address + 64) & ~63) - address;
         }
 
-        primask = __get_PRIMASK();
-
-        __disable_irq();
-
-        if (size == 64)
+        if (((uint32_t)data & 3) || (((uint32_t)data >= FLASH_BASE) && ((uint32_t)data < (FLASH_BASE + stm32l0_flash_size()))))
         {
-            FLASH->PECR |= (FLASH_PECR_PROG | FLASH_PECR_FPRG);
+            memcpy(&buffer[0], data, size);
 
-            stm32l0_flash_do_program(address, data, data + 64);
+            source = &buffer[0];
+        }
+        else
+        {
+            source = (const uint32_t*)data;
+        }
 
-            if (FLASH->SR & FLASH_SR_EOP)
-            {
-                FLASH->SR = FLASH_SR_EOP;
-            }
-            else
-            {
-                FLASH->SR = (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_RDERR | FLASH_SR_NOTZEROERR | FLASH_SR_FWWERR);
+        written = 0;
+        differ = 0;
 
-                success = false;
-            }
-
-            data    += 64;
-            address += 64;
-        
-            FLASH->PECR &= ~(FLASH_PECR_PROG | FLASH_PECR_FPRG);
+        for (index = 0; index < (size / 4); index++)
+        {
+            written |= ((volatile uint32_t*)address)[index];
+            differ |= (((volatile uint32_t*)address)[index] ^ source[index]);
         }
-        else
+
+        if (differ)
         {
-            FLASH->PECR |= FLASH_PECR_PROG;
+            primask = __get_PRIMASK();
 
-            data_e = data + size;
+            __disable_irq();
 
-            do 
+            if ((size == 64) && !written)
             {
-                stm32l0_flash_do_program(address, data, data + 4);
+                FLASH->PECR |= (FLASH_PECR_PROG | FLASH_PECR_FPRG);
+
+                stm32l0_flash_do_program(address, source, source + 16);
 
                 if (FLASH->SR & FLASH_SR_EOP)
                 {
@@ -244,21 +251,46 @@ bool stm32l0_flash_program(uint32_t address, const uint8_t *data, uint32_t count
                 else
                 {
                     FLASH->SR = (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_RDERR | FLASH_SR_NOTZEROERR | FLASH_SR_FWWERR);
-                    
+
                     success = false;
                 }
 
-                address += 4;
-                data += 4;
+                FLASH->PECR &= ~(FLASH_PECR_PROG | FLASH_PECR_FPRG);
             }
-            while (success && (data != data_e));
+            else
+            {
+                FLASH->PECR |= FLASH_PECR_PROG;
 
-            FLASH->PECR &= ~FLASH_PECR_PROG;
+                for (index = 0; success && (index < (size / 4)); index++)
+                {
+                    if (((volatile uint32_t*)address)[index] == source[index])
+                    {
+                        continue;
+                    }
+
+                    stm32l0_flash_do_program(address + index * 4, &source[index], &source[index + 1]);
+
+                    if (FLASH->SR & FLASH_SR_EOP)
+                    {
+                        FLASH->SR = FLASH_SR_EOP;
+                    }
+                    else
+                    {
+                        FLASH->SR = (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_RDERR | FLASH_SR_NOTZEROERR | FLASH_SR_FWWERR);
+
+                        success = false;
+                    }
+                }
+
+                FLASH->PECR &= ~FLASH_PECR_PROG;
+            }
+
+            __set_PRIMASK(primask);
         }
-    
-        __set_PRIMASK(primask);
 
-        count -= size;
+        address += size;
+        data    += size;
+        count   -= size;
     }
     while (success && count);
 
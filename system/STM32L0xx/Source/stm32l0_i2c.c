@@ -385,11 +385,23 @@ static void stm32l0_i2c_master_receive(stm32l0_i2c_t *i2c)
 
     count = i2c->rx_data_e - i2c->rx_data;
 
+    if ((count > 1) && (i2c->rx_dma != STM32L0_DMA_CHANNEL_NONE))
+    {
+        rx_dma = stm32l0_dma_channel(i2c->rx_dma);
+
+        if (!rx_dma)
+        {
+            rx_dma = stm32l0_dma_enable(i2c->rx_dma, NULL, NULL);
+        }
+    }
+
     i2c_cr2 = (i2c->xf_address << 1) | I2C_CR2_RD_WRN | I2C_CR2_START;
 
     /* WAR for ERRATA if NBYTES != 1 and RELOAD is set. This case is handled by using
-     * interrupt driven receive mode with NBYTES set to 1 for each byte. This is
-     * only affecting receive operations with more than I2C_CR2_NBYTES_MAX bytes.
+     * receive mode with NBYTES set to 1 for each byte. This is only affecting receive
+     * operations with more than I2C_CR2_NBYTES_MAX bytes. With DMA the whole buffer
+     * is still covered by one DMA transfer, and only the leading bytes are reloaded
+     * one by one. The last I2C_CR2_NBYTES_MAX bytes are received in one go.
      */
 
     if (count > I2C_CR2_NBYTES_MAX)
@@ -406,17 +418,7 @@ static void stm32l0_i2c_master_receive(stm32l0_i2c_t *i2c)
         }
     }
 
-    if ((count > 1) && (i2c->rx_dma != STM32L0_DMA_CHANNEL_NONE))
-    {
-        rx_dma = stm32l0_dma_channel(i2c->rx_dma);
-
-        if (!rx_dma)
-        {
-            rx_dma = stm32l0_dma_enable(i2c->rx_dma, NULL, NULL);
-        }
-    }
-
-    if ((count > 1) && rx_dma)
+    if (rx_dma)
     {
         I2C->CR1 |= I2C_CR1_RXDMAEN;
 
@@ -894,19 +896,44 @@ static __attribute__((optimize("O3"))) void stm32l0_i2c_interrupt(stm32l0_i2c_t
                 
                 count = (i2c->rx_data_e - i2c->rx_data);
                 
-                if (count > 1)
+                if (I2C->CR1 & I2C_CR1_RXDMAEN)
                 {
-                    i2c_cr2 |= I2C_CR2_RELOAD;
+                    /* With DMA "rx_data" tracks the bytes handed to NBYTES so far.
+                     */
+                    if (count > I2C_CR2_NBYTES_MAX)
+                    {
+                        count = 1;
+
+                        i2c_cr2 |= I2C_CR2_RELOAD;
+                    }
+                    else
+                    {
+                        if (!(i2c->xf_control & STM32L0_I2C_CONTROL_RESTART))
+                        {
+                            i2c_cr2 |= I2C_CR2_AUTOEND;
+                        }
+                    }
+
+                    i2c->rx_data += count;
                 }
                 else
                 {
-                    if (!(i2c->xf_control & STM32L0_I2C_CONTROL_RESTART))
+                    if (count > 1)
                     {
-                        i2c_cr2 |= I2C_CR2_AUTOEND;
+                        i2c_cr2 |= I2C_CR2_RELOAD;
+                    }
+                    else
+                    {
+                        if (!(i2c->xf_control & STM32L0_I2C_CONTROL_RESTART))
+                        {
+                            i2c_cr2 |= I2C_CR2_AUTOEND;
+                        }
                     }
+
+                    count = 1;
                 }
                         
-                I2C->CR2 = (i2c_cr2 | (1 << I2C_CR2_NBYTES_SHIFT));
+                I2C->CR2 = (i2c_cr2 | (count << I2C_CR2_NBYTES_SHIFT));
             }
         }
         break;
@@ -1351,19 +1378,31 @@ bool stm32l0_i2c_submit(stm32l0_i2c_t *i2c, stm32l0_i2c_transaction_t *transacti
 
 void I2C1_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     stm32l0_i2c_interrupt(stm32l0_i2c_device.instances[STM32L0_I2C_INSTANCE_I2C1]);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 void I2C2_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     stm32l0_i2c_interrupt(stm32l0_i2c_device.instances[STM32L0_I2C_INSTANCE_I2C2]);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 #if defined(STM32L072xx) || defined(STM32L082xx)
 
 void I2C3_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     stm32l0_i2c_interrupt(stm32l0_i2c_device.instances[STM32L0_I2C_INSTANCE_I2C3]);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 #endif /* STM32L072xx || STM32L082xx */
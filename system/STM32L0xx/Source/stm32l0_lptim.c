@@ -428,6 +428,8 @@ void LPTIM1_IRQHandler(void)
     uint32_t lptim_isr, clock, compare, reference;
     bool flush = false;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     lptim_isr = LPTIM1->ISR;
 
     if (lptim_isr & LPTIM_ISR_ARRM)
@@ -517,6 +519,8 @@ void LPTIM1_IRQHandler(void)
             armv6m_atomic_add(&stm32l0_lptim_device.timeout_events, 1);
         }
     }
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 void SWI_LPTIM_IRQHandler(void)
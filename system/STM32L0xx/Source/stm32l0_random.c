@@ -32,7 +32,111 @@
 #include "stm32l0_random.h"
 #include "stm32l0_system.h"
 
-bool stm32l0_random(uint8_t *data, uint32_t count)
+#if defined(STM32L082xx)
+#include "stm32l0_aes.h"
+#else
+#include "aes.h"
+#endif
+
+#define STM32L0_RANDOM_STATE_NONE          0
+#define STM32L0_RANDOM_STATE_READY         1
+#define STM32L0_RANDOM_STATE_ERROR         2
+
+#define STM32L0_RANDOM_SEED_WORDS          8     /* seedlen = keylen + outlen = 256 bits */
+#define STM32L0_RANDOM_STARTUP_WORDS       256   /* 1024 samples, discarded */
+#define STM32L0_RANDOM_GENERATE_MAX        4096  /* bytes per generate call (2^19 bits max) */
+
+/* SP 800-90B health tests, alpha = 2^-20. The repetition count test runs
+ * on 32 bit words with an assumed H of 16 bits per word, C = 1 + ceil(20 / 16).
+ * The adaptive proportion test runs on the bytes of a word with an assumed
+ * H of 4 bits per byte, C = 1 + critbinom(512, 2^-4, 1 - 2^-20).
+ */
+#define STM32L0_RANDOM_RCT_CUTOFF          3
+#define STM32L0_RANDOM_APT_WINDOW          512
+#define STM32L0_RANDOM_APT_CUTOFF          62
+
+typedef struct _stm32l0_random_device_t {
+    volatile uint32_t         lock;
+    uint8_t                   state;
+    uint8_t                   rct_count;
+    uint8_t                   apt_sample;
+    uint16_t                  apt_count;
+    uint16_t                  apt_index;
+    uint32_t                  rct_data;
+    uint32_t                  reseed_counter;
+    uint8_t                   K[16];
+    uint8_t                   V[16];
+} stm32l0_random_device_t;
+
+static stm32l0_random_device_t stm32l0_random_device;
+
+static void stm32l0_random_memzero(void *data, uint32_t count)
+{
+    volatile uint8_t *p = (volatile uint8_t*)data;
+
+    while (count--)
+    {
+        *p++ = 0;
+    }
+}
+
+static bool stm32l0_random_health(uint32_t rng_data)
+{
+    unsigned int i;
+    uint8_t sample;
+
+    if (stm32l0_random_device.rct_count && (stm32l0_random_device.rct_data == rng_data))
+    {
+        stm32l0_random_device.rct_count++;
+
+        if (stm32l0_random_device.rct_count >= STM32L0_RANDOM_RCT_CUTOFF)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        stm32l0_random_device.rct_data = rng_data;
+        stm32l0_random_device.rct_count = 1;
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        sample = rng_data >> (i * 8);
+
+        if (stm32l0_random_device.apt_index == 0)
+        {
+            stm32l0_random_device.apt_sample = sample;
+            stm32l0_random_device.apt_count = 1;
+        }
+        else
+        {
+            if (stm32l0_random_device.apt_sample == sample)
+            {
+                stm32l0_random_device.apt_count++;
+
+                if (stm32l0_random_device.apt_count >= STM32L0_RANDOM_APT_CUTOFF)
+                {
+                    return false;
+                }
+            }
+        }
+
+        stm32l0_random_device.apt_index++;
+
+        if (stm32l0_random_device.apt_index == STM32L0_RANDOM_APT_WINDOW)
+        {
+            stm32l0_random_device.apt_index = 0;
+        }
+    }
+
+    return true;
+}
+
+/* Power up the RNG for one burst of "count" health tested words. With "data"
+ * being NULL the words are only fed to the health tests.
+ */
+static bool stm32l0_random_harvest(uint32_t *data, uint32_t count)
 {
     uint32_t rng_data;
     bool success = false;
@@ -57,47 +161,294 @@ bool stm32l0_random(uint8_t *data, uint32_t count)
 
         rng_data = RNG->DR;
 
-        if (count >= 4)
+        if (!stm32l0_random_health(rng_data))
         {
-            data[0] = rng_data;
-            data[1] = rng_data >> 8;
-            data[2] = rng_data >> 16;
-            data[3] = rng_data >> 24;
-            
-            data += 4;
-            count -= 4;
+            goto bailout;
         }
-        else
-        {
-            if (count >= 3) 
-            {
-                data[2] = rng_data >> 16;
-            }
-
-            if (count >= 2) 
-            {
-                data[1] = rng_data >> 8;
-            }
 
-            if (count >= 1) 
-            {
-                data[0] = rng_data >> 8;
-            }
-
-            count = 0;
+        if (data)
+        {
+            *data++ = rng_data;
         }
+
+        count--;
     }
-    
+
     success = true;
 
 bailout:
     RNG->CR &= ~RNG_CR_RNGEN;
-    
+
     stm32l0_system_periph_disable(STM32L0_SYSTEM_PERIPH_RNG);
 
     stm32l0_system_unreference(STM32L0_SYSTEM_REFERENCE_RNG);
 
     stm32l0_system_clk48_disable();
-    
+
+    return success;
+}
+
+/* V is a 128 bit block, but only the low 32 bits count (ctr_len = 32),
+ * which is what the AES peripheral's CTR mode increments.
+ */
+static void stm32l0_random_increment(uint8_t *ctr, uint32_t n)
+{
+    uint32_t data;
+
+    data = ((ctr[12] << 24) | (ctr[13] << 16) | (ctr[14] << 8) | (ctr[15] << 0)) + n;
+
+    ctr[12] = data >> 24;
+    ctr[13] = data >> 16;
+    ctr[14] = data >> 8;
+    ctr[15] = data >> 0;
+}
+
+/* E(K, V + 1) || E(K, V + 2) || ... truncated to "count" bytes.
+ */
+static void stm32l0_random_keystream(uint8_t *out, uint32_t count)
+{
+    uint8_t ctr[16];
+
+#if defined(STM32L082xx)
+    memcpy(ctr, stm32l0_random_device.V, 16);
+
+    stm32l0_random_increment(ctr, 1);
+
+    stm32l0_aes_ctr_keystream(stm32l0_random_device.K, ctr, out, count);
+#else
+    aes_context ctx;
+    uint8_t block[16];
+
+    memcpy(ctr, stm32l0_random_device.V, 16);
+
+    aes_set_key(stm32l0_random_device.K, 16, &ctx);
+
+    while (count)
+    {
+        stm32l0_random_increment(ctr, 1);
+
+        if (count >= 16)
+        {
+            aes_encrypt(ctr, out, &ctx);
+
+            out += 16;
+            count -= 16;
+        }
+        else
+        {
+            aes_encrypt(ctr, block, &ctx);
+
+            memcpy(out, block, count);
+
+            count = 0;
+        }
+    }
+
+    stm32l0_random_memzero(&ctx, sizeof(ctx));
+    stm32l0_random_memzero(block, sizeof(block));
+#endif
+
+    stm32l0_random_memzero(ctr, sizeof(ctr));
+}
+
+/* CTR_DRBG_Update(provided_data, K, V), with NULL being all zeros.
+ */
+static void stm32l0_random_update(const uint32_t *provided)
+{
+    uint32_t temp[STM32L0_RANDOM_SEED_WORDS];
+    unsigned int i;
+
+    stm32l0_random_keystream((uint8_t*)&temp[0], sizeof(temp));
+
+    if (provided)
+    {
+        for (i = 0; i < STM32L0_RANDOM_SEED_WORDS; i++)
+        {
+            temp[i] ^= provided[i];
+        }
+    }
+
+    memcpy(stm32l0_random_device.K, &temp[0], 16);
+    memcpy(stm32l0_random_device.V, &temp[4], 16);
+
+    stm32l0_random_memzero(temp, sizeof(temp));
+}
+
+static bool stm32l0_random_instantiate(void)
+{
+    uint32_t seed[STM32L0_RANDOM_SEED_WORDS];
+
+    stm32l0_random_device.state = STM32L0_RANDOM_STATE_ERROR;
+    stm32l0_random_device.rct_count = 0;
+    stm32l0_random_device.apt_index = 0;
+
+    if (!stm32l0_random_harvest(NULL, STM32L0_RANDOM_STARTUP_WORDS))
+    {
+        return false;
+    }
+
+    if (!stm32l0_random_harvest(&seed[0], STM32L0_RANDOM_SEED_WORDS))
+    {
+        stm32l0_random_memzero(seed, sizeof(seed));
+
+        return false;
+    }
+
+    /* The UID as personalization string.
+     */
+    seed[0] ^= *((const uint32_t*)(UID_BASE + 0x00));
+    seed[1] ^= *((const uint32_t*)(UID_BASE + 0x04));
+    seed[2] ^= *((const uint32_t*)(UID_BASE + 0x14));
+
+    stm32l0_random_memzero(stm32l0_random_device.K, 16);
+    stm32l0_random_memzero(stm32l0_random_device.V, 16);
+
+    stm32l0_random_update(&seed[0]);
+
+    stm32l0_random_memzero(seed, sizeof(seed));
+
+    stm32l0_random_device.reseed_counter = 1;
+    stm32l0_random_device.state = STM32L0_RANDOM_STATE_READY;
+
+    return true;
+}
+
+static bool stm32l0_random_do_reseed(void)
+{
+    uint32_t seed[STM32L0_RANDOM_SEED_WORDS];
+
+    if (!stm32l0_random_harvest(&seed[0], STM32L0_RANDOM_SEED_WORDS))
+    {
+        stm32l0_random_memzero(seed, sizeof(seed));
+
+        stm32l0_random_device.state = STM32L0_RANDOM_STATE_ERROR;
+
+        return false;
+    }
+
+    stm32l0_random_update(&seed[0]);
+
+    stm32l0_random_memzero(seed, sizeof(seed));
+
+    stm32l0_random_device.reseed_counter = 1;
+
+    return true;
+}
+
+static bool stm32l0_random_ready(void)
+{
+    if (stm32l0_random_device.state != STM32L0_RANDOM_STATE_READY)
+    {
+        return stm32l0_random_instantiate();
+    }
+
+    if (stm32l0_random_device.reseed_counter >= STM32L0_RANDOM_RESEED_INTERVAL)
+    {
+        return stm32l0_random_do_reseed();
+    }
+
+    return true;
+}
+
+bool stm32l0_random(uint8_t *data, uint32_t count)
+{
+    uint32_t size;
+    bool success = true;
+
+    if (armv6m_atomic_cas(&stm32l0_random_device.lock, 0, 1) != 0)
+    {
+        return false;
+    }
+
+    while (count)
+    {
+        if (!stm32l0_random_ready())
+        {
+            success = false;
+
+            break;
+        }
+
+        size = (count > STM32L0_RANDOM_GENERATE_MAX) ? STM32L0_RANDOM_GENERATE_MAX : count;
+
+        stm32l0_random_keystream(data, size);
+
+        stm32l0_random_increment(stm32l0_random_device.V, ((size + 15) / 16));
+
+        stm32l0_random_update(NULL);
+
+        stm32l0_random_device.reseed_counter++;
+
+        data += size;
+        count -= size;
+    }
+
+    stm32l0_random_device.lock = 0;
+
+    return success;
+}
+
+bool stm32l0_random_entropy(uint8_t *data, uint32_t count)
+{
+    uint32_t rng_data[STM32L0_RANDOM_SEED_WORDS];
+    uint32_t size;
+    bool success = true;
+
+    if (armv6m_atomic_cas(&stm32l0_random_device.lock, 0, 1) != 0)
+    {
+        return false;
+    }
+
+    if (stm32l0_random_device.state != STM32L0_RANDOM_STATE_READY)
+    {
+        success = stm32l0_random_instantiate();
+    }
+
+    while (success && count)
+    {
+        size = (count > sizeof(rng_data)) ? sizeof(rng_data) : count;
+
+        if (!stm32l0_random_harvest(&rng_data[0], ((size + 3) / 4)))
+        {
+            stm32l0_random_device.state = STM32L0_RANDOM_STATE_ERROR;
+
+            success = false;
+
+            break;
+        }
+
+        memcpy(data, &rng_data[0], size);
+
+        data += size;
+        count -= size;
+    }
+
+    stm32l0_random_memzero(rng_data, sizeof(rng_data));
+
+    stm32l0_random_device.lock = 0;
+
+    return success;
+}
+
+bool stm32l0_random_reseed(void)
+{
+    bool success;
+
+    if (armv6m_atomic_cas(&stm32l0_random_device.lock, 0, 1) != 0)
+    {
+        return false;
+    }
+
+    if (stm32l0_random_device.state != STM32L0_RANDOM_STATE_READY)
+    {
+        success = stm32l0_random_instantiate();
+    }
+    else
+    {
+        success = stm32l0_random_do_reseed();
+    }
+
+    stm32l0_random_device.lock = 0;
+
     return success;
 }
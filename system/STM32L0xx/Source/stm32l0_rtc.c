@@ -66,10 +66,9 @@ typedef struct _stm32l0_rtc_device_t {
     volatile uint8_t                       alarm_events;
     volatile stm32l0_rtc_timer_routine_t   timer_routine;
     uint64_t                               timer_clock;
-    stm32l0_rtc_timer_t                    *timer_active;
+    stm32l0_rtc_timer_t                    *timer_heap;
     stm32l0_rtc_timer_t * volatile         timer_modify;
     volatile uint8_t                       timer_busy;
-    volatile uint8_t                       timer_reclaim;
     volatile uint8_t                       timer_events;
     volatile uint8_t                       wakeup_busy;
     volatile stm32l0_rtc_wakeup_callback_t wakeup_callback;
@@ -85,6 +84,7 @@ static stm32l0_rtc_device_t stm32l0_rtc_device;
 
 #define STM32L0_RTC_TIMER_NULL   ((stm32l0_rtc_timer_t*)0)
 #define STM32L0_RTC_TIMER_TAIL   ((stm32l0_rtc_timer_t*)1)
+#define STM32L0_RTC_TIMER_HEAP   ((stm32l0_rtc_timer_t*)2)
 
 static void stm32l0_rtc_modify_routine();
 static void stm32l0_rtc_alarm_routine();
@@ -236,7 +236,7 @@ void __stm32l0_rtc_initialize(void)
                                      ((RTC->BKP4R & STM32L0_RTC_BKP4R_UTC_OFFSET_WRITTEN) ? STM32L0_RTC_STATUS_UTC_OFFSET_INTERNAL : 0));
     }
     
-    stm32l0_rtc_device.timer_active = STM32L0_RTC_TIMER_TAIL;
+    stm32l0_rtc_device.timer_heap = NULL;
     stm32l0_rtc_device.timer_modify = STM32L0_RTC_TIMER_TAIL;
 
     RTC->CR = (RTC->CR & ~RTC_CR_WUCKSEL) | RTC_CR_WUCKSEL_2;
@@ -1009,92 +1009,156 @@ bool stm32l0_rtc_alarm_done(void)
     return !stm32l0_rtc_device.alarm_active;
 }
 
-static void stm32l0_rtc_timer_reclaim(void)
+/* The active timers are kept in a pairing heap keyed by "deadline", which is
+ * the latest point in time a timer may expire, i.e. "clock" plus "slack". Both
+ * are private copies taken by the timer routine. "child", "sibling" and
+ * "previous" are only ever touched from SWI_RTC_TIMER, so no atomics are needed
+ * for the heap itself. "previous" points to the parent for the leftmost child,
+ * and to the left sibling otherwise. The root has "previous" set to NULL.
+ *
+ * A timer that sits in the heap has "next" set to STM32L0_RTC_TIMER_HEAP. Hence
+ * stm32l0_rtc_timer_modify() can claim it via a CAS and hand it over through
+ * "timer_modify" without having to search for it.
+ *
+ * The RTC alarm is programmed for the "deadline" of the root. On expiry all
+ * timers whose window [deadline - window, deadline] has been entered are
+ * dispatched, so that timers with overlapping windows share a single wakeup.
+ */
+
+static inline __attribute__((always_inline)) stm32l0_rtc_timer_t *stm32l0_rtc_timer_meld(stm32l0_rtc_timer_t *timer_a, stm32l0_rtc_timer_t *timer_b)
 {
-    stm32l0_rtc_timer_t *timer_this, **pp_timer_previous;
+    stm32l0_rtc_timer_t *timer_t;
 
-    stm32l0_rtc_device.timer_reclaim = 0;
+    if (timer_b->deadline < timer_a->deadline)
+    {
+        timer_t = timer_a;
+        timer_a = timer_b;
+        timer_b = timer_t;
+    }
 
-    for (pp_timer_previous = &stm32l0_rtc_device.timer_active, timer_this = *pp_timer_previous; timer_this != STM32L0_RTC_TIMER_TAIL; timer_this = *pp_timer_previous)
+    timer_b->previous = timer_a;
+    timer_b->sibling = timer_a->child;
+
+    if (timer_a->child)
     {
-        if (!((uint32_t)timer_this->callback & 1))
-        {
-            *pp_timer_previous = timer_this->next;
-            
-            timer_this->next = (stm32l0_rtc_timer_t*)armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)timer_this);
-        }
-        else
-        {
-            pp_timer_previous = (stm32l0_rtc_timer_t**)&timer_this->next;
-        }
+        timer_a->child->previous = timer_b;
     }
+
+    timer_a->child = timer_b;
+
+    return timer_a;
 }
 
-static void stm32l0_rtc_timer_insert(stm32l0_rtc_timer_t *timer, uint64_t clock)
+static stm32l0_rtc_timer_t *stm32l0_rtc_timer_combine(stm32l0_rtc_timer_t *timer_this)
 {
-    stm32l0_rtc_timer_t *timer_this, **pp_timer_previous;
-    uint64_t clock_this;
+    stm32l0_rtc_timer_t *timer_next, *timer_pairs;
 
-    if (stm32l0_rtc_device.timer_active == STM32L0_RTC_TIMER_TAIL)
+    if (!timer_this)
     {
-        timer->next = STM32L0_RTC_TIMER_TAIL;
-        
-        stm32l0_rtc_device.timer_active = timer;
+        return NULL;
     }
-    else
+
+    /* First pass, meld pairs left to right and collect them in reverse order.
+     */
+    for (timer_pairs = NULL; timer_this; timer_this = timer_next)
     {
-        for (pp_timer_previous = &stm32l0_rtc_device.timer_active, timer_this = *pp_timer_previous; timer_this != STM32L0_RTC_TIMER_TAIL; timer_this = *pp_timer_previous)
+        if (!timer_this->sibling)
         {
-            clock_this = (((uint64_t)timer_this->clock[0] << 0) | ((uint64_t)timer_this->clock[1] << 32));
+            timer_this->sibling = timer_pairs;
+            timer_pairs = timer_this;
 
-            if (!((uint32_t)timer_this->callback & 1))
-            {
-                *pp_timer_previous = timer_this->next;
+            break;
+        }
 
-                timer_this->next = (stm32l0_rtc_timer_t*)armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)timer_this);
-            }
-            else
-            {
-                if (clock_this > clock)
-                {
-                    *pp_timer_previous = timer;
+        timer_next = timer_this->sibling->sibling;
 
-                    timer->next = timer_this;
-                    
-                    break;
-                }
+        timer_this = stm32l0_rtc_timer_meld(timer_this, timer_this->sibling);
 
-                if (timer_this->next == STM32L0_RTC_TIMER_TAIL)
-                {
-                    timer->next = STM32L0_RTC_TIMER_TAIL;
+        timer_this->sibling = timer_pairs;
+        timer_pairs = timer_this;
+    }
 
-                    timer_this->next = timer;
+    /* Second pass, meld the pairs right to left into a single tree.
+     */
+    for (timer_this = timer_pairs, timer_pairs = timer_pairs->sibling; timer_pairs; timer_pairs = timer_next)
+    {
+        timer_next = timer_pairs->sibling;
 
-                    break;
-                }
+        timer_this = stm32l0_rtc_timer_meld(timer_this, timer_pairs);
+    }
 
-                pp_timer_previous = (stm32l0_rtc_timer_t**)&timer_this->next;
-            }
+    timer_this->sibling = NULL;
+    timer_this->previous = NULL;
+
+    return timer_this;
+}
+
+static void stm32l0_rtc_timer_insert(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_t slack)
+{
+    timer->child = NULL;
+    timer->sibling = NULL;
+    timer->previous = NULL;
+    timer->window = slack;
+    timer->deadline = clock + slack;
+
+    if (stm32l0_rtc_device.timer_heap == NULL)
+    {
+        stm32l0_rtc_device.timer_heap = timer;
+    }
+    else
+    {
+        stm32l0_rtc_device.timer_heap = stm32l0_rtc_timer_meld(stm32l0_rtc_device.timer_heap, timer);
+    }
+}
+
+static void stm32l0_rtc_timer_remove(stm32l0_rtc_timer_t *timer)
+{
+    stm32l0_rtc_timer_t *timer_child;
+
+    if (timer == stm32l0_rtc_device.timer_heap)
+    {
+        stm32l0_rtc_device.timer_heap = stm32l0_rtc_timer_combine(timer->child);
+    }
+    else
+    {
+        if (timer->previous->child == timer)
+        {
+            timer->previous->child = timer->sibling;
+        }
+        else
+        {
+            timer->previous->sibling = timer->sibling;
+        }
+
+        if (timer->sibling)
+        {
+            timer->sibling->previous = timer->previous;
+        }
+
+        timer_child = stm32l0_rtc_timer_combine(timer->child);
+
+        if (timer_child)
+        {
+            stm32l0_rtc_device.timer_heap = stm32l0_rtc_timer_meld(stm32l0_rtc_device.timer_heap, timer_child);
         }
     }
+
+    timer->child = NULL;
+    timer->sibling = NULL;
+    timer->previous = NULL;
 }
 
 static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)
 {
     stm32l0_rtc_capture_t capture;
     stm32l0_rtc_tod_t tod;
-    stm32l0_rtc_timer_t *timer_this, *timer_next, *timer_modify, **pp_timer_previous;
+    stm32l0_rtc_timer_t *timer_this, *timer_next, *timer_modify;
     stm32l0_rtc_timer_callback_t callback;
     void *context;
-    uint32_t seconds, ticks, alrmr, alrmssr;
+    uint32_t seconds, ticks, alrmr, alrmssr, slack;
     uint64_t timeout, clock, clock_this;
     bool retry;
 
-    if (stm32l0_rtc_device.timer_reclaim)
-    {
-        stm32l0_rtc_timer_reclaim();
-    }
-
     if (stm32l0_rtc_device.timer_modify != STM32L0_RTC_TIMER_TAIL)
     {
         timer_modify = (stm32l0_rtc_timer_t*)armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)STM32L0_RTC_TIMER_TAIL);
@@ -1115,8 +1179,14 @@ static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)
             do
             {
                 clock = (((uint64_t)timer_this->clock[0] << 0) | ((uint64_t)timer_this->clock[1] << 32));
+                slack = timer_this->slack;
             }
             while (!(armv6m_atomic_or((volatile uint32_t*)&timer_this->callback, 1) & 1));
+
+            if ((timer_this == stm32l0_rtc_device.timer_heap) || timer_this->previous)
+            {
+                stm32l0_rtc_timer_remove(timer_this);
+            }
             
             if (clock == 0)
             {
@@ -1132,7 +1202,17 @@ static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)
             }
             else
             {
-                stm32l0_rtc_timer_insert(timer_this, clock);
+                stm32l0_rtc_timer_insert(timer_this, clock, slack);
+
+                timer_this->next = STM32L0_RTC_TIMER_HEAP;
+
+                if (!((uint32_t)timer_this->callback & 1))
+                {
+                    if (armv6m_atomic_cas((volatile uint32_t*)&timer_this->next, (uint32_t)STM32L0_RTC_TIMER_HEAP, (uint32_t)STM32L0_RTC_TIMER_TAIL) == (uint32_t)STM32L0_RTC_TIMER_HEAP)
+                    {
+                        timer_this->next = (stm32l0_rtc_timer_t*)armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)timer_this);
+                    }
+                }
             }
         }
     }
@@ -1143,50 +1223,34 @@ static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)
         
         clock = __stm32l0_rtc_clock_convert(&capture, &tod);
         
-        if (stm32l0_rtc_device.timer_active != STM32L0_RTC_TIMER_TAIL)
+        while (stm32l0_rtc_device.timer_heap != NULL)
         {
-            for (pp_timer_previous = &stm32l0_rtc_device.timer_active, timer_this = *pp_timer_previous; timer_this != STM32L0_RTC_TIMER_TAIL; timer_this = *pp_timer_previous)
+            timer_this = stm32l0_rtc_device.timer_heap;
+
+            if (timer_this->deadline > (clock + timer_this->window))
             {
-                clock_this = (((uint64_t)timer_this->clock[0] << 0) | ((uint64_t)timer_this->clock[1] << 32));
-                
-                if (!((uint32_t)timer_this->callback & 1))
-                {
-                    *pp_timer_previous = timer_this->next;
-                    
-                    timer_this->next = (stm32l0_rtc_timer_t*)armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)timer_this);
-                }
-                else
-                {
-                    if (clock_this > clock)
-                    {
-                        break;
-                    }
-                    
-                    callback = timer_this->callback;
-                    context =  timer_this->context;
+                break;
+            }
 
-                    *pp_timer_previous = timer_this->next;
-                    
-                    timer_this->next = STM32L0_RTC_TIMER_NULL;
-                    
-                    if (!((uint32_t)timer_this->callback & 1))
+            stm32l0_rtc_timer_remove(timer_this);
+
+            callback = timer_this->callback;
+            context =  timer_this->context;
+
+            /* If the CAS fails the timer got modified and is now owned by "timer_modify".
+             */
+            if (__armv6m_atomic_cas((volatile uint32_t*)&timer_this->next, (uint32_t)STM32L0_RTC_TIMER_HEAP, (uint32_t)STM32L0_RTC_TIMER_NULL) == (uint32_t)STM32L0_RTC_TIMER_HEAP)
+            {
+                if ((uint32_t)timer_this->callback & 1)
+                {
+                    if ((uint32_t)callback & ~1)
                     {
-                        if (armv6m_atomic_cas((volatile uint32_t*)&timer_this->next, (uint32_t)STM32L0_RTC_TIMER_NULL, (uint32_t)STM32L0_RTC_TIMER_TAIL) == (uint32_t)STM32L0_RTC_TIMER_NULL)
-                        {
-                            timer_this->next = (stm32l0_rtc_timer_t*)__armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)timer_this);
-                        }
+                        (*callback)(context);
                     }
-                    else
-                    {
-                        if ((uint32_t)callback & ~1)
-                        {
-                            (*callback)(context);
-                        }
                         
-                        __stm32l0_rtc_clock_capture(&capture);
+                    __stm32l0_rtc_clock_capture(&capture);
                         
-                        clock = __stm32l0_rtc_clock_convert(&capture, &tod);
-                    }
+                    clock = __stm32l0_rtc_clock_convert(&capture, &tod);
                 }
             }
         }
@@ -1197,13 +1261,13 @@ static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)
             {
                 retry = false;
 
-                if (stm32l0_rtc_device.timer_active != STM32L0_RTC_TIMER_TAIL)
+                if (stm32l0_rtc_device.timer_heap != NULL)
                 {
-                    timer_this = stm32l0_rtc_device.timer_active;
+                    clock_this = stm32l0_rtc_device.timer_heap->deadline;
                 
-                    clock_this = (((uint64_t)timer_this->clock[0] << 0) | ((uint64_t)timer_this->clock[1] << 32));
-                
-                    timeout = clock_this - clock;
+                    /* On a retry the deadline may have passed meanwhile.
+                     */
+                    timeout = (clock_this > clock) ? (clock_this - clock) : 0;
                 
                     if (timeout > (2419200ull * STM32L0_RTC_CLOCK_TICKS_PER_SECOND))
                     {
@@ -1323,7 +1387,7 @@ static void  __attribute__((optimize("O3"))) stm32l0_rtc_timer_routine(void)
     }
 }
 
-static void stm32l0_rtc_timer_modify(stm32l0_rtc_timer_t *timer, uint32_t clock_l, uint32_t clock_h)
+static void stm32l0_rtc_timer_modify(stm32l0_rtc_timer_t *timer, uint32_t clock_l, uint32_t clock_h, uint32_t slack)
 {
     EXCn_Type ipsr;
 
@@ -1331,18 +1395,17 @@ static void stm32l0_rtc_timer_modify(stm32l0_rtc_timer_t *timer, uint32_t clock_
 
     stm32l0_rtc_device.timer_routine = stm32l0_rtc_timer_routine;
     
+    timer->slack = slack;
+
     armv6m_core_store_2(&timer->clock[0], (uint32_t)clock_l, (uint32_t)clock_h);
 
     armv6m_atomic_and((volatile uint32_t*)&timer->callback, ~1);
 
-    if (armv6m_atomic_cas((volatile uint32_t*)&timer->next, (uint32_t)STM32L0_RTC_TIMER_NULL, (uint32_t)STM32L0_RTC_TIMER_TAIL) == (uint32_t)STM32L0_RTC_TIMER_NULL)
+    if ((armv6m_atomic_cas((volatile uint32_t*)&timer->next, (uint32_t)STM32L0_RTC_TIMER_NULL, (uint32_t)STM32L0_RTC_TIMER_TAIL) == (uint32_t)STM32L0_RTC_TIMER_NULL) ||
+        (armv6m_atomic_cas((volatile uint32_t*)&timer->next, (uint32_t)STM32L0_RTC_TIMER_HEAP, (uint32_t)STM32L0_RTC_TIMER_TAIL) == (uint32_t)STM32L0_RTC_TIMER_HEAP))
     {
         timer->next = (stm32l0_rtc_timer_t*)armv6m_atomic_swap((volatile uint32_t*)&stm32l0_rtc_device.timer_modify, (uint32_t)timer);
     }
-    else
-    {
-        stm32l0_rtc_device.timer_reclaim = 1;
-    }
 
     if (ipsr == SVCall_EXCn)
     {
@@ -1364,6 +1427,12 @@ void stm32l0_rtc_timer_create(stm32l0_rtc_timer_t *timer, stm32l0_rtc_timer_call
     timer->context = context;
     timer->clock[0] = 0;
     timer->clock[1] = 0;
+    timer->slack = 0;
+    timer->child = NULL;
+    timer->sibling = NULL;
+    timer->previous = NULL;
+    timer->window = 0;
+    timer->deadline = 0;
 }
 
 bool stm32l0_rtc_timer_destroy(stm32l0_rtc_timer_t *timer)
@@ -1372,6 +1441,11 @@ bool stm32l0_rtc_timer_destroy(stm32l0_rtc_timer_t *timer)
 }
 
 void stm32l0_rtc_timer_start(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_t mode)
+{
+    stm32l0_rtc_timer_start_slack(timer, clock, 0, mode);
+}
+
+void stm32l0_rtc_timer_start_slack(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_t slack, uint32_t mode)
 {
     stm32l0_rtc_capture_t capture;
 
@@ -1389,11 +1463,11 @@ void stm32l0_rtc_timer_start(stm32l0_rtc_timer_t *timer, uint64_t clock, uint32_
 
     if (__get_IPSR() == ThreadMode_EXCn)
     {
-        armv6m_svcall_3((uint32_t)&stm32l0_rtc_timer_modify, (uint32_t)timer, (uint32_t)(clock >> 0), (uint32_t)(clock >> 32));
+        armv6m_svcall_4((uint32_t)&stm32l0_rtc_timer_modify, (uint32_t)timer, (uint32_t)(clock >> 0), (uint32_t)(clock >> 32), slack);
     }
     else
     {
-        stm32l0_rtc_timer_modify(timer, (uint32_t)(clock >> 0), (uint32_t)(clock >> 32));
+        stm32l0_rtc_timer_modify(timer, (uint32_t)(clock >> 0), (uint32_t)(clock >> 32), slack);
     }
 }
 
@@ -1401,11 +1475,11 @@ void stm32l0_rtc_timer_stop(stm32l0_rtc_timer_t *timer)
 {
     if (__get_IPSR() == ThreadMode_EXCn)
     {
-        armv6m_svcall_3((uint32_t)&stm32l0_rtc_timer_modify, (uint32_t)timer, (uint32_t)0, (uint32_t)0);
+        armv6m_svcall_4((uint32_t)&stm32l0_rtc_timer_modify, (uint32_t)timer, (uint32_t)0, (uint32_t)0, (uint32_t)0);
     }
     else
     {
-        stm32l0_rtc_timer_modify(timer, 0, 0);
+        stm32l0_rtc_timer_modify(timer, 0, 0, 0);
     }
 }
 
@@ -1729,6 +1803,8 @@ void RTC_IRQHandler(void)
 {
     stm32l0_rtc_callback_t callback;
 
+    ARMV6M_TRACE_IRQ_ENTER();
+
     if (EXTI->PR & EXTI_PR_PIF17)
     {
         do
@@ -1873,6 +1949,8 @@ void RTC_IRQHandler(void)
             (*callback)(stm32l0_rtc_device.alarm_current.context);
         }
     }
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 void SWI_RTC_MODIFY_IRQHandler(void)
@@ -349,17 +349,21 @@ static void stm32l0_sfspi_callback(void *context, uint32_t notify)
             /* acquire/release will block shared interrupts and USB/MSC.
              */
 
+            /* stm32l0_spi_acquire() fails if the SPI is busy and cannot be
+             * waited for, in which case the flash simply stays awake.
+             */
             if (sfspi->state == STM32L0_SFSPI_STATE_READY)
             {
-                stm32l0_spi_acquire(sfspi->spi, 32000000, 0);
-
-                stm32l0_sfspi_select(sfspi);
-                stm32l0_spi_data8(sfspi->spi, SFLASH_CMD_DPD);
-                stm32l0_sfspi_unselect(sfspi);
+                if (stm32l0_spi_acquire(sfspi->spi, 32000000, 0))
+                {
+                    stm32l0_sfspi_select(sfspi);
+                    stm32l0_spi_data8(sfspi->spi, SFLASH_CMD_DPD);
+                    stm32l0_sfspi_unselect(sfspi);
                 
-                stm32l0_spi_release(sfspi->spi);
+                    stm32l0_spi_release(sfspi->spi);
 
-                sfspi->state = STM32L0_SFSPI_STATE_SLEEP;
+                    sfspi->state = STM32L0_SFSPI_STATE_SLEEP;
+                }
             }
         }
     }
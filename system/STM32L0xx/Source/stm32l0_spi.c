@@ -109,6 +109,247 @@ static void stm32l0_spi_dma_callback(stm32l0_spi_t *spi, uint32_t events)
     }
 }
 
+static bool stm32l0_spi_configure(stm32l0_spi_t *spi, uint32_t clock, uint32_t option)
+{
+    SPI_TypeDef *SPI = spi->SPI;
+    uint32_t pclk, spiclk, div;
+    bool reconfigure = false;
+
+    if (spi->instance == STM32L0_SPI_INSTANCE_SPI1)
+    {
+        pclk = stm32l0_system_pclk2();
+    }
+    else
+    {
+        pclk = stm32l0_system_pclk1();
+    }
+
+    if (spi->pclk != pclk)
+    {
+        spi->pclk = pclk;
+        spi->clock = 0;
+        spi->option = ~0;
+    }
+
+    if ((spi->clock != clock) || ((spi->option ^ option) & (SPI_CR1_CPHA | SPI_CR1_CPOL | SPI_CR1_LSBFIRST)))
+    {
+        spiclk = spi->pclk / 2;
+        div = 0;
+
+        while ((spiclk > clock) && (div < 7))
+        {
+            spiclk >>= 1;
+            div++;
+        }
+    
+        SPI->CR1 &= ~SPI_CR1_SPE;
+        SPI->SR = 0;
+        SPI->CRCPR = 0x1021;
+        SPI->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | (option & (STM32L0_SPI_OPTION_MODE_MASK | STM32L0_SPI_OPTION_LSB_FIRST)) | (div << SPI_CR1_BR_Pos);
+        SPI->CR2 = 0;
+
+        spi->clock = clock;
+
+        reconfigure = true;
+    }
+
+    spi->option = option;
+
+    return reconfigure;
+}
+
+/* The transaction queue owns the SPI between stm32l0_spi_acquire()/stm32l0_spi_release() 
+ * pairs (STM32L0_SPI_STATE_QUEUE). Transactions are chained in the DMA completion interrupt:
+ * at the end of a segment the next one is started, at the end of a transaction the CS pin
+ * is released, the settings for the next transaction are applied while no CS pin is
+ * asserted, and its CS pin is asserted. A waiting stm32l0_spi_acquire() gets the SPI at
+ * the next transaction boundary. The lock hook is not called, as this runs in interrupt
+ * context.
+ */
+
+static void stm32l0_spi_queue_segment(stm32l0_spi_t *spi)
+{
+    SPI_TypeDef *SPI = spi->SPI;
+    const stm32l0_spi_segment_t *segment;
+
+    segment = &spi->xf_transaction->segments[spi->xf_segment];
+
+    if (segment->rx_data)
+    {
+        stm32l0_dma_start(spi->rx_dma, (uint32_t)segment->rx_data, (uint32_t)&SPI->DR, segment->count, STM32L0_SPI_RX_DMA_OPTION_TRANSFER_8 | STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE);
+    }
+    else
+    {
+        stm32l0_dma_start(spi->rx_dma, (uint32_t)&spi->rx_none, (uint32_t)&SPI->DR, segment->count, STM32L0_SPI_RX_DMA_OPTION_TRANSMIT_8 | STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE);
+    }
+
+    if (segment->tx_data)
+    {
+        stm32l0_dma_start(spi->tx_dma, (uint32_t)&SPI->DR, (uint32_t)segment->tx_data, segment->count, STM32L0_SPI_TX_DMA_OPTION_TRANSMIT_8);
+    }
+    else
+    {
+        stm32l0_dma_start(spi->tx_dma, (uint32_t)&SPI->DR, (uint32_t)&spi->tx_default, segment->count, STM32L0_SPI_TX_DMA_OPTION_RECEIVE_8);
+    }
+}
+
+static bool stm32l0_spi_queue_next(stm32l0_spi_t *spi)
+{
+    SPI_TypeDef *SPI = spi->SPI;
+    stm32l0_spi_transaction_t *transaction, **pp_transaction, *entry, **pp_entry;
+
+    transaction = NULL;
+
+    if (!spi->rq_acquire)
+    {
+        do
+        {
+            transaction = NULL;
+            pp_transaction = NULL;
+
+            for (pp_entry = &spi->xf_queue, entry = *pp_entry; entry; pp_entry = &entry->next, entry = *pp_entry) 
+            {
+                transaction = entry;
+                pp_transaction = pp_entry;
+            }
+
+            if (!transaction)
+            {
+                break;
+            }
+        }
+        while (armv6m_atomic_cas((volatile uint32_t*)pp_transaction, (uint32_t)transaction, (uint32_t)NULL) != (uint32_t)transaction);
+    }
+
+    if (transaction)
+    {
+        if (stm32l0_spi_configure(spi, transaction->clock, transaction->option))
+        {
+            SPI->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+            SPI->CR1 |= SPI_CR1_SPE;
+        }
+
+        if (transaction->pin != STM32L0_GPIO_PIN_NONE)
+        {
+            stm32l0_gpio_pin_write(transaction->pin, 0);
+        }
+
+        spi->xf_transaction = transaction;
+        spi->xf_segment = 0;
+
+        stm32l0_spi_queue_segment(spi);
+
+        return true;
+    }
+
+    SPI->CR1 &= ~SPI_CR1_SPE;
+    SPI->CR2 = 0;
+
+    if (stm32l0_dma_channel(spi->rx_dma))
+    {
+        stm32l0_dma_disable(spi->rx_dma);
+    }
+    
+    if (stm32l0_dma_channel(spi->tx_dma))
+    {
+        stm32l0_dma_disable(spi->tx_dma);
+    }
+
+    stm32l0_system_periph_disable(STM32L0_SYSTEM_PERIPH_SPI1 + spi->instance);
+
+    stm32l0_system_unlock(STM32L0_SYSTEM_LOCK_RUN);
+
+    if (spi->mask)
+    {
+        stm32l0_exti_unblock(spi->mask);
+    }
+
+    spi->state = STM32L0_SPI_STATE_READY;
+
+    return false;
+}
+
+static void stm32l0_spi_queue_callback(stm32l0_spi_t *spi, uint32_t events);
+
+static void stm32l0_spi_queue_start(stm32l0_spi_t *spi)
+{
+    SPI_TypeDef *SPI = spi->SPI;
+
+    if (spi->xf_queue && !spi->rq_acquire)
+    {
+        if (armv6m_atomic_casb(&spi->state, STM32L0_SPI_STATE_READY, STM32L0_SPI_STATE_QUEUE) != STM32L0_SPI_STATE_READY)
+        {
+            return;
+        }
+
+        if (spi->mask)
+        {
+            stm32l0_exti_block(spi->mask);
+        }
+
+        stm32l0_system_lock(STM32L0_SYSTEM_LOCK_RUN);
+
+        stm32l0_system_periph_enable(STM32L0_SYSTEM_PERIPH_SPI1 + spi->instance);
+
+        stm32l0_dma_enable(spi->rx_dma, (stm32l0_dma_callback_t)stm32l0_spi_queue_callback, spi);
+        stm32l0_dma_enable(spi->tx_dma, NULL, NULL);
+
+        SPI->CR1 &= ~SPI_CR1_SPE;
+        SPI->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+        SPI->CR1 |= SPI_CR1_SPE;
+
+        stm32l0_spi_queue_next(spi);
+    }
+}
+
+static void stm32l0_spi_queue_callback(stm32l0_spi_t *spi, uint32_t events)
+{
+    SPI_TypeDef *SPI = spi->SPI;
+    stm32l0_spi_transaction_t *transaction = spi->xf_transaction;
+
+    stm32l0_dma_stop(spi->rx_dma);
+    stm32l0_dma_stop(spi->tx_dma);
+
+    spi->xf_segment++;
+
+    if (spi->xf_segment != transaction->segment_count)
+    {
+        stm32l0_spi_queue_segment(spi);
+
+        return;
+    }
+
+    while (!(SPI->SR & SPI_SR_TXE))
+    {
+    }
+
+    while (SPI->SR & SPI_SR_BSY)
+    {
+    }
+
+    if (transaction->pin != STM32L0_GPIO_PIN_NONE)
+    {
+        stm32l0_gpio_pin_write(transaction->pin, 1);
+    }
+
+    spi->xf_transaction = NULL;
+
+    transaction->status = STM32L0_SPI_STATUS_SUCCESS;
+
+    if (transaction->callback)
+    {
+        (*transaction->callback)(transaction->context);
+    }
+
+    /* A transaction submitted after stm32l0_spi_queue_next() found the queue empty, but
+     * before it released the SPI, is picked up by stm32l0_spi_queue_start().
+     */
+    if (!stm32l0_spi_queue_next(spi))
+    {
+        stm32l0_spi_queue_start(spi);
+    }
+}
+
 bool stm32l0_spi_create(stm32l0_spi_t *spi, const stm32l0_spi_params_t *params)
 {
     if (spi->state != STM32L0_SPI_STATE_NONE)
@@ -123,6 +364,9 @@ bool stm32l0_spi_create(stm32l0_spi_t *spi, const stm32l0_spi_params_t *params)
     spi->tx_dma = params->tx_dma;
     spi->pins = params->pins;
     spi->tx_default = 0xff;
+    spi->rq_acquire = 0;
+    spi->xf_queue = NULL;
+    spi->xf_transaction = NULL;
     
     stm32l0_spi_device.instances[spi->instance] = spi;
 
@@ -244,9 +488,31 @@ bool stm32l0_spi_unblock(stm32l0_spi_t *spi, uint16_t pin)
 bool stm32l0_spi_acquire(stm32l0_spi_t *spi, uint32_t clock, uint32_t option)
 {
     SPI_TypeDef *SPI = spi->SPI;
-    uint32_t pclk, spiclk, div;
+    uint32_t state;
+
+    /* If the transaction queue owns the SPI, wait for it to hand it back at the end
+     * of the current transaction. The hand back happens in the DMA interrupt, so
+     * waiting is only possible in thread mode with interrupts enabled. In handler
+     * mode, or with PRIMASK set, a queue owned SPI is simply busy.
+     */
+    if ((__get_IPSR() != 0) || __get_PRIMASK())
+    {
+        state = armv6m_atomic_casb(&spi->state, STM32L0_SPI_STATE_READY, STM32L0_SPI_STATE_DATA);
+    }
+    else
+    {
+        armv6m_atomic_incb(&spi->rq_acquire);
 
-    if (spi->state != STM32L0_SPI_STATE_READY)
+        do
+        {
+            state = armv6m_atomic_casb(&spi->state, STM32L0_SPI_STATE_READY, STM32L0_SPI_STATE_DATA);
+        }
+        while (state == STM32L0_SPI_STATE_QUEUE);
+
+        armv6m_atomic_decb(&spi->rq_acquire);
+    }
+
+    if (state != STM32L0_SPI_STATE_READY)
     {
         return false;
     }
@@ -275,48 +541,10 @@ bool stm32l0_spi_acquire(stm32l0_spi_t *spi, uint32_t clock, uint32_t option)
         stm32l0_dma_enable(spi->tx_dma, NULL, NULL);
     }
 
-    if (spi->instance == STM32L0_SPI_INSTANCE_SPI1)
-    {
-        pclk = stm32l0_system_pclk2();
-    }
-    else
-    {
-        pclk = stm32l0_system_pclk1();
-    }
-
-    if (spi->pclk != pclk)
-    {
-        spi->pclk = pclk;
-        spi->clock = 0;
-        spi->option = ~0;
-    }
-
-    if ((spi->clock != clock) || ((spi->option ^ option) & (SPI_CR1_CPHA | SPI_CR1_CPOL | SPI_CR1_LSBFIRST)))
-    {
-        spiclk = spi->pclk / 2;
-        div = 0;
-
-        while ((spiclk > clock) && (div < 7))
-        {
-            spiclk >>= 1;
-            div++;
-        }
-    
-        SPI->CR1 &= ~SPI_CR1_SPE;
-        SPI->SR = 0;
-        SPI->CRCPR = 0x1021;
-        SPI->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | (option & (STM32L0_SPI_OPTION_MODE_MASK | STM32L0_SPI_OPTION_LSB_FIRST)) | (div << SPI_CR1_BR_Pos);
-        SPI->CR2 = 0;
-
-        spi->clock = clock;
-    }
-
-    spi->option = option;
+    stm32l0_spi_configure(spi, clock, option);
 
     SPI->CR1 |= SPI_CR1_SPE;
 
-    spi->state = STM32L0_SPI_STATE_DATA;
-
     return true;
 }
 
@@ -349,8 +577,6 @@ bool stm32l0_spi_release(stm32l0_spi_t *spi)
 
     stm32l0_system_unlock(STM32L0_SYSTEM_LOCK_RUN);
 
-    spi->state = STM32L0_SPI_STATE_READY;
-
     if (spi->mask)
     {
         stm32l0_exti_unblock(spi->mask);
@@ -361,6 +587,13 @@ bool stm32l0_spi_release(stm32l0_spi_t *spi)
         (*spi->lock_callback)(spi->lock_cookie, false);
     }
 
+    /* Only hand out the SPI once it is fully released, as a stm32l0_spi_submit()
+     * or stm32l0_spi_acquire() from an interrupt may take it right away.
+     */
+    spi->state = STM32L0_SPI_STATE_READY;
+
+    stm32l0_spi_queue_start(spi);
+
     return true;
 }
 
@@ -873,3 +1106,45 @@ bool stm32l0_spi_done(stm32l0_spi_t *spi)
 {
     return (spi->state != STM32L0_SPI_STATE_DMA);
 }
+
+bool stm32l0_spi_submit(stm32l0_spi_t *spi, stm32l0_spi_transaction_t *transaction)
+{
+    stm32l0_spi_transaction_t *entry;
+    unsigned int index;
+
+    if (spi->state < STM32L0_SPI_STATE_READY)
+    {
+        return false;
+    }
+
+    if ((spi->rx_dma == STM32L0_DMA_CHANNEL_NONE) || (spi->tx_dma == STM32L0_DMA_CHANNEL_NONE))
+    {
+        return false;
+    }
+
+    if (!transaction->segment_count)
+    {
+        return false;
+    }
+
+    for (index = 0; index < transaction->segment_count; index++)
+    {
+        if (!transaction->segments[index].count)
+        {
+            return false;
+        }
+    }
+
+    transaction->status = STM32L0_SPI_STATUS_BUSY;
+
+    do
+    {
+        entry = spi->xf_queue;
+        transaction->next = entry;
+    }
+    while (armv6m_atomic_cas((volatile uint32_t*)&spi->xf_queue, (uint32_t)entry, (uint32_t)transaction) != (uint32_t)entry);
+
+    stm32l0_spi_queue_start(spi);
+
+    return true;
+}
@@ -33,6 +33,7 @@
 #include "stm32l0_rtc.h"
 #include "stm32l0_lptim.h"
 #include "stm32l0_eeprom.h"
+#include "stm32l0_timestamp.h"
 #include "stm32l0_system.h"
 
 #undef abs
@@ -78,8 +79,24 @@ typedef struct _stm32l0_system_device_t {
     volatile uint32_t         events;
     stm32l0_rtc_timer_t       timeout;
     stm32l0_system_fatal_callback_t callback;
+    uint64_t                  profile_clock;
+    uint64_t                  frequency_clock;
+    stm32l0_system_profile_t  profile;
+    uint32_t                  governor_low;
+    uint32_t                  governor_high;
+    volatile uint8_t          governor_level;
+    volatile uint8_t          governor_pending;
+    volatile uint8_t          sysclk_busy;
 } stm32l0_system_device_t;
 
+#define STM32L0_SYSTEM_GOVERNOR_LEVEL_NONE 0
+#define STM32L0_SYSTEM_GOVERNOR_LEVEL_LOW  1
+#define STM32L0_SYSTEM_GOVERNOR_LEVEL_HIGH 2
+
+static void stm32l0_system_frequency_update(void);
+static void stm32l0_system_idle(uint32_t policy);
+static stm32l0_system_frequency_t *stm32l0_system_frequency_entry(uint32_t hclk);
+
 static stm32l0_system_device_t stm32l0_system_device;
 
 static volatile uint32_t * const stm32l0_system_xlate_RSTR[STM32L0_SYSTEM_PERIPH_COUNT] = {
@@ -702,6 +719,8 @@ void stm32l0_system_initialize(uint32_t hclk, uint32_t pclk1, uint32_t pclk2, ui
     RCC->APB1ENR &= ~RCC_APB1ENR_PWREN;
 
     __armv6m_core_initialize();
+
+    armv6m_task_idle(stm32l0_system_idle);
     
     __stm32l0_gpio_initialize();
     __stm32l0_exti_initialize();
@@ -712,13 +731,87 @@ void stm32l0_system_initialize(uint32_t hclk, uint32_t pclk1, uint32_t pclk2, ui
 
     stm32l0_system_sysclk_configure(hclk, pclk1, pclk2);
 
+    __stm32l0_timestamp_initialize();
+
     __set_PRIMASK(primask);
 }
 
+/* Start the PLL (via HSI16) or MSI needed for the next switch, and wait for
+ * them to settle with interrupts enabled. Only the register updates are done
+ * with interrupts disabled. Each wait gives up once the oscillator's ON bit
+ * is found cleared, as nothing but the switch itself may turn it off. The
+ * switch re-enables and re-checks all of them with interrupts disabled. A
+ * PLL fed by HSE is left to the switch.
+ */
+static void stm32l0_system_sysclk_prepare(uint32_t pllcfg, uint32_t msirange)
+{
+    uint32_t primask, on, ready;
+
+    on = 0;
+    ready = 0;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (pllcfg && !(pllcfg & RCC_CFGR_PLLSRC_HSE) && !stm32l0_system_device.pllsys && !(RCC->CR & RCC_CR_PLLON))
+    {
+        RCC->CR |= RCC_CR_HSION;
+
+        on = RCC_CR_HSION;
+        ready = RCC_CR_HSIRDY;
+    }
+
+    if (msirange && !(RCC->CR & RCC_CR_MSION))
+    {
+        RCC->ICSCR = (RCC->ICSCR & ~RCC_ICSCR_MSIRANGE) | msirange;
+
+        RCC->CR |= RCC_CR_MSION;
+
+        on = RCC_CR_MSION;
+        ready = RCC_CR_MSIRDY;
+    }
+
+    __set_PRIMASK(primask);
+
+    while ((RCC->CR & ready) != ready)
+    {
+        if (!(RCC->CR & on))
+        {
+            return;
+        }
+    }
+
+    if (ready == RCC_CR_HSIRDY)
+    {
+        primask = __get_PRIMASK();
+
+        __disable_irq();
+
+        if (!stm32l0_system_device.pllsys && !(RCC->CR & RCC_CR_PLLON))
+        {
+            RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_PLLSRC | RCC_CFGR_PLLMUL | RCC_CFGR_PLLDIV)) | pllcfg;
+
+            RCC->CR |= RCC_CR_PLLON;
+        }
+
+        __set_PRIMASK(primask);
+
+        while (!(RCC->CR & RCC_CR_PLLRDY))
+        {
+            if (!(RCC->CR & RCC_CR_PLLON))
+            {
+                break;
+            }
+        }
+    }
+}
+
 bool stm32l0_system_sysclk_configure(uint32_t hclk, uint32_t pclk1, uint32_t pclk2)
 {
     uint32_t primask, sysclk, hpre, ppre1, ppre2, msirange, pllcfg, latency, buspre, busspre;
     uint8_t pllsys;
+    stm32l0_system_frequency_t *frequency;
     
     if (hclk <= 4200000)
     {
@@ -862,6 +955,30 @@ bool stm32l0_system_sysclk_configure(uint32_t hclk, uint32_t pclk1, uint32_t pcl
     else if (sysclk >=  8000000) { busspre = (RCC_CFGR_HPRE_DIV4  | RCC_CFGR_PPRE1_DIV1 | RCC_CFGR_PPRE2_DIV1); }
     else if (sysclk >=  4000000) { busspre = (RCC_CFGR_HPRE_DIV2  | RCC_CFGR_PPRE1_DIV1 | RCC_CFGR_PPRE2_DIV1); }
     else                         { busspre = buspre;                                                            }
+
+    /* Switches are serialized. A call that comes in while another one waits
+     * in stm32l0_system_sysclk_prepare() fails rather than pulling the
+     * oscillators from under it.
+     */
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (stm32l0_system_device.sysclk_busy)
+    {
+        __set_PRIMASK(primask);
+
+        return false;
+    }
+
+    stm32l0_system_device.sysclk_busy = true;
+
+    __set_PRIMASK(primask);
+
+    if (stm32l0_system_device.sysclk != sysclk)
+    {
+        stm32l0_system_sysclk_prepare(pllsys ? pllcfg : 0, msirange);
+    }
         
     primask = __get_PRIMASK();
 
@@ -872,12 +989,38 @@ bool stm32l0_system_sysclk_configure(uint32_t hclk, uint32_t pclk1, uint32_t pcl
         ((stm32l0_system_device.reference & STM32L0_SYSTEM_REFERENCE_USB)  && (pclk1  <  16000000)) ||
         ((stm32l0_system_device.reference & STM32L0_SYSTEM_REFERENCE_I2C2) && (pclk1  <   4000000)))
     {
+        /* Stop what stm32l0_system_sysclk_prepare() started for nothing.
+         */
+        if (stm32l0_system_device.sysclk != sysclk)
+        {
+            if (!stm32l0_system_device.pllsys)
+            {
+                RCC->CR &= ~RCC_CR_PLLON;
+            }
+
+            if (!stm32l0_system_device.msi)
+            {
+                RCC->CR &= ~RCC_CR_MSION;
+            }
+
+            if (!stm32l0_system_device.hsi16)
+            {
+                RCC->CR &= ~RCC_CR_HSION;
+            }
+        }
+
+        stm32l0_system_device.sysclk_busy = false;
+
         __set_PRIMASK(primask);
         
         return false;
     }
-    
-    armv6m_systick_disable();
+
+    stm32l0_system_frequency_update();
+
+    /* SysTick is left running across the switch so that armv6m_systick_nanos()
+     * does not lose the time it takes the clocks to settle.
+     */
 
     if (stm32l0_system_device.sysclk != sysclk)
     {
@@ -1007,9 +1150,12 @@ bool stm32l0_system_sysclk_configure(uint32_t hclk, uint32_t pclk1, uint32_t pcl
         
         if (pllsys)
         {
-            RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_PLLSRC | RCC_CFGR_PLLMUL | RCC_CFGR_PLLDIV)) | pllcfg;
+            if (!(RCC->CR & RCC_CR_PLLON))
+            {
+                RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_PLLSRC | RCC_CFGR_PLLMUL | RCC_CFGR_PLLDIV)) | pllcfg;
             
-            RCC->CR |= RCC_CR_PLLON;
+                RCC->CR |= RCC_CR_PLLON;
+            }
             
             while (!(RCC->CR & RCC_CR_PLLRDY))
             {
@@ -1107,6 +1253,8 @@ bool stm32l0_system_sysclk_configure(uint32_t hclk, uint32_t pclk1, uint32_t pcl
     
     armv6m_systick_enable();
 
+    ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_CLOCK, 0, hclk);
+
     stm32l0_system_device.sysclk = sysclk;
     stm32l0_system_device.hclk = hclk;
     stm32l0_system_device.pclk1 = pclk1;
@@ -1115,8 +1263,17 @@ bool stm32l0_system_sysclk_configure(uint32_t hclk, uint32_t pclk1, uint32_t pcl
     stm32l0_system_device.pllsys = pllsys;
     stm32l0_system_device.busspre = busspre;
 
+    frequency = stm32l0_system_frequency_entry(hclk);
+
+    if (frequency)
+    {
+        frequency->count++;
+    }
+
     stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_CLOCKS);
 
+    stm32l0_system_device.sysclk_busy = false;
+
     __set_PRIMASK(primask);
 
     return true;
@@ -1552,9 +1709,16 @@ void stm32l0_system_unlock(uint32_t lock)
     __armv6m_atomic_decb(&stm32l0_system_device.lock[lock]);
 }
 
+static void stm32l0_system_governor_update(bool idle);
+
 void stm32l0_system_reference(uint32_t reference)
 {
     __armv6m_atomic_or(&stm32l0_system_device.reference, reference);
+
+    if (reference & STM32L0_SYSTEM_REFERENCE_PERFORMANCE)
+    {
+        stm32l0_system_governor_update(false);
+    }
 }
 
 void stm32l0_system_unreference(uint32_t reference)
@@ -1562,223 +1726,496 @@ void stm32l0_system_unreference(uint32_t reference)
     __armv6m_atomic_and(&stm32l0_system_device.reference, ~reference);
 }
 
-void stm32l0_system_sleep(uint32_t policy, uint32_t mask, uint32_t timeout)
+/* Residency is accounted on every mode transition in stm32l0_system_idle(),
+ * which only ever runs in thread mode. Time spent in interrupt handlers after
+ * a SLEEP/STOP wakeup counts as RUN, while handlers executing during a WFE are
+ * part of IDLE.
+ */
+static uint64_t stm32l0_system_profile_update(uint32_t mode)
 {
-    uint32_t primask, rcc_cfgr;
-    stm32l0_gpio_stop_state_t gpio_stop_state;
+    uint64_t clock, elapsed;
 
-    if (timeout != STM32L0_SYSTEM_TIMEOUT_NONE)
+    clock = stm32l0_rtc_clock_read();
+
+    elapsed = clock - stm32l0_system_device.profile_clock;
+
+    stm32l0_system_device.profile_clock = clock;
+    stm32l0_system_device.profile.residency[mode] += elapsed;
+
+    return elapsed;
+}
+
+static void stm32l0_system_profile_wakeup(void)
+{
+    uint32_t mask, index;
+
+    mask = NVIC->ISPR[0] & NVIC->ISER[0];
+
+    while (mask)
     {
-        if (!(stm32l0_system_device.events & mask))
+        index = __builtin_ctz(mask);
+
+        mask &= ~(1ul << index);
+
+        stm32l0_system_device.profile.wakeup[index]++;
+    }
+}
+
+/* Frequency residency is accounted by stm32l0_system_sysclk_configure() with
+ * interrupts disabled, independent of the sleep mode. Only the first
+ * STM32L0_SYSTEM_FREQUENCY_COUNT distinct HCLK values are tracked.
+ */
+static stm32l0_system_frequency_t *stm32l0_system_frequency_entry(uint32_t hclk)
+{
+    stm32l0_system_frequency_t *frequency;
+    uint32_t index;
+
+    for (index = 0; index < STM32L0_SYSTEM_FREQUENCY_COUNT; index++)
+    {
+        frequency = &stm32l0_system_device.profile.frequency[index];
+
+        if (frequency->hclk == 0)
         {
-            if (timeout != STM32L0_SYSTEM_TIMEOUT_FOREVER)
+            frequency->hclk = hclk;
+        }
+
+        if (frequency->hclk == hclk)
+        {
+            return frequency;
+        }
+    }
+
+    return NULL;
+}
+
+static void stm32l0_system_frequency_update(void)
+{
+    stm32l0_system_frequency_t *frequency;
+    uint64_t clock;
+
+    clock = stm32l0_rtc_clock_read();
+
+    if (stm32l0_system_device.hclk)
+    {
+        frequency = stm32l0_system_frequency_entry(stm32l0_system_device.hclk);
+
+        if (frequency)
+        {
+            frequency->residency += (clock - stm32l0_system_device.frequency_clock);
+        }
+    }
+
+    stm32l0_system_device.frequency_clock = clock;
+}
+
+void stm32l0_system_profile(stm32l0_system_profile_t *p_profile_return)
+{
+    uint32_t primask;
+
+    stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_RUN);
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    stm32l0_system_frequency_update();
+
+    *p_profile_return = stm32l0_system_device.profile;
+
+    __set_PRIMASK(primask);
+}
+
+void stm32l0_system_profile_reset(void)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    stm32l0_system_device.profile_clock = stm32l0_rtc_clock_read();
+    stm32l0_system_device.frequency_clock = stm32l0_system_device.profile_clock;
+
+    memset(&stm32l0_system_device.profile, 0, sizeof(stm32l0_system_profile_t));
+
+    __set_PRIMASK(primask);
+}
+
+/* The governor switches to "hclk_high" as soon as work gets queued or a
+ * STM32L0_SYSTEM_REFERENCE_PERFORMANCE is taken, and drops back to "hclk_low"
+ * only once stm32l0_system_idle() finds nothing else to do. Peripherals are
+ * re-timed via STM32L0_SYSTEM_NOTIFY_CLOCKS. A switch is skipped (and retried
+ * on the next idle) while STM32L0_SYSTEM_LOCK_RUN is held, as a transfer may
+ * be in progress.
+ *
+ * Switches are only done in thread mode, so that the notify callbacks never
+ * run from PendSV or an interrupt handler. There a switch to "hclk_high" is
+ * only recorded in "governor_pending", which keeps stm32l0_system_idle() from
+ * going to sleep until it has picked it up. A switch down simply waits for
+ * the next idle.
+ */
+static void stm32l0_system_governor_update(bool idle)
+{
+    uint32_t primask, level;
+
+    if (stm32l0_system_device.governor_high)
+    {
+        /* stm32l0_system_sysclk_configure() is called with interrupts enabled,
+         * so that they are not held off while the oscillators settle. If an
+         * interrupt updates the governor in between, the level is simply
+         * re-evaluated after the switch.
+         */
+        while (1)
+        {
+            primask = __get_PRIMASK();
+
+            __disable_irq();
+
+            if (armv6m_work_is_busy() || (stm32l0_system_device.reference & STM32L0_SYSTEM_REFERENCE_PERFORMANCE))
             {
-                mask |= STM32L0_SYSTEM_EVENT_TIMEOUT;
+                level = STM32L0_SYSTEM_GOVERNOR_LEVEL_HIGH;
+            }
+            else
+            {
+                level = idle ? STM32L0_SYSTEM_GOVERNOR_LEVEL_LOW : stm32l0_system_device.governor_level;
+            }
 
-                if (stm32l0_system_device.timeout.callback == NULL)
+            __set_PRIMASK(primask);
+
+            if (stm32l0_system_device.governor_level == level)
+            {
+                break;
+            }
+
+            if (__get_IPSR())
+            {
+                if (level == STM32L0_SYSTEM_GOVERNOR_LEVEL_HIGH)
                 {
-                    stm32l0_rtc_timer_create(&stm32l0_system_device.timeout, (stm32l0_rtc_timer_callback_t)stm32l0_system_wakeup, (void*)STM32L0_SYSTEM_EVENT_TIMEOUT);
+                    stm32l0_system_device.governor_pending = true;
+
+                    __SEV();
                 }
-                
-                stm32l0_rtc_timer_start(&stm32l0_system_device.timeout, stm32l0_rtc_millis_to_clock(timeout), STM32L0_RTC_TIMER_MODE_RELATIVE);
+
+                break;
             }
 
-            if (!(stm32l0_system_device.events & mask))
+            stm32l0_system_device.governor_pending = false;
+
+            if (!stm32l0_system_sysclk_configure(((level == STM32L0_SYSTEM_GOVERNOR_LEVEL_HIGH) ? stm32l0_system_device.governor_high : stm32l0_system_device.governor_low), 0, 0))
             {
-                if (policy >= STM32L0_SYSTEM_POLICY_SLEEP)
+                break;
+            }
+
+            stm32l0_system_device.governor_level = level;
+        }
+    }
+}
+
+static void stm32l0_system_governor_notify(bool busy)
+{
+    if (busy)
+    {
+        stm32l0_system_governor_update(false);
+    }
+}
+
+void stm32l0_system_governor(uint32_t hclk_low, uint32_t hclk_high)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    stm32l0_system_device.governor_low = hclk_low;
+    stm32l0_system_device.governor_high = hclk_high;
+    stm32l0_system_device.governor_level = STM32L0_SYSTEM_GOVERNOR_LEVEL_NONE;
+
+    armv6m_work_notify(hclk_high ? stm32l0_system_governor_notify : NULL);
+
+    __set_PRIMASK(primask);
+
+    stm32l0_system_governor_update(false);
+}
+
+/* Idle routine of armv6m_task_sleep(). It is only called once all tasks are
+ * parked, and only on the main task (or in handler mode), so that
+ * STM32L0_SYSTEM_NOTIFY_SLEEP does not power down a device another task is
+ * about to use.
+ */
+static void stm32l0_system_idle(uint32_t policy)
+{
+    uint32_t primask, rcc_cfgr;
+    uint64_t elapsed;
+    stm32l0_gpio_stop_state_t gpio_stop_state;
+
+    if (policy >= STM32L0_SYSTEM_POLICY_SLEEP)
+    {
+        stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_SLEEP);
+    }
+
+    stm32l0_system_governor_update(true);
+
+    if ((policy <= STM32L0_SYSTEM_POLICY_RUN) || stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_RUN])
+    {
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_SLEEP_ENTER, STM32L0_SYSTEM_POLICY_RUN, 0);
+
+        stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_RUN);
+
+        __WFE();
+
+        elapsed = stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_IDLE);
+
+        if (policy > STM32L0_SYSTEM_POLICY_RUN)
+        {
+            stm32l0_system_device.profile.blocked[STM32L0_SYSTEM_LOCK_RUN] += elapsed;
+        }
+
+        ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_SLEEP_LEAVE, STM32L0_SYSTEM_POLICY_RUN, 0);
+    }
+    else
+    {
+        primask = __get_PRIMASK();
+
+        __disable_irq();
+
+        /* A switch to "hclk_high" recorded by an interrupt handler since the
+         * governor update above needs another pass in thread mode first.
+         */
+        if (!stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_RUN] && (!stm32l0_system_device.governor_pending || __get_IPSR()))
+        {
+            if ((policy <= STM32L0_SYSTEM_POLICY_SLEEP) || stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_SLEEP])
+            {
+                ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_SLEEP_ENTER, STM32L0_SYSTEM_POLICY_SLEEP, 0);
+
+                stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_RUN);
+
+                if (stm32l0_system_device.reference & STM32L0_SYSTEM_REFERENCE_SWD)
                 {
-                    stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_SLEEP);
+                    __WFI();
+                }
+                else
+                {
+                    __stm32l0_dma_sleep_enter();
+
+                    rcc_cfgr = RCC->CFGR;                                   
+
+                    RCC->CFGR = (rcc_cfgr & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2)) | stm32l0_system_device.busspre;
+                    __DSB();
+                    __NOP();
+                    __NOP();
+                    __NOP();
+                    __NOP();
+
+                    __WFI();
+                    __NOP();
+                    __NOP();
+                    __NOP();
+                    __NOP();
+
+                    RCC->CFGR = rcc_cfgr;
+                    __DSB();
+                    __NOP();
+                    __NOP();
+                    __NOP();
+                    __NOP();
+                    
+                    __stm32l0_dma_sleep_leave();
                 }
 
-                while (!(stm32l0_system_device.events & mask))
+                elapsed = stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_SLEEP);
+
+                if (policy > STM32L0_SYSTEM_POLICY_SLEEP)
                 {
-                    if ((policy <= STM32L0_SYSTEM_POLICY_RUN) || stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_RUN])
-                    {
-                        __WFE();
-                    }
-                    else
-                    {
-                        primask = __get_PRIMASK();
+                    stm32l0_system_device.profile.blocked[STM32L0_SYSTEM_LOCK_SLEEP] += elapsed;
+                }
+
+                stm32l0_system_profile_wakeup();
 
-                        __disable_irq();
+                ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_SLEEP_LEAVE, STM32L0_SYSTEM_POLICY_SLEEP, 0);
+            }
+            else
+            {
+                if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
+                {
+                    stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_STOP_ENTER);
 
-                        if (!stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_RUN])
+                    if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
+                    {
+                        __stm32l0_exti_stop_enter();
+                        __stm32l0_gpio_stop_enter(&gpio_stop_state);
+
+                        if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
                         {
-                            if ((policy <= STM32L0_SYSTEM_POLICY_SLEEP) || stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_SLEEP])
+                            RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+
+                            if (stm32l0_system_device.hsi48)
+                            {
+                                CRS->CR &= ~(CRS_CR_AUTOTRIMEN | CRS_CR_CEN);
+
+                                RCC->CRRCR &= ~RCC_CRRCR_HSI48ON;
+                            }
+
+                            /* The lowpower voltage regulator adds 3.3uS wakeup time, plus it prevents HSIKERON, 
+                             * which may be needed by USART1/USART2/LPUART to wakeup. In those cases do not
+                             * enable the low power voltage regulator in stop mode.
+                             */
+                            if (!stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_REGULATOR])
+                            {
+                                PWR->CR |= PWR_CR_LPSDSR;
+                            }
+    
+                            if (!stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_VREFINT])
                             {
+                                /* Set ULP to disable VREFINT */
+                                SYSCFG->CFGR3 &= ~SYSCFG_CFGR3_EN_VREFINT;
+        
+                                PWR->CR |= (PWR_CR_FWU | PWR_CR_ULP);
+                            }
+
+                            /* Clear WUF flag */
+                            PWR->CR |= PWR_CR_CWUF;
+    
+                            /* Select STOP */
+                            PWR->CR &= ~PWR_CR_PDDS;
+
+                            if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
+                            {
+                                ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_SLEEP_ENTER, STM32L0_SYSTEM_POLICY_DEEPSLEEP, 0);
+
+                                stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_RUN);
+
+                                SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+
                                 if (stm32l0_system_device.reference & STM32L0_SYSTEM_REFERENCE_SWD)
                                 {
                                     __WFI();
                                 }
                                 else
                                 {
-                                    __stm32l0_dma_sleep_enter();
-
-                                    rcc_cfgr = RCC->CFGR;                                   
-
-                                    RCC->CFGR = (rcc_cfgr & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2)) | stm32l0_system_device.busspre;
-                                    __DSB();
-                                    __NOP();
-                                    __NOP();
-                                    __NOP();
-                                    __NOP();
-
+                                    FLASH->ACR |= FLASH_ACR_SLEEP_PD;
+        
                                     __WFI();
                                     __NOP();
                                     __NOP();
                                     __NOP();
                                     __NOP();
+        
+                                    FLASH->ACR &= ~FLASH_ACR_SLEEP_PD;
+                                }
 
-                                    RCC->CFGR = rcc_cfgr;
-                                    __DSB();
-                                    __NOP();
-                                    __NOP();
-                                    __NOP();
-                                    __NOP();
-                                    
-                                    __stm32l0_dma_sleep_leave();
+                                SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+                                elapsed = stm32l0_system_profile_update(STM32L0_SYSTEM_MODE_STOP);
+
+                                if (stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_REGULATOR])
+                                {
+                                    stm32l0_system_device.profile.blocked[STM32L0_SYSTEM_LOCK_REGULATOR] += elapsed;
                                 }
-                            }
-                            else
-                            {
-                                if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
+
+                                if (stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_VREFINT])
                                 {
-                                    stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_STOP_ENTER);
+                                    stm32l0_system_device.profile.blocked[STM32L0_SYSTEM_LOCK_VREFINT] += elapsed;
+                                }
 
-                                    if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
-                                    {
-                                        __stm32l0_exti_stop_enter();
-                                        __stm32l0_gpio_stop_enter(&gpio_stop_state);
+                                stm32l0_system_profile_wakeup();
 
-                                        if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
-                                        {
-                                            RCC->APB1ENR |= RCC_APB1ENR_PWREN;
-
-                                            if (stm32l0_system_device.hsi48)
-                                            {
-                                                CRS->CR &= ~(CRS_CR_AUTOTRIMEN | CRS_CR_CEN);
-
-                                                RCC->CRRCR &= ~RCC_CRRCR_HSI48ON;
-                                            }
-
-                                            /* The lowpower voltage regulator adds 3.3uS wakeup time, plus it prevents HSIKERON, 
-                                             * which may be needed by USART1/USART2/LPUART to wakeup. In those cases do not
-                                             * enable the low power voltage regulator in stop mode.
-                                             */
-                                            if (!stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_REGULATOR])
-                                            {
-                                                PWR->CR |= PWR_CR_LPSDSR;
-                                            }
-                    
-                                            if (!stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_VREFINT])
-                                            {
-                                                /* Set ULP to disable VREFINT */
-                                                SYSCFG->CFGR3 &= ~SYSCFG_CFGR3_EN_VREFINT;
-                        
-                                                PWR->CR |= (PWR_CR_FWU | PWR_CR_ULP);
-                                            }
+                                ARMV6M_TRACE_EVENT(ARMV6M_TRACE_TYPE_SLEEP_LEAVE, STM32L0_SYSTEM_POLICY_DEEPSLEEP, 0);
+                                
+                                /* Clear ULP to enable VREFINT, disable lowpower voltage regulator */
+                                PWR->CR &= ~(PWR_CR_FWU | PWR_CR_ULP | PWR_CR_LPSDSR);
 
-                                            /* Clear WUF flag */
-                                            PWR->CR |= PWR_CR_CWUF;
-                    
-                                            /* Select STOP */
-                                            PWR->CR &= ~PWR_CR_PDDS;
-
-                                            if (!(SCB->ICSR & SCB_ICSR_ISRPENDING_Msk))
-                                            {
-                                                SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
-
-                                                if (stm32l0_system_device.reference & STM32L0_SYSTEM_REFERENCE_SWD)
-                                                {
-                                                    __WFI();
-                                                }
-                                                else
-                                                {
-                                                    FLASH->ACR |= FLASH_ACR_SLEEP_PD;
-                        
-                                                    __WFI();
-                                                    __NOP();
-                                                    __NOP();
-                                                    __NOP();
-                                                    __NOP();
-                        
-                                                    FLASH->ACR &= ~FLASH_ACR_SLEEP_PD;
-                                                }
-
-                                                SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
-                                                
-                                                /* Clear ULP to enable VREFINT, disable lowpower voltage regulator */
-                                                PWR->CR &= ~(PWR_CR_FWU | PWR_CR_ULP | PWR_CR_LPSDSR);
-
-                                                if (stm32l0_system_device.hse)
-                                                {
-                                                    if (stm32l0_system_device.options & STM32L0_SYSTEM_OPTION_HSE_BYPASS)
-                                                    {
-                                                        RCC->CR |= RCC_CR_HSEBYP;
-                                                    }
-                                                    else
-                                                    {
-                                                        RCC->CR |= RCC_CR_HSEON;
-                                                        
-                                                        while (!(RCC->CR & RCC_CR_HSERDY))
-                                                        {
-                                                        }
-                                                    }
-                                                }
-
-                                                if (stm32l0_system_device.pllsys)
-                                                {
-                                                    RCC->CR |= RCC_CR_PLLON;
-                                                        
-                                                    while (!(RCC->CR & RCC_CR_PLLRDY))
-                                                    {
-                                                    }
-                                                    
-                                                    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
-                                                    
-                                                    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
-                                                    {
-                                                    }
-                                                }
-                                            }
-                                            else
-                                            {
-                                                /* Clear ULP to enable VREFINT, disable lowpower voltage regulator */
-                                                PWR->CR &= ~(PWR_CR_FWU | PWR_CR_ULP | PWR_CR_LPSDSR);
-                                            }
-                                            
-                                            if (!stm32l0_system_device.hsi16)
-                                            {
-                                                RCC->CR &= ~RCC_CR_HSION;
-                                            }
-                                            
-                                            if (stm32l0_system_device.hsi48)
-                                            {
-                                                RCC->CRRCR |= RCC_CRRCR_HSI48ON;
-
-                                                while(!(RCC->CRRCR & RCC_CRRCR_HSI48RDY))
-                                                {
-                                                }
-                                                
-                                                CRS->CR |= (CRS_CR_AUTOTRIMEN | CRS_CR_CEN);
-                                            }
-                                            
-                                            RCC->APB1ENR &= ~RCC_APB1ENR_PWREN;
+                                if (stm32l0_system_device.hse)
+                                {
+                                    if (stm32l0_system_device.options & STM32L0_SYSTEM_OPTION_HSE_BYPASS)
+                                    {
+                                        RCC->CR |= RCC_CR_HSEBYP;
+                                    }
+                                    else
+                                    {
+                                        RCC->CR |= RCC_CR_HSEON;
+                                        
+                                        while (!(RCC->CR & RCC_CR_HSERDY))
+                                        {
                                         }
+                                    }
+                                }
+
+                                if (stm32l0_system_device.pllsys)
+                                {
+                                    RCC->CR |= RCC_CR_PLLON;
                                         
-                                        __stm32l0_gpio_stop_leave(&gpio_stop_state);
-                                        __stm32l0_exti_stop_leave();
+                                    while (!(RCC->CR & RCC_CR_PLLRDY))
+                                    {
                                     }
                                     
-                                    stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_STOP_LEAVE);
+                                    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+                                    
+                                    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
+                                    {
+                                    }
                                 }
                             }
+                            else
+                            {
+                                /* Clear ULP to enable VREFINT, disable lowpower voltage regulator */
+                                PWR->CR &= ~(PWR_CR_FWU | PWR_CR_ULP | PWR_CR_LPSDSR);
+                            }
+                            
+                            if (!stm32l0_system_device.hsi16)
+                            {
+                                RCC->CR &= ~RCC_CR_HSION;
+                            }
+                            
+                            if (stm32l0_system_device.hsi48)
+                            {
+                                RCC->CRRCR |= RCC_CRRCR_HSI48ON;
+
+                                while(!(RCC->CRRCR & RCC_CRRCR_HSI48RDY))
+                                {
+                                }
+                                
+                                CRS->CR |= (CRS_CR_AUTOTRIMEN | CRS_CR_CEN);
+                            }
+                            
+                            RCC->APB1ENR &= ~RCC_APB1ENR_PWREN;
                         }
                         
-                        __set_PRIMASK(primask);
+                        __stm32l0_gpio_stop_leave(&gpio_stop_state);
+                        __stm32l0_exti_stop_leave();
                     }
+                    
+                    stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_STOP_LEAVE);
                 }
             }
+        }
+        
+        __set_PRIMASK(primask);
+    }
+}
+
+void stm32l0_system_sleep(uint32_t policy, uint32_t mask, uint32_t timeout)
+{
+    if (timeout != STM32L0_SYSTEM_TIMEOUT_NONE)
+    {
+        if (!(stm32l0_system_device.events & mask))
+        {
+            if (timeout != STM32L0_SYSTEM_TIMEOUT_FOREVER)
+            {
+                mask |= STM32L0_SYSTEM_EVENT_TIMEOUT;
+
+                if (stm32l0_system_device.timeout.callback == NULL)
+                {
+                    stm32l0_rtc_timer_create(&stm32l0_system_device.timeout, (stm32l0_rtc_timer_callback_t)stm32l0_system_wakeup, (void*)STM32L0_SYSTEM_EVENT_TIMEOUT);
+                }
+                
+                stm32l0_rtc_timer_start(&stm32l0_system_device.timeout, stm32l0_rtc_millis_to_clock(timeout), STM32L0_RTC_TIMER_MODE_RELATIVE);
+            }
+
+            while (!(stm32l0_system_device.events & mask))
+            {
+                armv6m_task_sleep(policy);
+            }
             
             if (timeout != STM32L0_SYSTEM_TIMEOUT_FOREVER)
             {
@@ -1936,6 +2373,62 @@ void stm32l0_system_dfu(void)
     }
 }
 
+void stm32l0_system_swap(void)
+{
+#if defined(FLASH_OPTR_BFB2)
+    uint32_t user;
+#endif /* defined(FLASH_OPTR_BFB2) */
+
+    while (stm32l0_system_device.lock[STM32L0_SYSTEM_LOCK_EEPROM])
+    {
+        __WFE();
+    }
+
+    __disable_irq();
+
+    stm32l0_system_notify(STM32L0_SYSTEM_NOTIFY_RESET);
+
+    stm32l0_rtc_reset();
+
+#if defined(FLASH_OPTR_BFB2)
+    /* Toggle BFB2. With BFB2 set the ROM bootloader starts bank 2 and maps
+     * it to FLASH_BASE (SYSCFG_CFGR1_UFB), otherwise bank 1 starts. Either
+     * way the inactive bank becomes the active one. Launching the option
+     * byte reload resets the system.
+     */
+    if (FLASH->PECR & FLASH_PECR_PELOCK)
+    {
+        FLASH->PEKEYR = 0x89abcdef;
+        FLASH->PEKEYR = 0x02030405;
+    }
+
+    if (FLASH->PECR & FLASH_PECR_OPTLOCK)
+    {
+        FLASH->OPTKEYR = 0xfbead9c8;
+        FLASH->OPTKEYR = 0x24252627;
+    }
+
+    if (!(FLASH->PECR & FLASH_PECR_OPTLOCK))
+    {
+        user = ((FLASH->OPTR >> 16) ^ (FLASH_OPTR_BFB2 >> 16)) & 0x0000ffff;
+
+        OB->USER = (user | (~user << 16));
+
+        while (FLASH->SR & FLASH_SR_BSY)
+        {
+        }
+
+        FLASH->PECR |= FLASH_PECR_OBL_LAUNCH;
+    }
+#endif /* defined(FLASH_OPTR_BFB2) */
+
+    NVIC_SystemReset();
+    
+    while (1)
+    {
+    }
+}
+
 static void __empty() { }
 
 void __stm32l0_lptim_initialize(void) __attribute__ ((weak, alias("__empty")));
@@ -30,6 +30,7 @@
 #include "stm32l0xx.h"
 
 #include "stm32l0_timer.h"
+#include "stm32l0_dma.h"
 #include "stm32l0_system.h"
 
 extern void TIM2_IRQHandler(void);
@@ -75,6 +76,29 @@ static const IRQn_Type stm32l0_timer_xlate_IRQn[STM32L0_TIMER_INSTANCE_COUNT] =
     TIM22_IRQn,
 };
 
+/* TIM6/TIM7 have no capture channels, TIM21/TIM22 and TIM3_CH2 no DMA request.
+ */
+static const uint16_t stm32l0_timer_xlate_DMA[STM32L0_TIMER_INSTANCE_COUNT][4] = {
+    { STM32L0_DMA_CHANNEL_DMA1_CH5_TIM2_CH1, STM32L0_DMA_CHANNEL_DMA1_CH3_TIM2_CH2, STM32L0_DMA_CHANNEL_DMA1_CH1_TIM2_CH3, STM32L0_DMA_CHANNEL_DMA1_CH4_TIM2_CH4 },
+#if defined(STM32L072xx) || defined(STM32L082xx)
+    { STM32L0_DMA_CHANNEL_DMA1_CH5_TIM3_CH1, STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_DMA1_CH2_TIM3_CH3, STM32L0_DMA_CHANNEL_DMA1_CH3_TIM3_CH4 },
+#endif /* STM32L072xx || STM32L082xx */
+    { STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE              },
+#if defined(STM32L072xx) || defined(STM32L082xx)
+    { STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE              },
+#endif /* STM32L072xx || STM32L082xx */
+    { STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE              },
+    { STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE,              STM32L0_DMA_CHANNEL_NONE              },
+};
+
+#define STM32L0_TIMER_DMA_OPTION_CAPTURE            \
+    (STM32L0_DMA_OPTION_EVENT_TRANSFER_DONE |       \
+     STM32L0_DMA_OPTION_PERIPHERAL_TO_MEMORY |      \
+     STM32L0_DMA_OPTION_PERIPHERAL_DATA_SIZE_32 |   \
+     STM32L0_DMA_OPTION_MEMORY_DATA_SIZE_16 |       \
+     STM32L0_DMA_OPTION_MEMORY_DATA_INCREMENT |     \
+     STM32L0_DMA_OPTION_PRIORITY_HIGH)
+
 static void stm32l0_timer_interrupt(stm32l0_timer_t *timer)
 {
     TIM_TypeDef *TIM = timer->TIM;
@@ -84,10 +108,27 @@ static void stm32l0_timer_interrupt(stm32l0_timer_t *timer)
 
     tim_sr = TIM->SR;
 
-    TIM->SR = 0;
+    /* Only clear the flags seen here, so that a capture that happens
+     * right now is not lost.
+     */
+    TIM->SR = ~tim_sr;
 
     if (timer)
     {
+        if (timer->capture_data && (timer->capture_dma == STM32L0_DMA_CHANNEL_NONE) && (tim_sr & (TIM_SR_CC1IF << timer->capture_channel)))
+        {
+            timer->capture_data[timer->capture_count++] = (&TIM->CCR1)[timer->capture_channel];
+
+            if (timer->capture_count == timer->capture_size)
+            {
+                armv6m_atomic_and(&TIM->DIER, ~(TIM_DIER_CC1IE << timer->capture_channel));
+
+                timer->capture_data = NULL;
+
+                events |= STM32L0_TIMER_EVENT_CAPTURE_DONE;
+            }
+        }
+
         if (tim_sr & TIM_SR_UIF)
         {
             events |= STM32L0_TIMER_EVENT_PERIOD;
@@ -136,6 +177,8 @@ bool stm32l0_timer_create(stm32l0_timer_t *timer, unsigned int instance, unsigne
     timer->instance = instance;
     timer->interrupt = stm32l0_timer_xlate_IRQn[instance];
     timer->priority = priority;
+    timer->capture_dma = STM32L0_DMA_CHANNEL_NONE;
+    timer->capture_data = NULL;
 
     stm32l0_timer_device.instances[timer->instance] = timer;
 
@@ -352,9 +395,14 @@ bool stm32l0_timer_start(stm32l0_timer_t *timer, uint32_t period, bool oneshot)
         armv6m_atomic_and(&TIM->CR1, ~TIM_CR1_CEN);
     }
 
-    TIM->SR = 0;
     TIM->ARR = period;
 
+    /* PSC (and ARR with ARPE) only get taken over at an update event, so
+     * generate one to start out with them from 0.
+     */
+    TIM->EGR = TIM_EGR_UG;
+    TIM->SR = 0;
+
     if (oneshot)
     {
         armv6m_atomic_or(&TIM->CR1, (TIM_CR1_OPM | TIM_CR1_CEN));
@@ -558,6 +606,123 @@ uint32_t stm32l0_timer_capture(stm32l0_timer_t *timer, unsigned int channel)
     }
 }
 
+static void stm32l0_timer_dma_callback(void *context, uint32_t events)
+{
+    stm32l0_timer_t *timer = (stm32l0_timer_t*)context;
+    TIM_TypeDef *TIM = timer->TIM;
+
+    armv6m_atomic_and(&TIM->DIER, ~(TIM_DIER_CC1DE << timer->capture_channel));
+
+    timer->capture_count = stm32l0_dma_stop(timer->capture_dma);
+
+    stm32l0_dma_disable(timer->capture_dma);
+
+    timer->capture_dma = STM32L0_DMA_CHANNEL_NONE;
+    timer->capture_data = NULL;
+
+    if (timer->events & STM32L0_TIMER_EVENT_CAPTURE_DONE)
+    {
+        (*timer->callback)(timer->context, STM32L0_TIMER_EVENT_CAPTURE_DONE);
+    }
+}
+
+bool stm32l0_timer_capture_stream(stm32l0_timer_t *timer, unsigned int channel, uint16_t *data, uint32_t count, uint32_t control)
+{
+    TIM_TypeDef *TIM = timer->TIM;
+    uint16_t dma;
+
+    if ((timer->state != STM32L0_TIMER_STATE_ACTIVE) || timer->capture_data || (channel > STM32L0_TIMER_CHANNEL_4))
+    {
+        return false;
+    }
+
+    if (!(control & STM32L0_TIMER_CONTROL_CAPTURE_MASK) || (count == 0) || (count > 65535))
+    {
+        return false;
+    }
+
+    dma = stm32l0_timer_xlate_DMA[timer->instance][channel];
+
+    /* If the DMA channel is taken (TIM2_CH3 shares it with the ADC), fall
+     * back to the capture interrupt.
+     */
+    if ((dma != STM32L0_DMA_CHANNEL_NONE) && !stm32l0_dma_enable(dma, stm32l0_timer_dma_callback, timer))
+    {
+        dma = STM32L0_DMA_CHANNEL_NONE;
+    }
+
+    timer->capture_dma = dma;
+    timer->capture_channel = channel;
+    timer->capture_size = count;
+    timer->capture_count = 0;
+    timer->capture_data = data;
+
+    if (dma != STM32L0_DMA_CHANNEL_NONE)
+    {
+        stm32l0_dma_start(dma, (uint32_t)data, (uint32_t)(&TIM->CCR1 + channel), count, STM32L0_TIMER_DMA_OPTION_CAPTURE);
+
+        stm32l0_timer_channel(timer, channel, 0, control);
+
+        armv6m_atomic_or(&TIM->DIER, (TIM_DIER_CC1DE << channel));
+    }
+    else
+    {
+        stm32l0_timer_channel(timer, channel, 0, control);
+
+        armv6m_atomic_or(&TIM->DIER, (TIM_DIER_CC1IE << channel));
+    }
+
+    return true;
+}
+
+uint32_t stm32l0_timer_capture_count(stm32l0_timer_t *timer)
+{
+    uint16_t dma;
+
+    dma = timer->capture_dma;
+
+    if (timer->capture_data && (dma != STM32L0_DMA_CHANNEL_NONE))
+    {
+        return stm32l0_dma_count(dma);
+    }
+
+    return timer->capture_count;
+}
+
+uint32_t stm32l0_timer_capture_cancel(stm32l0_timer_t *timer)
+{
+    TIM_TypeDef *TIM = timer->TIM;
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if (timer->capture_data)
+    {
+        if (timer->capture_dma != STM32L0_DMA_CHANNEL_NONE)
+        {
+            armv6m_atomic_and(&TIM->DIER, ~(TIM_DIER_CC1DE << timer->capture_channel));
+
+            timer->capture_count = stm32l0_dma_stop(timer->capture_dma);
+
+            stm32l0_dma_disable(timer->capture_dma);
+
+            timer->capture_dma = STM32L0_DMA_CHANNEL_NONE;
+        }
+        else
+        {
+            armv6m_atomic_and(&TIM->DIER, ~(TIM_DIER_CC1IE << timer->capture_channel));
+        }
+
+        timer->capture_data = NULL;
+    }
+
+    __set_PRIMASK(primask);
+
+    return timer->capture_count;
+}
+
 void TIM2_IRQHandler(void)
 {
     stm32l0_timer_interrupt(stm32l0_timer_device.instances[STM32L0_TIMER_INSTANCE_TIM2]);
@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+
+#include "stm32l0_timestamp.h"
+#include "stm32l0_rtc.h"
+#include "stm32l0_system.h"
+
+/* The timeline is "base" plus the SysTick nanoseconds elapsed since "anchor",
+ * corrected by "rate" (in units of 2^-32). A new anchor is taken at least
+ * once per second on read, whenever the rate changes, and across STOP and
+ * clock changes. While in STOP SysTick is halted, so the time spent there is
+ * taken from the RTC.
+ *
+ * MSI and HSI16 (which also feeds the PLL) have different errors, so there is
+ * one rate per clock source. Without PPS each rate is calibrated against the
+ * RTC over STM32L0_TIMESTAMP_WINDOW_TICKS of running time on that source,
+ * collected in segments between STOP and clock changes. As the RTC only has a
+ * resolution of 1/STM32L0_RTC_CLOCK_TICKS_PER_SECOND, every segment adds
+ * quantization noise: long segments converge to some 10ppm, frequent STOP or
+ * clock changes to some 100ppm. A PPS measures the rate with SysTick
+ * resolution instead.
+ *
+ * extras/timestamp_test.py in the STM32L0 library runs this file and
+ * armv6m_systick.c on the host.
+ */
+
+#define STM32L0_TIMESTAMP_ANCHOR_NANOS      STM32L0_TIMESTAMP_NANOS_PER_SECOND
+#define STM32L0_TIMESTAMP_WINDOW_TICKS      (16 * STM32L0_RTC_CLOCK_TICKS_PER_SECOND)
+#define STM32L0_TIMESTAMP_PPS_LOCK          4
+#define STM32L0_TIMESTAMP_PPS_TOLERANCE     20000000     /* 2% */
+#define STM32L0_TIMESTAMP_RATE_COARSE       4294967      /* 1000ppm in 2^-32 */
+#define STM32L0_TIMESTAMP_RATE_LIMIT        85899345     /* 2% in 2^-32 */
+
+#define STM32L0_TIMESTAMP_SOURCE_MSI        0
+#define STM32L0_TIMESTAMP_SOURCE_HSI16      1
+#define STM32L0_TIMESTAMP_SOURCE_COUNT      2
+
+typedef struct _stm32l0_timestamp_device_t {
+    stm32l0_system_notify_t   notify;
+    uint64_t                  base;
+    uint64_t                  anchor;
+    uint32_t                  source;
+    int32_t                   rate[STM32L0_TIMESTAMP_SOURCE_COUNT];
+    uint64_t                  last;
+    uint64_t                  stop_clock;
+    uint64_t                  stop_base;
+    uint64_t                  window_clock;
+    uint64_t                  window_base;
+    uint32_t                  window_ticks[STM32L0_TIMESTAMP_SOURCE_COUNT];
+    uint64_t                  window_nanos[STM32L0_TIMESTAMP_SOURCE_COUNT];
+    uint64_t                  pps_timestamp;
+    uint64_t                  pps_clock;
+    uint32_t                  pps_count;
+} stm32l0_timestamp_device_t;
+
+static stm32l0_timestamp_device_t stm32l0_timestamp_device;
+
+static uint64_t stm32l0_timestamp_clock_to_nanos(uint64_t clock)
+{
+    uint32_t seconds, ticks;
+
+    seconds = clock / STM32L0_RTC_CLOCK_TICKS_PER_SECOND;
+    ticks = clock & (STM32L0_RTC_CLOCK_TICKS_PER_SECOND -1);
+
+    return ((uint64_t)seconds * STM32L0_TIMESTAMP_NANOS_PER_SECOND) + (((uint64_t)ticks * STM32L0_TIMESTAMP_NANOS_PER_SECOND) / STM32L0_RTC_CLOCK_TICKS_PER_SECOND);
+}
+
+static uint64_t stm32l0_timestamp_project(uint64_t nanos)
+{
+    uint64_t elapsed;
+
+    elapsed = nanos - stm32l0_timestamp_device.anchor;
+
+    /* Dropping 16 bits of "elapsed" keeps the product within 64 bits for hours
+     * between anchors, while losing less than 1ns at a 2% correction.
+     */
+    return stm32l0_timestamp_device.base + elapsed + (((int64_t)(elapsed >> 16) * stm32l0_timestamp_device.rate[stm32l0_timestamp_device.source]) >> 16);
+}
+
+static uint32_t stm32l0_timestamp_source(void)
+{
+    return ((stm32l0_system_sysclk() <= 4200000) ? STM32L0_TIMESTAMP_SOURCE_MSI : STM32L0_TIMESTAMP_SOURCE_HSI16);
+}
+
+static void stm32l0_timestamp_anchor(uint64_t nanos, uint64_t timestamp)
+{
+    stm32l0_timestamp_device.base = timestamp;
+    stm32l0_timestamp_device.anchor = nanos;
+}
+
+static void stm32l0_timestamp_adjust(uint32_t source, int64_t adjust)
+{
+    int64_t rate;
+
+    rate = (int64_t)stm32l0_timestamp_device.rate[source] - adjust;
+
+    if (rate >  STM32L0_TIMESTAMP_RATE_LIMIT) { rate =  STM32L0_TIMESTAMP_RATE_LIMIT; }
+    if (rate < -STM32L0_TIMESTAMP_RATE_LIMIT) { rate = -STM32L0_TIMESTAMP_RATE_LIMIT; }
+
+    stm32l0_timestamp_device.rate[source] = rate;
+}
+
+static void stm32l0_timestamp_window(uint64_t clock, uint64_t timestamp)
+{
+    stm32l0_timestamp_device.window_clock = clock;
+    stm32l0_timestamp_device.window_base = timestamp;
+}
+
+/* Closes the current segment, and starts a new one at the same point. The
+ * caller has to take a new anchor before, as the rate may change.
+ */
+static void stm32l0_timestamp_segment(uint64_t clock, uint64_t timestamp)
+{
+    uint32_t source, ticks;
+    uint64_t delta;
+    int64_t error, adjust;
+
+    source = stm32l0_timestamp_device.source;
+
+    stm32l0_timestamp_device.window_ticks[source] += (clock - stm32l0_timestamp_device.window_clock);
+    stm32l0_timestamp_device.window_nanos[source] += (timestamp - stm32l0_timestamp_device.window_base);
+
+    stm32l0_timestamp_window(clock, timestamp);
+
+    if (stm32l0_timestamp_device.pps_count)
+    {
+        if ((clock - stm32l0_timestamp_device.pps_clock) > (2 * STM32L0_RTC_CLOCK_TICKS_PER_SECOND))
+        {
+            stm32l0_timestamp_device.pps_count = 0;
+        }
+    }
+
+    ticks = stm32l0_timestamp_device.window_ticks[source];
+
+    if ((stm32l0_timestamp_device.pps_count >= STM32L0_TIMESTAMP_PPS_LOCK) || (ticks >= STM32L0_TIMESTAMP_WINDOW_TICKS))
+    {
+        /* A window that grew too long between segments would overflow
+         * "error << 32", and is simply discarded.
+         */
+        if ((stm32l0_timestamp_device.pps_count < STM32L0_TIMESTAMP_PPS_LOCK) && (ticks <= (4 * STM32L0_TIMESTAMP_WINDOW_TICKS)))
+        {
+            delta = stm32l0_timestamp_clock_to_nanos(ticks);
+
+            error = (int64_t)(stm32l0_timestamp_device.window_nanos[source] - delta);
+
+            adjust = (error << 32) / (int64_t)delta;
+
+            /* Halve the step once close, to average out the RTC quantization.
+             */
+            if ((adjust < STM32L0_TIMESTAMP_RATE_COARSE) && (adjust > -STM32L0_TIMESTAMP_RATE_COARSE))
+            {
+                adjust = adjust / 2;
+            }
+
+            stm32l0_timestamp_adjust(source, adjust);
+        }
+
+        stm32l0_timestamp_device.window_ticks[source] = 0;
+        stm32l0_timestamp_device.window_nanos[source] = 0;
+    }
+}
+
+static void stm32l0_timestamp_notify_callback(void *context, uint32_t notify)
+{
+    uint64_t nanos, clock, timestamp;
+
+    nanos = armv6m_systick_nanos();
+
+    if (notify & STM32L0_SYSTEM_NOTIFY_STOP_ENTER)
+    {
+        stm32l0_timestamp_device.stop_clock = stm32l0_rtc_clock_read();
+        stm32l0_timestamp_device.stop_base = stm32l0_timestamp_project(nanos);
+
+        stm32l0_timestamp_segment(stm32l0_timestamp_device.stop_clock, stm32l0_timestamp_device.stop_base);
+    }
+
+    if (notify & STM32L0_SYSTEM_NOTIFY_STOP_LEAVE)
+    {
+        clock = stm32l0_rtc_clock_read();
+
+        timestamp = stm32l0_timestamp_device.stop_base + stm32l0_timestamp_clock_to_nanos(clock - stm32l0_timestamp_device.stop_clock);
+
+        stm32l0_timestamp_anchor(nanos, timestamp);
+        stm32l0_timestamp_window(clock, timestamp);
+    }
+
+    if (notify & STM32L0_SYSTEM_NOTIFY_CLOCKS)
+    {
+        /* SysTick keeps counting through a clock change, so "nanos" is
+         * continuous. Close the segment of the old source, and continue with
+         * the rate of the new one.
+         */
+        clock = stm32l0_rtc_clock_read();
+
+        timestamp = stm32l0_timestamp_project(nanos);
+
+        stm32l0_timestamp_segment(clock, timestamp);
+
+        stm32l0_timestamp_device.source = stm32l0_timestamp_source();
+
+        stm32l0_timestamp_anchor(nanos, timestamp);
+    }
+}
+
+void __stm32l0_timestamp_initialize(void)
+{
+    uint64_t clock;
+
+    clock = stm32l0_rtc_clock_read();
+
+    stm32l0_timestamp_device.source = stm32l0_timestamp_source();
+    stm32l0_timestamp_device.last = 0;
+    stm32l0_timestamp_device.pps_timestamp = 0;
+    stm32l0_timestamp_device.pps_count = 0;
+
+    stm32l0_timestamp_anchor(armv6m_systick_nanos(), stm32l0_timestamp_clock_to_nanos(clock));
+    stm32l0_timestamp_window(clock, stm32l0_timestamp_device.base);
+
+    stm32l0_system_register(&stm32l0_timestamp_device.notify, stm32l0_timestamp_notify_callback, NULL, (STM32L0_SYSTEM_NOTIFY_CLOCKS | STM32L0_SYSTEM_NOTIFY_STOP_ENTER | STM32L0_SYSTEM_NOTIFY_STOP_LEAVE));
+}
+
+uint64_t stm32l0_timestamp_read(void)
+{
+    uint32_t primask;
+    uint64_t nanos, timestamp;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    nanos = armv6m_systick_nanos();
+
+    timestamp = stm32l0_timestamp_project(nanos);
+
+    if ((nanos - stm32l0_timestamp_device.anchor) >= STM32L0_TIMESTAMP_ANCHOR_NANOS)
+    {
+        stm32l0_timestamp_anchor(nanos, timestamp);
+
+        stm32l0_timestamp_segment(stm32l0_rtc_clock_read(), timestamp);
+    }
+
+    if (timestamp < stm32l0_timestamp_device.last)
+    {
+        timestamp = stm32l0_timestamp_device.last;
+    }
+    else
+    {
+        stm32l0_timestamp_device.last = timestamp;
+    }
+
+    __set_PRIMASK(primask);
+
+    return timestamp;
+}
+
+/* "timestamp" is the stm32l0_timestamp_read() value captured as close to the
+ * PPS edge as possible, typically in the EXTI callback of the PPS pin.
+ */
+void stm32l0_timestamp_pps(uint64_t timestamp)
+{
+    uint32_t primask;
+    uint64_t nanos, clock, interval;
+    int64_t error;
+
+    primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    clock = stm32l0_rtc_clock_read();
+
+    interval = clock - stm32l0_timestamp_device.pps_clock;
+
+    error = (int64_t)(timestamp - stm32l0_timestamp_device.pps_timestamp) - (int64_t)STM32L0_TIMESTAMP_NANOS_PER_SECOND;
+
+    if (stm32l0_timestamp_device.pps_timestamp &&
+        (interval >= (STM32L0_RTC_CLOCK_TICKS_PER_SECOND / 2)) &&
+        (interval <= (STM32L0_RTC_CLOCK_TICKS_PER_SECOND + STM32L0_RTC_CLOCK_TICKS_PER_SECOND / 2)) &&
+        (error <= STM32L0_TIMESTAMP_PPS_TOLERANCE) &&
+        (error >= -STM32L0_TIMESTAMP_PPS_TOLERANCE))
+    {
+        /* Apply the new rate from "now" on. Half the measured error is
+         * corrected per pulse, which filters the PPS and interrupt jitter.
+         */
+        nanos = armv6m_systick_nanos();
+
+        stm32l0_timestamp_anchor(nanos, stm32l0_timestamp_project(nanos));
+
+        stm32l0_timestamp_adjust(stm32l0_timestamp_device.source, (error << 31) / (int64_t)STM32L0_TIMESTAMP_NANOS_PER_SECOND);
+
+        if (stm32l0_timestamp_device.pps_count != 0xffffffff)
+        {
+            stm32l0_timestamp_device.pps_count++;
+        }
+    }
+    else
+    {
+        stm32l0_timestamp_device.pps_count = 0;
+    }
+
+    stm32l0_timestamp_device.pps_timestamp = timestamp;
+    stm32l0_timestamp_device.pps_clock = clock;
+
+    __set_PRIMASK(primask);
+}
+
+void stm32l0_timestamp_status(stm32l0_timestamp_status_t *p_status_return)
+{
+    p_status_return->correction = ((int64_t)stm32l0_timestamp_device.rate[stm32l0_timestamp_device.source] * (int64_t)STM32L0_TIMESTAMP_NANOS_PER_SECOND) >> 32;
+    p_status_return->pps_count = stm32l0_timestamp_device.pps_count;
+    p_status_return->locked = (stm32l0_timestamp_device.pps_count >= STM32L0_TIMESTAMP_PPS_LOCK);
+}
@@ -1272,18 +1272,28 @@ bool stm32l0_uart_done(stm32l0_uart_t *uart)
 
 void USART1_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     stm32l0_uart_interrupt(stm32l0_uart_device.instances[STM32L0_UART_INSTANCE_USART1]);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 void USART2_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     stm32l0_uart_interrupt(stm32l0_uart_device.instances[STM32L0_UART_INSTANCE_USART2]);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 #if defined(STM32L072xx) || defined(STM32L082xx)
 
 void USART4_5_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     if (stm32l0_uart_device.instances[STM32L0_UART_INSTANCE_USART4])
     {
         stm32l0_uart_interrupt(stm32l0_uart_device.instances[STM32L0_UART_INSTANCE_USART4]);
@@ -1293,11 +1303,17 @@ void USART4_5_IRQHandler(void)
     {
         stm32l0_uart_interrupt(stm32l0_uart_device.instances[STM32L0_UART_INSTANCE_USART5]);
     }
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
 
 #endif /* STM32L072xx || STM32L082xx */
 
 void LPUART1_IRQHandler(void)
 {
+    ARMV6M_TRACE_IRQ_ENTER();
+
     stm32l0_uart_interrupt(stm32l0_uart_device.instances[STM32L0_UART_INSTANCE_LPUART1]);
+
+    ARMV6M_TRACE_IRQ_LEAVE();
 }
@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2019-2020 Thomas Roell.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimers.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Thomas Roell, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "armv6m.h"
+#include "stm32l0xx.h"
+
+#include "stm32l0_update.h"
+#include "stm32l0_flash.h"
+
+extern uint32_t __FlashBase;
+
+/* The patch is parsed byte by byte, so it can arrive in pieces of any size.
+ * Multi byte fields are LEB128 varints, collected in "value"/"shift" before
+ * the "next" state consumes them. The output is collected in a half-page
+ * buffer, which is programmed into the inactive bank once full. A flash
+ * page is erased just before its first half-page is programmed. The source
+ * is read directly from the running image.
+ */
+
+#define STM32L0_UPDATE_STATE_HEADER         0
+#define STM32L0_UPDATE_STATE_OPCODE         1
+#define STM32L0_UPDATE_STATE_VARINT         2
+#define STM32L0_UPDATE_STATE_ADD_LENGTH     3
+#define STM32L0_UPDATE_STATE_ADD_SEEK       4
+#define STM32L0_UPDATE_STATE_ADD_ZEROS      5
+#define STM32L0_UPDATE_STATE_ADD_COUNT      6
+#define STM32L0_UPDATE_STATE_ADD_DATA       7
+#define STM32L0_UPDATE_STATE_INSERT_LENGTH  8
+#define STM32L0_UPDATE_STATE_INSERT_DATA    9
+#define STM32L0_UPDATE_STATE_END            10
+
+#define STM32L0_UPDATE_OPCODE_END           0x00
+#define STM32L0_UPDATE_OPCODE_ADD           0x01
+#define STM32L0_UPDATE_OPCODE_INSERT        0x02
+
+#define STM32L0_UPDATE_HEADER_MAGIC         0
+#define STM32L0_UPDATE_HEADER_SOURCE_SIZE   1
+#define STM32L0_UPDATE_HEADER_SOURCE_CRC    2
+#define STM32L0_UPDATE_HEADER_TARGET_SIZE   3
+#define STM32L0_UPDATE_HEADER_TARGET_CRC    4
+#define STM32L0_UPDATE_HEADER_CRC           5
+
+static const uint32_t stm32l0_update_crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static uint32_t stm32l0_update_crc(const uint8_t *data, uint32_t count)
+{
+    uint32_t crc;
+
+    crc = 0xffffffff;
+
+    while (count--)
+    {
+        crc = stm32l0_update_crc_table[(crc ^ *data) & 0x0f] ^ (crc >> 4);
+        crc = stm32l0_update_crc_table[(crc ^ (*data >> 4)) & 0x0f] ^ (crc >> 4);
+
+        data++;
+    }
+
+    return ~crc;
+}
+
+uint32_t stm32l0_update_bank_size(void)
+{
+#if defined(FLASH_OPTR_BFB2)
+    return stm32l0_flash_size() / 2;
+#else /* defined(FLASH_OPTR_BFB2) */
+    return 0;
+#endif /* defined(FLASH_OPTR_BFB2) */
+}
+
+static void stm32l0_update_flush(stm32l0_update_t *update, uint32_t offset, uint32_t size)
+{
+    uint32_t address;
+    bool success;
+
+    /* The inactive bank is always mapped above the running one.
+     */
+    address = FLASH_BASE + stm32l0_update_bank_size() + offset;
+
+    if (update->status != STM32L0_UPDATE_STATUS_BUSY)
+    {
+        return;
+    }
+
+    if (!stm32l0_flash_unlock())
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_FLASH;
+
+        return;
+    }
+
+    success = true;
+
+    if (!(address & 127))
+    {
+        success = stm32l0_flash_erase(address, 128);
+    }
+
+    if (success)
+    {
+        success = stm32l0_flash_program(address, (const uint8_t*)&update->data[0], size);
+    }
+
+    stm32l0_flash_lock();
+
+    if (!success)
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_FLASH;
+    }
+}
+
+static void stm32l0_update_output(stm32l0_update_t *update, uint8_t data)
+{
+    ((uint8_t*)&update->data[0])[update->target & 63] = data;
+
+    update->target++;
+
+    if (!(update->target & 63))
+    {
+        stm32l0_update_flush(update, update->target - 64, 64);
+    }
+}
+
+static void stm32l0_update_header(stm32l0_update_t *update)
+{
+    uint32_t bank_size;
+
+    bank_size = stm32l0_update_bank_size();
+
+    if ((update->header[STM32L0_UPDATE_HEADER_MAGIC] != STM32L0_UPDATE_MAGIC) ||
+        (update->header[STM32L0_UPDATE_HEADER_CRC] != stm32l0_update_crc((const uint8_t*)&update->header[0], 20)))
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+        return;
+    }
+
+    if ((update->header[STM32L0_UPDATE_HEADER_SOURCE_SIZE] > bank_size) ||
+        (update->header[STM32L0_UPDATE_HEADER_TARGET_SIZE] > bank_size) ||
+        (update->header[STM32L0_UPDATE_HEADER_TARGET_SIZE] == 0))
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_SIZE;
+
+        return;
+    }
+
+    if (update->header[STM32L0_UPDATE_HEADER_SOURCE_CRC] != stm32l0_update_crc((const uint8_t*)FLASH_BASE, update->header[STM32L0_UPDATE_HEADER_SOURCE_SIZE]))
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_SOURCE;
+
+        return;
+    }
+
+    update->state = STM32L0_UPDATE_STATE_OPCODE;
+}
+
+static void stm32l0_update_varint(stm32l0_update_t *update, uint8_t next)
+{
+    update->state = STM32L0_UPDATE_STATE_VARINT;
+    update->next = next;
+    update->value = 0;
+    update->shift = 0;
+}
+
+static void stm32l0_update_field(stm32l0_update_t *update)
+{
+    const uint8_t *source;
+    uint32_t source_size, target_size, value, count, index;
+    int32_t seek;
+
+    source_size = update->header[STM32L0_UPDATE_HEADER_SOURCE_SIZE];
+    target_size = update->header[STM32L0_UPDATE_HEADER_TARGET_SIZE];
+
+    value = update->value;
+
+    switch (update->next) {
+    case STM32L0_UPDATE_STATE_ADD_LENGTH:
+        if (value > (target_size - update->target))
+        {
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+            break;
+        }
+
+        update->length = value;
+
+        stm32l0_update_varint(update, STM32L0_UPDATE_STATE_ADD_SEEK);
+        break;
+
+    case STM32L0_UPDATE_STATE_ADD_SEEK:
+        seek = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+
+        if ((seek < 0) ? ((uint32_t)-seek > update->source) : ((uint32_t)seek > (source_size - update->source)))
+        {
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+            break;
+        }
+
+        update->source += seek;
+
+        if (update->length > (source_size - update->source))
+        {
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+            break;
+        }
+
+        if (update->length == 0)
+        {
+            update->state = STM32L0_UPDATE_STATE_OPCODE;
+        }
+        else
+        {
+            stm32l0_update_varint(update, STM32L0_UPDATE_STATE_ADD_ZEROS);
+        }
+        break;
+
+    case STM32L0_UPDATE_STATE_ADD_ZEROS:
+        if (value > update->length)
+        {
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+            break;
+        }
+
+        update->length -= value;
+
+        source = (const uint8_t*)(FLASH_BASE + update->source);
+
+        update->source += value;
+
+        while (value-- && (update->status == STM32L0_UPDATE_STATUS_BUSY))
+        {
+            stm32l0_update_output(update, *source++);
+        }
+
+        stm32l0_update_varint(update, STM32L0_UPDATE_STATE_ADD_COUNT);
+        break;
+
+    case STM32L0_UPDATE_STATE_ADD_COUNT:
+        count = value >> 1;
+
+        if (count > update->length)
+        {
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+            break;
+        }
+
+        if (value & 1)
+        {
+            /* Repeat the previous difference bytes.
+             */
+            if ((count == 0) || (count != update->delta_count))
+            {
+                update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+                break;
+            }
+
+            update->length -= count;
+
+            source = (const uint8_t*)(FLASH_BASE + update->source);
+
+            update->source += count;
+
+            for (index = 0; (index < count) && (update->status == STM32L0_UPDATE_STATUS_BUSY); index++)
+            {
+                stm32l0_update_output(update, source[index] + update->delta[index]);
+            }
+
+            count = 0;
+        }
+        else
+        {
+            update->delta_count = (count <= sizeof(update->delta)) ? count : 0;
+        }
+
+        update->count = count;
+
+        if (update->count != 0)
+        {
+            update->state = STM32L0_UPDATE_STATE_ADD_DATA;
+        }
+        else if (update->length == 0)
+        {
+            update->state = STM32L0_UPDATE_STATE_OPCODE;
+        }
+        else
+        {
+            stm32l0_update_varint(update, STM32L0_UPDATE_STATE_ADD_ZEROS);
+        }
+        break;
+
+    case STM32L0_UPDATE_STATE_INSERT_LENGTH:
+        if (value > (target_size - update->target))
+        {
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+            break;
+        }
+
+        update->length = value;
+
+        if (update->length == 0)
+        {
+            update->state = STM32L0_UPDATE_STATE_OPCODE;
+        }
+        else
+        {
+            update->state = STM32L0_UPDATE_STATE_INSERT_DATA;
+        }
+        break;
+
+    default:
+        update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+        break;
+    }
+}
+
+bool stm32l0_update_begin(stm32l0_update_t *update)
+{
+    update->status = STM32L0_UPDATE_STATUS_BUSY;
+    update->state = STM32L0_UPDATE_STATE_HEADER;
+    update->count = 0;
+    update->delta_count = 0;
+    update->source = 0;
+    update->target = 0;
+
+    /* The running image has to fit into its bank, as the other one gets erased.
+     */
+    if ((stm32l0_update_bank_size() == 0) || ((uint32_t)&__FlashBase > (FLASH_BASE + stm32l0_update_bank_size())))
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_SIZE;
+
+        return false;
+    }
+
+    return true;
+}
+
+bool stm32l0_update_write(stm32l0_update_t *update, const uint8_t *data, uint32_t count)
+{
+    const uint8_t *data_e;
+    uint8_t c;
+
+    data_e = data + count;
+
+    while ((update->status == STM32L0_UPDATE_STATUS_BUSY) && (data != data_e))
+    {
+        c = *data++;
+
+        switch (update->state) {
+        case STM32L0_UPDATE_STATE_HEADER:
+            ((uint8_t*)&update->header[0])[update->count++] = c;
+
+            if (update->count == sizeof(update->header))
+            {
+                stm32l0_update_header(update);
+            }
+            break;
+
+        case STM32L0_UPDATE_STATE_OPCODE:
+            if (c == STM32L0_UPDATE_OPCODE_END)
+            {
+                update->state = STM32L0_UPDATE_STATE_END;
+            }
+            else if (c == STM32L0_UPDATE_OPCODE_ADD)
+            {
+                stm32l0_update_varint(update, STM32L0_UPDATE_STATE_ADD_LENGTH);
+            }
+            else if (c == STM32L0_UPDATE_OPCODE_INSERT)
+            {
+                stm32l0_update_varint(update, STM32L0_UPDATE_STATE_INSERT_LENGTH);
+            }
+            else
+            {
+                update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+            }
+            break;
+
+        case STM32L0_UPDATE_STATE_VARINT:
+            if ((update->shift == 28) && (c & 0xf0))
+            {
+                update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+                break;
+            }
+
+            update->value |= ((uint32_t)(c & 0x7f) << update->shift);
+            update->shift += 7;
+
+            if (!(c & 0x80))
+            {
+                stm32l0_update_field(update);
+            }
+            break;
+
+        case STM32L0_UPDATE_STATE_ADD_DATA:
+            if (update->delta_count)
+            {
+                update->delta[update->delta_count - update->count] = c;
+            }
+
+            stm32l0_update_output(update, *((const uint8_t*)(FLASH_BASE + update->source)) + c);
+
+            update->source++;
+            update->length--;
+            update->count--;
+
+            if (update->count == 0)
+            {
+                if (update->length == 0)
+                {
+                    update->state = STM32L0_UPDATE_STATE_OPCODE;
+                }
+                else
+                {
+                    stm32l0_update_varint(update, STM32L0_UPDATE_STATE_ADD_ZEROS);
+                }
+            }
+            break;
+
+        case STM32L0_UPDATE_STATE_INSERT_DATA:
+            stm32l0_update_output(update, c);
+
+            update->length--;
+
+            if (update->length == 0)
+            {
+                update->state = STM32L0_UPDATE_STATE_OPCODE;
+            }
+            break;
+
+        default:
+            update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+            break;
+        }
+    }
+
+    return (update->status == STM32L0_UPDATE_STATUS_BUSY);
+}
+
+bool stm32l0_update_end(stm32l0_update_t *update)
+{
+    uint32_t target_size;
+
+    if (update->status != STM32L0_UPDATE_STATUS_BUSY)
+    {
+        return false;
+    }
+
+    target_size = update->header[STM32L0_UPDATE_HEADER_TARGET_SIZE];
+
+    if ((update->state != STM32L0_UPDATE_STATE_END) || (update->target != target_size))
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_FORMAT;
+
+        return false;
+    }
+
+    if (update->target & 63)
+    {
+        memset((uint8_t*)&update->data[0] + (update->target & 63), 0, 64 - (update->target & 63));
+
+        stm32l0_update_flush(update, (update->target & ~63), (((update->target & 63) + 3) & ~3));
+
+        if (update->status != STM32L0_UPDATE_STATUS_BUSY)
+        {
+            return false;
+        }
+    }
+
+    if (update->header[STM32L0_UPDATE_HEADER_TARGET_CRC] != stm32l0_update_crc((const uint8_t*)(FLASH_BASE + stm32l0_update_bank_size()), target_size))
+    {
+        update->status = STM32L0_UPDATE_STATUS_ERROR_VERIFY;
+
+        return false;
+    }
+
+    update->status = STM32L0_UPDATE_STATUS_SUCCESS;
+
+    return true;
+}
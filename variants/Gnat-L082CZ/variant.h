@@ -146,6 +146,53 @@ static const uint8_t SCL = PIN_WIRE_SCL;
 }
 #endif
 
+/*----------------------------------------------------------------------------
+ *        Pin GPIOs - C++ only
+ *----------------------------------------------------------------------------*/
+
+#ifdef __cplusplus
+#include "stm32l0_gpio.h"
+
+// GPIO of each g_APinDescription[] entry (STM32L0_GPIO_PIN_NONE if it has
+// none), resolved at compile time by digitalWriteFast() and FastPin<>;
+// variant.cpp static_asserts it against g_APinDescription[]
+static constexpr uint8_t g_APinGPIO[PINS_COUNT] =
+{
+    // 0..13 - Digital pins
+    STM32L0_GPIO_PIN_PA10,
+    STM32L0_GPIO_PIN_PA9,
+    STM32L0_GPIO_PIN_PB5,
+    STM32L0_GPIO_PIN_PB6,
+    STM32L0_GPIO_PIN_PB7,
+    STM32L0_GPIO_PIN_PB2,
+    STM32L0_GPIO_PIN_NONE,
+    STM32L0_GPIO_PIN_NONE,
+    STM32L0_GPIO_PIN_PA13,
+    STM32L0_GPIO_PIN_PA14,
+    STM32L0_GPIO_PIN_PB12,
+    STM32L0_GPIO_PIN_NONE,
+    STM32L0_GPIO_PIN_NONE,
+    STM32L0_GPIO_PIN_NONE,
+
+    // 14..15 - I2C pins (SDA,SCL)
+    STM32L0_GPIO_PIN_PB9,
+    STM32L0_GPIO_PIN_PB8,
+
+    // 16..21 - Analog pins
+    STM32L0_GPIO_PIN_PA4,
+    STM32L0_GPIO_PIN_PA5,
+    STM32L0_GPIO_PIN_PA2,
+    STM32L0_GPIO_PIN_PA3,
+    STM32L0_GPIO_PIN_PA0,
+    STM32L0_GPIO_PIN_NONE,
+
+    // 22..25 - Special pins (USB_DM, USB_DP, USB_VBUS)
+    STM32L0_GPIO_PIN_NONE,
+    STM32L0_GPIO_PIN_NONE,
+    STM32L0_GPIO_PIN_NONE,
+};
+#endif
+
 /*----------------------------------------------------------------------------
  *        Arduino objects - C++ only
  *----------------------------------------------------------------------------*/
@@ -80,6 +80,41 @@ extern const PinDescription g_APinDescription[PINS_COUNT] =
     { NULL,  STM32L0_GPIO_PIN_MASK(STM32L0_GPIO_PIN_PH0),  STM32L0_GPIO_PIN_PH0,            0,                                             PWM_INSTANCE_NONE,  PWM_CHANNEL_NONE, ADC_CHANNEL_NONE },
 };
 
+// g_APinGPIO[] in variant.h has to name the GPIO of each entry above
+static_assert(g_APinGPIO[0] == STM32L0_GPIO_PIN_PA10, "g_APinGPIO[0] does not match g_APinDescription[0]");
+static_assert(g_APinGPIO[1] == STM32L0_GPIO_PIN_PA9, "g_APinGPIO[1] does not match g_APinDescription[1]");
+static_assert(g_APinGPIO[2] == STM32L0_GPIO_PIN_PB5, "g_APinGPIO[2] does not match g_APinDescription[2]");
+static_assert(g_APinGPIO[3] == STM32L0_GPIO_PIN_PB6, "g_APinGPIO[3] does not match g_APinDescription[3]");
+static_assert(g_APinGPIO[4] == STM32L0_GPIO_PIN_PB7, "g_APinGPIO[4] does not match g_APinDescription[4]");
+static_assert(g_APinGPIO[5] == STM32L0_GPIO_PIN_PB2, "g_APinGPIO[5] does not match g_APinDescription[5]");
+static_assert(g_APinGPIO[6] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[6] does not match g_APinDescription[6]");
+static_assert(g_APinGPIO[7] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[7] does not match g_APinDescription[7]");
+static_assert(g_APinGPIO[8] == STM32L0_GPIO_PIN_PA13, "g_APinGPIO[8] does not match g_APinDescription[8]");
+static_assert(g_APinGPIO[9] == STM32L0_GPIO_PIN_PA14, "g_APinGPIO[9] does not match g_APinDescription[9]");
+#if (DOSFS_SDCARD >= 1) || (DOSFS_SFLASH >= 1)
+static_assert(g_APinGPIO[10] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[10] does not match g_APinDescription[10]");
+static_assert(g_APinGPIO[11] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[11] does not match g_APinDescription[11]");
+static_assert(g_APinGPIO[12] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[12] does not match g_APinDescription[12]");
+static_assert(g_APinGPIO[13] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[13] does not match g_APinDescription[13]");
+#else /* (DOSFS_SDCARD >= 1) || (DOSFS_SFLASH >= 1) */
+static_assert(g_APinGPIO[10] == STM32L0_GPIO_PIN_PB12, "g_APinGPIO[10] does not match g_APinDescription[10]");
+static_assert(g_APinGPIO[11] == STM32L0_GPIO_PIN_PB15, "g_APinGPIO[11] does not match g_APinDescription[11]");
+static_assert(g_APinGPIO[12] == STM32L0_GPIO_PIN_PB14, "g_APinGPIO[12] does not match g_APinDescription[12]");
+static_assert(g_APinGPIO[13] == STM32L0_GPIO_PIN_PB13, "g_APinGPIO[13] does not match g_APinDescription[13]");
+#endif /* (DOSFS_SDCARD >= 1) || (DOSFS_SFLASH >= 1) */
+static_assert(g_APinGPIO[14] == STM32L0_GPIO_PIN_PB9, "g_APinGPIO[14] does not match g_APinDescription[14]");
+static_assert(g_APinGPIO[15] == STM32L0_GPIO_PIN_PB8, "g_APinGPIO[15] does not match g_APinDescription[15]");
+static_assert(g_APinGPIO[16] == STM32L0_GPIO_PIN_PA4, "g_APinGPIO[16] does not match g_APinDescription[16]");
+static_assert(g_APinGPIO[17] == STM32L0_GPIO_PIN_PA5, "g_APinGPIO[17] does not match g_APinDescription[17]");
+static_assert(g_APinGPIO[18] == STM32L0_GPIO_PIN_PA2, "g_APinGPIO[18] does not match g_APinDescription[18]");
+static_assert(g_APinGPIO[19] == STM32L0_GPIO_PIN_PA3, "g_APinGPIO[19] does not match g_APinDescription[19]");
+static_assert(g_APinGPIO[20] == STM32L0_GPIO_PIN_PA0, "g_APinGPIO[20] does not match g_APinDescription[20]");
+static_assert(g_APinGPIO[21] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[21] does not match g_APinDescription[21]");
+static_assert(g_APinGPIO[22] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[22] does not match g_APinDescription[22]");
+static_assert(g_APinGPIO[23] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[23] does not match g_APinDescription[23]");
+static_assert(g_APinGPIO[24] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[24] does not match g_APinDescription[24]");
+static_assert(g_APinGPIO[25] == STM32L0_GPIO_PIN_NONE, "g_APinGPIO[25] does not match g_APinDescription[25]");
+
 extern const unsigned int g_PWMInstances[PWM_INSTANCE_COUNT] = {
     STM32L0_TIMER_INSTANCE_TIM2,
     STM32L0_TIMER_INSTANCE_TIM22,